@@ -0,0 +1,116 @@
+// Wake word to the first uplink audio packet at the server, with the channel opened on
+// wake as before, resumed, and parked between conversations (request 015)
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "application.h"
+#include "loopback_server.h"
+#include "mqtt_protocol.h"
+#include "websocket_protocol.h"
+
+// 20ms each way, TCP + TLS 1.2 before a connection is up
+#define ONE_WAY_DELAY_US 20000
+#define CONNECT_ROUND_TRIPS 3
+#define TURNS 20
+
+enum ChannelMode {
+    kChannelFirstWake,      // First conversation after boot, the protocol has just started
+    kChannelReopen,         // Closed after every conversation, opened again on wake (before)
+    kChannelParked,         // Prewarmed, then kept open between conversations (after)
+};
+
+static AudioStreamPacket FirstFrame() {
+    AudioStreamPacket packet;
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.payload.assign(40, 0x5a);
+    return packet;
+}
+
+// What Application does between the wake word and the first uplink packet
+static bool Wake(Protocol& protocol) {
+    if (!protocol.IsAudioChannelOpened() && !protocol.OpenAudioChannel()) {
+        return false;
+    }
+    protocol.SendWakeWordDetected("你好小智");
+    protocol.SendStartListening(kListeningModeAutoStop);
+    return protocol.SendAudio(FirstFrame());
+}
+
+// Milliseconds from the wake word to the server receiving the first frame, one entry per turn
+static std::vector<double> RunTurns(bool mqtt, ChannelMode mode) {
+    LoopbackServerOptions options;
+    options.one_way_delay_us = ONE_WAY_DELAY_US;
+    options.connect_round_trips = CONNECT_ROUND_TRIPS;
+    LoopbackServer server(options);
+    server.Install(3);
+
+    auto create = [mqtt]() -> std::unique_ptr<Protocol> {
+        if (mqtt) {
+            return std::make_unique<MqttProtocol>();
+        }
+        return std::make_unique<WebsocketProtocol>();
+    };
+    auto protocol = create();
+    protocol->Start();
+    if (mode == kChannelParked) {
+        // Application::PrewarmAudioChannel, while the device is idle
+        protocol->OpenAudioChannel();
+    }
+
+    std::vector<double> latencies;
+    int turns = BenchIterations(TURNS);
+    for (int i = 0; i < turns; i++) {
+        if (mode == kChannelFirstWake && i > 0) {
+            Application::GetInstance().WaitForScheduled();
+            protocol = create();
+            protocol->Start();
+        }
+        server.ClearRecords();
+        int64_t start = BenchNowUs();
+        if (!Wake(*protocol) || !server.WaitForAudio(1, 5000)) {
+            break;
+        }
+        latencies.push_back((server.audio().front().time_us - start) / 1000.0);
+
+        // End of the conversation
+        if (mode == kChannelParked) {
+            protocol->SendStopListening();
+            protocol->SendAbortSpeaking(kAbortReasonNone);
+        } else {
+            protocol->CloseAudioChannel();
+        }
+    }
+    Application::GetInstance().WaitForScheduled();
+    protocol.reset();
+    return latencies;
+}
+
+static void PrintTurns(const std::string& name, std::vector<double> latencies) {
+    if (latencies.empty()) {
+        BenchPrintRow(name, "failed");
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (auto latency : latencies) {
+        sum += latency;
+    }
+    BenchPrintRow(name, BenchFormat("median %.1f ms, mean %.1f ms, max %.1f ms (%zu turns)",
+        latencies[latencies.size() / 2], sum / latencies.size(), latencies.back(), latencies.size()));
+}
+
+int main(int argc, char** argv) {
+    BenchInit(argc, argv, "wake to first uplink packet");
+    BenchPrintRow("link", BenchFormat("%d ms one way, %d round trips to connect",
+        ONE_WAY_DELAY_US / 1000, CONNECT_ROUND_TRIPS));
+    for (bool mqtt : {true, false}) {
+        std::string transport = mqtt ? "mqtt+udp" : "websocket";
+        PrintTurns(transport + " first wake", RunTurns(mqtt, kChannelFirstWake));
+        PrintTurns(transport + " reopen (resume)", RunTurns(mqtt, kChannelReopen));
+        PrintTurns(transport + " parked", RunTurns(mqtt, kChannelParked));
+    }
+    return BenchExit();
+}
@@ -0,0 +1,197 @@
+// Control messages: CBOR vs JSON size and encode / decode cost (request 014), and the
+// JsonScanner chat dispatch vs a full cJSON parse over a message corpus (request 016)
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "cbor.h"
+#include "json_scanner.h"
+#include "loopback_protocol.h"
+
+#define ENCODE_ITERATIONS 200000
+#define DECODE_ITERATIONS 100000
+
+// Counts what the protocol sends without keeping it, so only the encoding is measured
+class CountingProtocol : public LoopbackProtocol {
+public:
+    // Keeps a copy of the next CBOR message, for the decode cases
+    void Keep(bool keep) { keep_ = keep; }
+
+    size_t last_size = 0;
+    std::vector<uint8_t> last_cbor;
+
+protected:
+    bool SendText(const std::string& text) override {
+        last_size = text.size();
+        return true;
+    }
+    bool SendCbor(const uint8_t* data, size_t size) override {
+        last_size = size;
+        if (keep_) {
+            last_cbor.assign(data, data + size);
+        }
+        return true;
+    }
+
+private:
+    bool keep_ = false;
+};
+
+struct ControlMessage {
+    const char* name;
+    std::function<void(Protocol&)> send;
+};
+
+static const std::vector<ControlMessage> kControlMessages = {
+    {"listen start", [](Protocol& p) { p.SendStartListening(kListeningModeAutoStop); }},
+    {"listen stop", [](Protocol& p) { p.SendStopListening(); }},
+    {"listen detect", [](Protocol& p) { p.SendWakeWordDetected("你好小智"); }},
+    {"abort", [](Protocol& p) { p.SendAbortSpeaking(kAbortReasonWakeWordDetected); }},
+};
+
+// What the server sends during a turn, in the order it usually arrives
+static const std::vector<std::string> kCorpus = {
+    R"({"type":"stt","text":"今天天气怎么样","session_id":"5c9e2f1a"})",
+    R"({"type":"llm","text":"😊","emotion":"happy","session_id":"5c9e2f1a"})",
+    R"({"type":"tts","state":"start","sample_rate":24000,"session_id":"5c9e2f1a"})",
+    R"({"type":"tts","state":"sentence_start","text":"今天杭州晴，最高气温二十六度。","session_id":"5c9e2f1a"})",
+    R"({"type":"tts","state":"sentence_end","text":"今天杭州晴，最高气温二十六度。","session_id":"5c9e2f1a"})",
+    R"({"type":"tts","state":"sentence_start","text":"适合出门散步，记得带上\"防晒\"哦。","session_id":"5c9e2f1a"})",
+    R"({"type":"tts","state":"sentence_end","text":"适合出门散步，记得带上\"防晒\"哦。","session_id":"5c9e2f1a"})",
+    R"({"type":"tts","state":"stop","session_id":"5c9e2f1a"})",
+};
+
+// Application::OnIncomingJson before: every message parsed into a cJSON tree, fields copied out
+static void DispatchBefore(const std::string& json, std::string& text) {
+    auto root = cJSON_Parse(json.c_str());
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (strcmp(type->valuestring, "tts") == 0) {
+        auto state = cJSON_GetObjectItem(root, "state");
+        if (strcmp(state->valuestring, "sentence_start") == 0) {
+            auto t = cJSON_GetObjectItem(root, "text");
+            if (cJSON_IsString(t)) {
+                text = t->valuestring;
+            }
+        }
+    } else if (strcmp(type->valuestring, "stt") == 0) {
+        auto t = cJSON_GetObjectItem(root, "text");
+        if (cJSON_IsString(t)) {
+            text = t->valuestring;
+        }
+    } else if (strcmp(type->valuestring, "llm") == 0) {
+        auto emotion = cJSON_GetObjectItem(root, "emotion");
+        if (cJSON_IsString(emotion)) {
+            text = emotion->valuestring;
+        }
+    }
+    cJSON_Delete(root);
+}
+
+static void BenchEncode() {
+    CountingProtocol json;
+    json.ReceiveHello(R"({"type":"hello","session_id":"5c9e2f1a"})");
+    CountingProtocol cbor;
+    cbor.ReceiveHello(R"({"type":"hello","session_id":"5c9e2f1a","features":{"cbor":true}})");
+
+    int iterations = BenchIterations(ENCODE_ITERATIONS);
+    for (auto& message : kControlMessages) {
+        message.send(json);
+        message.send(cbor);
+        BenchPrintRow(std::string(message.name) + " size",
+            BenchFormat("json %zu B, cbor %zu B", json.last_size, cbor.last_size));
+        BenchPrint(std::string(message.name) + " json", BenchRun(iterations, [&]() { message.send(json); }));
+        BenchPrint(std::string(message.name) + " cbor", BenchRun(iterations, [&]() { message.send(cbor); }));
+    }
+}
+
+// The same listen message decoded from JSON text and from CBOR, as the server would
+static void BenchDecode() {
+    CountingProtocol cbor;
+    cbor.ReceiveHello(R"({"type":"hello","session_id":"5c9e2f1a","features":{"cbor":true}})");
+    cbor.Keep(true);
+    cbor.SendWakeWordDetected("你好小智");
+    std::string text = R"({"session_id":"5c9e2f1a","type":"listen","state":"detect","text":"你好小智"})";
+    auto& encoded = cbor.last_cbor;
+
+    int iterations = BenchIterations(DECODE_ITERATIONS);
+    BenchPrint("decode detect cJSON_Parse", BenchRun(iterations, [&]() {
+        cJSON_Delete(cJSON_Parse(text.c_str()));
+    }));
+    BenchPrint("decode detect CborToJson", BenchRun(iterations, [&]() {
+        cJSON_Delete(CborToJson(encoded.data(), encoded.size()));
+    }));
+    BenchPrint("decode detect CborReader walk", BenchRun(iterations, [&]() {
+        CborReader reader(encoded.data(), encoded.size());
+        CborItem item;
+        while (reader.Next(item)) {
+        }
+    }));
+
+    // A sentence of the reply, dispatched as websocket / MQTT do with CBOR control messages
+    uint8_t buffer[128];
+    CborWriter tts(buffer, sizeof(buffer));
+    tts.Map(4);
+    tts.Text("session_id");
+    tts.Text("5c9e2f1a");
+    tts.Text("type");
+    tts.Text("tts");
+    tts.Text("state");
+    tts.Text("sentence_start");
+    tts.Text("text");
+    tts.Text("今天天气不错，适合出去走走。");
+    LoopbackProtocol protocol;
+    std::string sentence;
+    protocol.OnIncomingChat([&sentence](ChatMessage&& message) {
+        sentence = std::move(message.text);
+    });
+    BenchPrint("dispatch tts CborToJson", BenchRun(iterations, [&]() {
+        auto root = CborToJson(tts.data(), tts.size());
+        sentence = cJSON_GetObjectItem(root, "text")->valuestring;
+        cJSON_Delete(root);
+    }));
+    BenchPrint("dispatch tts CborReader", BenchRun(iterations, [&]() {
+        protocol.ReceiveCbor(tts.data(), tts.size());
+    }));
+}
+
+static void BenchDispatch() {
+    size_t corpus_bytes = 0;
+    for (auto& json : kCorpus) {
+        corpus_bytes += json.size();
+    }
+    BenchPrintRow("corpus", BenchFormat("%zu messages, %zu B", kCorpus.size(), corpus_bytes));
+
+    int iterations = BenchIterations(DECODE_ITERATIONS) / kCorpus.size();
+    std::string text;
+    auto before = BenchRun(iterations, [&]() {
+        for (auto& json : kCorpus) {
+            DispatchBefore(json, text);
+        }
+    });
+    BenchPrint("turn cJSON dispatch", before);
+
+    LoopbackProtocol protocol;
+    protocol.OnIncomingChat([&](ChatMessage&& message) {
+        if (message.has_text) {
+            text = std::move(message.text);
+        }
+    });
+    auto after = BenchRun(iterations, [&]() {
+        for (auto& json : kCorpus) {
+            protocol.Receive(json);
+        }
+    });
+    BenchPrint("turn JsonScanner dispatch", after);
+    BenchPrintRow("per message", BenchFormat("cJSON %.2f us, scanner %.2f us",
+        before.us_per_op / kCorpus.size(), after.us_per_op / kCorpus.size()));
+}
+
+int main(int argc, char** argv) {
+    BenchInit(argc, argv, "control messages");
+    AllocCounter::UseCountingCJsonHooks();
+    BenchEncode();
+    BenchDecode();
+    BenchDispatch();
+    return BenchExit();
+}
@@ -0,0 +1,118 @@
+// Switching decoders between the server TTS and a local notification sound: a new decoder
+// per format change as before vs the DecoderPool (request 020)
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "decoder_pool.h"
+#include "opus_encoder.h"
+
+#define OUTPUT_SAMPLE_RATE 24000
+#define SWITCHES 20000
+
+static std::vector<uint8_t> EncodeTone(int sample_rate, int frame_duration) {
+    OpusEncoderWrapper encoder(sample_rate, 1, frame_duration);
+    std::vector<int16_t> pcm(sample_rate / 1000 * frame_duration, 12000);
+    std::vector<uint8_t> packet;
+    encoder.Encode(std::move(pcm), [&packet](std::vector<uint8_t>&& opus) {
+        packet = std::move(opus);
+    });
+    return packet;
+}
+
+// Application::SetDecodeSampleRate before: the decoder is recreated on every format change
+class RecreatingDecoder {
+public:
+    void Decode(int sample_rate, int frame_duration, const std::vector<uint8_t>& opus, std::vector<int16_t>& output) {
+        // The packets come from a recycled buffer on the device
+        packet_.assign(opus.begin(), opus.end());
+        if (!decoder_ || decoder_->sample_rate() != sample_rate || decoder_->duration_ms() != frame_duration) {
+            decoder_.reset();
+            decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+            if (sample_rate != OUTPUT_SAMPLE_RATE) {
+                resampler_.Configure(sample_rate, OUTPUT_SAMPLE_RATE);
+            }
+        }
+        decoder_->Decode(std::move(packet_), pcm_);
+        if (sample_rate != OUTPUT_SAMPLE_RATE) {
+            output.resize(resampler_.GetOutputSamples(pcm_.size()));
+            resampler_.Process(pcm_.data(), pcm_.size(), output.data());
+        } else {
+            output.swap(pcm_);
+        }
+    }
+
+private:
+    std::unique_ptr<OpusDecoderWrapper> decoder_;
+    OpusResampler resampler_;
+    std::vector<uint8_t> packet_;
+    std::vector<int16_t> pcm_;
+};
+
+// The decode task after: the slot for the format, reset if it was not the last one used
+class PooledDecoder {
+public:
+    PooledDecoder() { pool_.Initialize(OUTPUT_SAMPLE_RATE); }
+
+    void Decode(int sample_rate, int frame_duration, const std::vector<uint8_t>& opus, std::vector<int16_t>& output) {
+        // The packets come from a recycled buffer on the device
+        packet_.assign(opus.begin(), opus.end());
+        auto slot = pool_.Get(sample_rate, frame_duration);
+        slot->decoder->Decode(std::move(packet_), pcm_);
+        if (slot->resample) {
+            output.resize(slot->resampler.GetOutputSamples(pcm_.size()));
+            slot->resampler.Process(pcm_.data(), pcm_.size(), output.data());
+        } else {
+            output.swap(pcm_);
+        }
+    }
+
+    inline DecoderPool& pool() { return pool_; }
+
+private:
+    DecoderPool pool_;
+    std::vector<uint8_t> packet_;
+    std::vector<int16_t> pcm_;
+};
+
+// One TTS frame, then the first frame of a 16kHz P3 notification sound, as the decode task sees them
+template <typename Decoder>
+static void RunSwitches(const std::string& name, Decoder& decoder) {
+    auto tts = EncodeTone(24000, 60);
+    auto sound = EncodeTone(16000, 60);
+    std::vector<int16_t> output;
+    output.reserve(OUTPUT_SAMPLE_RATE / 1000 * 60);
+
+    // Reaches the steady state: both formats seen once
+    decoder.Decode(24000, 60, tts, output);
+    decoder.Decode(16000, 60, sound, output);
+
+    int switches = BenchIterations(SWITCHES);
+    uint32_t created = OpusDecoderWrapper::created;
+    int64_t to_sound_us = 0;
+    auto result = BenchRun(switches, [&]() {
+        decoder.Decode(24000, 60, tts, output);
+        int64_t start = BenchNowUs();
+        decoder.Decode(16000, 60, sound, output);
+        to_sound_us += BenchNowUs() - start;
+    });
+    // BenchRun warms up with a few extra round trips
+    int round_trips = switches + std::min(switches, 16);
+    // The host decoder is a couple of vectors, on the device the opus_decoder_create() that
+    // the recreate case pays on every switch is what delays the first sound frame
+    BenchPrint(name + " tts -> sound -> tts", result);
+    BenchPrintRow(name + " first sound frame", BenchFormat("%.3f us after the switch", (double)to_sound_us / round_trips));
+    BenchPrintRow(name + " decoders created", BenchFormat("%.2f per switch",
+        (double)(OpusDecoderWrapper::created - created) / (round_trips * 2)));
+}
+
+int main(int argc, char** argv) {
+    BenchInit(argc, argv, "decoder switch");
+    RecreatingDecoder before;
+    RunSwitches("recreate", before);
+    PooledDecoder after;
+    RunSwitches("pool", after);
+    BenchPrintRow("pool hits / misses", BenchFormat("%u / %u", after.pool().hits(), after.pool().misses()));
+    return BenchExit();
+}
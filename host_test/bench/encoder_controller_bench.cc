@@ -0,0 +1,78 @@
+// Simulated conversations over a changing link: what the EncoderController picks for the
+// complexity and frame duration, and the per-packet overhead that costs (request 019)
+#include <algorithm>
+#include <vector>
+
+#include "bench.h"
+#include "encoder_controller.h"
+
+// Requested by the user for lower latency, ApplyFrameDuration() may lengthen it
+#define REQUESTED_FRAME_DURATION 20
+#define MAX_ADAPTIVE_COMPLEXITY 5
+#define SESSION_SECONDS 20
+// IPv4 + UDP headers and the 16 byte nonce of every MQTT+UDP audio packet
+#define PACKET_OVERHEAD_BYTES (20 + 8 + 16)
+// Encoder load of one core on the device: a base cost and a step per complexity level
+#define LOAD_BASE_PERCENT 8
+#define LOAD_PER_COMPLEXITY_PERCENT 8
+
+struct LinkState {
+    const char* name;
+    int queue_percent;      // Send queue fill
+    int loss_percent;
+};
+
+static const std::vector<LinkState> kSessions = {
+    {"wifi", 5, 0},
+    {"wifi", 5, 0},
+    {"4g congested", 70, 2},
+    {"4g congested", 75, 6},
+    {"4g congested", 80, 8},
+    {"wifi", 5, 0},
+    {"wifi", 5, 0},
+};
+
+int main(int argc, char** argv) {
+    BenchInit(argc, argv, "encoder controller");
+    EncoderController controller;
+    // As on the ML307 boards, WiFi boards start at 0 and have nothing to adapt
+    controller.Configure(MAX_ADAPTIVE_COMPLEXITY, MAX_ADAPTIVE_COMPLEXITY);
+
+    int64_t overhead_total = 0;
+    int64_t overhead_fixed = 0;
+    for (size_t i = 0; i < kSessions.size(); i++) {
+        auto& link = kSessions[i];
+        // Application::ApplyFrameDuration
+        controller.StartSession();
+        int frame_duration = std::max(REQUESTED_FRAME_DURATION, controller.min_frame_duration());
+        int packets_per_second = 1000 / frame_duration;
+
+        uint32_t received = 0;
+        uint32_t lost = 0;
+        int changes = 0;
+        for (int second = 0; second < SESSION_SECONDS; second++) {
+            EncoderSample sample;
+            sample.elapsed_us = 1000000;
+            sample.encode_time_us = (LOAD_BASE_PERCENT + LOAD_PER_COMPLEXITY_PERCENT * controller.complexity()) * 10000;
+            sample.send_queue_limit = 100;
+            sample.send_queue_depth = link.queue_percent;
+            lost += packets_per_second * link.loss_percent / 100;
+            received += packets_per_second - packets_per_second * link.loss_percent / 100;
+            sample.received = received;
+            sample.lost = lost;
+            if (controller.Update(sample)) {
+                changes++;
+            }
+        }
+
+        int overhead = packets_per_second * PACKET_OVERHEAD_BYTES;
+        overhead_total += (int64_t)overhead * SESSION_SECONDS;
+        overhead_fixed += (int64_t)(1000 / REQUESTED_FRAME_DURATION) * PACKET_OVERHEAD_BYTES * SESSION_SECONDS;
+        BenchPrintRow(BenchFormat("session %zu %s", i + 1, link.name),
+            BenchFormat("%d ms frames, complexity %d (%d changes), overhead %d B/s",
+                frame_duration, controller.complexity(), changes, overhead));
+    }
+    BenchPrintRow("packet overhead, all sessions", BenchFormat("%lld B adaptive, %lld B with %d ms frames throughout",
+        (long long)overhead_total, (long long)overhead_fixed, REQUESTED_FRAME_DURATION));
+    return BenchExit();
+}
@@ -0,0 +1,175 @@
+// First received packet to the first audio written to the speaker, while the microphone is
+// encoded at the same time (realtime / AEC mode): playback polled from the audio loop and
+// decoded on the shared background task as before vs the decode and output tasks of
+// AudioPipeline (request 005)
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "audio_pipeline.h"
+#include "loopback_protocol.h"
+#include "no_audio_processor.h"
+#include "no_wake_word.h"
+#include "wav_audio_codec.h"
+
+// Opus encode of a 60ms frame on the device, the host stand-in encoder costs nothing
+#define ENCODE_US_PER_FRAME 12000
+#define TRIALS 30
+
+static void SpinFor(int64_t us) {
+    int64_t end = BenchNowUs() + us;
+    while (BenchNowUs() < end) {
+    }
+}
+
+static AudioStreamPacket Packet(uint32_t sequence) {
+    OpusEncoderWrapper encoder(16000, 1, 60);
+    AudioStreamPacket packet;
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.sequence = sequence;
+    encoder.Encode(std::vector<int16_t>(960, 8000), [&packet](std::vector<uint8_t>&& opus) {
+        packet.payload = std::move(opus);
+    });
+    return packet;
+}
+
+// Application::AudioLoop before: each pass reads the microphone and, unless a decode is still
+// pending, hands one packet to the background task, which also runs the opus encoder and
+// blocks in OutputData while the frame plays
+class LoopPlayback {
+public:
+    LoopPlayback() : codec_(16000, 16000, true), decoder_(16000, 1, 60) {
+        codec_.Start();
+        std::thread([this]() { Loop(); }).detach();
+    }
+
+    void Push(AudioStreamPacket&& packet) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(packet));
+    }
+    void Reset() {}
+    void Stop() { running_ = false; }
+    size_t output_size() { return codec_.output().size(); }
+
+private:
+    WavAudioCodec codec_;
+    BackgroundTask background_task_;
+    std::atomic<bool> running_{true};
+    OpusDecoderWrapper decoder_;
+    std::mutex mutex_;
+    std::deque<AudioStreamPacket> queue_;
+    std::atomic<bool> busy_decoding_audio_{false};
+
+    void Loop() {
+        // NoAudioProcessor feeds 30ms, the encoder emits a frame every other feed
+        std::vector<int16_t> input(480);
+        while (running_) {
+            codec_.InputData(input);
+            background_task_.Schedule([]() { SpinFor(ENCODE_US_PER_FRAME / 2); });
+            if (busy_decoding_audio_) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (queue_.empty()) {
+                continue;
+            }
+            auto packet = std::move(queue_.front());
+            queue_.pop_front();
+            lock.unlock();
+            busy_decoding_audio_ = true;
+            background_task_.Schedule([this, packet = std::move(packet)]() mutable {
+                busy_decoding_audio_ = false;
+                std::vector<int16_t> pcm;
+                if (decoder_.Decode(std::move(packet.payload), pcm)) {
+                    codec_.OutputData(pcm);
+                }
+            });
+        }
+    }
+};
+
+// The device pipeline, with the same encoder load on the background task
+class TaskPlayback {
+public:
+    TaskPlayback() : codec_(16000, 16000, true) {
+        codec_.Start();
+        processor_.Initialize(&codec_);
+        wake_word_.Initialize(&codec_);
+        processor_.OnOutput([this](std::vector<int16_t>&& data) {
+            background_task_.Schedule([]() { SpinFor(ENCODE_US_PER_FRAME / 2); });
+            pipeline_.EncodeAudio(std::move(data));
+        });
+        // The channel is closed, so the uplink is dropped as soon as it is queued
+        pipeline_.OnAudioQueued([this]() { pipeline_.SendQueuedAudio(protocol_); });
+        pipeline_.Start(&codec_, &wake_word_, &processor_, &background_task_, 60, 0);
+        processor_.Start();
+        pipeline_.NotifyAudioInput();
+    }
+
+    void Push(AudioStreamPacket&& packet) { pipeline_.PushDecodePacket(std::move(packet)); }
+    // A new reply, as SetDeviceState(kDeviceStateSpeaking) does
+    void Reset() { pipeline_.ResetDecoder(); }
+    size_t output_size() { return codec_.output().size(); }
+
+private:
+    WavAudioCodec codec_;
+    NoWakeWord wake_word_;
+    NoAudioProcessor processor_;
+    BackgroundTask background_task_;
+    LoopbackProtocol protocol_;
+    AudioPipeline pipeline_;
+};
+
+// Milliseconds from pushing the first packet of a reply to its audio reaching the speaker
+template <typename Playback>
+static std::vector<double> RunReplies(Playback& playback) {
+    std::mt19937 random(5);
+    std::vector<double> latencies;
+    int trials = BenchIterations(TRIALS);
+    for (int i = 0; i < trials; i++) {
+        playback.Reset();
+        // Replies arrive at any point of the microphone frame
+        std::this_thread::sleep_for(std::chrono::microseconds(random() % 60000));
+        size_t played = playback.output_size();
+        int64_t start = BenchNowUs();
+        for (uint32_t sequence = 1; sequence <= 3; sequence++) {
+            playback.Push(Packet(sequence));
+        }
+        while (playback.output_size() == played && BenchNowUs() - start < 2000000) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        latencies.push_back((BenchNowUs() - start) / 1000.0);
+        // Let the reply play out
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    }
+    return latencies;
+}
+
+static void PrintReplies(const std::string& name, std::vector<double> latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (auto latency : latencies) {
+        sum += latency;
+    }
+    BenchPrintRow(name, BenchFormat("median %.1f ms, mean %.1f ms, max %.1f ms (%zu replies)",
+        latencies[latencies.size() / 2], sum / latencies.size(), latencies.back(), latencies.size()));
+}
+
+int main(int argc, char** argv) {
+    BenchInit(argc, argv, "first packet to audio out");
+    BenchPrintRow("load", BenchFormat("microphone read every 30 ms, %d ms encode per 60 ms frame",
+        ENCODE_US_PER_FRAME / 1000));
+    // The tasks of both keep running, each playback is built once
+    auto before = new LoopPlayback();
+    PrintReplies("audio loop + background task", RunReplies(*before));
+    before->Stop();
+    auto after = new TaskPlayback();
+    PrintReplies("decode + output tasks", RunReplies(*after));
+    return BenchExit();
+}
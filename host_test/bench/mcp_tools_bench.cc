@@ -0,0 +1,304 @@
+// MCP server with 50 / 200 / 1000 tools: tools/list time and bytes allocated per full walk,
+// tools/call dispatch (requests 021 / 023), and round trips of singles vs a batch (request 024)
+#include <cJSON.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "application.h"
+#include "mcp_server.h"
+
+#define DESCRIPTION_SIZE 120
+#define BATCH_CALLS 8
+#define CALL_ITERATIONS 2000
+#define WALK_ITERATIONS 200
+// A 4G link, the client waits for every reply before the next request
+#define ROUND_TRIP_MS 80
+
+// The server end of the "mcp" messages, keeps the last reply only
+class McpSink {
+public:
+    McpSink() {
+        last_.reserve(MAX_REPLY_SIZE);
+        Application::GetInstance().OnMcpMessage([this](const std::string& payload) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            last_.assign(payload);
+            messages_++;
+            condition_variable_.notify_all();
+        });
+    }
+
+    ~McpSink() {
+        Application::GetInstance().OnMcpMessage(nullptr);
+    }
+
+    // The nextCursor of the last tools/list reply, false on the last page
+    bool NextCursor(std::string& cursor) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        static const std::string key = "\"nextCursor\":\"";
+        auto start = last_.find(key);
+        if (start == std::string::npos) {
+            return false;
+        }
+        start += key.size();
+        cursor.assign(last_, start, last_.find('"', start) - start);
+        return true;
+    }
+
+    bool WaitForMessages(uint64_t count) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return condition_variable_.wait_for(lock, std::chrono::seconds(5), [this, count]() { return messages_ >= count; });
+    }
+
+    uint64_t messages() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return messages_;
+    }
+
+private:
+    static constexpr size_t MAX_REPLY_SIZE = 9000;
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    std::string last_;
+    uint64_t messages_ = 0;
+};
+
+static std::string ToolName(int index) {
+    return BenchFormat("bench.device_%04d.set_level", index);
+}
+
+// Grows the server's tool set to count tools, the same ones are kept in tools for the reference
+static void AddTools(std::vector<McpTool*>& tools, int count) {
+    std::string description(DESCRIPTION_SIZE, 'x');
+    for (int i = tools.size(); i < count; i++) {
+        auto tool = new McpTool(ToolName(i), description,
+            PropertyList({Property("level", kPropertyTypeInteger, 0, 100), Property("fade", kPropertyTypeBoolean, false)}),
+            [](const PropertyList& properties) -> ReturnValue {
+                return true;
+            });
+        McpServer::GetInstance().AddTool(tool);
+        tools.push_back(tool);
+    }
+}
+
+// McpTool::to_json before: a cJSON tree per descriptor, the properties printed and parsed again
+static std::string ToolJsonBefore(const McpTool* tool) {
+    cJSON* properties = cJSON_CreateObject();
+    std::vector<std::string> required;
+    for (auto& property : tool->properties()) {
+        cJSON* json = cJSON_CreateObject();
+        if (property.type() == kPropertyTypeBoolean) {
+            cJSON_AddStringToObject(json, "type", "boolean");
+            if (property.has_default_value()) {
+                cJSON_AddBoolToObject(json, "default", property.value<bool>());
+            }
+        } else if (property.type() == kPropertyTypeInteger) {
+            cJSON_AddStringToObject(json, "type", "integer");
+            if (property.has_default_value()) {
+                cJSON_AddNumberToObject(json, "default", property.value<int>());
+            }
+            if (property.has_range()) {
+                cJSON_AddNumberToObject(json, "minimum", property.min_value());
+                cJSON_AddNumberToObject(json, "maximum", property.max_value());
+            }
+        }
+        char* text = cJSON_PrintUnformatted(json);
+        cJSON_AddItemToObject(properties, property.name().c_str(), cJSON_Parse(std::string(text).c_str()));
+        cJSON_free(text);
+        cJSON_Delete(json);
+        if (!property.has_default_value()) {
+            required.push_back(property.name());
+        }
+    }
+    char* properties_text = cJSON_PrintUnformatted(properties);
+    std::string properties_json(properties_text);
+    cJSON_free(properties_text);
+    cJSON_Delete(properties);
+
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddStringToObject(json, "name", tool->name().c_str());
+    cJSON_AddStringToObject(json, "description", tool->description().c_str());
+    cJSON* input_schema = cJSON_CreateObject();
+    cJSON_AddStringToObject(input_schema, "type", "object");
+    cJSON_AddItemToObject(input_schema, "properties", cJSON_Parse(properties_json.c_str()));
+    if (!required.empty()) {
+        cJSON* required_array = cJSON_CreateArray();
+        for (auto& name : required) {
+            cJSON_AddItemToArray(required_array, cJSON_CreateString(name.c_str()));
+        }
+        cJSON_AddItemToObject(input_schema, "required", required_array);
+    }
+    cJSON_AddItemToObject(json, "inputSchema", input_schema);
+    char* text = cJSON_PrintUnformatted(json);
+    std::string result(text);
+    cJSON_free(text);
+    cJSON_Delete(json);
+    return result;
+}
+
+// McpServer::GetToolsList before: a linear search for the cursor, every descriptor rendered per request
+static std::string ToolsListBefore(const std::vector<McpTool*>& tools, const std::string& cursor, std::string& next_cursor) {
+    std::string json = "{\"tools\":[";
+    bool found_cursor = cursor.empty();
+    next_cursor.clear();
+    for (auto it = tools.begin(); it != tools.end(); ++it) {
+        if (!found_cursor) {
+            if ((*it)->name() != cursor) {
+                continue;
+            }
+            found_cursor = true;
+        }
+        std::string tool_json = ToolJsonBefore(*it) + ",";
+        if (json.length() + tool_json.length() + 30 > 8000) {
+            next_cursor = (*it)->name();
+            break;
+        }
+        json += tool_json;
+    }
+    if (json.back() == ',') {
+        json.pop_back();
+    }
+    if (next_cursor.empty()) {
+        json += "]}";
+    } else {
+        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+    }
+    return "{\"jsonrpc\":\"2.0\",\"id\":1,\"result\":" + json + "}";
+}
+
+static std::string ToolsListRequest(const std::string& cursor) {
+    return "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"tools/list\",\"params\":{\"cursor\":\"" + cursor + "\"}}";
+}
+
+static std::string ToolCallRequest(int id, const std::string& name) {
+    return BenchFormat(R"({"jsonrpc":"2.0","id":%d,"method":"tools/call","params":{"name":"%s","arguments":{"level":%d}}})",
+        id, name.c_str(), id % 100);
+}
+
+static void BenchToolsList(McpSink& sink, const std::vector<McpTool*>& tools) {
+    int count = tools.size();
+    int iterations = BenchIterations(WALK_ITERATIONS);
+    // Built up front, so the walk only measures the server
+    std::vector<std::string> requests;
+    std::string cursor;
+    std::string next_cursor;
+    requests.push_back(ToolsListRequest(""));
+    while (true) {
+        ToolsListBefore(tools, cursor, next_cursor);
+        if (next_cursor.empty()) {
+            break;
+        }
+        cursor = next_cursor;
+        requests.push_back(ToolsListRequest(cursor));
+    }
+
+    auto before = BenchRun(iterations, [&]() {
+        std::string cursor;
+        std::string next_cursor;
+        for (auto& request : requests) {
+            cJSON_Delete(cJSON_Parse(request.c_str()));
+            ToolsListBefore(tools, cursor, next_cursor);
+            cursor = next_cursor;
+        }
+    });
+    BenchPrint(BenchFormat("%d tools, list walk before", count), before);
+
+    int64_t start = BenchNowUs();
+    for (auto& request : requests) {
+        McpServer::GetInstance().ParseMessage(request);
+    }
+    BenchPrintRow(BenchFormat("%d tools, first walk after a change", count), BenchFormat("%.1f us", (double)(BenchNowUs() - start)));
+
+    auto after = BenchRun(iterations, [&]() {
+        for (auto& request : requests) {
+            McpServer::GetInstance().ParseMessage(request);
+        }
+    });
+    BenchPrint(BenchFormat("%d tools, list walk", count), after);
+
+    // The walk the server answered has as many pages as the reference
+    size_t pages = 1;
+    McpServer::GetInstance().ParseMessage(requests.front());
+    while (sink.NextCursor(cursor)) {
+        McpServer::GetInstance().ParseMessage(ToolsListRequest(cursor));
+        pages++;
+    }
+    BenchPrintRow(BenchFormat("%d tools, pages", count), BenchFormat("%zu (reference %zu)", pages, requests.size()));
+}
+
+static void BenchToolCall(McpSink& sink, const std::vector<McpTool*>& tools) {
+    int count = tools.size();
+    int iterations = BenchIterations(CALL_ITERATIONS);
+    auto& last_name = tools.back()->name();
+
+    // Finding the last tool added, before: a linear search by name
+    auto lookup = BenchRun(iterations * 10, [&]() {
+        auto it = std::find_if(tools.begin(), tools.end(), [&last_name](const McpTool* tool) { return tool->name() == last_name; });
+        if (it == tools.end()) {
+            abort();
+        }
+    });
+    BenchPrint(BenchFormat("%d tools, linear lookup before", count), lookup);
+
+    auto request = ToolCallRequest(7, last_name);
+    auto call = BenchRun(iterations, [&]() {
+        uint64_t messages = sink.messages();
+        McpServer::GetInstance().ParseMessage(request);
+        sink.WaitForMessages(messages + 1);
+    });
+    BenchPrint(BenchFormat("%d tools, call to reply", count), call);
+}
+
+// The same calls sent one by one, each waiting for its reply, and as one batch
+static void BenchBatch(McpSink& sink, const std::vector<McpTool*>& tools) {
+    std::vector<std::string> singles;
+    std::string batch = "[";
+    for (int i = 0; i < BATCH_CALLS; i++) {
+        singles.push_back(ToolCallRequest(100 + i, tools[i]->name()));
+        batch += (i > 0 ? "," : "") + singles.back();
+    }
+    batch += "]";
+
+    uint64_t messages = sink.messages();
+    int64_t start = BenchNowUs();
+    for (auto& single : singles) {
+        uint64_t before = sink.messages();
+        McpServer::GetInstance().ParseMessage(single);
+        sink.WaitForMessages(before + 1);
+    }
+    int64_t singles_us = BenchNowUs() - start;
+    uint64_t single_replies = sink.messages() - messages;
+
+    messages = sink.messages();
+    start = BenchNowUs();
+    McpServer::GetInstance().ParseMessage(batch);
+    sink.WaitForMessages(messages + 1);
+    int64_t batch_us = BenchNowUs() - start;
+    uint64_t batch_replies = sink.messages() - messages;
+
+    BenchPrintRow(BenchFormat("%d calls one by one", BATCH_CALLS),
+        BenchFormat("%d requests answered in %llu messages, %.1f us on the device", BATCH_CALLS, (unsigned long long)single_replies, (double)singles_us));
+    BenchPrintRow(BenchFormat("%d calls in a batch", BATCH_CALLS),
+        BenchFormat("1 request answered in %llu messages, %.1f us on the device", (unsigned long long)batch_replies, (double)batch_us));
+    BenchPrintRow(BenchFormat("at %d ms per round trip", ROUND_TRIP_MS),
+        BenchFormat("one by one %d ms, batch %d ms", BATCH_CALLS * ROUND_TRIP_MS, ROUND_TRIP_MS));
+}
+
+int main(int argc, char** argv) {
+    BenchInit(argc, argv, "mcp tools");
+    AllocCounter::UseCountingCJsonHooks();
+    McpSink sink;
+    std::vector<McpTool*> tools;
+    for (int count : {50, 200, 1000}) {
+        AddTools(tools, count);
+        BenchToolsList(sink, tools);
+        BenchToolCall(sink, tools);
+    }
+    BenchBatch(sink, tools);
+    return BenchExit();
+}
@@ -0,0 +1,170 @@
+// MQTT+UDP audio: AES-CTR send / receive cost per frame before and after the copy-free path,
+// single frames against bursts (requests 011 and 013)
+#include <arpa/inet.h>
+#include <mbedtls/aes.h>
+
+#include <cstring>
+#include <vector>
+
+#include "bench.h"
+#include "board.h"
+#include "mqtt_protocol.h"
+#include "loopback_server.h"
+#include "audio_payload_pool.h"
+
+#define OPUS_PACKET_SIZE 240
+
+// Takes the datagrams without copying them anywhere, so only the protocol is timed
+class NullUdp : public Udp {
+public:
+    bool Connect(const std::string& host, int port) override { return true; }
+    void Disconnect() override {}
+    int Send(const std::string& data) override {
+        datagrams++;
+        bytes += data.size();
+        return data.size();
+    }
+    void Deliver(const std::string& data) { message_callback_(data); }
+
+    uint64_t datagrams = 0;
+    uint64_t bytes = 0;
+};
+
+// MqttProtocol::SendAudio before: a nonce string, a new ciphertext string per frame
+class BaselineSender {
+public:
+    explicit BaselineSender(Udp* udp) : udp_(udp), aes_nonce_(16, '\x01') {
+        uint8_t key[16] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+        mbedtls_aes_init(&aes_ctx_);
+        mbedtls_aes_setkey_enc(&aes_ctx_, key, 128);
+    }
+    ~BaselineSender() { mbedtls_aes_free(&aes_ctx_); }
+
+    bool SendAudio(const AudioStreamPacket& packet) {
+        std::string nonce(aes_nonce_);
+        *(uint16_t*)&nonce[2] = htons(packet.payload.size());
+        *(uint32_t*)&nonce[8] = htonl(packet.timestamp);
+        *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
+
+        std::string encrypted;
+        encrypted.resize(aes_nonce_.size() + packet.payload.size());
+        memcpy(encrypted.data(), nonce.data(), nonce.size());
+
+        size_t nc_off = 0;
+        uint8_t stream_block[16] = {0};
+        if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet.payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
+            (uint8_t*)packet.payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
+            return false;
+        }
+        return udp_->Send(encrypted) > 0;
+    }
+
+    // The receive callback before: a new payload vector per packet
+    void Receive(const std::string& data, AudioStreamPacket& packet) {
+        uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
+        size_t decrypted_size = data.size() - aes_nonce_.size();
+        size_t nc_off = 0;
+        uint8_t stream_block[16] = {0};
+        auto nonce = (uint8_t*)data.data();
+        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
+        packet = AudioStreamPacket();
+        packet.sample_rate = 24000;
+        packet.frame_duration = 60;
+        packet.timestamp = timestamp;
+        packet.payload.resize(decrypted_size);
+        mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet.payload.data());
+    }
+
+private:
+    Udp* udp_;
+    std::string aes_nonce_;
+    mbedtls_aes_context aes_ctx_;
+    uint32_t local_sequence_ = 0;
+};
+
+static AudioStreamPacket MakeFrame(uint32_t timestamp) {
+    AudioStreamPacket packet;
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.timestamp = timestamp;
+    packet.payload.assign(OPUS_PACKET_SIZE, (uint8_t)timestamp);
+    return packet;
+}
+
+static void PrintPerFrame(const std::string& name, const BenchResult& result, int frames_per_op = 1) {
+    BenchResult per_frame = result;
+    per_frame.us_per_op /= frames_per_op;
+    per_frame.allocs_per_op /= frames_per_op;
+    per_frame.bytes_per_op /= frames_per_op;
+    BenchPrint(name, per_frame);
+    BenchPrintRow("  frames/s", BenchFormat("%.0f", 1000000.0 / per_frame.us_per_op));
+}
+
+int main(int argc, char** argv) {
+    BenchInit(argc, argv, "mqtt+udp audio, 240 byte opus frames");
+    int iterations = BenchIterations(100000);
+
+    LoopbackServerOptions options;
+    options.udp_burst = AUDIO_MAX_BURST_FRAMES;
+    LoopbackServer server(options);
+    server.Install();
+    NullUdp* udp = nullptr;
+    Board::GetInstance().SetUdpFactory([&udp]() -> Udp* {
+        udp = new NullUdp();
+        return udp;
+    });
+
+    auto protocol = new MqttProtocol();
+    protocol->OnIncomingAudio([](AudioStreamPacket&& packet) {
+        AudioPayloadPool::GetInstance().Release(std::move(packet.payload));
+    });
+    if (!protocol->Start() || !protocol->OpenAudioChannel() || udp == nullptr) {
+        printf("Failed to open the audio channel\n");
+        return 1;
+    }
+
+    NullUdp baseline_udp;
+    BaselineSender baseline(&baseline_udp);
+    auto frame = MakeFrame(0);
+    PrintPerFrame("send, before (string nonce + ciphertext)", BenchRun(iterations, [&]() {
+        baseline.SendAudio(frame);
+    }));
+    PrintPerFrame("send, in place", BenchRun(iterations, [&]() {
+        protocol->SendAudio(frame);
+    }));
+
+    std::vector<AudioStreamPacket> burst;
+    for (int i = 0; i < AUDIO_MAX_BURST_FRAMES; i++) {
+        burst.push_back(MakeFrame(i * 60));
+    }
+    uint64_t datagrams = udp->datagrams;
+    uint64_t bytes = udp->bytes;
+    int burst_iterations = iterations / AUDIO_MAX_BURST_FRAMES;
+    PrintPerFrame("send, burst of " + std::to_string(AUDIO_MAX_BURST_FRAMES), BenchRun(burst_iterations, [&]() {
+        protocol->SendAudioBurst(burst.data(), burst.size());
+    }), AUDIO_MAX_BURST_FRAMES);
+    int burst_ops = burst_iterations + std::min(burst_iterations, 16);
+    BenchPrintRow("  datagrams per frame", BenchFormat("%.2f",
+        (double)(udp->datagrams - datagrams) / (burst_ops * AUDIO_MAX_BURST_FRAMES)));
+    BenchPrintRow("  wire bytes per frame", BenchFormat("%.1f (single: %d)",
+        (double)(udp->bytes - bytes) / (burst_ops * AUDIO_MAX_BURST_FRAMES), OPUS_PACKET_SIZE + 16));
+
+    // Downlink, the datagrams are encrypted by the server beforehand
+    int warm_up = std::min(iterations, 16);
+    std::vector<std::string> datagrams_in;
+    datagrams_in.reserve(iterations + warm_up);
+    for (int i = 0; i < iterations + warm_up; i++) {
+        datagrams_in.push_back(server.EncryptDatagram(i + 1, i * 60, frame.payload));
+    }
+    size_t next = 0;
+    AudioStreamPacket packet;
+    PrintPerFrame("receive, before (new payload vector)", BenchRun(iterations, [&]() {
+        baseline.Receive(datagrams_in[next++], packet);
+    }));
+    next = 0;
+    PrintPerFrame("receive, pooled payload", BenchRun(iterations, [&]() {
+        udp->Deliver(datagrams_in[next++]);
+    }));
+
+    return BenchExit();
+}
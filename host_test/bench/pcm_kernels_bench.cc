@@ -0,0 +1,164 @@
+// Sample format kernels against the loops they replaced, per 60ms block (requests 003 and 007)
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "bench.h"
+#include "pcm_kernels.h"
+#include "opus_resampler.h"
+
+#define BLOCK_MS 60
+
+// Application::ReadAudio before: new vectors for each channel and for the resampled data
+static void StereoBefore(const std::vector<int16_t>& input, std::vector<int16_t>& data, OpusResampler& mic_resampler,
+    OpusResampler& reference_resampler) {
+    data = input;
+    auto mic_channel = std::vector<int16_t>(data.size() / 2);
+    auto reference_channel = std::vector<int16_t>(data.size() / 2);
+    for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
+        mic_channel[i] = data[j];
+        reference_channel[i] = data[j + 1];
+    }
+    auto resampled_mic = std::vector<int16_t>(mic_resampler.GetOutputSamples(mic_channel.size()));
+    auto resampled_reference = std::vector<int16_t>(reference_resampler.GetOutputSamples(reference_channel.size()));
+    mic_resampler.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
+    reference_resampler.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
+    data.resize(resampled_mic.size() + resampled_reference.size());
+    for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
+        data[j] = resampled_mic[i];
+        data[j + 1] = resampled_reference[i];
+    }
+}
+
+// Application::ReadAudio now: scratch buffers owned by the Application and the stereo kernels
+static void StereoAfter(const std::vector<int16_t>& input, std::vector<int16_t>& data, std::vector<int16_t>& input_scratch,
+    std::vector<int16_t>& channel_scratch, OpusResampler& mic_resampler, OpusResampler& reference_resampler) {
+    input_scratch.assign(input.begin(), input.end());
+    size_t frames = input_scratch.size() / 2;
+    channel_scratch.resize(frames * 2);
+    auto mic_channel = channel_scratch.data();
+    auto reference_channel = channel_scratch.data() + frames;
+    PcmDeinterleaveStereo(input_scratch.data(), mic_channel, reference_channel, frames);
+    size_t resampled_frames = mic_resampler.GetOutputSamples(frames);
+    auto resampled_mic = input_scratch.data();
+    auto resampled_reference = input_scratch.data() + resampled_frames;
+    mic_resampler.Process(mic_channel, frames, resampled_mic);
+    reference_resampler.Process(reference_channel, frames, resampled_reference);
+    data.resize(resampled_frames * 2);
+    PcmInterleaveStereo(resampled_mic, resampled_reference, data.data(), resampled_frames);
+}
+
+// NoAudioCodec::Write before: pow() per call, a new buffer and a 64-bit clamp per sample
+static void OutputBefore(const int16_t* data, int samples, int output_volume, std::vector<int32_t>& sink) {
+    std::vector<int32_t> buffer(samples);
+    int32_t volume_factor = pow(double(output_volume) / 100.0, 2) * 65536;
+    for (int i = 0; i < samples; i++) {
+        int64_t temp = int64_t(data[i]) * volume_factor;
+        if (temp > INT32_MAX) {
+            buffer[i] = INT32_MAX;
+        } else if (temp < INT32_MIN) {
+            buffer[i] = INT32_MIN;
+        } else {
+            buffer[i] = static_cast<int32_t>(temp);
+        }
+    }
+    sink.swap(buffer);
+}
+
+// NoAudioCodec::Read before
+static void InputBefore(int16_t* dest, int samples) {
+    std::vector<int32_t> bit32_buffer(samples);
+    for (int i = 0; i < samples; i++) {
+        bit32_buffer[i] = (i * 7919) << 12;
+    }
+    for (int i = 0; i < samples; i++) {
+        int32_t value = bit32_buffer[i] >> 12;
+        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+    }
+}
+
+static void InputAfter(int16_t* dest, int32_t* rx_buffer, int samples) {
+    for (int i = 0; i < samples; i++) {
+        rx_buffer[i] = (i * 7919) << 12;
+    }
+    PcmConvertQ31ToQ15(rx_buffer, dest, samples, 12);
+}
+
+int main(int argc, char** argv) {
+    BenchInit(argc, argv, "pcm kernels, 60ms blocks");
+    int iterations = BenchIterations(20000);
+
+    for (int rate : {16000, 24000, 48000}) {
+        std::string suffix = " " + std::to_string(rate / 1000) + "k";
+        size_t frames = rate / 1000 * BLOCK_MS;
+        std::vector<int16_t> input(frames * 2);
+        for (size_t i = 0; i < input.size(); i++) {
+            input[i] = (int16_t)(i * 2654435761u >> 16);
+        }
+        std::vector<int16_t> data;
+        OpusResampler mic_resampler;
+        OpusResampler reference_resampler;
+        mic_resampler.Configure(rate, 16000);
+        reference_resampler.Configure(rate, 16000);
+
+        BenchPrint("stereo read, before" + suffix, BenchRun(iterations, [&]() {
+            StereoBefore(input, data, mic_resampler, reference_resampler);
+        }));
+        std::vector<int16_t> input_scratch;
+        std::vector<int16_t> channel_scratch;
+        BenchPrint("stereo read, kernels" + suffix, BenchRun(iterations, [&]() {
+            StereoAfter(input, data, input_scratch, channel_scratch, mic_resampler, reference_resampler);
+        }));
+
+        // The kernels alone, without the resampler
+        std::vector<int16_t> left(frames);
+        std::vector<int16_t> right(frames);
+        BenchPrint("deinterleave loop" + suffix, BenchRun(iterations, [&]() {
+            for (size_t i = 0, j = 0; i < frames; ++i, j += 2) {
+                left[i] = input[j];
+                right[i] = input[j + 1];
+            }
+        }));
+        BenchPrint("PcmDeinterleaveStereo" + suffix, BenchRun(iterations, [&]() {
+            PcmDeinterleaveStereo(input.data(), left.data(), right.data(), frames);
+        }));
+        // Misaligned channel buffers take the scalar path
+        std::vector<int16_t> unaligned(frames * 2 + 1);
+        BenchPrint("PcmDeinterleaveStereo misaligned" + suffix, BenchRun(iterations, [&]() {
+            PcmDeinterleaveStereo(input.data(), unaligned.data() + 1, unaligned.data() + 1 + frames, frames);
+        }));
+        std::vector<int16_t> stereo(frames * 2);
+        BenchPrint("interleave loop" + suffix, BenchRun(iterations, [&]() {
+            for (size_t i = 0, j = 0; i < frames; ++i, j += 2) {
+                stereo[j] = left[i];
+                stereo[j + 1] = right[i];
+            }
+        }));
+        BenchPrint("PcmInterleaveStereo" + suffix, BenchRun(iterations, [&]() {
+            PcmInterleaveStereo(left.data(), right.data(), stereo.data(), frames);
+        }));
+
+        // Output volume stage of NoAudioCodec, mono
+        std::vector<int32_t> sink;
+        BenchPrint("volume, before" + suffix, BenchRun(iterations, [&]() {
+            OutputBefore(input.data(), frames, 70, sink);
+        }));
+        std::vector<int32_t> tx_buffer(frames);
+        BenchPrint("PcmApplyGainQ31" + suffix, BenchRun(iterations, [&]() {
+            PcmApplyGainQ31(input.data(), tx_buffer.data(), frames, 32112, 32112);
+        }));
+        BenchPrint("PcmApplyGainQ31 ramp" + suffix, BenchRun(iterations, [&]() {
+            PcmApplyGainQ31(input.data(), tx_buffer.data(), frames, 16384, 32112);
+        }));
+
+        std::vector<int16_t> dest(frames);
+        BenchPrint("mic read, before" + suffix, BenchRun(iterations, [&]() {
+            InputBefore(dest.data(), frames);
+        }));
+        std::vector<int32_t> rx_buffer(frames);
+        BenchPrint("mic read, PcmConvertQ31ToQ15" + suffix, BenchRun(iterations, [&]() {
+            InputAfter(dest.data(), rx_buffer.data(), frames);
+        }));
+    }
+    return BenchExit();
+}
@@ -0,0 +1,166 @@
+// Audio packet queues: the std::list + mutex the Application used before, against
+// BoundedQueue with pooled payloads (requests 001 and 002)
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <thread>
+
+#include "bench.h"
+#include "bounded_queue.h"
+#include "audio_payload_pool.h"
+#include "audio_stream_packet.h"
+
+// MAX_AUDIO_PACKETS_IN_QUEUE of the device Application: 2400ms of 20ms frames
+#define QUEUE_PACKETS 120
+#define OPUS_PACKET_SIZE 240
+
+// What audio_send_queue_ was: a list under the Application mutex, dropping the oldest when full
+class ListQueue {
+public:
+    void Push(AudioStreamPacket&& packet) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (packets_.size() >= QUEUE_PACKETS) {
+            packets_.pop_front();
+        }
+        packets_.emplace_back(std::move(packet));
+    }
+
+    bool Pop(AudioStreamPacket& packet) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (packets_.empty()) {
+            return false;
+        }
+        packet = std::move(packets_.front());
+        packets_.pop_front();
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::list<AudioStreamPacket> packets_;
+};
+
+// The device pushes like Application::OnAudioOutput does, dropping the oldest when full
+static void PushDropOldest(BoundedQueue<AudioStreamPacket>& queue, AudioStreamPacket&& packet) {
+    AudioStreamPacket dropped;
+    while (!queue.TryPush(std::move(packet))) {
+        if (queue.TryPop(dropped)) {
+            AudioPayloadPool::GetInstance().Release(std::move(dropped.payload));
+        }
+    }
+}
+
+static AudioStreamPacket NewPacket(uint32_t timestamp) {
+    AudioStreamPacket packet;
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.timestamp = timestamp;
+    packet.payload.resize(OPUS_PACKET_SIZE);
+    return packet;
+}
+
+static AudioStreamPacket PooledPacket(uint32_t timestamp) {
+    AudioStreamPacket packet;
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.timestamp = timestamp;
+    packet.payload = AudioPayloadPool::GetInstance().Acquire(OPUS_PACKET_SIZE);
+    return packet;
+}
+
+// One producer and one consumer moving `packets` packets, like the audio and network tasks
+template <typename Push, typename Pop>
+static double Transfer(int packets, Push push, Pop pop) {
+    std::atomic<bool> done{false};
+    int64_t start = BenchNowUs();
+    std::thread consumer([&]() {
+        int received = 0;
+        AudioStreamPacket packet;
+        while (received < packets) {
+            if (pop(packet)) {
+                received++;
+            } else if (done) {
+                break;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    for (int i = 0; i < packets; i++) {
+        push(i);
+    }
+    done = true;
+    consumer.join();
+    return (double)(BenchNowUs() - start) / packets;
+}
+
+int main(int argc, char** argv) {
+    BenchInit(argc, argv, "audio packet queues");
+    int iterations = BenchIterations(200000);
+
+    {
+        ListQueue queue;
+        uint32_t timestamp = 0;
+        BenchPrint("list+mutex push/pop, new payload", BenchRun(iterations, [&]() {
+            queue.Push(NewPacket(timestamp++));
+            AudioStreamPacket packet;
+            queue.Pop(packet);
+        }));
+    }
+    {
+        BoundedQueue<AudioStreamPacket> queue(QUEUE_PACKETS);
+        uint32_t timestamp = 0;
+        BenchPrint("ring push/pop, pooled payload", BenchRun(iterations, [&]() {
+            PushDropOldest(queue, PooledPacket(timestamp++));
+            AudioStreamPacket packet;
+            queue.TryPop(packet);
+            AudioPayloadPool::GetInstance().Release(std::move(packet.payload));
+        }));
+    }
+
+    // A backlog: every push has to drop the oldest packet
+    {
+        ListQueue queue;
+        for (int i = 0; i < QUEUE_PACKETS; i++) {
+            queue.Push(NewPacket(i));
+        }
+        uint32_t timestamp = 0;
+        BenchPrint("list+mutex push when full", BenchRun(iterations, [&]() {
+            queue.Push(NewPacket(timestamp++));
+        }));
+    }
+    {
+        BoundedQueue<AudioStreamPacket> queue(QUEUE_PACKETS);
+        for (int i = 0; i < QUEUE_PACKETS; i++) {
+            PushDropOldest(queue, PooledPacket(i));
+        }
+        uint32_t timestamp = 0;
+        BenchPrint("ring push when full", BenchRun(iterations, [&]() {
+            PushDropOldest(queue, PooledPacket(timestamp++));
+        }));
+    }
+
+    // Contention between a producer and a consumer task
+    {
+        ListQueue queue;
+        double us = Transfer(iterations, [&](int i) { queue.Push(NewPacket(i)); },
+            [&](AudioStreamPacket& packet) { return queue.Pop(packet); });
+        BenchPrintRow("list+mutex 1 producer / 1 consumer", BenchFormat("%.3f us/packet", us));
+    }
+    {
+        BoundedQueue<AudioStreamPacket> queue(QUEUE_PACKETS);
+        double us = Transfer(iterations, [&](int i) { PushDropOldest(queue, PooledPacket(i)); },
+            [&](AudioStreamPacket& packet) {
+                if (!queue.TryPop(packet)) {
+                    return false;
+                }
+                AudioPayloadPool::GetInstance().Release(std::move(packet.payload));
+                return true;
+            });
+        BenchPrintRow("ring 1 producer / 1 consumer", BenchFormat("%.3f us/packet", us));
+    }
+
+    auto& pool = AudioPayloadPool::GetInstance();
+    BenchPrintRow("payload pool hits / misses", BenchFormat("%u / %u", pool.hits(), pool.misses()));
+    return BenchExit();
+}
@@ -0,0 +1,174 @@
+// Websocket audio framing: allocations and copies during a 60s TTS stream (and 60s of
+// uplink) before and after the pooled / reused buffers (request 012)
+#include <arpa/inet.h>
+
+#include <cstring>
+#include <vector>
+
+#include "bench.h"
+#include "board.h"
+#include "websocket_protocol.h"
+#include "loopback_server.h"
+#include "audio_payload_pool.h"
+
+#define OPUS_PACKET_SIZE 240
+// 60 seconds of 60ms frames
+#define STREAM_FRAMES 1000
+
+// Answers the hello at once and drops what the device sends, so only the protocol is measured
+class NullWebSocket : public WebSocket {
+public:
+    bool Connect(const char* uri) override { return true; }
+    bool IsConnected() const override { return true; }
+    bool Send(const std::string& data) override {
+        if (data.find("\"hello\"") != std::string::npos) {
+            std::string hello = R"({"type":"hello","transport":"websocket","session_id":"bench",)"
+                R"("audio_params":{"sample_rate":24000,"frame_duration":60}})";
+            on_data_(hello.c_str(), hello.size(), false);
+        }
+        return true;
+    }
+    bool Send(const void* data, size_t len, bool binary, bool fin) override {
+        frames++;
+        bytes += len;
+        return true;
+    }
+    void Close() override {}
+    void Deliver(const std::string& frame) { on_data_(frame.data(), frame.size(), true); }
+
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+};
+
+// A downlink frame as the server sends it on each protocol version
+static std::string MakeFrame(int version, uint32_t timestamp, const std::vector<uint8_t>& opus) {
+    std::string frame;
+    if (version == 2) {
+        frame.resize(sizeof(BinaryProtocol2) + opus.size());
+        auto bp2 = (BinaryProtocol2*)frame.data();
+        bp2->version = htons(2);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(timestamp);
+        bp2->payload_size = htonl(opus.size());
+        memcpy(bp2->payload, opus.data(), opus.size());
+    } else if (version == 3) {
+        frame.resize(sizeof(BinaryProtocol3) + opus.size());
+        auto bp3 = (BinaryProtocol3*)frame.data();
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(opus.size());
+        memcpy(bp3->payload, opus.data(), opus.size());
+    } else {
+        frame.assign(opus.begin(), opus.end());
+    }
+    return frame;
+}
+
+// WebsocketProtocol::SendAudio before: a new string per frame on v2 / v3
+static void SendBefore(WebSocket* websocket, int version, const AudioStreamPacket& packet) {
+    if (version == 2) {
+        std::string serialized;
+        serialized.resize(sizeof(BinaryProtocol2) + packet.payload.size());
+        auto bp2 = (BinaryProtocol2*)serialized.data();
+        bp2->version = htons(version);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(packet.timestamp);
+        bp2->payload_size = htonl(packet.payload.size());
+        memcpy(bp2->payload, packet.payload.data(), packet.payload.size());
+        websocket->Send(serialized.data(), serialized.size(), true);
+    } else if (version == 3) {
+        std::string serialized;
+        serialized.resize(sizeof(BinaryProtocol3) + packet.payload.size());
+        auto bp3 = (BinaryProtocol3*)serialized.data();
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(packet.payload.size());
+        memcpy(bp3->payload, packet.payload.data(), packet.payload.size());
+        websocket->Send(serialized.data(), serialized.size(), true);
+    } else {
+        websocket->Send(packet.payload.data(), packet.payload.size(), true);
+    }
+}
+
+// The OnData binary branch before: the header is byte swapped in place and the payload copied
+// into a new vector; the consumer (decode stage) frees it
+static void ReceiveBefore(int version, std::string& frame) {
+    AudioStreamPacket packet;
+    if (version == 2) {
+        auto bp2 = (BinaryProtocol2*)frame.data();
+        auto payload = (uint8_t*)bp2->payload;
+        packet.timestamp = ntohl(bp2->timestamp);
+        packet.payload = std::vector<uint8_t>(payload, payload + ntohl(bp2->payload_size));
+    } else if (version == 3) {
+        auto bp3 = (BinaryProtocol3*)frame.data();
+        auto payload = (uint8_t*)bp3->payload;
+        packet.payload = std::vector<uint8_t>(payload, payload + ntohs(bp3->payload_size));
+    } else {
+        packet.payload = std::vector<uint8_t>((uint8_t*)frame.data(), (uint8_t*)frame.data() + frame.size());
+    }
+}
+
+static void PrintStream(const std::string& name, const BenchResult& result) {
+    // One op is one frame, a stream is STREAM_FRAMES frames over 60 seconds
+    BenchPrintRow(name, BenchFormat("%8.2f us/frame %8.2f allocs/s %10.1f bytes allocated/s",
+        result.us_per_op, result.allocs_per_op * STREAM_FRAMES / 60, result.bytes_per_op * STREAM_FRAMES / 60));
+}
+
+int main(int argc, char** argv) {
+    BenchInit(argc, argv, "websocket audio, 60s streams of 240 byte frames");
+    int frames = BenchQuick() ? STREAM_FRAMES / 10 : STREAM_FRAMES;
+
+    LoopbackServer server;
+    std::vector<uint8_t> opus(OPUS_PACKET_SIZE, 0x5A);
+    AudioStreamPacket packet;
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.payload = opus;
+
+    for (int version : {1, 2, 3}) {
+        server.Install(version);
+        NullWebSocket* websocket = nullptr;
+        Board::GetInstance().SetWebSocketFactory([&websocket]() -> WebSocket* {
+            websocket = new NullWebSocket();
+            return websocket;
+        });
+        // Kept until exit, like the device keeps its protocol
+        auto protocol = new WebsocketProtocol();
+        protocol->OnIncomingAudio([](AudioStreamPacket&& packet) {
+            AudioPayloadPool::GetInstance().Release(std::move(packet.payload));
+        });
+        if (!protocol->Start() || !protocol->OpenAudioChannel() || websocket == nullptr) {
+            printf("Failed to open the audio channel\n");
+            return 1;
+        }
+        std::string v = " v" + std::to_string(version);
+
+        std::vector<std::string> stream;
+        for (int i = 0; i < frames + 16; i++) {
+            stream.push_back(MakeFrame(version, i * 60, opus));
+        }
+        size_t next = 0;
+        PrintStream("receive, before" + v, BenchRun(frames, [&]() {
+            ReceiveBefore(version, stream[next++]);
+        }));
+        for (int i = 0; i < frames + 16; i++) {
+            stream[i] = MakeFrame(version, i * 60, opus);
+        }
+        next = 0;
+        PrintStream("receive, pooled" + v, BenchRun(frames, [&]() {
+            websocket->Deliver(stream[next++]);
+        }));
+
+        PrintStream("send, before" + v, BenchRun(frames, [&]() {
+            packet.timestamp += 60;
+            SendBefore(websocket, version, packet);
+        }));
+        PrintStream("send, reused buffer" + v, BenchRun(frames, [&]() {
+            packet.timestamp += 60;
+            protocol->SendAudio(packet);
+        }));
+    }
+    return BenchExit();
+}
@@ -0,0 +1,26 @@
+#include "application.h"
+
+void Application::SendMcpMessage(const std::string& payload) {
+    std::function<void(const std::string& payload)> sink;
+    {
+        std::lock_guard<std::mutex> lock(mcp_mutex_);
+        sink = mcp_sink_;
+    }
+    if (sink != nullptr) {
+        sink(payload);
+    }
+}
+
+void Application::OnMcpMessage(std::function<void(const std::string& payload)> sink) {
+    std::lock_guard<std::mutex> lock(mcp_mutex_);
+    mcp_sink_ = std::move(sink);
+}
+
+bool Application::SetFrameDuration(int duration_ms) {
+    if (duration_ms != 20 && duration_ms != 40 && duration_ms != 60) {
+        return false;
+    }
+    // Applied right away, there is no session to wait for on the host
+    frame_duration_ = duration_ms;
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef _APPLICATION_H_
+#define _APPLICATION_H_
+
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "audio_codec.h"
+#include "background_task.h"
+#include "encoder_controller.h"
+#include "audio_pipeline.h"
+
+/*
+ * The part of Application the protocols and the MCP server call into.
+ *
+ * The device Application also owns the display, OTA and the conversation
+ * state, none of which build on the host; its AudioPipeline does, and tests
+ * drive one directly. Here Schedule() runs callbacks on a real BackgroundTask
+ * (standing in for the main event loop) and MCP replies go to a sink the test
+ * installs.
+ */
+class Application {
+public:
+    static Application& GetInstance() {
+        static Application instance;
+        return instance;
+    }
+    Application(const Application&) = delete;
+    Application& operator=(const Application&) = delete;
+
+    void Schedule(std::function<void()> callback) { main_loop_.Schedule(std::move(callback)); }
+    // Returns after every scheduled callback ran
+    void WaitForScheduled() { main_loop_.WaitForCompletion(); }
+
+    void SendMcpMessage(const std::string& payload);
+    void OnMcpMessage(std::function<void(const std::string& payload)> sink);
+
+    bool SetFrameDuration(int duration_ms);
+    int frame_duration() const { return frame_duration_; }
+    std::string GetEncoderStatusJson() const { return encoder_controller_.GetStatusJson(); }
+    EncoderController& encoder_controller() { return encoder_controller_; }
+
+private:
+    Application() = default;
+
+    BackgroundTask main_loop_;
+    std::mutex mcp_mutex_;
+    std::function<void(const std::string& payload)> mcp_sink_;
+    int frame_duration_ = OPUS_FRAME_DURATION_MS;
+    EncoderController encoder_controller_;
+};
+
+#endif // _APPLICATION_H_
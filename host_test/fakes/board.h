@@ -0,0 +1,77 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <mqtt.h>
+#include <udp.h>
+#include <web_socket.h>
+
+#include "camera.h"
+
+class AudioCodec;
+class Display;
+
+class Backlight {
+public:
+    void SetBrightness(uint8_t brightness, bool permanent = false) { brightness_ = brightness; }
+    inline uint8_t brightness() const { return brightness_; }
+
+private:
+    uint8_t brightness_ = 0;
+};
+
+/*
+ * The host board: network clients come from factories the test installs
+ * (usually the loopback transports), peripherals are whatever the test sets.
+ */
+class Board {
+public:
+    static Board& GetInstance() {
+        static Board instance;
+        return instance;
+    }
+    Board(const Board&) = delete;
+    Board& operator=(const Board&) = delete;
+
+    std::string GetBoardType() { return "host"; }
+    std::string GetUuid() { return "00000000-0000-4000-8000-000000000001"; }
+    AudioCodec* GetAudioCodec() { return audio_codec_; }
+    Backlight* GetBacklight() { return backlight_; }
+    Display* GetDisplay() { return display_; }
+    Camera* GetCamera() { return camera_; }
+    std::string GetDeviceStatusJson() { return "{\"audio_speaker\":{\"volume\":70}}"; }
+
+    Mqtt* CreateMqtt() { return create_mqtt_(); }
+    Udp* CreateUdp() { return create_udp_(); }
+    WebSocket* CreateWebSocket() { return create_websocket_(); }
+
+    void SetAudioCodec(AudioCodec* codec) { audio_codec_ = codec; }
+    void SetBacklight(Backlight* backlight) { backlight_ = backlight; }
+    void SetDisplay(Display* display) { display_ = display; }
+    void SetCamera(Camera* camera) { camera_ = camera; }
+    void SetTransports(std::function<Mqtt*()> create_mqtt, std::function<Udp*()> create_udp,
+        std::function<WebSocket*()> create_websocket) {
+        create_mqtt_ = std::move(create_mqtt);
+        create_udp_ = std::move(create_udp);
+        create_websocket_ = std::move(create_websocket);
+    }
+    // Replace a single factory, e.g. to time a protocol against a transport that does nothing
+    void SetUdpFactory(std::function<Udp*()> create_udp) { create_udp_ = std::move(create_udp); }
+    void SetWebSocketFactory(std::function<WebSocket*()> create_websocket) { create_websocket_ = std::move(create_websocket); }
+
+private:
+    Board() = default;
+
+    AudioCodec* audio_codec_ = nullptr;
+    Backlight* backlight_ = nullptr;
+    Display* display_ = nullptr;
+    Camera* camera_ = nullptr;
+    std::function<Mqtt*()> create_mqtt_;
+    std::function<Udp*()> create_udp_;
+    std::function<WebSocket*()> create_websocket_;
+};
+
+#endif // BOARD_H
@@ -0,0 +1,17 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <string>
+
+// Records what the MCP tools ask of the screen
+class Display {
+public:
+    virtual ~Display() = default;
+    virtual void SetTheme(const std::string& theme_name) { current_theme_name_ = theme_name; }
+    virtual std::string GetTheme() { return current_theme_name_; }
+
+protected:
+    std::string current_theme_name_;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "loopback_link.h"
+
+#include <esp_timer.h>
+
+LoopbackLink::LoopbackLink(int one_way_delay_us) : one_way_delay_us_(one_way_delay_us) {
+    thread_ = std::thread([this]() { Loop(); });
+}
+
+LoopbackLink::~LoopbackLink() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+        condition_variable_.notify_all();
+    }
+    thread_.join();
+}
+
+void LoopbackLink::Post(std::function<void()> delivery) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Equal keys keep their insertion order
+    queue_.emplace(esp_timer_get_time() + one_way_delay_us_, std::move(delivery));
+    condition_variable_.notify_all();
+}
+
+void LoopbackLink::Flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_variable_.wait(lock, [this]() { return queue_.empty() && !delivering_; });
+}
+
+void LoopbackLink::Loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        if (stopped_) {
+            return;
+        }
+        if (queue_.empty()) {
+            condition_variable_.wait(lock);
+            continue;
+        }
+        auto due = queue_.begin()->first;
+        auto now = esp_timer_get_time();
+        if (due > now) {
+            condition_variable_.wait_for(lock, std::chrono::microseconds(due - now));
+            continue;
+        }
+        auto delivery = std::move(queue_.begin()->second);
+        queue_.erase(queue_.begin());
+        delivering_ = true;
+        lock.unlock();
+        delivery();
+        lock.lock();
+        delivering_ = false;
+        condition_variable_.notify_all();
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef LOOPBACK_LINK_H
+#define LOOPBACK_LINK_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+/*
+ * One network thread with a fixed one-way delay.
+ *
+ * Everything the loopback transports send, in either direction, is posted
+ * here and delivered on the link thread once the delay has passed, in the
+ * order it was posted. That is the task the device's network stack would
+ * deliver callbacks on.
+ */
+class LoopbackLink {
+public:
+    explicit LoopbackLink(int one_way_delay_us = 0);
+    ~LoopbackLink();
+    LoopbackLink(const LoopbackLink&) = delete;
+    LoopbackLink& operator=(const LoopbackLink&) = delete;
+
+    void Post(std::function<void()> delivery);
+    // Returns once everything posted so far was delivered
+    void Flush();
+    inline int one_way_delay_us() const { return one_way_delay_us_; }
+
+private:
+    int one_way_delay_us_;
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    std::multimap<int64_t, std::function<void()>> queue_;
+    bool delivering_ = false;
+    bool stopped_ = false;
+    std::thread thread_;
+
+    void Loop();
+};
+
+#endif // LOOPBACK_LINK_H
@@ -0,0 +1,120 @@
+#include "loopback_protocol.h"
+#include "cbor.h"
+
+bool LoopbackProtocol::OpenAudioChannel() {
+    opened_ = true;
+    last_incoming_time_ = std::chrono::steady_clock::now();
+    if (on_audio_channel_opened_ != nullptr) {
+        on_audio_channel_opened_();
+    }
+    return true;
+}
+
+void LoopbackProtocol::CloseAudioChannel() {
+    opened_ = false;
+    if (on_audio_channel_closed_ != nullptr) {
+        on_audio_channel_closed_();
+    }
+}
+
+bool LoopbackProtocol::SendAudio(const AudioStreamPacket& packet) {
+    if (!opened_) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        audio_.push_back(AudioStreamPacket{
+            .sample_rate = packet.sample_rate,
+            .frame_duration = packet.frame_duration,
+            .timestamp = packet.timestamp,
+            .payload = packet.payload
+        });
+    }
+    if (echo_audio_ && on_incoming_audio_ != nullptr) {
+        on_incoming_audio_(AudioStreamPacket{
+            .sample_rate = server_sample_rate_,
+            .frame_duration = server_frame_duration_,
+            .timestamp = packet.timestamp,
+            .payload = packet.payload
+        });
+    }
+    return true;
+}
+
+void LoopbackProtocol::ReceiveHello(const std::string& hello) {
+    auto root = cJSON_Parse(hello.c_str());
+    if (root == nullptr) {
+        return;
+    }
+    auto session_id = cJSON_GetObjectItem(root, "session_id");
+    if (cJSON_IsString(session_id)) {
+        session_id_ = session_id->valuestring;
+    }
+    ParseServerFeatures(root);
+    cJSON_Delete(root);
+}
+
+void LoopbackProtocol::Receive(const std::string& json) {
+    if (DispatchChatMessage(json.data(), json.size())) {
+        return;
+    }
+    auto root = cJSON_Parse(json.c_str());
+    if (root != nullptr) {
+        DispatchJson(root);
+        cJSON_Delete(root);
+    }
+}
+
+void LoopbackProtocol::ReceiveCbor(const uint8_t* data, size_t size) {
+    if (DispatchChatMessage(data, size)) {
+        return;
+    }
+    auto root = CborToJson(data, size);
+    if (root != nullptr) {
+        DispatchJson(root);
+        cJSON_Delete(root);
+    }
+}
+
+void LoopbackProtocol::ReceiveAudio(AudioStreamPacket&& packet) {
+    if (on_incoming_audio_ != nullptr) {
+        on_incoming_audio_(std::move(packet));
+    }
+}
+
+bool LoopbackProtocol::SendText(const std::string& text) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    texts_.push_back(text);
+    return true;
+}
+
+bool LoopbackProtocol::SendCbor(const uint8_t* data, size_t size) {
+    if (fail_cbor_) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    cbor_messages_.emplace_back(data, data + size);
+    return true;
+}
+
+std::vector<std::string> LoopbackProtocol::texts() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return texts_;
+}
+
+std::vector<std::vector<uint8_t>> LoopbackProtocol::cbor_messages() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cbor_messages_;
+}
+
+std::vector<AudioStreamPacket> LoopbackProtocol::audio() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return audio_;
+}
+
+void LoopbackProtocol::ClearRecords() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    texts_.clear();
+    cbor_messages_.clear();
+    audio_.clear();
+}
@@ -0,0 +1,56 @@
+#ifndef LOOPBACK_PROTOCOL_H
+#define LOOPBACK_PROTOCOL_H
+
+#include "protocol.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * A Protocol with no transport at all: what the device sends is recorded,
+ * and the test plays the server by calling Receive() / ReceiveAudio(). Used
+ * for the code in Protocol itself: chat dispatch and CBOR control messages
+ * with their JSON fallback, and as the uplink of an AudioPipeline.
+ */
+class LoopbackProtocol : public Protocol {
+public:
+    LoopbackProtocol() = default;
+
+    bool Start() override { return true; }
+    bool OpenAudioChannel() override;
+    void CloseAudioChannel() override;
+    bool IsAudioChannelOpened() const override { return opened_; }
+    bool SendAudio(const AudioStreamPacket& packet) override;
+
+    // As if the server had answered the hello with these features
+    void ReceiveHello(const std::string& hello);
+    void Receive(const std::string& json);
+    void ReceiveCbor(const uint8_t* data, size_t size);
+    void ReceiveAudio(AudioStreamPacket&& packet);
+
+    // Makes SendCbor fail, the caller must fall back to JSON text
+    void set_fail_cbor(bool fail) { fail_cbor_ = fail; }
+    // Uplink audio is fed back as downlink audio
+    void set_echo_audio(bool echo) { echo_audio_ = echo; }
+
+    std::vector<std::string> texts();
+    std::vector<std::vector<uint8_t>> cbor_messages();
+    std::vector<AudioStreamPacket> audio();
+    void ClearRecords();
+
+protected:
+    bool SendText(const std::string& text) override;
+    bool SendCbor(const uint8_t* data, size_t size) override;
+
+private:
+    std::mutex mutex_;
+    bool opened_ = false;
+    bool fail_cbor_ = false;
+    bool echo_audio_ = false;
+    std::vector<std::string> texts_;
+    std::vector<std::vector<uint8_t>> cbor_messages_;
+    std::vector<AudioStreamPacket> audio_;
+};
+
+#endif // LOOPBACK_PROTOCOL_H
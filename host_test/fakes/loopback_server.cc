@@ -0,0 +1,585 @@
+#include "loopback_server.h"
+#include "board.h"
+#include "settings.h"
+#include "protocol.h"
+#include "cbor.h"
+
+#include <mqtt.h>
+#include <udp.h>
+#include <web_socket.h>
+#include <cJSON.h>
+#include <esp_timer.h>
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#define LOOPBACK_PUBLISH_TOPIC "device-server"
+#define LOOPBACK_SUBSCRIBE_TOPIC "server-device"
+
+class LoopbackMqtt : public Mqtt {
+public:
+    explicit LoopbackMqtt(LoopbackServer* server) : server_(server) {}
+    ~LoopbackMqtt() {
+        std::lock_guard<std::recursive_mutex> lock(server_->transport_mutex_);
+        if (server_->mqtt_ == this) {
+            server_->mqtt_ = nullptr;
+        }
+    }
+
+    bool Connect(const std::string broker_address, int broker_port, const std::string client_id,
+        const std::string username, const std::string password) override {
+        server_->Handshake();
+        connected_ = true;
+        return true;
+    }
+    void Disconnect() override { connected_ = false; }
+    bool Publish(const std::string topic, const std::string payload, int qos = 0) override {
+        if (!connected_) {
+            return false;
+        }
+        auto server = server_;
+        server_->link_.Post([server, payload]() { server->OnControlMessage(payload, true); });
+        return true;
+    }
+    bool Subscribe(const std::string topic, int qos = 0) override { return true; }
+    bool Unsubscribe(const std::string topic) override { return true; }
+    bool IsConnected() override { return connected_; }
+
+    void Deliver(const std::string& payload) {
+        if (on_message_callback_ != nullptr) {
+            on_message_callback_(LOOPBACK_SUBSCRIBE_TOPIC, payload);
+        }
+    }
+
+private:
+    LoopbackServer* server_;
+    bool connected_ = false;
+};
+
+class LoopbackUdp : public Udp {
+public:
+    explicit LoopbackUdp(LoopbackServer* server) : server_(server) {}
+    ~LoopbackUdp() {
+        std::lock_guard<std::recursive_mutex> lock(server_->transport_mutex_);
+        if (server_->udp_ == this) {
+            server_->udp_ = nullptr;
+        }
+    }
+
+    bool Connect(const std::string& host, int port) override {
+        remote_address_ = host;
+        remote_port_ = port;
+        return true;
+    }
+    void Disconnect() override {}
+    int Send(const std::string& data) override {
+        auto server = server_;
+        server_->link_.Post([server, data]() { server->OnDatagram(data); });
+        return data.size();
+    }
+
+    void Deliver(const std::string& data) {
+        if (message_callback_ != nullptr) {
+            message_callback_(data);
+        }
+    }
+
+private:
+    LoopbackServer* server_;
+};
+
+class LoopbackWebSocket : public WebSocket {
+public:
+    explicit LoopbackWebSocket(LoopbackServer* server) : server_(server) {}
+    ~LoopbackWebSocket() {
+        std::lock_guard<std::recursive_mutex> lock(server_->transport_mutex_);
+        if (server_->websocket_ == this) {
+            server_->websocket_ = nullptr;
+        }
+    }
+
+    bool Connect(const char* uri) override {
+        if (server_->refuse_connections_) {
+            return false;
+        }
+        server_->Handshake();
+        auto version = headers_.find("Protocol-Version");
+        server_->websocket_version_ = version != headers_.end() ? std::stoi(version->second) : 1;
+        connected_ = true;
+        return true;
+    }
+    bool IsConnected() const override { return connected_; }
+    bool Send(const std::string& data) override {
+        return Send(data.data(), data.size(), false);
+    }
+    bool Send(const void* data, size_t len, bool binary = false, bool fin = true) override {
+        if (!connected_) {
+            return false;
+        }
+        auto server = server_;
+        std::string frame((const char*)data, len);
+        if (binary) {
+            server_->link_.Post([server, frame]() { server->OnWebSocketBinary(frame); });
+        } else {
+            server_->link_.Post([server, frame]() { server->OnControlMessage(frame, false); });
+        }
+        return true;
+    }
+    void Close() override { connected_ = false; }
+
+    void Deliver(const std::string& data, bool binary) {
+        if (on_data_ != nullptr) {
+            on_data_(data.data(), data.size(), binary);
+        }
+    }
+    void Disconnected() {
+        connected_ = false;
+        if (on_disconnected_ != nullptr) {
+            on_disconnected_();
+        }
+    }
+
+private:
+    LoopbackServer* server_;
+    bool connected_ = false;
+};
+
+static std::string EncodeHex(const uint8_t* data, size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    std::string out;
+    for (size_t i = 0; i < size; i++) {
+        out += hex[data[i] >> 4];
+        out += hex[data[i] & 0x0f];
+    }
+    return out;
+}
+
+LoopbackServer::LoopbackServer(const LoopbackServerOptions& options)
+    : options_(options), link_(options.one_way_delay_us) {
+    for (int i = 0; i < 16; i++) {
+        key_[i] = (uint8_t)(0x10 + i * 7);
+    }
+    // |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|, the device fills in the last three
+    memset(nonce_, 0, sizeof(nonce_));
+    nonce_[0] = 0x01;
+    nonce_[4] = 0x12;
+    nonce_[5] = 0x34;
+    nonce_[6] = 0x56;
+    nonce_[7] = 0x78;
+    mbedtls_aes_init(&aes_ctx_);
+    mbedtls_aes_setkey_enc(&aes_ctx_, key_, 128);
+}
+
+LoopbackServer::~LoopbackServer() {
+    link_.Flush();
+    mbedtls_aes_free(&aes_ctx_);
+}
+
+void LoopbackServer::Install(int websocket_version) {
+    Settings mqtt("mqtt", true);
+    mqtt.SetString("endpoint", "loopback.local:8883");
+    mqtt.SetString("client_id", "host-test");
+    mqtt.SetString("username", "device");
+    mqtt.SetString("password", "secret");
+    mqtt.SetString("publish_topic", LOOPBACK_PUBLISH_TOPIC);
+
+    Settings websocket("websocket", true);
+    websocket.SetString("url", "wss://loopback.local/xiaozhi/v1/");
+    websocket.SetString("token", "test-token");
+    websocket.SetInt("version", websocket_version);
+
+    Board::GetInstance().SetTransports(
+        [this]() -> Mqtt* {
+            std::lock_guard<std::recursive_mutex> lock(transport_mutex_);
+            mqtt_ = new LoopbackMqtt(this);
+            return mqtt_;
+        },
+        [this]() -> Udp* {
+            std::lock_guard<std::recursive_mutex> lock(transport_mutex_);
+            udp_ = new LoopbackUdp(this);
+            return udp_;
+        },
+        [this]() -> WebSocket* {
+            std::lock_guard<std::recursive_mutex> lock(transport_mutex_);
+            websocket_ = new LoopbackWebSocket(this);
+            return websocket_;
+        });
+}
+
+// A connect blocks for the handshake round trips, like the modem / lwIP connect does
+void LoopbackServer::Handshake() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connects_++;
+    }
+    int64_t delay_us = (int64_t)options_.connect_round_trips * 2 * options_.one_way_delay_us;
+    if (delay_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+    }
+}
+
+std::vector<std::string> LoopbackServer::messages() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return messages_;
+}
+
+std::vector<LoopbackAudioFrame> LoopbackServer::audio() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return audio_;
+}
+
+std::string LoopbackServer::last_hello() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_hello_;
+}
+
+uint32_t LoopbackServer::cbor_messages() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cbor_messages_;
+}
+
+uint32_t LoopbackServer::datagrams() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return datagrams_;
+}
+
+uint32_t LoopbackServer::burst_datagrams() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return burst_datagrams_;
+}
+
+uint32_t LoopbackServer::connects() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connects_;
+}
+
+void LoopbackServer::ClearRecords() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    messages_.clear();
+    audio_.clear();
+    cbor_messages_ = 0;
+    datagrams_ = 0;
+    burst_datagrams_ = 0;
+}
+
+bool LoopbackServer::WaitForAudio(size_t frames, int timeout_ms) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return condition_variable_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+        [this, frames]() { return audio_.size() >= frames; });
+}
+
+bool LoopbackServer::WaitForMessage(const std::string& type, int timeout_ms) {
+    std::string needle = "\"type\":\"" + type + "\"";
+    std::unique_lock<std::mutex> lock(mutex_);
+    return condition_variable_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this, &needle]() {
+        for (auto& message : messages_) {
+            if (message.find(needle) != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
+// Runs on the link thread
+void LoopbackServer::OnControlMessage(const std::string& data, bool over_mqtt) {
+    bool cbor = IsCborMessage((const uint8_t*)data.data(), data.size());
+    cJSON* root = cbor ? CborToJson((const uint8_t*)data.data(), data.size()) : cJSON_Parse(data.c_str());
+    if (root == nullptr) {
+        return;
+    }
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (cJSON_IsString(type) && strcmp(type->valuestring, "hello") == 0) {
+        OnHello(root, over_mqtt);
+        cJSON_Delete(root);
+        return;
+    }
+    auto json = cJSON_PrintUnformatted(root);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        messages_.push_back(json);
+        if (cbor) {
+            cbor_messages_++;
+        }
+        condition_variable_.notify_all();
+    }
+    cJSON_free(json);
+    cJSON_Delete(root);
+}
+
+void LoopbackServer::OnHello(const cJSON* root, bool over_mqtt) {
+    auto text = cJSON_PrintUnformatted(root);
+    std::string session_id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        last_hello_ = text;
+        auto resume = cJSON_GetObjectItem(root, "resume_session_id");
+        if (options_.resume && cJSON_IsString(resume) && resume->valuestring[0] != '\0') {
+            session_id_ = resume->valuestring;
+        } else {
+            session_id_ = "loopback-" + std::to_string(++sessions_);
+        }
+        session_id = session_id_;
+        downlink_sequence_ = 0;
+        websocket_frames_ = 0;
+    }
+    cJSON_free(text);
+
+    auto features = cJSON_GetObjectItem(root, "features");
+    auto udp_burst = cJSON_GetObjectItem(features, "udp_burst");
+    int burst = 0;
+    if (options_.udp_burst > 1 && cJSON_IsNumber(udp_burst)) {
+        burst = std::min(options_.udp_burst, udp_burst->valueint);
+    }
+
+    cJSON* reply = cJSON_CreateObject();
+    cJSON_AddStringToObject(reply, "type", "hello");
+    cJSON_AddStringToObject(reply, "transport", over_mqtt ? "udp" : "websocket");
+    cJSON_AddStringToObject(reply, "session_id", session_id.c_str());
+    cJSON* reply_features = cJSON_CreateObject();
+    cJSON_AddBoolToObject(reply_features, "cbor", options_.cbor && cJSON_IsTrue(cJSON_GetObjectItem(features, "cbor")));
+    cJSON_AddItemToObject(reply, "features", reply_features);
+    cJSON* audio_params = cJSON_CreateObject();
+    cJSON_AddStringToObject(audio_params, "format", "opus");
+    cJSON_AddNumberToObject(audio_params, "sample_rate", options_.sample_rate);
+    cJSON_AddNumberToObject(audio_params, "channels", 1);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", options_.frame_duration);
+    cJSON_AddItemToObject(reply, "audio_params", audio_params);
+    if (over_mqtt) {
+        cJSON* udp = cJSON_CreateObject();
+        cJSON_AddStringToObject(udp, "server", "loopback.local");
+        cJSON_AddNumberToObject(udp, "port", 8888);
+        cJSON_AddStringToObject(udp, "encryption", "aes-128-ctr");
+        cJSON_AddStringToObject(udp, "key", EncodeHex(key_, sizeof(key_)).c_str());
+        cJSON_AddStringToObject(udp, "nonce", EncodeHex(nonce_, sizeof(nonce_)).c_str());
+        if (burst > 1) {
+            cJSON_AddNumberToObject(udp, "burst", burst);
+        }
+        cJSON_AddItemToObject(reply, "udp", udp);
+    }
+    auto json = cJSON_PrintUnformatted(reply);
+    std::string message(json);
+    cJSON_free(json);
+    cJSON_Delete(reply);
+    DeliverText(message);
+}
+
+void LoopbackServer::OnDatagram(const std::string& data) {
+    if (data.size() < sizeof(nonce_)) {
+        return;
+    }
+    auto header = (const uint8_t*)data.data();
+    uint32_t timestamp = ntohl(*(const uint32_t*)&header[8]);
+    uint32_t sequence = ntohl(*(const uint32_t*)&header[12]);
+    size_t size = data.size() - sizeof(nonce_);
+    std::vector<uint8_t> plain(size);
+    uint8_t nonce_counter[16];
+    memcpy(nonce_counter, header, sizeof(nonce_counter));
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    mbedtls_aes_crypt_ctr(&aes_ctx_, size, &nc_off, nonce_counter, stream_block, header + sizeof(nonce_), plain.data());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        datagrams_++;
+        if (header[0] == 0x02) {
+            burst_datagrams_++;
+        }
+    }
+
+    if (header[0] == 0x01) {
+        RecordAudio(sequence, timestamp, plain.data(), plain.size());
+    } else if (header[0] == 0x02) {
+        // |frame_len 2u|opus frame_len| x frames, consecutive sequence numbers
+        size_t offset = 0;
+        for (int i = 0; i < header[1] && offset + 2 <= plain.size(); i++) {
+            size_t frame_size = ntohs(*(const uint16_t*)&plain[offset]);
+            if (offset + 2 + frame_size > plain.size()) {
+                break;
+            }
+            RecordAudio(sequence + i, timestamp, &plain[offset + 2], frame_size);
+            offset += 2 + frame_size;
+        }
+    }
+}
+
+void LoopbackServer::OnWebSocketBinary(const std::string& data) {
+    auto bytes = (const uint8_t*)data.data();
+    uint16_t type = 0;
+    uint32_t timestamp = 0;
+    const uint8_t* payload = bytes;
+    size_t size = data.size();
+    if (websocket_version_ == 2) {
+        if (size < sizeof(BinaryProtocol2)) {
+            return;
+        }
+        auto bp2 = (const BinaryProtocol2*)bytes;
+        type = ntohs(bp2->type);
+        timestamp = ntohl(bp2->timestamp);
+        payload = bp2->payload;
+        size = ntohl(bp2->payload_size);
+    } else if (websocket_version_ == 3) {
+        if (size < sizeof(BinaryProtocol3)) {
+            return;
+        }
+        auto bp3 = (const BinaryProtocol3*)bytes;
+        type = bp3->type;
+        payload = bp3->payload;
+        size = ntohs(bp3->payload_size);
+    }
+    if (type == BINARY_PROTOCOL_TYPE_CBOR) {
+        OnControlMessage(std::string((const char*)payload, size), false);
+        return;
+    }
+    if (type != 0) {
+        return;
+    }
+    uint32_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sequence = ++websocket_frames_;
+    }
+    RecordAudio(sequence, timestamp, payload, size);
+}
+
+void LoopbackServer::RecordAudio(uint32_t sequence, uint32_t timestamp, const uint8_t* data, size_t size) {
+    std::vector<uint8_t> payload(data, data + size);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        audio_.push_back(LoopbackAudioFrame{sequence, timestamp, payload, esp_timer_get_time()});
+        condition_variable_.notify_all();
+    }
+    if (options_.echo_audio) {
+        SendAudio(timestamp, payload);
+    }
+}
+
+void LoopbackServer::SendText(const std::string& json) {
+    DeliverText(json);
+}
+
+void LoopbackServer::SendCbor(const std::vector<uint8_t>& cbor) {
+    std::lock_guard<std::recursive_mutex> lock(transport_mutex_);
+    if (websocket_ != nullptr) {
+        std::string frame;
+        if (websocket_version_ == 2) {
+            frame.resize(sizeof(BinaryProtocol2) + cbor.size());
+            auto bp2 = (BinaryProtocol2*)&frame[0];
+            bp2->version = htons(2);
+            bp2->type = htons(BINARY_PROTOCOL_TYPE_CBOR);
+            bp2->reserved = 0;
+            bp2->timestamp = 0;
+            bp2->payload_size = htonl(cbor.size());
+            memcpy(bp2->payload, cbor.data(), cbor.size());
+        } else {
+            frame.resize(sizeof(BinaryProtocol3) + cbor.size());
+            auto bp3 = (BinaryProtocol3*)&frame[0];
+            bp3->type = BINARY_PROTOCOL_TYPE_CBOR;
+            bp3->reserved = 0;
+            bp3->payload_size = htons(cbor.size());
+            memcpy(bp3->payload, cbor.data(), cbor.size());
+        }
+        DeliverWebSocket(std::move(frame), true);
+    } else {
+        DeliverText(std::string((const char*)cbor.data(), cbor.size()));
+    }
+}
+
+void LoopbackServer::SendAudio(uint32_t timestamp, const std::vector<uint8_t>& opus) {
+    uint32_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sequence = ++downlink_sequence_;
+    }
+    std::lock_guard<std::recursive_mutex> lock(transport_mutex_);
+    if (udp_ != nullptr) {
+        DeliverDatagram(EncryptDatagram(sequence, timestamp, opus));
+        return;
+    }
+    if (websocket_ == nullptr) {
+        return;
+    }
+    std::string frame;
+    if (websocket_version_ == 2) {
+        frame.resize(sizeof(BinaryProtocol2) + opus.size());
+        auto bp2 = (BinaryProtocol2*)&frame[0];
+        bp2->version = htons(2);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = htonl(timestamp);
+        bp2->payload_size = htonl(opus.size());
+        memcpy(bp2->payload, opus.data(), opus.size());
+    } else if (websocket_version_ == 3) {
+        frame.resize(sizeof(BinaryProtocol3) + opus.size());
+        auto bp3 = (BinaryProtocol3*)&frame[0];
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(opus.size());
+        memcpy(bp3->payload, opus.data(), opus.size());
+    } else {
+        frame.assign((const char*)opus.data(), opus.size());
+    }
+    DeliverWebSocket(std::move(frame), true);
+}
+
+std::string LoopbackServer::EncryptDatagram(uint32_t sequence, uint32_t timestamp, const std::vector<uint8_t>& opus) {
+    std::string datagram(sizeof(nonce_) + opus.size(), '\0');
+    auto header = (uint8_t*)&datagram[0];
+    memcpy(header, nonce_, sizeof(nonce_));
+    *(uint16_t*)&header[2] = htons(opus.size());
+    *(uint32_t*)&header[8] = htonl(timestamp);
+    *(uint32_t*)&header[12] = htonl(sequence);
+    uint8_t nonce_counter[16];
+    memcpy(nonce_counter, header, sizeof(nonce_counter));
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    mbedtls_aes_crypt_ctr(&aes_ctx_, opus.size(), &nc_off, nonce_counter, stream_block, opus.data(), header + sizeof(nonce_));
+    return datagram;
+}
+
+void LoopbackServer::SendDatagram(const std::string& datagram) {
+    DeliverDatagram(datagram);
+}
+
+void LoopbackServer::SendWebSocketFrame(const std::string& frame) {
+    DeliverWebSocket(frame, true);
+}
+
+void LoopbackServer::CloseWebSocket() {
+    link_.Post([this]() {
+        std::lock_guard<std::recursive_mutex> lock(transport_mutex_);
+        if (websocket_ != nullptr) {
+            websocket_->Disconnected();
+        }
+    });
+}
+
+void LoopbackServer::DeliverText(const std::string& data) {
+    link_.Post([this, data]() {
+        std::lock_guard<std::recursive_mutex> lock(transport_mutex_);
+        if (websocket_ != nullptr) {
+            websocket_->Deliver(data, false);
+        } else if (mqtt_ != nullptr) {
+            mqtt_->Deliver(data);
+        }
+    });
+}
+
+void LoopbackServer::DeliverWebSocket(std::string data, bool binary) {
+    link_.Post([this, data = std::move(data), binary]() {
+        std::lock_guard<std::recursive_mutex> lock(transport_mutex_);
+        if (websocket_ != nullptr) {
+            websocket_->Deliver(data, binary);
+        }
+    });
+}
+
+void LoopbackServer::DeliverDatagram(std::string data) {
+    link_.Post([this, data = std::move(data)]() {
+        std::lock_guard<std::recursive_mutex> lock(transport_mutex_);
+        if (udp_ != nullptr) {
+            udp_->Deliver(data);
+        }
+    });
+}
@@ -0,0 +1,131 @@
+#ifndef LOOPBACK_SERVER_H
+#define LOOPBACK_SERVER_H
+
+#include <mbedtls/aes.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "loopback_link.h"
+
+class Mqtt;
+class Udp;
+class WebSocket;
+class LoopbackMqtt;
+class LoopbackUdp;
+class LoopbackWebSocket;
+struct cJSON;
+
+struct LoopbackServerOptions {
+    int one_way_delay_us = 0;
+    int connect_round_trips = 0;    // Handshakes before an MQTT / websocket connection is up (e.g. 3 for TCP + TLS 1.2)
+    int udp_burst = 0;              // Frames per UDP packet the server accepts, 0 ignores the device's offer
+    bool cbor = false;              // Accept CBOR control messages
+    bool resume = true;             // Continue the session named by resume_session_id
+    bool echo_audio = false;        // Send every uplink frame back as downlink audio
+    int sample_rate = 24000;
+    int frame_duration = 60;
+};
+
+struct LoopbackAudioFrame {
+    uint32_t sequence;              // UDP sequence, or the arrival index on a websocket
+    uint32_t timestamp;
+    std::vector<uint8_t> payload;
+    int64_t time_us;                // When the server received it
+};
+
+/*
+ * In-process stand-in for the xiaozhi server, speaking both dialects.
+ *
+ * Install() points the "mqtt" and "websocket" settings and the board's
+ * network factories at it, so the unmodified MqttProtocol (MQTT + AES-CTR
+ * UDP) and WebsocketProtocol (v1 / v2 / v3 framing) run against it. The
+ * server answers hellos, records what the device sends and can push text,
+ * CBOR and audio back. Destroy the protocol before the server.
+ */
+class LoopbackServer {
+public:
+    explicit LoopbackServer(const LoopbackServerOptions& options = LoopbackServerOptions());
+    ~LoopbackServer();
+    LoopbackServer(const LoopbackServer&) = delete;
+    LoopbackServer& operator=(const LoopbackServer&) = delete;
+
+    void Install(int websocket_version = 1);
+
+    // Control messages from the device as JSON text, CBOR ones converted
+    std::vector<std::string> messages();
+    std::vector<LoopbackAudioFrame> audio();
+    std::string last_hello();
+    uint32_t cbor_messages();
+    uint32_t datagrams();
+    uint32_t burst_datagrams();
+    uint32_t connects();
+    void ClearRecords();
+    // Return false on timeout
+    bool WaitForAudio(size_t frames, int timeout_ms);
+    bool WaitForMessage(const std::string& type, int timeout_ms);
+
+    void SendText(const std::string& json);
+    void SendCbor(const std::vector<uint8_t>& cbor);
+    // Next downlink sequence number, on UDP or the websocket, whichever is open
+    void SendAudio(uint32_t timestamp, const std::vector<uint8_t>& opus);
+    // An encrypted UDP audio packet, to send out of order or twice with SendDatagram
+    std::string EncryptDatagram(uint32_t sequence, uint32_t timestamp, const std::vector<uint8_t>& opus);
+    void SendDatagram(const std::string& datagram);
+    // A binary websocket frame as is, e.g. one with a broken header
+    void SendWebSocketFrame(const std::string& frame);
+    void CloseWebSocket();
+    // New websocket connections fail while set
+    void set_refuse_connections(bool refuse) { refuse_connections_ = refuse; }
+
+    inline LoopbackLink& link() { return link_; }
+
+private:
+    friend class LoopbackMqtt;
+    friend class LoopbackUdp;
+    friend class LoopbackWebSocket;
+
+    LoopbackServerOptions options_;
+    LoopbackLink link_;
+
+    std::recursive_mutex transport_mutex_;  // Held while delivering to a transport, and to unregister one
+    LoopbackMqtt* mqtt_ = nullptr;
+    LoopbackUdp* udp_ = nullptr;
+    LoopbackWebSocket* websocket_ = nullptr;
+    int websocket_version_ = 1;
+    std::atomic<bool> refuse_connections_{false};
+
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    std::vector<std::string> messages_;
+    std::vector<LoopbackAudioFrame> audio_;
+    std::string last_hello_;
+    uint32_t cbor_messages_ = 0;
+    uint32_t datagrams_ = 0;
+    uint32_t burst_datagrams_ = 0;
+    uint32_t connects_ = 0;
+    uint32_t sessions_ = 0;
+    std::string session_id_;
+    uint32_t downlink_sequence_ = 0;
+    uint32_t websocket_frames_ = 0;
+
+    mbedtls_aes_context aes_ctx_;
+    uint8_t key_[16];
+    uint8_t nonce_[16];
+
+    void Handshake();
+    void OnControlMessage(const std::string& data, bool over_mqtt);
+    void OnHello(const cJSON* root, bool over_mqtt);
+    void OnDatagram(const std::string& data);
+    void OnWebSocketBinary(const std::string& data);
+    void RecordAudio(uint32_t sequence, uint32_t timestamp, const uint8_t* data, size_t size);
+    void DeliverText(const std::string& data);
+    void DeliverWebSocket(std::string data, bool binary);
+    void DeliverDatagram(std::string data);
+};
+
+#endif // LOOPBACK_SERVER_H
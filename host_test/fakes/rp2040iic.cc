@@ -0,0 +1,40 @@
+#include "rp2040iic.h"
+
+#include <chrono>
+#include <thread>
+
+bool Rp2040::SetServoAngle(uint8_t servo_id, uint8_t angle) {
+    Run(Command{0, servo_id, angle});
+    return true;
+}
+
+bool Rp2040::etPwmOutput(uint8_t pin, uint8_t value) {
+    Run(Command{1, pin, value});
+    return true;
+}
+
+void Rp2040::Run(const Command& command) {
+    int in_flight = ++in_flight_;
+    int max = max_in_flight_.load();
+    while (in_flight > max && !max_in_flight_.compare_exchange_weak(max, in_flight)) {
+    }
+    if (command_time_us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(command_time_us.load()));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        commands_.push_back(command);
+    }
+    in_flight_--;
+}
+
+void Rp2040::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    commands_.clear();
+    max_in_flight_ = 0;
+}
+
+std::vector<Rp2040::Command> Rp2040::commands() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return commands_;
+}
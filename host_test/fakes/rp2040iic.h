@@ -0,0 +1,47 @@
+#ifndef RP2040IIC_H
+#define RP2040IIC_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*
+ * The motor / servo coprocessor, as seen by the MCP tools.
+ *
+ * Each command takes `command_time_us` like an I2C transaction would, and the
+ * fake records how many commands were on the bus at once, so a test can check
+ * that tools sharing a resource group never overlap.
+ */
+class Rp2040 {
+public:
+    struct Command {
+        int kind;       // 0: servo angle, 1: PWM output
+        int channel;
+        int value;
+    };
+
+    static Rp2040* getInstance() {
+        static Rp2040 instance;
+        return &instance;
+    }
+
+    bool SetServoAngle(uint8_t servo_id, uint8_t angle);
+    bool etPwmOutput(uint8_t pin, uint8_t value);
+
+    void Reset();
+    std::vector<Command> commands();
+    inline int max_in_flight() const { return max_in_flight_.load(); }
+
+    std::atomic<int> command_time_us{0};
+
+private:
+    std::mutex mutex_;
+    std::vector<Command> commands_;
+    std::atomic<int> in_flight_{0};
+    std::atomic<int> max_in_flight_{0};
+
+    void Run(const Command& command);
+};
+
+#endif // RP2040IIC_H
@@ -0,0 +1,63 @@
+#include "settings.h"
+
+#include <map>
+#include <mutex>
+
+struct SettingsStore {
+    std::mutex mutex;
+    std::map<std::string, std::string> strings;
+    std::map<std::string, int32_t> ints;
+};
+
+static SettingsStore& Store() {
+    static SettingsStore store;
+    return store;
+}
+
+Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
+}
+
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
+    auto& store = Store();
+    std::lock_guard<std::mutex> lock(store.mutex);
+    auto it = store.strings.find(ns_ + "." + key);
+    return it != store.strings.end() ? it->second : default_value;
+}
+
+void Settings::SetString(const std::string& key, const std::string& value) {
+    auto& store = Store();
+    std::lock_guard<std::mutex> lock(store.mutex);
+    store.strings[ns_ + "." + key] = value;
+}
+
+int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
+    auto& store = Store();
+    std::lock_guard<std::mutex> lock(store.mutex);
+    auto it = store.ints.find(ns_ + "." + key);
+    return it != store.ints.end() ? it->second : default_value;
+}
+
+void Settings::SetInt(const std::string& key, int32_t value) {
+    auto& store = Store();
+    std::lock_guard<std::mutex> lock(store.mutex);
+    store.ints[ns_ + "." + key] = value;
+}
+
+void Settings::EraseKey(const std::string& key) {
+    auto& store = Store();
+    std::lock_guard<std::mutex> lock(store.mutex);
+    store.strings.erase(ns_ + "." + key);
+    store.ints.erase(ns_ + "." + key);
+}
+
+void Settings::EraseAll() {
+    auto& store = Store();
+    std::lock_guard<std::mutex> lock(store.mutex);
+    auto prefix = ns_ + ".";
+    for (auto it = store.strings.begin(); it != store.strings.end();) {
+        it = it->first.compare(0, prefix.size(), prefix) == 0 ? store.strings.erase(it) : std::next(it);
+    }
+    for (auto it = store.ints.begin(); it != store.ints.end();) {
+        it = it->first.compare(0, prefix.size(), prefix) == 0 ? store.ints.erase(it) : std::next(it);
+    }
+}
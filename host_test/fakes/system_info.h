@@ -0,0 +1,12 @@
+#ifndef SYSTEM_INFO_H
+#define SYSTEM_INFO_H
+
+#include <string>
+
+class SystemInfo {
+public:
+    static std::string GetMacAddress() { return "02:00:00:00:00:01"; }
+    static std::string GetChipModelName() { return "host"; }
+};
+
+#endif // SYSTEM_INFO_H
@@ -0,0 +1,185 @@
+#include "wav_audio_codec.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#define TAG "WavAudioCodec"
+
+static uint32_t ReadLe32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t ReadLe16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+bool ReadWavFile(const std::string& path, std::vector<int16_t>& samples, int& sample_rate) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        ESP_LOGE(TAG, "Failed to open %s", path.c_str());
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    fclose(file);
+
+    if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) != 0 || memcmp(data.data() + 8, "WAVE", 4) != 0) {
+        ESP_LOGE(TAG, "%s is not a WAV file", path.c_str());
+        return false;
+    }
+    int channels = 0;
+    int bits = 0;
+    size_t offset = 12;
+    while (offset + 8 <= data.size()) {
+        uint32_t size = ReadLe32(&data[offset + 4]);
+        const uint8_t* body = &data[offset + 8];
+        if (offset + 8 + size > data.size()) {
+            size = data.size() - offset - 8;
+        }
+        if (memcmp(&data[offset], "fmt ", 4) == 0 && size >= 16) {
+            channels = ReadLe16(body + 2);
+            sample_rate = ReadLe32(body + 4);
+            bits = ReadLe16(body + 14);
+        } else if (memcmp(&data[offset], "data", 4) == 0) {
+            if (bits != 16 || channels < 1) {
+                ESP_LOGE(TAG, "%s: only 16-bit PCM is supported", path.c_str());
+                return false;
+            }
+            size_t frames = size / (2 * channels);
+            samples.resize(frames);
+            for (size_t i = 0; i < frames; i++) {
+                samples[i] = (int16_t)ReadLe16(body + i * 2 * channels);
+            }
+            return true;
+        }
+        offset += 8 + size + (size & 1);
+    }
+    ESP_LOGE(TAG, "%s has no data chunk", path.c_str());
+    return false;
+}
+
+bool WriteWavFile(const std::string& path, const std::vector<int16_t>& samples, int sample_rate) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        ESP_LOGE(TAG, "Failed to create %s", path.c_str());
+        return false;
+    }
+    uint32_t data_size = samples.size() * 2;
+    uint8_t header[44];
+    auto put32 = [&header](int offset, uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            header[offset + i] = (uint8_t)(value >> (8 * i));
+        }
+    };
+    auto put16 = [&header](int offset, uint16_t value) {
+        header[offset] = (uint8_t)value;
+        header[offset + 1] = (uint8_t)(value >> 8);
+    };
+    memcpy(header, "RIFF", 4);
+    put32(4, 36 + data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put32(16, 16);
+    put16(20, 1);
+    put16(22, 1);
+    put32(24, sample_rate);
+    put32(28, sample_rate * 2);
+    put16(32, 2);
+    put16(34, 16);
+    memcpy(header + 36, "data", 4);
+    put32(40, data_size);
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    for (auto sample : samples) {
+        uint8_t bytes[2] = {(uint8_t)sample, (uint8_t)((uint16_t)sample >> 8)};
+        ok = ok && fwrite(bytes, 1, 2, file) == 2;
+    }
+    fclose(file);
+    return ok;
+}
+
+WavAudioCodec::WavAudioCodec(int input_sample_rate, int output_sample_rate, bool paced) : paced_(paced) {
+    duplex_ = true;
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+}
+
+bool WavAudioCodec::LoadInput(const std::string& path) {
+    std::vector<int16_t> samples;
+    int sample_rate = 0;
+    if (!ReadWavFile(path, samples, sample_rate)) {
+        return false;
+    }
+    if (sample_rate != input_sample_rate_) {
+        ESP_LOGW(TAG, "%s is %d Hz, the codec reads at %d Hz", path.c_str(), sample_rate, input_sample_rate_);
+    }
+    SetInput(std::move(samples));
+    return true;
+}
+
+void WavAudioCodec::SetInput(std::vector<int16_t> samples) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    input_ = std::move(samples);
+    input_position_ = 0;
+}
+
+bool WavAudioCodec::SaveOutput(const std::string& path) {
+    return WriteWavFile(path, output(), output_sample_rate_);
+}
+
+std::vector<int16_t> WavAudioCodec::output() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return output_;
+}
+
+size_t WavAudioCodec::input_position() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return input_position_;
+}
+
+bool WavAudioCodec::input_finished() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return input_position_ >= input_.size();
+}
+
+// Sleeps until `samples` more samples are due on a clock that started at `start_us`
+static void WaitForSampleClock(int64_t& start_us, int64_t& done, int samples, int sample_rate) {
+    int64_t now = esp_timer_get_time();
+    if (start_us < 0) {
+        start_us = now;
+    }
+    done += samples;
+    int64_t due = start_us + done * 1000000 / sample_rate;
+    if (due > now) {
+        std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+    }
+}
+
+int WavAudioCodec::Read(int16_t* dest, int samples) {
+    if (paced_) {
+        WaitForSampleClock(input_start_us_, input_samples_read_, samples, input_sample_rate_);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t available = input_position_ < input_.size() ? input_.size() - input_position_ : 0;
+    size_t count = available < (size_t)samples ? available : (size_t)samples;
+    memcpy(dest, input_.data() + input_position_, count * sizeof(int16_t));
+    memset(dest + count, 0, (samples - count) * sizeof(int16_t));
+    input_position_ += count;
+    return samples;
+}
+
+int WavAudioCodec::Write(const int16_t* data, int samples) {
+    if (paced_) {
+        WaitForSampleClock(output_start_us_, output_samples_written_, samples, output_sample_rate_);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    output_.insert(output_.end(), data, data + samples);
+    return samples;
+}
@@ -0,0 +1,49 @@
+#ifndef WAV_AUDIO_CODEC_H
+#define WAV_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 16-bit PCM WAV files, mono or the first channel of a multi-channel file
+bool ReadWavFile(const std::string& path, std::vector<int16_t>& samples, int& sample_rate);
+bool WriteWavFile(const std::string& path, const std::vector<int16_t>& samples, int sample_rate);
+
+/*
+ * Mono codec backed by sample buffers (or WAV files) instead of I2S.
+ *
+ * The microphone plays the input buffer and then silence, the speaker appends
+ * to the output buffer. With `paced` set, reads and writes wait for the sample
+ * clock like the DMA would, otherwise they return at once so tests run faster
+ * than real time.
+ */
+class WavAudioCodec : public AudioCodec {
+public:
+    WavAudioCodec(int input_sample_rate, int output_sample_rate, bool paced = false);
+
+    bool LoadInput(const std::string& path);
+    void SetInput(std::vector<int16_t> samples);
+    bool SaveOutput(const std::string& path);
+    std::vector<int16_t> output();
+    size_t input_position();
+    bool input_finished();
+
+private:
+    bool paced_;
+    std::mutex mutex_;
+    std::vector<int16_t> input_;
+    size_t input_position_ = 0;
+    std::vector<int16_t> output_;
+    int64_t input_start_us_ = -1;
+    int64_t input_samples_read_ = 0;
+    int64_t output_start_us_ = -1;
+    int64_t output_samples_written_ = 0;
+
+    int Read(int16_t* dest, int samples) override;
+    int Write(const int16_t* data, int samples) override;
+};
+
+#endif // WAV_AUDIO_CODEC_H
@@ -0,0 +1,20 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <cstdarg>
+
+// Log output is off unless XIAOZHI_HOST_LOG is set (E, W, I or D), the format strings are
+// written for the device's 32-bit types so they are not checked here
+void HostLog(char level, const char* tag, const char* format, ...);
+bool HostLogEnabled(char level);
+
+#define HOST_LOG(level, tag, format, ...) \
+    do { if (HostLogEnabled(level)) HostLog(level, tag, format, ##__VA_ARGS__); } while (0)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG('E', tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG('W', tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG('I', tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOST_LOG('D', tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) HOST_LOG('V', tag, format, ##__VA_ARGS__)
+
+#endif // HOST_ESP_LOG_H
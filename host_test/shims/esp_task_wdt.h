@@ -0,0 +1,9 @@
+#ifndef HOST_ESP_TASK_WDT_H
+#define HOST_ESP_TASK_WDT_H
+
+#include "esp_err.h"
+
+// There is no task watchdog on the host
+inline esp_err_t esp_task_wdt_reset() { return ESP_OK; }
+
+#endif // HOST_ESP_TASK_WDT_H
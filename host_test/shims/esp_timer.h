@@ -0,0 +1,9 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <cstdint>
+
+// Microseconds since the process started, like the time since boot on the device
+int64_t esp_timer_get_time();
+
+#endif // HOST_ESP_TIMER_H
@@ -0,0 +1,22 @@
+#ifndef HOST_CLOCK_H
+#define HOST_CLOCK_H
+
+#include <cstdint>
+
+/*
+ * Virtual time for tests that count wakeups or measure latency of the tasks.
+ *
+ * While it is on, esp_timer_get_time() and xTaskGetTickCount() stand still
+ * and ulTaskNotifyTake() timeouts expire only when the test advances the
+ * clock. Notifications still wake tasks at once. vTaskDelay, event group and
+ * condition variable timeouts stay on the real clock. Turning it off carries
+ * on from the virtual time, so esp_timer_get_time() never goes backwards.
+ */
+void HostClockUseVirtualTime(bool enable);
+
+// Moves the virtual clock forward by `us`. Every task whose ulTaskNotifyTake timeout falls in
+// the step is woken in deadline order, with the clock at its deadline, and runs up to its next
+// wait before the clock moves on
+void HostClockAdvance(int64_t us);
+
+#endif // HOST_CLOCK_H
@@ -0,0 +1,82 @@
+#include "opus_encoder.h"
+#include "opus_decoder.h"
+#include "opus_resampler.h"
+
+#include <algorithm>
+
+std::atomic<uint32_t> OpusDecoderWrapper::created{0};
+
+OpusEncoderWrapper::OpusEncoderWrapper(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), duration_ms_(duration_ms), frame_size_(sample_rate / 1000 * channels * duration_ms) {
+    in_buffer_.reserve(frame_size_ * 2);
+}
+
+void OpusEncoderWrapper::Encode(std::vector<int16_t>&& pcm, std::function<void(std::vector<uint8_t>&& opus)> handler) {
+    in_buffer_.insert(in_buffer_.end(), pcm.begin(), pcm.end());
+    while ((int)in_buffer_.size() >= frame_size_) {
+        std::vector<uint8_t> opus(HOST_OPUS_HEADER_SIZE + frame_size_ / HOST_OPUS_DECIMATION);
+        opus[0] = HOST_OPUS_MAGIC;
+        opus[1] = (uint8_t)duration_ms_;
+        opus[2] = (uint8_t)(sample_rate_ / 100);
+        opus[3] = (uint8_t)((sample_rate_ / 100) >> 8);
+        for (size_t i = HOST_OPUS_HEADER_SIZE; i < opus.size(); i++) {
+            opus[i] = (uint8_t)(in_buffer_[(i - HOST_OPUS_HEADER_SIZE) * HOST_OPUS_DECIMATION] >> 8);
+        }
+        in_buffer_.erase(in_buffer_.begin(), in_buffer_.begin() + frame_size_);
+        if (handler != nullptr) {
+            handler(std::move(opus));
+        }
+    }
+}
+
+OpusDecoderWrapper::OpusDecoderWrapper(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), duration_ms_(duration_ms), frame_size_(sample_rate / 1000 * channels * duration_ms) {
+    last_frame_.assign(frame_size_, 0);
+    created++;
+}
+
+bool OpusDecoderWrapper::Decode(std::vector<uint8_t>&& opus, std::vector<int16_t>& pcm) {
+    pcm.resize(frame_size_);
+    if (opus.empty()) {
+        for (int i = 0; i < frame_size_; i++) {
+            last_frame_[i] /= 2;
+        }
+        std::copy(last_frame_.begin(), last_frame_.end(), pcm.begin());
+        return true;
+    }
+    if (opus.size() <= HOST_OPUS_HEADER_SIZE || opus[0] != HOST_OPUS_MAGIC) {
+        return false;
+    }
+    size_t samples = opus.size() - HOST_OPUS_HEADER_SIZE;
+    for (int i = 0; i < frame_size_; i++) {
+        size_t index = (size_t)i * samples / frame_size_;
+        pcm[i] = (int16_t)((int8_t)opus[HOST_OPUS_HEADER_SIZE + index] * 256);
+    }
+    std::copy(pcm.begin(), pcm.end(), last_frame_.begin());
+    return true;
+}
+
+void OpusDecoderWrapper::ResetState() {
+    std::fill(last_frame_.begin(), last_frame_.end(), 0);
+}
+
+void OpusResampler::Configure(int input_sample_rate, int output_sample_rate) {
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+}
+
+int OpusResampler::GetOutputSamples(int input_samples) const {
+    return (int)((int64_t)input_samples * output_sample_rate_ / input_sample_rate_);
+}
+
+void OpusResampler::Process(const int16_t* input, int input_samples, int16_t* output) {
+    int output_samples = GetOutputSamples(input_samples);
+    for (int i = 0; i < output_samples; i++) {
+        int64_t position = (int64_t)i * input_sample_rate_ * 256 / output_sample_rate_;
+        int index = (int)(position >> 8);
+        int fraction = (int)(position & 0xff);
+        int16_t a = input[index];
+        int16_t b = index + 1 < input_samples ? input[index + 1] : a;
+        output[i] = (int16_t)(a + (((b - a) * fraction) >> 8));
+    }
+}
@@ -0,0 +1,285 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host_clock.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct HostTask {
+    std::string name;
+    std::mutex mutex;
+    std::condition_variable condition_variable;
+    uint32_t notifications = 0;
+    // Counts the calls to ulTaskNotifyTake, so HostClockAdvance can tell when the task waits again
+    uint64_t waits = 0;
+    // Virtual time at which the pending ulTaskNotifyTake times out, -1 if there is none
+    int64_t deadline_us = -1;
+};
+
+struct HostEventGroup {
+    std::mutex mutex;
+    std::condition_variable condition_variable;
+    EventBits_t bits = 0;
+};
+
+static const auto kStartTime = std::chrono::steady_clock::now();
+static std::atomic<bool> virtual_time{false};
+static std::atomic<int64_t> virtual_now_us{0};
+// Added to the real clock once virtual time is turned off again
+static std::atomic<int64_t> real_offset_us{0};
+
+// Every task, for HostClockAdvance to find the ones waiting on the virtual clock
+static std::mutex tasks_mutex;
+static std::vector<HostTask*> tasks;
+
+static int64_t RealTimeUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - kStartTime).count();
+}
+
+int64_t esp_timer_get_time() {
+    if (virtual_time) {
+        return virtual_now_us;
+    }
+    return RealTimeUs() + real_offset_us;
+}
+
+static char LogLevel() {
+    static const char level = []() {
+        auto env = getenv("XIAOZHI_HOST_LOG");
+        return env != nullptr && env[0] != '\0' ? env[0] : '\0';
+    }();
+    return level;
+}
+
+bool HostLogEnabled(char level) {
+    static const char order[] = "EWIDV";
+    auto threshold = LogLevel();
+    if (threshold == '\0') {
+        return false;
+    }
+    for (auto c : order) {
+        if (c == level) {
+            return true;
+        }
+        if (c == threshold) {
+            return false;
+        }
+    }
+    return false;
+}
+
+void HostLog(char level, const char* tag, const char* format, ...) {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    fprintf(stderr, "%c (%lld) %s: ", level, (long long)(esp_timer_get_time() / 1000), tag);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+// Tasks live as long as the process, a deleted task may still be blocked in its thread
+static thread_local HostTask* current_task = nullptr;
+
+static HostTask* RegisterTask(const char* name) {
+    auto task = new HostTask{name};
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    tasks.push_back(task);
+    return task;
+}
+
+static HostTask* CurrentTask() {
+    if (current_task == nullptr) {
+        current_task = RegisterTask("main");
+    }
+    return current_task;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle) {
+    auto task = RegisterTask(name != nullptr ? name : "");
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    std::thread([task, function, arg]() {
+        current_task = task;
+        function(arg);
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* handle, BaseType_t core_id) {
+    return xTaskCreate(function, name, stack_size, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return CurrentTask();
+}
+
+const char* pcTaskGetName(TaskHandle_t handle) {
+    return (handle != nullptr ? handle : CurrentTask())->name.c_str();
+}
+
+void xTaskNotifyGive(TaskHandle_t handle) {
+    if (handle == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(handle->mutex);
+    handle->notifications++;
+    handle->condition_variable.notify_all();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    auto task = CurrentTask();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto ready = [task]() { return task->notifications > 0; };
+    task->waits++;
+    if (ticks == portMAX_DELAY) {
+        task->condition_variable.wait(lock, ready);
+    } else if (virtual_time) {
+        task->deadline_us = virtual_now_us + (int64_t)ticks * 1000;
+        task->condition_variable.wait(lock, [task, &ready]() {
+            return ready() || !virtual_time || virtual_now_us >= task->deadline_us;
+        });
+        task->deadline_us = -1;
+    } else {
+        task->condition_variable.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+    }
+    uint32_t value = task->notifications;
+    if (value > 0) {
+        task->notifications = clear_on_exit ? 0 : value - 1;
+    }
+    return value;
+}
+
+void HostClockUseVirtualTime(bool enable) {
+    if (enable == virtual_time) {
+        return;
+    }
+    if (enable) {
+        virtual_now_us = RealTimeUs() + real_offset_us;
+        virtual_time = true;
+        return;
+    }
+    real_offset_us = virtual_now_us - RealTimeUs();
+    virtual_time = false;
+    // Tasks waiting on the virtual clock time out now
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    for (auto task : tasks) {
+        std::lock_guard<std::mutex> task_lock(task->mutex);
+        task->condition_variable.notify_all();
+    }
+}
+
+void HostClockAdvance(int64_t us) {
+    int64_t target = virtual_now_us + us;
+    while (true) {
+        HostTask* next = nullptr;
+        int64_t next_deadline = target;
+        {
+            std::lock_guard<std::mutex> lock(tasks_mutex);
+            for (auto task : tasks) {
+                std::lock_guard<std::mutex> task_lock(task->mutex);
+                if (task->deadline_us >= 0 && task->deadline_us <= next_deadline) {
+                    next = task;
+                    next_deadline = task->deadline_us;
+                }
+            }
+        }
+        if (next == nullptr) {
+            break;
+        }
+
+        uint64_t waits;
+        {
+            std::lock_guard<std::mutex> lock(next->mutex);
+            if (next_deadline > virtual_now_us) {
+                virtual_now_us = next_deadline;
+            }
+            waits = next->waits;
+            next->condition_variable.notify_all();
+        }
+        // Let it run up to its next wait, unless it blocks on something else
+        auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (std::chrono::steady_clock::now() < give_up) {
+            {
+                std::lock_guard<std::mutex> lock(next->mutex);
+                if (next->waits != waits) {
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+    }
+    virtual_now_us = target;
+}
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new HostEventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(group->mutex);
+    auto ready = [group, bits, wait_for_all]() {
+        return wait_for_all ? (group->bits & bits) == bits : (group->bits & bits) != 0;
+    };
+    bool satisfied;
+    if (ticks == portMAX_DELAY) {
+        group->condition_variable.wait(lock, ready);
+        satisfied = true;
+    } else {
+        satisfied = group->condition_variable.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+    }
+    EventBits_t value = group->bits;
+    if (satisfied && clear_on_exit) {
+        group->bits &= ~bits;
+    }
+    return value;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    group->bits |= bits;
+    group->condition_variable.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    EventBits_t value = group->bits;
+    group->bits &= ~bits;
+    return value;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    std::lock_guard<std::mutex> lock(group->mutex);
+    return group->bits;
+}
@@ -0,0 +1,22 @@
+#ifndef HOST_MBEDTLS_AES_H
+#define HOST_MBEDTLS_AES_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define MBEDTLS_ERR_AES_INVALID_KEY_LENGTH -0x0020
+
+// AES encryption (FIPS-197) with the mbedtls 3 signatures, enough for the CTR mode the protocols use
+typedef struct mbedtls_aes_context {
+    int rounds;
+    uint32_t round_keys[60];
+} mbedtls_aes_context;
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx);
+void mbedtls_aes_free(mbedtls_aes_context* ctx);
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits);
+void mbedtls_aes_encrypt_block(const mbedtls_aes_context* ctx, const unsigned char input[16], unsigned char output[16]);
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16],
+    unsigned char stream_block[16], const unsigned char* input, unsigned char* output);
+
+#endif // HOST_MBEDTLS_AES_H
@@ -0,0 +1,6 @@
+#ifndef HOST_ML307_MQTT_H
+#define HOST_ML307_MQTT_H
+
+#include "mqtt.h"
+
+#endif // HOST_ML307_MQTT_H
@@ -0,0 +1,6 @@
+#ifndef HOST_ML307_UDP_H
+#define HOST_ML307_UDP_H
+
+#include "udp.h"
+
+#endif // HOST_ML307_UDP_H
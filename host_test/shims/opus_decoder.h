@@ -0,0 +1,32 @@
+#ifndef HOST_OPUS_DECODER_H
+#define HOST_OPUS_DECODER_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Decodes the packets of the host OpusEncoderWrapper, see opus_encoder.h
+class OpusDecoderWrapper {
+public:
+    OpusDecoderWrapper(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusDecoderWrapper() = default;
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+    // An empty packet asks for packet loss concealment: the last frame, faded. The packet is
+    // only read, like opus_decode() does, so the caller can still recycle its buffer.
+    bool Decode(std::vector<uint8_t>&& opus, std::vector<int16_t>& pcm);
+    void ResetState();
+
+    // Decoders constructed so far, the device allocates the opus state for each
+    static std::atomic<uint32_t> created;
+
+private:
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_;
+    std::vector<int16_t> last_frame_;
+};
+
+#endif // HOST_OPUS_DECODER_H
@@ -0,0 +1,45 @@
+#ifndef HOST_OPUS_ENCODER_H
+#define HOST_OPUS_ENCODER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*
+ * Stand-in for the opus encoder wrapper, it keeps the frame bookkeeping of the
+ * real one but not the codec.
+ *
+ * A packet is a 4 byte header (HOST_OPUS_MAGIC, frame duration, sample rate / 100
+ * little endian) and the high byte of every HOST_OPUS_DECIMATION-th sample, so a
+ * 60ms 16kHz frame is 244 bytes, about what opus produces for speech. The
+ * decoder stretches that back to a full frame.
+ */
+#define HOST_OPUS_MAGIC 0x5A
+#define HOST_OPUS_HEADER_SIZE 4
+#define HOST_OPUS_DECIMATION 4
+
+class OpusEncoderWrapper {
+public:
+    OpusEncoderWrapper(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusEncoderWrapper() = default;
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+    void SetDtx(bool enable) {}
+    void SetComplexity(int complexity) { complexity_ = complexity; }
+    inline int complexity() const { return complexity_; }
+    // Buffers the samples and calls `handler` for every complete frame
+    void Encode(std::vector<int16_t>&& pcm, std::function<void(std::vector<uint8_t>&& opus)> handler);
+    bool IsBufferEmpty() const { return in_buffer_.empty(); }
+    void ResetState() { in_buffer_.clear(); }
+
+private:
+    int sample_rate_;
+    int duration_ms_;
+    int frame_size_;
+    int complexity_ = 0;
+    std::vector<int16_t> in_buffer_;
+};
+
+#endif // HOST_OPUS_ENCODER_H
@@ -0,0 +1,26 @@
+#ifndef HOST_UDP_H
+#define HOST_UDP_H
+
+#include <functional>
+#include <string>
+
+// The UDP socket interface of the ml307 component
+class Udp {
+public:
+    virtual ~Udp() = default;
+    virtual bool Connect(const std::string& host, int port) = 0;
+    virtual void Disconnect() = 0;
+    // Returns the bytes sent, or a negative value on error
+    virtual int Send(const std::string& data) = 0;
+
+    virtual void OnMessage(std::function<void(const std::string& data)> callback) {
+        message_callback_ = std::move(callback);
+    }
+
+protected:
+    std::function<void(const std::string& data)> message_callback_;
+    std::string remote_address_;
+    int remote_port_ = 0;
+};
+
+#endif // HOST_UDP_H
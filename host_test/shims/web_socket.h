@@ -0,0 +1,34 @@
+#ifndef HOST_WEB_SOCKET_H
+#define HOST_WEB_SOCKET_H
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+
+// The websocket client of the ml307 component, as an interface so the loopback transport can implement it
+class WebSocket {
+public:
+    virtual ~WebSocket() = default;
+
+    void SetHeader(const char* key, const char* value) { headers_[key] = value; }
+    virtual bool Connect(const char* uri) = 0;
+    virtual bool IsConnected() const = 0;
+    virtual bool Send(const std::string& data) = 0;
+    virtual bool Send(const void* data, size_t len, bool binary = false, bool fin = true) = 0;
+    virtual void Close() = 0;
+
+    void OnConnected(std::function<void()> callback) { on_connected_ = std::move(callback); }
+    void OnDisconnected(std::function<void()> callback) { on_disconnected_ = std::move(callback); }
+    void OnData(std::function<void(const char*, size_t, bool binary)> callback) { on_data_ = std::move(callback); }
+    void OnError(std::function<void(int)> callback) { on_error_ = std::move(callback); }
+
+protected:
+    std::map<std::string, std::string> headers_;
+    std::function<void()> on_connected_;
+    std::function<void()> on_disconnected_;
+    std::function<void(const char*, size_t, bool binary)> on_data_;
+    std::function<void(int)> on_error_;
+};
+
+#endif // HOST_WEB_SOCKET_H
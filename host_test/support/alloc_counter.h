@@ -0,0 +1,29 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Heap allocations made through operator new by the whole process
+struct AllocStats {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+
+    AllocStats operator-(const AllocStats& other) const {
+        return AllocStats{count - other.count, bytes - other.bytes};
+    }
+};
+
+/*
+ * Linked into the tests and benchmarks, it replaces the global operator new
+ * to count what the code under test allocates. cJSON's own malloc calls are
+ * not counted, hook them with UseCountingCJsonHooks().
+ */
+class AllocCounter {
+public:
+    static AllocStats Snapshot();
+    // Routes cJSON_malloc / cJSON_free through the counter as well
+    static void UseCountingCJsonHooks();
+};
+
+#endif // ALLOC_COUNTER_H
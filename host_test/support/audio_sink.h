@@ -0,0 +1,39 @@
+#ifndef AUDIO_SINK_H
+#define AUDIO_SINK_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "protocol.h"
+
+// Collects what a protocol hands to OnIncomingAudio, from whichever task delivers it
+class AudioSink {
+public:
+    void Attach(Protocol& protocol) {
+        protocol.OnIncomingAudio([this](AudioStreamPacket&& packet) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            packets_.push_back(std::move(packet));
+            condition_variable_.notify_all();
+        });
+    }
+
+    bool Wait(size_t packets, int timeout_ms = 5000) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return condition_variable_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+            [this, packets]() { return packets_.size() >= packets; });
+    }
+
+    std::vector<AudioStreamPacket> packets() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return packets_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    std::vector<AudioStreamPacket> packets_;
+};
+
+#endif // AUDIO_SINK_H
@@ -0,0 +1,75 @@
+#include "bench.h"
+
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+static bool quick = false;
+
+void BenchInit(int argc, char** argv, const char* title) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        }
+    }
+    printf("== %s%s\n", title, quick ? " (quick)" : "");
+}
+
+bool BenchQuick() {
+    return quick;
+}
+
+int BenchIterations(int iterations) {
+    return quick ? std::max(1, iterations / 100) : iterations;
+}
+
+int64_t BenchNowUs() {
+    return esp_timer_get_time();
+}
+
+BenchResult BenchRun(int iterations, const std::function<void()>& op) {
+    for (int i = 0; i < std::min(iterations, 16); i++) {
+        op();
+    }
+    auto allocs = AllocCounter::Snapshot();
+    int64_t start = BenchNowUs();
+    for (int i = 0; i < iterations; i++) {
+        op();
+    }
+    int64_t elapsed = BenchNowUs() - start;
+    auto delta = AllocCounter::Snapshot() - allocs;
+    BenchResult result;
+    result.us_per_op = (double)elapsed / iterations;
+    result.allocs_per_op = (double)delta.count / iterations;
+    result.bytes_per_op = (double)delta.bytes / iterations;
+    return result;
+}
+
+void BenchPrint(const std::string& name, const BenchResult& result) {
+    printf("%-44s %10.3f us/op %8.2f allocs/op %10.1f bytes/op\n", name.c_str(),
+        result.us_per_op, result.allocs_per_op, result.bytes_per_op);
+}
+
+void BenchPrintRow(const std::string& name, const std::string& value) {
+    printf("%-44s %s\n", name.c_str(), value.c_str());
+}
+
+std::string BenchFormat(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return buffer;
+}
+
+int BenchExit() {
+    // Singletons own tasks that never return, skip their destructors
+    fflush(stdout);
+    fflush(stderr);
+    _exit(0);
+}
@@ -0,0 +1,35 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "alloc_counter.h"
+
+/*
+ * Tiny harness for the host benchmarks. Each benchmark is a main() that calls
+ * BenchInit(), runs its cases and returns BenchExit(). With --quick every
+ * case runs a few iterations only, which is what ctest does.
+ */
+void BenchInit(int argc, char** argv, const char* title);
+bool BenchQuick();
+// Scales an iteration count down in quick mode
+int BenchIterations(int iterations);
+int64_t BenchNowUs();
+
+struct BenchResult {
+    double us_per_op = 0;
+    double allocs_per_op = 0;
+    double bytes_per_op = 0;
+};
+
+// Runs op() iterations times after a short warm-up
+BenchResult BenchRun(int iterations, const std::function<void()>& op);
+void BenchPrint(const std::string& name, const BenchResult& result);
+void BenchPrintRow(const std::string& name, const std::string& value);
+// printf into a string, for BenchPrintRow values
+std::string BenchFormat(const char* format, ...) __attribute__((format(printf, 1, 2)));
+int BenchExit();
+
+#endif // BENCH_H
@@ -0,0 +1,13 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    int result = RUN_ALL_TESTS();
+    // Singletons own tasks that never return (tool workers, the main loop), skip their destructors
+    fflush(stdout);
+    fflush(stderr);
+    _exit(result);
+}
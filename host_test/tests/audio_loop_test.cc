@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+#include <esp_timer.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "audio_pipeline.h"
+#include "host_clock.h"
+#include "no_audio_processor.h"
+#include "no_wake_word.h"
+
+// The audio loop checks the wake word first on every pass, so this counts its passes
+class CountingWakeWord : public NoWakeWord {
+public:
+    std::atomic<int> passes{0};
+
+    bool IsDetectionRunning() override {
+        passes++;
+        return NoWakeWord::IsDetectionRunning();
+    }
+};
+
+// Records the virtual time of the first chunk it is fed, then stops so the loop goes idle again
+class FirstFeedProcessor : public NoAudioProcessor {
+public:
+    std::atomic<int64_t> first_feed_us{-1};
+
+    void Feed(const std::vector<int16_t>& data) override {
+        if (first_feed_us < 0) {
+            first_feed_us = esp_timer_get_time();
+        }
+        Stop();
+    }
+};
+
+// Records the virtual time of the first write to the speaker
+class FirstWriteCodec : public AudioCodec {
+public:
+    std::atomic<int64_t> first_write_us{-1};
+
+    FirstWriteCodec() {
+        input_sample_rate_ = 16000;
+        output_sample_rate_ = 16000;
+    }
+
+private:
+    int Read(int16_t* dest, int samples) override {
+        std::fill(dest, dest + samples, 0);
+        return samples;
+    }
+    int Write(const int16_t* data, int samples) override {
+        if (first_write_us < 0) {
+            first_write_us = esp_timer_get_time();
+        }
+        return samples;
+    }
+};
+
+template <typename Predicate>
+static bool WaitUntil(Predicate predicate, int timeout_ms = 5000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// The pipeline tasks run for the rest of the process, so each rig is left allocated
+class AudioLoopTest : public testing::Test {
+protected:
+    FirstWriteCodec* codec_ = new FirstWriteCodec();
+    CountingWakeWord* wake_word_ = new CountingWakeWord();
+    FirstFeedProcessor* processor_ = new FirstFeedProcessor();
+    BackgroundTask* background_task_ = new BackgroundTask();
+    AudioPipeline* pipeline_ = new AudioPipeline();
+
+    void SetUp() override {
+        HostClockUseVirtualTime(true);
+        codec_->Start();
+        processor_->Initialize(codec_);
+        wake_word_->Initialize(codec_);
+        pipeline_->Start(codec_, wake_word_, processor_, background_task_, 60, 0);
+        // The first pass finds nothing to do
+        ASSERT_TRUE(WaitUntil([this]() { return wake_word_->passes > 0; }));
+        Settle();
+    }
+
+    void TearDown() override {
+        HostClockUseVirtualTime(false);
+    }
+
+    // Lets the tasks reach their waits, the virtual clock does not move meanwhile
+    static void Settle() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+};
+
+TEST_F(AudioLoopTest, IdleLoopDoesNotWakeUp) {
+    int passes = wake_word_->passes;
+    HostClockAdvance(10 * 1000000);
+    Settle();
+    // Polling at half a frame would have made 333 passes
+    EXPECT_EQ(wake_word_->passes, passes);
+}
+
+TEST_F(AudioLoopTest, UnavailableInputIsRetriedAtHalfAFrame) {
+    codec_->EnableInput(false);
+    processor_->Start();
+    pipeline_->NotifyAudioInput();
+    Settle();
+    int passes = wake_word_->passes;
+    HostClockAdvance(10 * 1000000);
+    Settle();
+    EXPECT_NEAR(wake_word_->passes - passes, 10000 / 30, 2);
+    processor_->Stop();
+}
+
+TEST_F(AudioLoopTest, StartedProcessorIsFedWithoutDelay) {
+    HostClockAdvance(1234567);
+    int64_t start = esp_timer_get_time();
+    // What SetDeviceState(kDeviceStateListening) does
+    processor_->Start();
+    pipeline_->NotifyAudioInput();
+    ASSERT_TRUE(WaitUntil([this]() { return processor_->first_feed_us >= 0; }));
+    EXPECT_EQ(processor_->first_feed_us - start, 0);
+}
+
+TEST_F(AudioLoopTest, FirstPacketIsPlayedWithoutDelay) {
+    HostClockAdvance(1234567);
+    OpusEncoderWrapper encoder(16000, 1, 60);
+    AudioStreamPacket packet;
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.sequence = 1;
+    encoder.Encode(std::vector<int16_t>(960, 1000), [&packet](std::vector<uint8_t>&& opus) {
+        packet.payload = std::move(opus);
+    });
+
+    int64_t start = esp_timer_get_time();
+    packet.receive_time_ms = start / 1000;
+    ASSERT_TRUE(pipeline_->PushDecodePacket(std::move(packet)));
+    ASSERT_TRUE(WaitUntil([this]() { return codec_->first_write_us >= 0; }));
+    EXPECT_EQ(codec_->first_write_us - start, 0);
+    // The audio loop has no part in playback any more
+    EXPECT_EQ(wake_word_->passes, 1);
+}
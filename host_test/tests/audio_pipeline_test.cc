@@ -0,0 +1,219 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "audio_pipeline.h"
+#include "loopback_protocol.h"
+#include "no_audio_processor.h"
+#include "no_wake_word.h"
+#include "wav_audio_codec.h"
+
+template <typename Predicate>
+static bool WaitUntil(Predicate predicate, int timeout_ms = 5000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return true;
+}
+
+// A 60ms 16kHz packet whose samples all decode to value * 256
+static AudioStreamPacket Packet(uint32_t sequence, int8_t value) {
+    OpusEncoderWrapper encoder(16000, 1, 60);
+    AudioStreamPacket packet;
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.sequence = sequence;
+    encoder.Encode(std::vector<int16_t>(960, (int16_t)(value * 256)), [&packet](std::vector<uint8_t>&& opus) {
+        packet.payload = std::move(opus);
+    });
+    return packet;
+}
+
+// The pipeline tasks run for the rest of the process, so each rig is left allocated
+struct PipelineRig {
+    WavAudioCodec codec;
+    NoWakeWord wake_word;
+    NoAudioProcessor processor;
+    BackgroundTask background_task;
+    AudioPipeline pipeline;
+
+    explicit PipelineRig(bool paced) : codec(16000, 16000, paced) {
+        codec.Start();
+        processor.Initialize(&codec);
+        wake_word.Initialize(&codec);
+        processor.OnOutput([this](std::vector<int16_t>&& data) {
+            pipeline.EncodeAudio(std::move(data));
+        });
+        pipeline.Start(&codec, &wake_word, &processor, &background_task, 60, 0);
+    }
+};
+
+TEST(AudioPipeline, UplinkEncodesTheMicrophoneAndSendsIt) {
+    auto rig = new PipelineRig(true);
+    std::vector<int16_t> ramp(960 * 5);
+    for (size_t i = 0; i < ramp.size(); i++) {
+        ramp[i] = (int16_t)(i * 13 - 30000);
+    }
+    rig->codec.SetInput(ramp);
+    LoopbackProtocol protocol;
+    protocol.OpenAudioChannel();
+
+    rig->processor.Start();
+    rig->pipeline.NotifyAudioInput();
+    // What the main event loop does on SEND_AUDIO_EVENT
+    ASSERT_TRUE(WaitUntil([&]() {
+        rig->pipeline.SendQueuedAudio(protocol);
+        return protocol.audio().size() >= 5;
+    }));
+    rig->processor.Stop();
+
+    auto packets = protocol.audio();
+    for (size_t frame = 0; frame < 5; frame++) {
+        auto& payload = packets[frame].payload;
+        ASSERT_EQ(payload.size(), HOST_OPUS_HEADER_SIZE + 960u / HOST_OPUS_DECIMATION);
+        EXPECT_EQ(payload[1], 60);
+        for (size_t i = HOST_OPUS_HEADER_SIZE; i < payload.size(); i += 37) {
+            size_t sample = frame * 960 + (i - HOST_OPUS_HEADER_SIZE) * HOST_OPUS_DECIMATION;
+            EXPECT_EQ((int8_t)payload[i], (int8_t)(ramp[sample] >> 8));
+        }
+    }
+}
+
+TEST(AudioPipeline, DownlinkDecodesPacketsIntoTheSpeaker) {
+    auto rig = new PipelineRig(false);
+    for (uint32_t sequence = 1; sequence <= 4; sequence++) {
+        ASSERT_TRUE(rig->pipeline.PushDecodePacket(Packet(sequence, (int8_t)(sequence * 10))));
+    }
+    ASSERT_TRUE(WaitUntil([&]() { return rig->codec.output().size() >= 4 * 960; }));
+
+    auto output = rig->codec.output();
+    for (int frame = 0; frame < 4; frame++) {
+        EXPECT_EQ(output[frame * 960], (frame + 1) * 10 * 256);
+        EXPECT_EQ(output[frame * 960 + 959], (frame + 1) * 10 * 256);
+    }
+    auto stats = rig->pipeline.GetJitterBufferStats();
+    EXPECT_EQ(stats.received, 4u);
+    EXPECT_EQ(stats.played, 4u);
+}
+
+TEST(AudioPipeline, ResetDecoderDropsQueuedPlayback) {
+    auto rig = new PipelineRig(false);
+    // With the output off the decode task leaves the packets queued
+    rig->codec.EnableOutput(false);
+    for (uint32_t sequence = 1; sequence <= 3; sequence++) {
+        ASSERT_TRUE(rig->pipeline.PushDecodePacket(Packet(sequence, 50)));
+    }
+    rig->pipeline.ResetDecoder();
+    EXPECT_TRUE(rig->codec.output_enabled());
+
+    ASSERT_TRUE(rig->pipeline.PushDecodePacket(Packet(1, 90)));
+    ASSERT_TRUE(WaitUntil([&]() { return rig->codec.output().size() >= 960; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto output = rig->codec.output();
+    ASSERT_EQ(output.size(), 960u);
+    EXPECT_EQ(output[0], 90 * 256);
+}
+
+// A speaker whose writes block while the gate is closed, like a full I2S DMA
+class GatedAudioCodec : public AudioCodec {
+public:
+    GatedAudioCodec() {
+        input_sample_rate_ = 16000;
+        output_sample_rate_ = 16000;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        open_ = false;
+    }
+    void Open() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        open_ = true;
+        condition_variable_.notify_all();
+    }
+    bool WaitForBlockedWrite() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return condition_variable_.wait_for(lock, std::chrono::seconds(5), [this]() { return blocked_; });
+    }
+    std::vector<int16_t> output() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return output_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    bool open_ = true;
+    bool blocked_ = false;
+    std::vector<int16_t> output_;
+
+    int Read(int16_t* dest, int samples) override {
+        std::fill(dest, dest + samples, 0);
+        return samples;
+    }
+    int Write(const int16_t* data, int samples) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        blocked_ = !open_;
+        condition_variable_.notify_all();
+        condition_variable_.wait(lock, [this]() { return open_; });
+        blocked_ = false;
+        output_.insert(output_.end(), data, data + samples);
+        return samples;
+    }
+};
+
+TEST(AudioPipeline, ResetDropsFramesAlreadyDecoded) {
+    auto codec = new GatedAudioCodec();
+    auto wake_word = new NoWakeWord();
+    auto processor = new NoAudioProcessor();
+    auto background_task = new BackgroundTask();
+    auto pipeline = new AudioPipeline();
+    codec->Start();
+    pipeline->Start(codec, wake_word, processor, background_task, 60, 0);
+
+    // The first frame is stuck in the speaker, the next ones are decoded and wait for it
+    codec->Close();
+    for (uint32_t sequence = 1; sequence <= 3; sequence++) {
+        ASSERT_TRUE(pipeline->PushDecodePacket(Packet(sequence, (int8_t)(sequence * 10))));
+    }
+    ASSERT_TRUE(codec->WaitForBlockedWrite());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // The reply is aborted: nothing decoded before the reset may reach the speaker
+    pipeline->ResetDecoder();
+    codec->Open();
+    ASSERT_TRUE(pipeline->PushDecodePacket(Packet(1, 90)));
+    ASSERT_TRUE(WaitUntil([&]() { return codec->output().size() >= 2 * 960; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto output = codec->output();
+    ASSERT_EQ(output.size(), 2 * 960u);
+    EXPECT_EQ(output[0], 10 * 256);
+    EXPECT_EQ(output[960], 90 * 256);
+}
+
+TEST(AudioPipeline, FrameDurationChangeKeepsTheQueueDuration) {
+    auto rig = new PipelineRig(false);
+    EXPECT_EQ(rig->pipeline.send_queue_limit(), (size_t)(AUDIO_QUEUE_DURATION_MS / 60));
+    rig->pipeline.SetFrameDuration(20);
+    EXPECT_EQ(rig->pipeline.frame_duration(), 20);
+    EXPECT_EQ(rig->pipeline.send_queue_limit(), (size_t)(AUDIO_QUEUE_DURATION_MS / 20));
+
+    LoopbackProtocol protocol;
+    protocol.OpenAudioChannel();
+    rig->codec.SetInput(std::vector<int16_t>(320 * 3, 1000));
+    rig->processor.Start();
+    rig->pipeline.NotifyAudioInput();
+    ASSERT_TRUE(WaitUntil([&]() {
+        rig->pipeline.SendQueuedAudio(protocol);
+        return !protocol.audio().empty();
+    }));
+    rig->processor.Stop();
+    EXPECT_EQ(protocol.audio()[0].payload[1], 20);
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "background_task.h"
+
+// The host vTaskDelete cannot stop a thread, so the tasks live until the process exits
+static BackgroundTask& NewTask() {
+    return *new BackgroundTask();
+}
+
+TEST(BackgroundTask, RunsCallbacksInOrder) {
+    auto& task = NewTask();
+    std::vector<int> order;
+    for (int i = 0; i < 100; i++) {
+        task.Schedule([&order, i]() { order.push_back(i); });
+    }
+    task.WaitForCompletion();
+    ASSERT_EQ(order.size(), 100u);
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(order[i], i);
+    }
+}
+
+TEST(BackgroundTask, WaitCoversCallbacksScheduledByCallbacks) {
+    auto& task = NewTask();
+    std::atomic<int> done{0};
+    task.Schedule([&task, &done]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        task.Schedule([&done]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            done++;
+        });
+        done++;
+    });
+    task.WaitForCompletion();
+    EXPECT_EQ(done.load(), 2);
+}
+
+TEST(BackgroundTask, ScheduleFromManyThreads) {
+    auto& task = NewTask();
+    std::atomic<int> done{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&task, &done]() {
+            for (int i = 0; i < 250; i++) {
+                task.Schedule([&done]() { done++; });
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    task.WaitForCompletion();
+    EXPECT_EQ(done.load(), 1000);
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "alloc_counter.h"
+
+TEST(BoundedQueue, KeepsFifoOrderUpToTheLimit) {
+    BoundedQueue<int> queue(5);
+    EXPECT_EQ(queue.capacity(), 8u);
+    EXPECT_EQ(queue.limit(), 5u);
+    for (int i = 0; i < 5; i++) {
+        int item = i;
+        EXPECT_TRUE(queue.TryPush(std::move(item)));
+    }
+    int rejected = 5;
+    EXPECT_FALSE(queue.TryPush(std::move(rejected)));
+    EXPECT_EQ(queue.Size(), 5u);
+    for (int i = 0; i < 5; i++) {
+        int item = -1;
+        ASSERT_TRUE(queue.TryPop(item));
+        EXPECT_EQ(item, i);
+    }
+    int item;
+    EXPECT_FALSE(queue.TryPop(item));
+    EXPECT_TRUE(queue.Empty());
+}
+
+TEST(BoundedQueue, RejectedItemIsLeftUntouched) {
+    BoundedQueue<std::vector<uint8_t>> queue(1);
+    std::vector<uint8_t> first(10, 1);
+    ASSERT_TRUE(queue.TryPush(std::move(first)));
+    std::vector<uint8_t> second(20, 2);
+    EXPECT_FALSE(queue.TryPush(std::move(second)));
+    EXPECT_EQ(second.size(), 20u);
+}
+
+TEST(BoundedQueue, LoweredLimitKeepsQueuedItems) {
+    BoundedQueue<int> queue(8);
+    for (int i = 0; i < 6; i++) {
+        int item = i;
+        ASSERT_TRUE(queue.TryPush(std::move(item)));
+    }
+    queue.set_limit(4);
+    int item = 6;
+    EXPECT_FALSE(queue.TryPush(std::move(item)));
+    EXPECT_EQ(queue.Size(), 6u);
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(queue.TryPop(item));
+    }
+    item = 7;
+    EXPECT_TRUE(queue.TryPush(std::move(item)));
+    queue.set_limit(100);
+    EXPECT_EQ(queue.limit(), queue.capacity());
+    queue.Clear();
+    EXPECT_TRUE(queue.Empty());
+}
+
+TEST(BoundedQueue, PushAndPopDoNotAllocate) {
+    BoundedQueue<std::vector<uint8_t>> queue(16);
+    std::vector<std::vector<uint8_t>> buffers(16, std::vector<uint8_t>(64));
+    auto before = AllocCounter::Snapshot();
+    for (int round = 0; round < 1000; round++) {
+        for (auto& buffer : buffers) {
+            ASSERT_TRUE(queue.TryPush(std::move(buffer)));
+        }
+        for (auto& buffer : buffers) {
+            ASSERT_TRUE(queue.TryPop(buffer));
+        }
+    }
+    EXPECT_EQ((AllocCounter::Snapshot() - before).count, 0u);
+}
+
+TEST(BoundedQueue, ConcurrentProducersAndConsumersLoseNothing) {
+    const int kProducers = 4;
+    const int kConsumers = 4;
+    const int kItems = 20000;
+    BoundedQueue<int> queue(64);
+    std::atomic<int64_t> sum{0};
+    std::atomic<int> popped{0};
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < kProducers; p++) {
+        threads.emplace_back([&queue, p]() {
+            for (int i = 1; i <= kItems; i++) {
+                int item = p * kItems + i;
+                while (!queue.TryPush(std::move(item))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (int c = 0; c < kConsumers; c++) {
+        threads.emplace_back([&]() {
+            int item;
+            while (popped.load() < kProducers * kItems) {
+                if (queue.TryPop(item)) {
+                    sum += item;
+                    popped++;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    int64_t n = (int64_t)kProducers * kItems;
+    EXPECT_EQ(popped.load(), n);
+    EXPECT_EQ(sum.load(), n * (n + 1) / 2);
+    EXPECT_TRUE(queue.Empty());
+}
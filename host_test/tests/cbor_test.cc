@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include "cbor.h"
+
+static std::string ToJson(const uint8_t* data, size_t size) {
+    cJSON* root = CborToJson(data, size);
+    if (root == nullptr) {
+        return "";
+    }
+    char* json = cJSON_PrintUnformatted(root);
+    std::string text(json);
+    cJSON_free(json);
+    cJSON_Delete(root);
+    return text;
+}
+
+TEST(Cbor, EncodesTheRfcExamples) {
+    uint8_t buffer[64];
+    CborWriter writer(buffer, sizeof(buffer));
+    writer.Int(0);
+    writer.Int(23);
+    writer.Int(24);
+    writer.Int(1000);
+    writer.Int(-1);
+    writer.Int(-1000);
+    writer.Bool(true);
+    writer.Null();
+    writer.Text("IETF");
+    ASSERT_TRUE(writer.ok());
+    const uint8_t expected[] = {0x00, 0x17, 0x18, 0x18, 0x19, 0x03, 0xe8, 0x20, 0x39, 0x03, 0xe7, 0xf5, 0xf6,
+        0x64, 'I', 'E', 'T', 'F'};
+    ASSERT_EQ(writer.size(), sizeof(expected));
+    EXPECT_EQ(memcmp(writer.data(), expected, sizeof(expected)), 0);
+}
+
+TEST(Cbor, ListenMessageRoundTripsThroughJson) {
+    uint8_t buffer[128];
+    CborWriter writer(buffer, sizeof(buffer));
+    writer.Map(5);
+    writer.Text("session_id");
+    writer.Text("abc");
+    writer.Text("type");
+    writer.Text("listen");
+    writer.Text("state");
+    writer.Text("detect");
+    writer.Text("text");
+    writer.Text("你好小智");
+    writer.Text("list");
+    writer.Array(3);
+    writer.Int(1);
+    writer.Int(-2);
+    writer.Bool(false);
+    ASSERT_TRUE(writer.ok());
+    EXPECT_TRUE(IsCborMessage(writer.data(), writer.size()));
+    EXPECT_EQ(ToJson(writer.data(), writer.size()),
+        R"({"session_id":"abc","type":"listen","state":"detect","text":"你好小智","list":[1,-2,false]})");
+}
+
+TEST(Cbor, WriterReportsOverflow) {
+    uint8_t buffer[8];
+    CborWriter writer(buffer, sizeof(buffer));
+    writer.Map(1);
+    writer.Text("session_id");
+    EXPECT_FALSE(writer.ok());
+}
+
+TEST(Cbor, ReaderDecodesFloats) {
+    // 1.5 as half, 100000.0 as single, 1.1 as double
+    const uint8_t data[] = {0x83, 0xf9, 0x3e, 0x00, 0xfa, 0x47, 0xc3, 0x50, 0x00,
+        0xfb, 0x3f, 0xf1, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9a};
+    cJSON* root = CborToJson(data, sizeof(data));
+    ASSERT_NE(root, nullptr);
+    ASSERT_EQ(cJSON_GetArraySize(root), 3);
+    EXPECT_DOUBLE_EQ(cJSON_GetArrayItem(root, 0)->valuedouble, 1.5);
+    EXPECT_DOUBLE_EQ(cJSON_GetArrayItem(root, 1)->valuedouble, 100000.0);
+    EXPECT_DOUBLE_EQ(cJSON_GetArrayItem(root, 2)->valuedouble, 1.1);
+    cJSON_Delete(root);
+}
+
+TEST(Cbor, ReaderSkipsNestedContainers) {
+    const uint8_t data[] = {0x82, 0xa1, 0x61, 'a', 0x83, 0x01, 0x02, 0x03, 0x80, 0x05};
+    CborReader reader(data, sizeof(data));
+    CborItem item;
+    ASSERT_TRUE(reader.Next(item));
+    ASSERT_EQ(item.type, kCborArray);
+    ASSERT_TRUE(reader.Skip(item));
+    ASSERT_TRUE(reader.Next(item));
+    EXPECT_EQ(item.type, kCborUnsigned);
+    EXPECT_EQ(item.value, 5u);
+    EXPECT_TRUE(reader.at_end());
+
+    // A container that claims more items than the buffer holds
+    const uint8_t truncated[] = {0xa2, 0x61, 'a', 0x01};
+    CborReader short_reader(truncated, sizeof(truncated));
+    ASSERT_TRUE(short_reader.Next(item));
+    EXPECT_FALSE(short_reader.Skip(item));
+}
+
+TEST(Cbor, MalformedInputIsRejected) {
+    // Truncated text, a map with an integer key, an indefinite length array
+    const uint8_t truncated[] = {0xa1, 0x64, 't', 'y'};
+    const uint8_t integer_key[] = {0xa1, 0x01, 0x02};
+    const uint8_t indefinite[] = {0x9f, 0x01, 0xff};
+    EXPECT_EQ(CborToJson(truncated, sizeof(truncated)), nullptr);
+    EXPECT_EQ(CborToJson(integer_key, sizeof(integer_key)), nullptr);
+    EXPECT_EQ(CborToJson(indefinite, sizeof(indefinite)), nullptr);
+
+    const char* json = "{\"type\":\"hello\"}";
+    EXPECT_FALSE(IsCborMessage((const uint8_t*)json, strlen(json)));
+}
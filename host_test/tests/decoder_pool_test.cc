@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include "decoder_pool.h"
+#include "opus_encoder.h"
+
+static std::vector<uint8_t> EncodeTone(int sample_rate, int frame_duration) {
+    OpusEncoderWrapper encoder(sample_rate, 1, frame_duration);
+    std::vector<int16_t> pcm(sample_rate / 1000 * frame_duration, 12000);
+    std::vector<uint8_t> packet;
+    encoder.Encode(std::move(pcm), [&packet](std::vector<uint8_t>&& opus) {
+        packet = std::move(opus);
+    });
+    return packet;
+}
+
+TEST(DecoderPool, SwitchBetweenCachedFormatsCreatesNothing) {
+    DecoderPool pool;
+    pool.Initialize(24000);
+    uint32_t created = OpusDecoderWrapper::created;
+
+    auto tts = pool.Get(24000, 60);
+    auto sound = pool.Get(16000, 60);
+    EXPECT_EQ(pool.misses(), 2u);
+    EXPECT_EQ(OpusDecoderWrapper::created, created + 2);
+    EXPECT_FALSE(tts->resample);
+    EXPECT_TRUE(sound->resample);
+    EXPECT_EQ(sound->resampler.output_sample_rate(), 24000);
+
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(pool.Get(24000, 60), tts);
+        EXPECT_EQ(pool.Get(16000, 60), sound);
+    }
+    EXPECT_EQ(pool.hits(), 20u);
+    EXPECT_EQ(pool.misses(), 2u);
+    EXPECT_EQ(OpusDecoderWrapper::created, created + 2);
+}
+
+TEST(DecoderPool, SameFormatIsNotCountedAsSwitch) {
+    DecoderPool pool;
+    pool.Initialize(16000);
+    auto slot = pool.Get(16000, 60);
+    EXPECT_EQ(pool.Get(16000, 60), slot);
+    EXPECT_EQ(pool.hits(), 0u);
+    EXPECT_EQ(pool.misses(), 1u);
+}
+
+TEST(DecoderPool, LeastRecentlyUsedFormatIsReplaced) {
+    DecoderPool pool;
+    pool.Initialize(24000);
+    pool.Get(24000, 60);
+    pool.Get(16000, 60);
+    pool.Get(24000, 60);
+    pool.Get(16000, 20);
+    // 16kHz 60ms was used longest ago
+    pool.Get(48000, 60);
+    EXPECT_EQ(pool.misses(), 4u);
+
+    uint32_t created = OpusDecoderWrapper::created;
+    pool.Get(24000, 60);
+    pool.Get(16000, 20);
+    EXPECT_EQ(OpusDecoderWrapper::created, created);
+    pool.Get(16000, 60);
+    EXPECT_EQ(OpusDecoderWrapper::created, created + 1);
+    EXPECT_EQ(pool.misses(), 5u);
+}
+
+TEST(DecoderPool, PreloadCreatesOnce) {
+    DecoderPool pool;
+    pool.Initialize(24000);
+    uint32_t created = OpusDecoderWrapper::created;
+    pool.Preload(24000, 60);
+    pool.Preload(24000, 60);
+    EXPECT_EQ(OpusDecoderWrapper::created, created + 1);
+    pool.Get(24000, 60);
+    EXPECT_EQ(OpusDecoderWrapper::created, created + 1);
+    EXPECT_EQ(pool.misses(), 0u);
+    EXPECT_EQ(pool.hits(), 1u);
+}
+
+TEST(DecoderPool, SwitchResetsTheDecoderState) {
+    DecoderPool pool;
+    pool.Initialize(24000);
+    auto tts = pool.Get(24000, 60);
+    std::vector<int16_t> pcm;
+    ASSERT_TRUE(tts->decoder->Decode(EncodeTone(24000, 60), pcm));
+    EXPECT_NE(pcm[0], 0);
+
+    pool.Get(16000, 60);
+    tts = pool.Get(24000, 60);
+    // Concealment after the switch must not replay the frame of the previous stream
+    ASSERT_TRUE(tts->decoder->Decode(std::vector<uint8_t>(), pcm));
+    EXPECT_EQ(pcm.size(), 1440u);
+    for (auto sample : pcm) {
+        ASSERT_EQ(sample, 0);
+    }
+}
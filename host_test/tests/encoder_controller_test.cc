@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include <cJSON.h>
+
+#include "encoder_controller.h"
+
+static EncoderSample MakeSample(int load_percent, int queue_percent = 0, uint32_t received = 0, uint32_t lost = 0) {
+    EncoderSample sample;
+    sample.elapsed_us = 1000000;
+    sample.encode_time_us = load_percent * 10000;
+    sample.send_queue_limit = 100;
+    sample.send_queue_depth = queue_percent;
+    sample.received = received;
+    sample.lost = lost;
+    return sample;
+}
+
+TEST(EncoderController, ConfigureCapsTheComplexity) {
+    EncoderController controller;
+    controller.Configure(5, 0);
+    EXPECT_EQ(controller.complexity(), 0);
+    controller.Configure(3, 5);
+    EXPECT_EQ(controller.complexity(), 3);
+}
+
+TEST(EncoderController, HighLoadLowersComplexityDownToZero) {
+    EncoderController controller;
+    controller.Configure(2, 5);
+    controller.StartSession();
+    EXPECT_TRUE(controller.Update(MakeSample(60)));
+    EXPECT_EQ(controller.complexity(), 1);
+    EXPECT_TRUE(controller.Update(MakeSample(60)));
+    EXPECT_FALSE(controller.Update(MakeSample(60)));
+    EXPECT_EQ(controller.complexity(), 0);
+}
+
+TEST(EncoderController, HeadroomGivesBackTheConfiguredComplexity) {
+    EncoderController controller;
+    controller.Configure(3, 5);
+    controller.StartSession();
+    EXPECT_TRUE(controller.Update(MakeSample(60)));
+    EXPECT_TRUE(controller.Update(MakeSample(60)));
+    EXPECT_EQ(controller.complexity(), 1);
+    EXPECT_FALSE(controller.Update(MakeSample(30)));
+    EXPECT_TRUE(controller.Update(MakeSample(5)));
+    EXPECT_TRUE(controller.Update(MakeSample(5)));
+    EXPECT_EQ(controller.complexity(), 3);
+    EXPECT_FALSE(controller.Update(MakeSample(5)));
+    EXPECT_EQ(controller.complexity(), 3);
+}
+
+TEST(EncoderController, CongestionLeavesTheComplexityAlone) {
+    EncoderController controller;
+    controller.Configure(2, 5);
+    controller.StartSession();
+    // Without bitrate control a higher complexity would not take any load off the link
+    for (uint32_t i = 1; i <= 5; i++) {
+        EXPECT_FALSE(controller.Update(MakeSample(5, 80, i * 90, i * 10)));
+    }
+    EXPECT_EQ(controller.complexity(), 2);
+
+    // With AEC the encoder stays at 0 whatever the load
+    controller.Configure(3, 0);
+    EXPECT_FALSE(controller.Update(MakeSample(5)));
+    EXPECT_EQ(controller.complexity(), 0);
+}
+
+TEST(EncoderController, LossIsMeasuredPerSample) {
+    EncoderController controller;
+    controller.Configure(0, 0);
+    controller.StartSession();
+    controller.Update(MakeSample(10, 0, 90, 10));
+    cJSON* status = cJSON_Parse(controller.GetStatusJson().c_str());
+    EXPECT_EQ(cJSON_GetObjectItem(status, "loss_percent")->valueint, 10);
+    EXPECT_TRUE(cJSON_IsTrue(cJSON_GetObjectItem(status, "congested")));
+    cJSON_Delete(status);
+
+    // No new loss since the last sample
+    controller.Update(MakeSample(10, 0, 190, 10));
+    status = cJSON_Parse(controller.GetStatusJson().c_str());
+    EXPECT_EQ(cJSON_GetObjectItem(status, "loss_percent")->valueint, 0);
+    EXPECT_TRUE(cJSON_IsFalse(cJSON_GetObjectItem(status, "congested")));
+    cJSON_Delete(status);
+}
+
+TEST(EncoderController, CongestedSessionMakesTheNextUseLongFrames) {
+    EncoderController controller;
+    controller.Configure(0, 0);
+    controller.StartSession();
+    EXPECT_EQ(controller.min_frame_duration(), 0);
+    controller.Update(MakeSample(10, 60));
+    controller.Update(MakeSample(10, 60));
+    // Not enough in a row
+    controller.Update(MakeSample(10, 0));
+    controller.StartSession();
+    EXPECT_EQ(controller.min_frame_duration(), 0);
+
+    for (int i = 0; i < ENCODER_CONGESTED_SAMPLES; i++) {
+        controller.Update(MakeSample(10, 60));
+    }
+    EXPECT_EQ(controller.min_frame_duration(), 0);
+    controller.StartSession();
+    EXPECT_EQ(controller.min_frame_duration(), 60);
+    // A clean session lifts it again
+    controller.StartSession();
+    EXPECT_EQ(controller.min_frame_duration(), 0);
+}
+
+TEST(EncoderController, CountersRestartWithTheSession) {
+    EncoderController controller;
+    controller.Configure(0, 0);
+    controller.StartSession();
+    controller.Update(MakeSample(10, 0, 1000, 0));
+    // The stream counters went back to zero without a StartSession
+    controller.Update(MakeSample(10, 0, 50, 50));
+    cJSON* status = cJSON_Parse(controller.GetStatusJson().c_str());
+    EXPECT_EQ(cJSON_GetObjectItem(status, "loss_percent")->valueint, 50);
+    EXPECT_EQ(cJSON_GetObjectItem(status, "encoder_load_percent")->valueint, 10);
+    EXPECT_EQ(cJSON_GetObjectItem(status, "max_complexity")->valueint, 0);
+    cJSON_Delete(status);
+}
@@ -0,0 +1,239 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "jitter_buffer.h"
+#include "sequence_tracker.h"
+
+#define FRAME_MS 60
+
+static AudioStreamPacket MakePacket(uint32_t sequence) {
+    AudioStreamPacket packet;
+    packet.sample_rate = 24000;
+    packet.frame_duration = FRAME_MS;
+    packet.sequence = sequence;
+    packet.payload.assign(4, (uint8_t)sequence);
+    return packet;
+}
+
+static bool Put(JitterBuffer& buffer, uint32_t sequence, int64_t arrival_ms) {
+    return buffer.Put(MakePacket(sequence), arrival_ms);
+}
+
+// Plays out everything that is ready at now_ms, 0 stands for a concealed frame
+static std::vector<uint32_t> PlayOut(JitterBuffer& buffer, int64_t now_ms, int max_frames = 64) {
+    std::vector<uint32_t> played;
+    for (int i = 0; i < max_frames; i++) {
+        AudioStreamPacket packet;
+        auto result = buffer.Get(packet, now_ms);
+        if (result == kJitterBufferEmpty) {
+            break;
+        }
+        if (result == kJitterBufferConceal) {
+            EXPECT_TRUE(packet.payload.empty());
+            EXPECT_EQ(packet.frame_duration, FRAME_MS);
+            played.push_back(0);
+        } else {
+            played.push_back(packet.sequence);
+        }
+    }
+    return played;
+}
+
+TEST(JitterBuffer, PlaysInOrder) {
+    JitterBuffer buffer(8);
+    for (uint32_t s = 1; s <= 5; s++) {
+        EXPECT_TRUE(Put(buffer, s, s * FRAME_MS));
+    }
+    EXPECT_EQ(PlayOut(buffer, 5 * FRAME_MS), (std::vector<uint32_t>{1, 2, 3, 4, 5}));
+    EXPECT_TRUE(buffer.Empty());
+    auto stats = buffer.GetStats();
+    EXPECT_EQ(stats.received, 5u);
+    EXPECT_EQ(stats.played, 5u);
+    EXPECT_EQ(stats.concealed, 0u);
+}
+
+TEST(JitterBuffer, RestoresOrderOfSwappedPackets) {
+    JitterBuffer buffer(8);
+    EXPECT_TRUE(Put(buffer, 1, 60));
+    EXPECT_TRUE(Put(buffer, 3, 180));
+    EXPECT_TRUE(Put(buffer, 2, 185));
+    EXPECT_TRUE(Put(buffer, 5, 300));
+    EXPECT_TRUE(Put(buffer, 4, 302));
+    EXPECT_EQ(PlayOut(buffer, 302), (std::vector<uint32_t>{1, 2, 3, 4, 5}));
+    EXPECT_EQ(buffer.GetStats().concealed, 0u);
+}
+
+TEST(JitterBuffer, ConcealsALostPacket) {
+    JitterBuffer buffer(8);
+    for (uint32_t s : {1, 2, 4, 5}) {
+        EXPECT_TRUE(Put(buffer, s, s * FRAME_MS));
+    }
+    EXPECT_EQ(PlayOut(buffer, 5 * FRAME_MS), (std::vector<uint32_t>{1, 2, 0, 4, 5}));
+    auto stats = buffer.GetStats();
+    EXPECT_EQ(stats.concealed, 1u);
+    EXPECT_EQ(stats.played, 4u);
+}
+
+TEST(JitterBuffer, ResyncsAfterTooManyLostPackets) {
+    JitterBuffer buffer(16);
+    Put(buffer, 1, FRAME_MS);
+    EXPECT_EQ(PlayOut(buffer, FRAME_MS), (std::vector<uint32_t>{1}));
+    Put(buffer, 10, 10 * FRAME_MS);
+    std::vector<uint32_t> expected(JITTER_BUFFER_MAX_CONCEAL, 0);
+    expected.push_back(10);
+    EXPECT_EQ(PlayOut(buffer, 10 * FRAME_MS), expected);
+}
+
+TEST(JitterBuffer, RejectsDuplicatesAndLatePackets) {
+    JitterBuffer buffer(8);
+    EXPECT_TRUE(Put(buffer, 1, 60));
+    EXPECT_TRUE(Put(buffer, 2, 120));
+    EXPECT_FALSE(Put(buffer, 2, 125));
+    EXPECT_TRUE(Put(buffer, 3, 180));
+    EXPECT_EQ(PlayOut(buffer, 180), (std::vector<uint32_t>{1, 2, 3}));
+    EXPECT_FALSE(Put(buffer, 2, 200));
+    auto stats = buffer.GetStats();
+    EXPECT_EQ(stats.duplicated, 1u);
+    EXPECT_EQ(stats.late, 1u);
+}
+
+TEST(JitterBuffer, RestartedSequenceIsAccepted) {
+    JitterBuffer buffer(4);
+    for (uint32_t s = 100; s < 104; s++) {
+        Put(buffer, s, s * FRAME_MS);
+    }
+    PlayOut(buffer, 104 * FRAME_MS);
+    EXPECT_TRUE(Put(buffer, 1, 105 * FRAME_MS));
+    EXPECT_EQ(PlayOut(buffer, 105 * FRAME_MS), (std::vector<uint32_t>{1}));
+}
+
+TEST(JitterBuffer, FullHoldsBackTheNextPacket) {
+    JitterBuffer buffer(4);
+    for (uint32_t s = 1; s <= 4; s++) {
+        EXPECT_FALSE(buffer.Full());
+        EXPECT_TRUE(Put(buffer, s, s * FRAME_MS));
+    }
+    EXPECT_TRUE(buffer.Full());
+    auto packet = MakePacket(5);
+    EXPECT_FALSE(buffer.Put(std::move(packet), 5 * FRAME_MS));
+    EXPECT_EQ(packet.payload.size(), 4u);
+    EXPECT_EQ(buffer.GetStats().overflowed, 1u);
+
+    AudioStreamPacket out;
+    EXPECT_EQ(buffer.Get(out, 5 * FRAME_MS), kJitterBufferPacket);
+    EXPECT_FALSE(buffer.Full());
+    EXPECT_TRUE(buffer.Put(std::move(packet), 5 * FRAME_MS));
+}
+
+TEST(JitterBuffer, PacketsWithoutSequenceKeepArrivalOrder) {
+    JitterBuffer buffer(8);
+    for (int i = 0; i < 3; i++) {
+        auto packet = MakePacket(0);
+        packet.payload[0] = (uint8_t)(10 + i);
+        EXPECT_TRUE(buffer.Put(std::move(packet), i * FRAME_MS));
+    }
+    for (int i = 0; i < 3; i++) {
+        AudioStreamPacket packet;
+        ASSERT_EQ(buffer.Get(packet, 3 * FRAME_MS), kJitterBufferPacket);
+        EXPECT_EQ(packet.payload[0], 10 + i);
+    }
+}
+
+// A local sound is queued in one burst, that is not network jitter
+TEST(JitterBuffer, PacketsWithoutSequenceStayOutOfTheJitter) {
+    JitterBuffer buffer(4);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_TRUE(buffer.Put(MakePacket(0), 0));
+    }
+    EXPECT_EQ(buffer.GetStats().jitter_ms, 0);
+    EXPECT_EQ(buffer.GetStats().target_depth, JITTER_BUFFER_MIN_DEPTH);
+
+    // Rejected, so it must come back as it went in
+    auto packet = MakePacket(0);
+    EXPECT_FALSE(buffer.Put(std::move(packet), 0));
+    EXPECT_EQ(packet.sequence, 0u);
+    EXPECT_EQ(packet.payload.size(), 4u);
+}
+
+TEST(JitterBuffer, CountsUnderruns) {
+    JitterBuffer buffer(8);
+    Put(buffer, 1, 60);
+    EXPECT_EQ(PlayOut(buffer, 60), (std::vector<uint32_t>{1}));
+    Put(buffer, 2, 400);
+    EXPECT_EQ(buffer.GetStats().underruns, 1u);
+}
+
+// A synthetic trace with 5% loss, arrival jitter of up to +-45ms and a few swaps
+TEST(JitterBuffer, JitterRaisesTheDepthAndLossIsConcealed) {
+    JitterBuffer buffer(16);
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<int> jitter(-45, 45);
+    std::uniform_int_distribution<int> percent(0, 99);
+
+    struct Arrival {
+        uint32_t sequence;
+        int64_t time_ms;
+    };
+    std::vector<Arrival> trace;
+    uint32_t lost = 0;
+    for (uint32_t s = 1; s <= 1000; s++) {
+        if (percent(random) < 5) {
+            lost++;
+            continue;
+        }
+        trace.push_back({s, (int64_t)s * FRAME_MS + 45 + jitter(random)});
+    }
+    std::stable_sort(trace.begin(), trace.end(), [](const Arrival& a, const Arrival& b) { return a.time_ms < b.time_ms; });
+
+    size_t next = 0;
+    uint32_t played = 0;
+    uint32_t concealed = 0;
+    uint32_t last_played = 0;
+    bool in_order = true;
+    for (int64_t now = 0; now <= 1002 * FRAME_MS; now += FRAME_MS) {
+        while (next < trace.size() && trace[next].time_ms <= now) {
+            Put(buffer, trace[next].sequence, trace[next].time_ms);
+            next++;
+        }
+        AudioStreamPacket packet;
+        auto result = buffer.Get(packet, now);
+        if (result == kJitterBufferPacket) {
+            in_order = in_order && packet.sequence > last_played;
+            last_played = packet.sequence;
+            played++;
+        } else if (result == kJitterBufferConceal) {
+            concealed++;
+        }
+    }
+    for (auto& frame : PlayOut(buffer, 2000 * FRAME_MS)) {
+        frame == 0 ? concealed++ : played++;
+    }
+
+    auto stats = buffer.GetStats();
+    EXPECT_TRUE(in_order);
+    EXPECT_GT(stats.jitter_ms, 10);
+    EXPECT_GT(stats.target_depth, JITTER_BUFFER_MIN_DEPTH);
+    EXPECT_LE(stats.target_depth, JITTER_BUFFER_MAX_DEPTH);
+    // Frames played late are dropped and concealed too, but most must get through
+    EXPECT_GT(played, (1000 - lost) * 95 / 100);
+    EXPECT_GE(concealed, lost / 2);
+    EXPECT_EQ(stats.duplicated, 0u);
+}
+
+TEST(JitterBuffer, JitterMatchesTheReceiveStatistics) {
+    JitterBuffer buffer(JITTER_BUFFER_MAX_DEPTH);
+    SequenceTracker tracker;
+    std::mt19937 random(7);
+    int64_t time = 0;
+    for (uint32_t sequence = 1; sequence <= 300; sequence++) {
+        time += FRAME_MS - 20 + random() % 41;
+        Put(buffer, sequence, time);
+        tracker.Update(sequence, time, FRAME_MS);
+        PlayOut(buffer, time);
+    }
+    EXPECT_GT(tracker.stats().jitter_ms, 0);
+    EXPECT_EQ(buffer.GetStats().jitter_ms, tracker.stats().jitter_ms);
+}
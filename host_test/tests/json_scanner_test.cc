@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include "json_scanner.h"
+
+static bool Find(const char* json, const char* key, std::string& value) {
+    std::string_view raw;
+    JsonScanner scanner(json, strlen(json));
+    if (!scanner.FindString(key, raw)) {
+        return false;
+    }
+    return UnescapeJsonString(raw, value);
+}
+
+TEST(JsonScanner, FindsTopLevelStrings) {
+    const char* json = R"({"type":"tts", "state" : "sentence_start","text":"你好","n":3})";
+    std::string value;
+    EXPECT_TRUE(Find(json, "type", value));
+    EXPECT_EQ(value, "tts");
+    EXPECT_TRUE(Find(json, "state", value));
+    EXPECT_EQ(value, "sentence_start");
+    EXPECT_TRUE(Find(json, "text", value));
+    EXPECT_EQ(value, "你好");
+    EXPECT_FALSE(Find(json, "n", value));
+    EXPECT_FALSE(Find(json, "missing", value));
+}
+
+TEST(JsonScanner, FindsTopLevelIntegers) {
+    const char* json = R"({"meta":{"turn":1},"text":"\"turn\":2","turn": 42,"big":4294967296,"neg":-1,"f":1.5})";
+    JsonScanner scanner(json, strlen(json));
+    uint32_t value = 0;
+    EXPECT_TRUE(scanner.FindUint("turn", value));
+    EXPECT_EQ(value, 42u);
+    EXPECT_FALSE(scanner.FindUint("big", value));
+    EXPECT_FALSE(scanner.FindUint("neg", value));
+    EXPECT_FALSE(scanner.FindUint("f", value));
+    EXPECT_FALSE(scanner.FindUint("text", value));
+    EXPECT_FALSE(scanner.FindUint("missing", value));
+}
+
+TEST(JsonScanner, SkipsNestedMembers) {
+    const char* json = R"({"meta":{"type":"inner","list":["type",{"type":"x"}]},"type":"outer"})";
+    std::string value;
+    EXPECT_TRUE(Find(json, "type", value));
+    EXPECT_EQ(value, "outer");
+}
+
+TEST(JsonScanner, KeysInsideStringsDoNotMatch) {
+    const char* json = R"({"text":"\"type\":\"fake\"","type":"stt"})";
+    std::string value;
+    EXPECT_TRUE(Find(json, "type", value));
+    EXPECT_EQ(value, "stt");
+    EXPECT_TRUE(Find(json, "text", value));
+    EXPECT_EQ(value, "\"type\":\"fake\"");
+}
+
+TEST(JsonScanner, UnescapesEscapesAndSurrogatePairs) {
+    std::string value;
+    EXPECT_TRUE(UnescapeJsonString(R"(a\nb\t\\\/é😀)", value));
+    EXPECT_EQ(value, "a\nb\t\\/\xc3\xa9\xf0\x9f\x98\x80");
+    EXPECT_FALSE(UnescapeJsonString(R"(\ud83d)", value));
+    EXPECT_FALSE(UnescapeJsonString(R"(\x)", value));
+}
+
+TEST(JsonScanner, MalformedTextFails) {
+    std::string value;
+    EXPECT_FALSE(Find(R"({"type":"tts)", "type", value));
+    EXPECT_FALSE(Find(R"(["type","tts"])", "type", value));
+    EXPECT_FALSE(Find("", "type", value));
+}
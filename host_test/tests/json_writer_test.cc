@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include <cJSON.h>
+
+#include "json_writer.h"
+#include "alloc_counter.h"
+
+TEST(JsonWriter, WritesNestedCompactJson) {
+    JsonWriter writer;
+    writer.BeginObject();
+    writer.Key("jsonrpc");
+    writer.String("2.0");
+    writer.Key("id");
+    writer.Number(-7);
+    writer.Key("result");
+    writer.BeginObject();
+    writer.Key("tools");
+    writer.BeginArray();
+    writer.BeginObject();
+    writer.Key("name");
+    writer.String("self.get_device_status");
+    writer.EndObject();
+    writer.Raw("{\"raw\":true}");
+    writer.EndArray();
+    writer.Key("isError");
+    writer.Bool(false);
+    writer.EndObject();
+    writer.EndObject();
+    EXPECT_EQ(writer.str(),
+        R"({"jsonrpc":"2.0","id":-7,"result":{"tools":[{"name":"self.get_device_status"},{"raw":true}],"isError":false}})");
+}
+
+TEST(JsonWriter, EscapesLikeCJson) {
+    JsonWriter writer;
+    writer.String(std::string("q\" b\\ n\n t\t \x01 é", 16));
+    EXPECT_EQ(writer.str(), "\"q\\\" b\\\\ n\\n t\\t \\u0001 é\"");
+    cJSON* parsed = cJSON_Parse(("[" + writer.str() + "]").c_str());
+    ASSERT_NE(parsed, nullptr);
+    EXPECT_STREQ(cJSON_GetArrayItem(parsed, 0)->valuestring, "q\" b\\ n\n t\t \x01 é");
+    cJSON_Delete(parsed);
+}
+
+TEST(JsonWriter, ClearKeepsTheCapacity) {
+    JsonWriter writer(1024);
+    writer.BeginArray();
+    writer.Number(1);
+    writer.EndArray();
+    writer.Clear();
+    auto before = AllocCounter::Snapshot();
+    writer.BeginArray();
+    for (int i = 0; i < 100; i++) {
+        writer.Number(i);
+    }
+    writer.EndArray();
+    EXPECT_EQ((AllocCounter::Snapshot() - before).count, 0u);
+    EXPECT_EQ(writer.str().substr(0, 7), "[0,1,2,");
+    auto released = writer.Release();
+    EXPECT_EQ(released.back(), ']');
+}
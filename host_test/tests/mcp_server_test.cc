@@ -0,0 +1,615 @@
+#include <gtest/gtest.h>
+
+#include <cJSON.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mcp_server.h"
+#include "application.h"
+#include "rp2040iic.h"
+
+// mcp_server.cc keeps every tools/list result below this
+#define TOOLS_LIST_PAYLOAD_LIMIT 8000
+#define PAGING_TOOL_COUNT 60
+
+// What the device sent back, batches flattened into their responses
+struct McpReply {
+    std::string json;           // The response object
+    bool in_batch = false;
+    size_t message_index = 0;   // Which message carried it
+};
+
+// Stands in for the server end of the "mcp" messages
+class McpClient {
+public:
+    void Install() {
+        Application::GetInstance().OnMcpMessage([this](const std::string& payload) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            messages_.push_back(payload);
+            condition_variable_.notify_all();
+        });
+    }
+
+    void Uninstall() {
+        Application::GetInstance().OnMcpMessage(nullptr);
+    }
+
+    void Send(const std::string& message) {
+        McpServer::GetInstance().ParseMessage(message);
+    }
+
+    std::vector<std::string> messages() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return messages_;
+    }
+
+    // Waits until responses for all the ids arrived
+    bool WaitForIds(const std::vector<int>& ids, int timeout_ms = 5000) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            bool all = true;
+            for (int id : ids) {
+                if (Find(id) == nullptr) {
+                    all = false;
+                    break;
+                }
+            }
+            if (all) {
+                return true;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (condition_variable_.wait_until(lock, deadline) == std::cv_status::timeout) {
+                return false;
+            }
+        }
+    }
+
+    bool WaitForMessages(size_t count, int timeout_ms = 5000) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return condition_variable_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+            [this, count]() { return messages_.size() >= count; });
+    }
+
+    std::vector<McpReply> Replies() {
+        std::vector<McpReply> replies;
+        auto messages = this->messages();
+        for (size_t i = 0; i < messages.size(); i++) {
+            cJSON* json = cJSON_Parse(messages[i].c_str());
+            if (json == nullptr) {
+                ADD_FAILURE() << "Not JSON: " << messages[i];
+                continue;
+            }
+            if (cJSON_IsArray(json)) {
+                cJSON* item;
+                cJSON_ArrayForEach(item, json) {
+                    char* text = cJSON_PrintUnformatted(item);
+                    replies.push_back(McpReply{text, true, i});
+                    cJSON_free(text);
+                }
+            } else if (cJSON_GetObjectItem(json, "id") != nullptr) {
+                replies.push_back(McpReply{messages[i], false, i});
+            }
+            cJSON_Delete(json);
+        }
+        return replies;
+    }
+
+    // The response with the id, the caller deletes it; null if there is none
+    cJSON* Find(int id) {
+        for (auto& reply : Replies()) {
+            cJSON* json = cJSON_Parse(reply.json.c_str());
+            auto reply_id = cJSON_GetObjectItem(json, "id");
+            if (cJSON_IsNumber(reply_id) && reply_id->valueint == id) {
+                return json;
+            }
+            cJSON_Delete(json);
+        }
+        return nullptr;
+    }
+
+    // The text a tool returned, or the error message
+    std::string Text(int id, bool* is_error = nullptr) {
+        cJSON* json = Find(id);
+        if (json == nullptr) {
+            return "";
+        }
+        std::string text;
+        auto error = cJSON_GetObjectItem(json, "error");
+        if (is_error != nullptr) {
+            *is_error = error != nullptr;
+        }
+        if (error != nullptr) {
+            text = cJSON_GetObjectItem(error, "message")->valuestring;
+        } else {
+            auto content = cJSON_GetObjectItem(cJSON_GetObjectItem(json, "result"), "content");
+            auto item = cJSON_GetArrayItem(content, 0);
+            if (item != nullptr) {
+                text = cJSON_GetObjectItem(item, "text")->valuestring;
+            }
+        }
+        cJSON_Delete(json);
+        return text;
+    }
+
+    std::vector<cJSON*> Progress(const std::string& token) {
+        std::vector<cJSON*> progress;
+        for (auto& message : messages()) {
+            cJSON* json = cJSON_Parse(message.c_str());
+            auto method = cJSON_GetObjectItem(json, "method");
+            if (cJSON_IsString(method) && std::string(method->valuestring) == "notifications/progress") {
+                auto params = cJSON_GetObjectItem(json, "params");
+                char* value = cJSON_PrintUnformatted(cJSON_GetObjectItem(params, "progressToken"));
+                bool match = token == value;
+                cJSON_free(value);
+                if (match) {
+                    progress.push_back(json);
+                    continue;
+                }
+            }
+            cJSON_Delete(json);
+        }
+        return progress;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    std::vector<std::string> messages_;
+};
+
+static std::string ToolCall(int id, const std::string& name, const std::string& arguments, const std::string& meta = "") {
+    std::string message = "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(id) +
+        ",\"method\":\"tools/call\",\"params\":{\"name\":\"" + name + "\",\"arguments\":" + arguments;
+    if (!meta.empty()) {
+        message += ",\"_meta\":" + meta;
+    }
+    return message + "}}";
+}
+
+static std::string ToolsList(int id, const std::string& cursor) {
+    return "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(id) +
+        ",\"method\":\"tools/list\",\"params\":{\"cursor\":\"" + cursor + "\"}}";
+}
+
+static std::string Cancel(int id) {
+    return "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/cancelled\",\"params\":{\"requestId\":" +
+        std::to_string(id) + ",\"reason\":\"test\"}}";
+}
+
+static std::string SetAngle(int id, int servo_id, int angle) {
+    return ToolCall(id, "self.servo.set_angle",
+        "{\"servo_id\":" + std::to_string(servo_id) + ",\"angle\":" + std::to_string(angle) + "}");
+}
+
+static std::string SetMultipleAngles(int id, int count, int angle, const std::string& meta = "") {
+    static const int servo_ids[] = {3, 4, 7, 9, 12, 26, 27, 28};
+    std::string servos = "[";
+    for (int i = 0; i < count; i++) {
+        if (i > 0) {
+            servos += ",";
+        }
+        servos += "{\\\"servo_id\\\":" + std::to_string(servo_ids[i % 8]) + ",\\\"angle\\\":" + std::to_string(angle) + "}";
+    }
+    servos += "]";
+    return ToolCall(id, "self.servo.set_multiple_angles", "{\"servos\":\"" + servos + "\"}", meta);
+}
+
+class McpServerTest : public testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        auto& server = McpServer::GetInstance();
+        server.AddCommonTools();
+        // Enough schema text to need several tools/list pages
+        std::string description(300, 'd');
+        for (int i = 0; i < PAGING_TOOL_COUNT; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "host.paging_tool_%02d", i);
+            server.AddTool(name, description, PropertyList({
+                Property("value", kPropertyTypeInteger, 0, 100)
+            }), [](const PropertyList& properties) -> ReturnValue {
+                return properties["value"].value<int>();
+            });
+        }
+        // Two tools on one bus
+        for (auto name : {"host.bus_a", "host.bus_b"}) {
+            server.AddTool(name, "", PropertyList({
+                Property("value", kPropertyTypeInteger, 0, 100)
+            }), [](const PropertyList& properties) -> ReturnValue {
+                return Rp2040::getInstance()->etPwmOutput(0, properties["value"].value<int>());
+            }, "host.bus");
+        }
+    }
+
+    void SetUp() override {
+        Rp2040::getInstance()->Reset();
+        Rp2040::getInstance()->command_time_us = 0;
+        client_.Install();
+    }
+
+    void TearDown() override {
+        client_.Uninstall();
+    }
+
+    McpClient client_;
+};
+
+TEST_F(McpServerTest, ToolsListPagesThroughEveryTool) {
+    std::set<std::string> names;
+    std::string cursor;
+    int pages = 0;
+    int id = 100;
+    do {
+        client_.Send(ToolsList(id, cursor));
+        cJSON* reply = client_.Find(id);
+        ASSERT_NE(reply, nullptr);
+        auto result = cJSON_GetObjectItem(reply, "result");
+        ASSERT_NE(result, nullptr);
+        char* text = cJSON_PrintUnformatted(result);
+        EXPECT_LE(strlen(text), (size_t)TOOLS_LIST_PAYLOAD_LIMIT);
+        cJSON_free(text);
+
+        cJSON* tool;
+        cJSON_ArrayForEach(tool, cJSON_GetObjectItem(result, "tools")) {
+            EXPECT_TRUE(names.insert(cJSON_GetObjectItem(tool, "name")->valuestring).second);
+        }
+        auto next = cJSON_GetObjectItem(result, "nextCursor");
+        cursor = cJSON_IsString(next) ? next->valuestring : "";
+        cJSON_Delete(reply);
+        pages++;
+        id++;
+    } while (!cursor.empty() && pages < 20);
+
+    EXPECT_GE(pages, 3);
+    EXPECT_TRUE(names.count("self.get_device_status"));
+    EXPECT_TRUE(names.count("self.servo.set_multiple_angles"));
+    for (int i = 0; i < PAGING_TOOL_COUNT; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "host.paging_tool_%02d", i);
+        EXPECT_TRUE(names.count(name)) << name;
+    }
+
+    // A page rendered from a tool that does not start a cached page
+    client_.Send(ToolsList(200, "host.paging_tool_07"));
+    cJSON* reply = client_.Find(200);
+    ASSERT_NE(reply, nullptr);
+    auto first = cJSON_GetArrayItem(cJSON_GetObjectItem(cJSON_GetObjectItem(reply, "result"), "tools"), 0);
+    EXPECT_STREQ(cJSON_GetObjectItem(first, "name")->valuestring, "host.paging_tool_07");
+    cJSON_Delete(reply);
+
+    bool is_error = false;
+    client_.Send(ToolsList(201, "no.such.tool"));
+    EXPECT_EQ(client_.Text(201, &is_error), "Invalid cursor: no.such.tool");
+    EXPECT_TRUE(is_error);
+}
+
+TEST_F(McpServerTest, BatchIsAnsweredWithOneArray) {
+    client_.Send("["
+        + ToolCall(1, "self.get_device_status", "{}") + ","
+        + SetAngle(2, 3, 90) + ","
+        + ToolsList(3, "") + ","
+        + "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/initialized\"},"
+        + ToolCall(4, "self.no_such_tool", "{}") + ","
+        + ToolCall(5, "host.paging_tool_00", "{\"value\":42}")
+        + "]");
+    ASSERT_TRUE(client_.WaitForIds({1, 2, 3, 4, 5}));
+    // The notification adds nothing to the reply
+    auto replies = client_.Replies();
+    ASSERT_EQ(replies.size(), 5u);
+    ASSERT_EQ(client_.messages().size(), 1u);
+    for (auto& reply : replies) {
+        EXPECT_TRUE(reply.in_batch);
+    }
+
+    bool is_error = true;
+    EXPECT_EQ(client_.Text(1, &is_error), "{\"audio_speaker\":{\"volume\":70}}");
+    EXPECT_FALSE(is_error);
+    EXPECT_EQ(client_.Text(4, &is_error), "Unknown tool: self.no_such_tool");
+    EXPECT_TRUE(is_error);
+    EXPECT_EQ(client_.Text(5), "42");
+    ASSERT_EQ(Rp2040::getInstance()->commands().size(), 1u);
+}
+
+TEST_F(McpServerTest, InvalidBatchSizeIsAnError) {
+    std::string batch = "[";
+    for (int i = 0; i <= TOOL_POOL_QUEUE_SIZE; i++) {
+        batch += (i > 0 ? "," : "") + ToolCall(10 + i, "self.get_device_status", "{}");
+    }
+    batch += "]";
+    client_.Send(batch);
+    client_.Send("[]");
+    ASSERT_TRUE(client_.WaitForMessages(2));
+    for (auto& message : client_.messages()) {
+        cJSON* json = cJSON_Parse(message.c_str());
+        EXPECT_TRUE(cJSON_IsNull(cJSON_GetObjectItem(json, "id")));
+        EXPECT_NE(cJSON_GetObjectItem(json, "error"), nullptr);
+        cJSON_Delete(json);
+    }
+    EXPECT_NE(client_.messages()[0].find("Invalid batch size: 17"), std::string::npos);
+    EXPECT_NE(client_.messages()[1].find("Invalid batch size: 0"), std::string::npos);
+}
+
+TEST_F(McpServerTest, InvalidBatchElementsGetANullId) {
+    client_.Send("[5,"
+        "{\"jsonrpc\":\"1.0\",\"id\":141,\"method\":\"tools/list\"},"
+        "{\"jsonrpc\":\"2.0\",\"id\":142},"
+        + ToolCall(143, "host.paging_tool_00", "{\"value\":7}")
+        + "]");
+    ASSERT_TRUE(client_.WaitForMessages(1));
+    auto replies = client_.Replies();
+    ASSERT_EQ(replies.size(), 4u);
+    int invalid = 0;
+    for (auto& reply : replies) {
+        EXPECT_TRUE(reply.in_batch);
+        cJSON* json = cJSON_Parse(reply.json.c_str());
+        if (cJSON_IsNull(cJSON_GetObjectItem(json, "id"))) {
+            EXPECT_NE(cJSON_GetObjectItem(json, "error"), nullptr);
+            invalid++;
+        }
+        cJSON_Delete(json);
+    }
+    EXPECT_EQ(invalid, 3);
+    EXPECT_EQ(client_.Text(143), "7");
+}
+
+TEST_F(McpServerTest, CancelledCallCompletesItsBatch) {
+    Rp2040::getInstance()->command_time_us = 30000;
+    // One tool, so 151 waits in the queue behind 150
+    client_.Send("[" + SetMultipleAngles(150, 3, 10) + "," + SetMultipleAngles(151, 1, 99) + "]");
+    client_.Send(Cancel(151));
+    ASSERT_TRUE(client_.WaitForIds({150}));
+
+    auto replies = client_.Replies();
+    ASSERT_EQ(replies.size(), 1u);
+    EXPECT_TRUE(replies[0].in_batch);
+    EXPECT_EQ(client_.Find(151), nullptr);
+}
+
+TEST_F(McpServerTest, FullBatchFitsWhenIdle) {
+    std::string batch = "[";
+    std::vector<int> ids;
+    for (int i = 0; i < TOOL_POOL_QUEUE_SIZE; i++) {
+        batch += (i > 0 ? "," : "") + SetAngle(20 + i, 3, i);
+        ids.push_back(20 + i);
+    }
+    batch += "]";
+    client_.Send(batch);
+    ASSERT_TRUE(client_.WaitForIds(ids));
+    for (int id : ids) {
+        bool is_error = true;
+        client_.Text(id, &is_error);
+        EXPECT_FALSE(is_error) << id;
+    }
+    // Same tool, so the angles were set in the order they were asked for
+    auto commands = Rp2040::getInstance()->commands();
+    ASSERT_EQ(commands.size(), (size_t)TOOL_POOL_QUEUE_SIZE);
+    for (int i = 0; i < TOOL_POOL_QUEUE_SIZE; i++) {
+        EXPECT_EQ(commands[i].value, i);
+    }
+}
+
+TEST_F(McpServerTest, CallsToOneToolNeverOverlap) {
+    Rp2040::getInstance()->command_time_us = 5000;
+    std::vector<int> ids;
+    for (int i = 0; i < 4; i++) {
+        client_.Send(SetAngle(20 + i, 3, i));
+        ids.push_back(20 + i);
+    }
+    ASSERT_TRUE(client_.WaitForIds(ids));
+    // Two workers were free, the calls still ran one at a time in the order they were sent
+    auto commands = Rp2040::getInstance()->commands();
+    ASSERT_EQ(commands.size(), 4u);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(commands[i].value, i);
+    }
+    EXPECT_EQ(Rp2040::getInstance()->max_in_flight(), 1);
+}
+
+TEST_F(McpServerTest, ProgressIncreasesBeforeTheResult) {
+    client_.Send(SetMultipleAngles(60, 5, 90, "{\"progressToken\":\"p60\"}"));
+    client_.Send(SetMultipleAngles(61, 2, 90, "{\"progressToken\":61}"));
+    ASSERT_TRUE(client_.WaitForIds({60, 61}));
+
+    auto progress = client_.Progress("\"p60\"");
+    ASSERT_EQ(progress.size(), 5u);
+    for (size_t i = 0; i < progress.size(); i++) {
+        auto params = cJSON_GetObjectItem(progress[i], "params");
+        EXPECT_EQ(cJSON_GetObjectItem(params, "progress")->valueint, (int)i);
+        EXPECT_EQ(cJSON_GetObjectItem(params, "total")->valueint, 5);
+        cJSON_Delete(progress[i]);
+    }
+    progress = client_.Progress("61");
+    EXPECT_EQ(progress.size(), 2u);
+    for (auto json : progress) {
+        cJSON_Delete(json);
+    }
+
+    // Every notification went out before the response
+    auto messages = client_.messages();
+    auto replies = client_.Replies();
+    for (auto& reply : replies) {
+        if (reply.json.find("\"id\":60") != std::string::npos) {
+            for (size_t i = reply.message_index + 1; i < messages.size(); i++) {
+                EXPECT_EQ(messages[i].find("\"p60\""), std::string::npos);
+            }
+        }
+    }
+
+    // No token, no notifications
+    client_.Send(SetMultipleAngles(62, 3, 90));
+    ASSERT_TRUE(client_.WaitForIds({62}));
+    EXPECT_EQ(client_.messages().size(), 5u + 2u + 2u + 1u);
+}
+
+TEST_F(McpServerTest, NumericProgressTokensAreNotTruncated) {
+    client_.Send(SetMultipleAngles(63, 1, 90, "{\"progressToken\":4294967296}"));
+    client_.Send(SetMultipleAngles(64, 1, 90, "{\"progressToken\":1.5}"));
+    ASSERT_TRUE(client_.WaitForIds({63, 64}));
+
+    for (auto token : {"4294967296", "1.5"}) {
+        auto progress = client_.Progress(token);
+        EXPECT_EQ(progress.size(), 1u) << token;
+        for (auto json : progress) {
+            cJSON_Delete(json);
+        }
+    }
+}
+
+TEST_F(McpServerTest, CancelStopsARunningCall) {
+    Rp2040::getInstance()->command_time_us = 30000;
+    client_.Send(SetMultipleAngles(70, 8, 45, "{\"progressToken\":\"c70\"}"));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (Rp2040::getInstance()->commands().empty() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    client_.Send(Cancel(70));
+    // Same tool, so it runs after the cancelled call has returned
+    client_.Send(SetMultipleAngles(71, 1, 1));
+    ASSERT_TRUE(client_.WaitForIds({71}));
+
+    EXPECT_EQ(client_.Find(70), nullptr);
+    EXPECT_LT(Rp2040::getInstance()->commands().size(), 8u + 1u);
+    auto progress = client_.Progress("\"c70\"");
+    EXPECT_LT(progress.size(), 8u);
+    for (auto json : progress) {
+        cJSON_Delete(json);
+    }
+}
+
+TEST_F(McpServerTest, CancelledQueuedCallNeverRuns) {
+    Rp2040::getInstance()->command_time_us = 30000;
+    // One tool, so 81 waits in the queue behind 80
+    client_.Send(SetMultipleAngles(80, 3, 10));
+    client_.Send(SetMultipleAngles(81, 1, 99));
+    client_.Send(Cancel(81));
+    client_.Send(SetMultipleAngles(82, 1, 50));
+    ASSERT_TRUE(client_.WaitForIds({80, 82}));
+
+    EXPECT_EQ(client_.Find(81), nullptr);
+    for (auto& command : Rp2040::getInstance()->commands()) {
+        EXPECT_NE(command.value, 99);
+    }
+    // Cancelling something that already answered is ignored
+    client_.Send(Cancel(80));
+}
+
+TEST_F(McpServerTest, ServoToolsNeverOverlap) {
+    Rp2040::getInstance()->command_time_us = 5000;
+    client_.Send("["
+        + SetAngle(30, 3, 10) + ","
+        + SetMultipleAngles(31, 3, 20) + ","
+        + SetAngle(32, 4, 30) + ","
+        + SetMultipleAngles(33, 2, 40)
+        + "]");
+    ASSERT_TRUE(client_.WaitForIds({30, 31, 32, 33}));
+    EXPECT_EQ(Rp2040::getInstance()->commands().size(), 7u);
+    EXPECT_EQ(Rp2040::getInstance()->max_in_flight(), 1);
+}
+
+TEST_F(McpServerTest, MotorToolsNeverOverlap) {
+    Rp2040::getInstance()->command_time_us = 5000;
+    client_.Send("["
+        + ToolCall(40, "self.motor.set_motion", "{\"direction\":\"forward\",\"speed\":100}") + ","
+        + ToolCall(41, "self.motor2.set_motion", "{\"direction\":\"reverse\",\"speed\":120}") + ","
+        + ToolCall(42, "self.motors.set_multiple_motion",
+            "{\"motors\":\"[{\\\"motor_id\\\":1,\\\"direction\\\":\\\"stop\\\"},{\\\"motor_id\\\":2,\\\"direction\\\":\\\"stop\\\"}]\"}") + ","
+        + ToolCall(43, "self.motor.set_motion", "{\"direction\":\"stop\"}")
+        + "]");
+    ASSERT_TRUE(client_.WaitForIds({40, 41, 42, 43}));
+    EXPECT_GE(Rp2040::getInstance()->commands().size(), 8u);
+    EXPECT_EQ(Rp2040::getInstance()->max_in_flight(), 1);
+}
+
+TEST_F(McpServerTest, ToolsInOneGroupNeverOverlap) {
+    Rp2040::getInstance()->command_time_us = 5000;
+    std::vector<int> ids;
+    for (int i = 0; i < 4; i++) {
+        client_.Send(ToolCall(130 + i, i % 2 ? "host.bus_b" : "host.bus_a", "{\"value\":" + std::to_string(i) + "}"));
+        ids.push_back(130 + i);
+    }
+    ASSERT_TRUE(client_.WaitForIds(ids));
+    auto commands = Rp2040::getInstance()->commands();
+    ASSERT_EQ(commands.size(), 4u);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(commands[i].value, i);
+    }
+    EXPECT_EQ(Rp2040::getInstance()->max_in_flight(), 1);
+}
+
+TEST_F(McpServerTest, DifferentGroupsRunSideBySide) {
+    // Checks the fake notices overlapping commands at all
+    Rp2040::getInstance()->command_time_us = 50000;
+    client_.Send(ToolCall(140, "host.bus_a", "{\"value\":1}"));
+    client_.Send(SetAngle(141, 3, 10));
+    ASSERT_TRUE(client_.WaitForIds({140, 141}));
+    EXPECT_EQ(Rp2040::getInstance()->max_in_flight(), 2);
+}
+
+TEST_F(McpServerTest, FullQueueAnswersDeviceBusy) {
+    Rp2040::getInstance()->command_time_us = 20000;
+    const int calls = TOOL_POOL_QUEUE_SIZE + 4;
+    std::vector<int> ids;
+    for (int i = 0; i < calls; i++) {
+        client_.Send(SetAngle(90 + i, 3, i));
+        ids.push_back(90 + i);
+    }
+    ASSERT_TRUE(client_.WaitForIds(ids, 10000));
+
+    int busy = 0;
+    for (int id : ids) {
+        bool is_error = false;
+        auto text = client_.Text(id, &is_error);
+        if (is_error) {
+            EXPECT_EQ(text, "Device busy: too many pending tool calls, retry later");
+            busy++;
+        }
+    }
+    EXPECT_GE(busy, 3);
+    EXPECT_EQ(Rp2040::getInstance()->commands().size(), (size_t)(calls - busy));
+}
+
+TEST_F(McpServerTest, ToolCallStatsCountTheCalls) {
+    client_.Send(ToolCall(120, "self.get_tool_call_stats", "{}"));
+    ASSERT_TRUE(client_.WaitForIds({120}));
+    cJSON* stats = cJSON_Parse(client_.Text(120).c_str());
+    ASSERT_NE(stats, nullptr);
+    EXPECT_NE(cJSON_GetObjectItem(stats, "completed"), nullptr);
+    EXPECT_NE(cJSON_GetObjectItem(stats, "rejected"), nullptr);
+    cJSON_Delete(stats);
+}
+
+TEST_F(McpServerTest, InvalidFrameDurationIsRejected) {
+    client_.Send(ToolCall(130, "self.audio.set_frame_duration", "{\"duration\":25}"));
+    client_.Send(ToolCall(131, "self.audio.set_frame_duration", "{\"duration\":40}"));
+    ASSERT_TRUE(client_.WaitForIds({130, 131}));
+
+    bool is_error = false;
+    EXPECT_EQ(client_.Text(130, &is_error), "Invalid frame duration 25 ms, must be 20, 40 or 60");
+    EXPECT_TRUE(is_error);
+    EXPECT_EQ(client_.Text(131, &is_error), "true");
+    EXPECT_FALSE(is_error);
+    EXPECT_EQ(Application::GetInstance().frame_duration(), 40);
+    Application::GetInstance().SetFrameDuration(OPUS_FRAME_DURATION_MS);
+}
+
+TEST_F(McpServerTest, StackSizeAboveTheLargeWorkerIsRejected) {
+    const std::string call = "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"tools/call\",\"params\":"
+        "{\"name\":\"self.get_tool_call_stats\",\"arguments\":{},\"stackSize\":%d}}";
+    char message[256];
+    snprintf(message, sizeof(message), call.c_str(), 140, TOOL_WORKER_LARGE_STACK_SIZE);
+    client_.Send(message);
+    snprintf(message, sizeof(message), call.c_str(), 141, TOOL_WORKER_LARGE_STACK_SIZE + 1);
+    client_.Send(message);
+    ASSERT_TRUE(client_.WaitForIds({140, 141}));
+
+    bool is_error = false;
+    client_.Text(140, &is_error);
+    EXPECT_FALSE(is_error);
+    EXPECT_EQ(client_.Text(141, &is_error), "stackSize " + std::to_string(TOOL_WORKER_LARGE_STACK_SIZE + 1) + " is not available");
+    EXPECT_TRUE(is_error);
+}
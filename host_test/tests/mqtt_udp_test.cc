@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+#include "mqtt_protocol.h"
+#include "loopback_server.h"
+#include "application.h"
+#include "audio_sink.h"
+
+static AudioStreamPacket MakeFrame(uint32_t index, size_t size = 40) {
+    AudioStreamPacket packet;
+    packet.sample_rate = 16000;
+    packet.frame_duration = 60;
+    packet.timestamp = index * 60;
+    packet.payload.resize(size);
+    for (size_t i = 0; i < size; i++) {
+        packet.payload[i] = (uint8_t)(index * 31 + i);
+    }
+    return packet;
+}
+
+class MqttUdpTest : public testing::Test {
+protected:
+    void Open(const LoopbackServerOptions& options) {
+        server_ = std::make_unique<LoopbackServer>(options);
+        server_->Install();
+        protocol_ = std::make_unique<MqttProtocol>();
+        sink_.Attach(*protocol_);
+        ASSERT_TRUE(protocol_->Start());
+        ASSERT_TRUE(protocol_->OpenAudioChannel());
+        ASSERT_TRUE(protocol_->IsAudioChannelOpened());
+    }
+
+    void TearDown() override {
+        Application::GetInstance().WaitForScheduled();
+        // The protocol unregisters its transports from the server on the way out
+        protocol_.reset();
+        server_.reset();
+    }
+
+    std::unique_ptr<LoopbackServer> server_;
+    std::unique_ptr<MqttProtocol> protocol_;
+    AudioSink sink_;
+};
+
+TEST_F(MqttUdpTest, HelloOffersBurstAndCbor) {
+    Open(LoopbackServerOptions());
+    cJSON* hello = cJSON_Parse(server_->last_hello().c_str());
+    ASSERT_NE(hello, nullptr);
+    auto features = cJSON_GetObjectItem(hello, "features");
+    EXPECT_EQ(cJSON_GetObjectItem(features, "udp_burst")->valueint, AUDIO_MAX_BURST_FRAMES);
+    EXPECT_TRUE(cJSON_IsTrue(cJSON_GetObjectItem(features, "cbor")));
+    EXPECT_TRUE(cJSON_IsTrue(cJSON_GetObjectItem(features, "mcp")));
+    EXPECT_STREQ(cJSON_GetObjectItem(hello, "transport")->valuestring, "udp");
+    cJSON_Delete(hello);
+
+    EXPECT_EQ(protocol_->session_id(), "loopback-1");
+    EXPECT_EQ(protocol_->server_sample_rate(), 24000);
+    // The server did not opt in
+    EXPECT_EQ(protocol_->max_audio_burst(), 1u);
+}
+
+// The hello reply is what refreshes the timeout, OpenAudioChannel must not return before it is recorded
+TEST_F(MqttUdpTest, ChannelIsOpenWhenOpenReturns) {
+    Open(LoopbackServerOptions());
+    for (int i = 0; i < 50; i++) {
+        protocol_->CloseAudioChannel();
+        ASSERT_TRUE(protocol_->OpenAudioChannel());
+        ASSERT_TRUE(protocol_->IsAudioChannelOpened()) << "open " << i;
+    }
+}
+
+TEST_F(MqttUdpTest, UplinkFramesAreEncryptedAndSequenced) {
+    Open(LoopbackServerOptions());
+    for (uint32_t i = 0; i < 5; i++) {
+        ASSERT_TRUE(protocol_->SendAudio(MakeFrame(i, 20 + i * 10)));
+    }
+    ASSERT_TRUE(server_->WaitForAudio(5, 5000));
+    auto audio = server_->audio();
+    for (uint32_t i = 0; i < 5; i++) {
+        EXPECT_EQ(audio[i].sequence, i + 1);
+        EXPECT_EQ(audio[i].timestamp, i * 60);
+        EXPECT_EQ(audio[i].payload, MakeFrame(i, 20 + i * 10).payload);
+    }
+    EXPECT_EQ(server_->datagrams(), 5u);
+    EXPECT_EQ(server_->burst_datagrams(), 0u);
+}
+
+TEST_F(MqttUdpTest, BurstCoalescesFramesIntoFewerDatagrams) {
+    LoopbackServerOptions options;
+    options.udp_burst = AUDIO_MAX_BURST_FRAMES;
+    Open(options);
+    ASSERT_EQ(protocol_->max_audio_burst(), (size_t)AUDIO_MAX_BURST_FRAMES);
+
+    std::vector<AudioStreamPacket> frames;
+    for (uint32_t i = 0; i < 10; i++) {
+        frames.push_back(MakeFrame(i, 30 + i));
+    }
+    ASSERT_TRUE(protocol_->SendAudioBurst(frames.data(), frames.size()));
+    ASSERT_TRUE(protocol_->SendAudio(MakeFrame(10)));
+    ASSERT_TRUE(server_->WaitForAudio(11, 5000));
+
+    // 4 + 4 + 2 frames, then a single frame packet
+    EXPECT_EQ(server_->datagrams(), 4u);
+    EXPECT_EQ(server_->burst_datagrams(), 3u);
+    auto audio = server_->audio();
+    for (uint32_t i = 0; i < 10; i++) {
+        EXPECT_EQ(audio[i].sequence, i + 1);
+        EXPECT_EQ(audio[i].payload, frames[i].payload);
+    }
+    EXPECT_EQ(audio[10].sequence, 11u);
+}
+
+TEST_F(MqttUdpTest, BurstRespectsTheDatagramSize) {
+    LoopbackServerOptions options;
+    options.udp_burst = AUDIO_MAX_BURST_FRAMES;
+    Open(options);
+    std::vector<AudioStreamPacket> frames;
+    for (uint32_t i = 0; i < 4; i++) {
+        frames.push_back(MakeFrame(i, 500));
+    }
+    ASSERT_TRUE(protocol_->SendAudioBurst(frames.data(), frames.size()));
+    ASSERT_TRUE(server_->WaitForAudio(4, 5000));
+    // Two 502 byte entries fit in 1400 bytes with the header, three do not
+    EXPECT_EQ(server_->datagrams(), 2u);
+    for (auto& frame : server_->audio()) {
+        EXPECT_EQ(frame.payload.size(), 500u);
+    }
+}
+
+TEST_F(MqttUdpTest, DownlinkIsDecryptedIntoPooledPackets) {
+    Open(LoopbackServerOptions());
+    for (uint32_t i = 0; i < 3; i++) {
+        server_->SendAudio(i * 60, MakeFrame(i).payload);
+    }
+    ASSERT_TRUE(sink_.Wait(3));
+    auto packets = sink_.packets();
+    for (uint32_t i = 0; i < 3; i++) {
+        EXPECT_EQ(packets[i].sequence, i + 1);
+        EXPECT_EQ(packets[i].timestamp, i * 60);
+        EXPECT_EQ(packets[i].sample_rate, 24000);
+        EXPECT_EQ(packets[i].payload, MakeFrame(i).payload);
+    }
+}
+
+TEST_F(MqttUdpTest, ShortDatagramsAreDropped) {
+    Open(LoopbackServerOptions());
+    server_->SendDatagram(std::string(15, '\x01'));
+    server_->SendAudio(0, MakeFrame(0).payload);
+    ASSERT_TRUE(sink_.Wait(1));
+    server_->link().Flush();
+    auto packets = sink_.packets();
+    ASSERT_EQ(packets.size(), 1u);
+    EXPECT_EQ(packets[0].payload, MakeFrame(0).payload);
+}
+
+TEST_F(MqttUdpTest, LateDatagramsArePassedOn) {
+    Open(LoopbackServerOptions());
+    auto payload = MakeFrame(1).payload;
+    for (uint32_t sequence : {1, 3, 2}) {
+        server_->SendDatagram(server_->EncryptDatagram(sequence, sequence * 60, payload));
+    }
+    ASSERT_TRUE(sink_.Wait(3));
+    auto packets = sink_.packets();
+    // The jitter buffer puts them back in order, the protocol keeps what it got
+    EXPECT_EQ(packets[0].sequence, 1u);
+    EXPECT_EQ(packets[1].sequence, 3u);
+    EXPECT_EQ(packets[2].sequence, 2u);
+}
+
+TEST_F(MqttUdpTest, ReorderedAndDuplicatedDatagramsAreCounted) {
+    Open(LoopbackServerOptions());
+    auto payload = MakeFrame(1).payload;
+    for (uint32_t sequence : {1, 3, 2, 3, 6, 5}) {
+        server_->SendDatagram(server_->EncryptDatagram(sequence, sequence * 60, payload));
+    }
+    ASSERT_TRUE(sink_.Wait(5));
+    server_->link().Flush();
+    AudioStreamStats stats;
+    ASSERT_TRUE(protocol_->GetAudioStreamStats(stats));
+    EXPECT_EQ(stats.received, 5u);
+    EXPECT_EQ(stats.duplicated, 1u);
+    EXPECT_EQ(stats.reordered, 2u);
+    EXPECT_EQ(stats.lost, 1u);
+    EXPECT_EQ(sink_.packets().size(), 5u);
+}
+
+TEST_F(MqttUdpTest, CborControlMessagesWhenAccepted) {
+    LoopbackServerOptions options;
+    options.cbor = true;
+    Open(options);
+    protocol_->SendStartListening(kListeningModeAutoStop);
+    ASSERT_TRUE(server_->WaitForMessage("listen", 5000));
+    EXPECT_EQ(server_->cbor_messages(), 1u);
+    EXPECT_EQ(server_->messages().back(), R"({"session_id":"loopback-1","type":"listen","state":"start","mode":"auto"})");
+}
+
+TEST_F(MqttUdpTest, ReopenResumesTheSession) {
+    Open(LoopbackServerOptions());
+    protocol_->CloseAudioChannel();
+    ASSERT_TRUE(server_->WaitForMessage("goodbye", 5000));
+    ASSERT_TRUE(protocol_->OpenAudioChannel());
+    EXPECT_NE(server_->last_hello().find(R"("resume_session_id":"loopback-1")"), std::string::npos);
+    EXPECT_EQ(protocol_->session_id(), "loopback-1");
+    // The MQTT connection stays up between channels
+    EXPECT_EQ(server_->connects(), 1u);
+}
+
+TEST_F(MqttUdpTest, ServerGoodbyeClosesTheChannel) {
+    Open(LoopbackServerOptions());
+    std::atomic<bool> closed{false};
+    protocol_->OnAudioChannelClosed([&closed]() { closed = true; });
+    server_->SendText(R"({"type":"goodbye","session_id":"loopback-1"})");
+    server_->link().Flush();
+    Application::GetInstance().WaitForScheduled();
+    EXPECT_TRUE(closed);
+    EXPECT_FALSE(protocol_->IsAudioChannelOpened());
+}
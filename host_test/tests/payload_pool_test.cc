@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include "audio_payload_pool.h"
+#include "jitter_buffer.h"
+#include "alloc_counter.h"
+
+static AudioStreamPacket MakePacket(uint32_t sequence, size_t size) {
+    AudioStreamPacket packet;
+    packet.sample_rate = 24000;
+    packet.frame_duration = 60;
+    packet.sequence = sequence;
+    packet.payload = AudioPayloadPool::GetInstance().Acquire(size);
+    packet.payload[0] = (uint8_t)sequence;
+    return packet;
+}
+
+TEST(AudioPayloadPool, ReusesReleasedBlocks) {
+    auto& pool = AudioPayloadPool::GetInstance();
+    auto payload = pool.Acquire(100);
+    EXPECT_EQ(payload.size(), 100u);
+    EXPECT_EQ(payload.capacity(), (size_t)AUDIO_PAYLOAD_BLOCK_SIZE);
+    auto data = payload.data();
+    pool.Release(std::move(payload));
+
+    uint32_t hits = pool.hits();
+    auto again = pool.Acquire(300);
+    EXPECT_EQ(pool.hits(), hits + 1);
+    EXPECT_EQ(again.data(), data);
+    EXPECT_EQ(again.size(), 300u);
+    pool.Release(std::move(again));
+}
+
+TEST(AudioPayloadPool, OversizedBuffersAreNotKept) {
+    auto& pool = AudioPayloadPool::GetInstance();
+    uint32_t misses = pool.misses();
+    auto before = AllocCounter::Snapshot();
+    auto big = pool.Acquire(AUDIO_PAYLOAD_BLOCK_SIZE + 1);
+    EXPECT_EQ(pool.misses(), misses + 1);
+    EXPECT_EQ((AllocCounter::Snapshot() - before).count, 1u);
+    EXPECT_EQ(big.size(), (size_t)AUDIO_PAYLOAD_BLOCK_SIZE + 1);
+    pool.Release(std::move(big));
+
+    std::vector<uint8_t> foreign(64);
+    pool.Release(std::move(foreign));
+    auto block = pool.Acquire(64);
+    EXPECT_EQ(block.capacity(), (size_t)AUDIO_PAYLOAD_BLOCK_SIZE);
+    pool.Release(std::move(block));
+}
+
+// The receive -> jitter buffer -> decode -> release cycle of a long reply, with
+// reordering and a lost frame now and then; once warm it must not touch the heap
+TEST(AudioPayloadPool, TenThousandPacketsWithoutAllocations) {
+    auto& pool = AudioPayloadPool::GetInstance();
+    JitterBuffer jitter_buffer(16);
+    const int kWarmup = 200;
+    const int kPackets = 10000;
+    int64_t now_ms = 0;
+    uint32_t sequence = 1;
+    int played = 0;
+
+    auto run = [&](int packets) {
+        for (int i = 0; i < packets; i++, sequence++) {
+            now_ms += 60;
+            // Swap every 7th pair, drop every 50th packet
+            uint32_t send_sequence = sequence;
+            if (sequence % 7 == 0) {
+                send_sequence = sequence + 1;
+            } else if (sequence % 7 == 1 && sequence > 1) {
+                send_sequence = sequence - 1;
+            }
+            if (send_sequence % 50 != 0) {
+                auto packet = MakePacket(send_sequence, 120 + send_sequence % 200);
+                if (!jitter_buffer.Put(std::move(packet), now_ms)) {
+                    pool.Release(std::move(packet.payload));
+                }
+            }
+            AudioStreamPacket out;
+            auto result = jitter_buffer.Get(out, now_ms);
+            if (result == kJitterBufferPacket) {
+                played++;
+                pool.Release(std::move(out.payload));
+            }
+        }
+    };
+
+    run(kWarmup);
+    auto before = AllocCounter::Snapshot();
+    uint32_t misses = pool.misses();
+    run(kPackets);
+    auto delta = AllocCounter::Snapshot() - before;
+
+    EXPECT_EQ(delta.count, 0u) << delta.bytes << " bytes allocated";
+    EXPECT_EQ(pool.misses(), misses);
+    auto stats = jitter_buffer.GetStats();
+    EXPECT_GT(played, kPackets * 9 / 10);
+    EXPECT_GT(stats.concealed, 0u);
+
+    AudioStreamPacket left;
+    while (jitter_buffer.Drain(left)) {
+        pool.Release(std::move(left.payload));
+    }
+}
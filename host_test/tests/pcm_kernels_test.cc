@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "pcm_kernels.h"
+
+// One 20 ms block at each output rate, plus odd sizes for the scalar tails
+static const size_t kFrameCounts[] = {0, 1, 3, 320, 480, 960, 961};
+
+static std::vector<int16_t> RandomPcm(size_t samples, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> sample(INT16_MIN, INT16_MAX);
+    std::vector<int16_t> pcm(samples);
+    for (auto& s : pcm) {
+        s = (int16_t)sample(random);
+    }
+    return pcm;
+}
+
+TEST(PcmKernels, DeinterleaveMatchesTheNaiveLoop) {
+    for (size_t frames : kFrameCounts) {
+        // Offset 1 makes every buffer misaligned and takes the scalar path
+        for (size_t offset : {0, 1}) {
+            auto input = RandomPcm(frames * 2 + 1, frames);
+            std::vector<int16_t> left(frames + 1), right(frames + 1);
+            PcmDeinterleaveStereo(input.data() + offset, left.data() + offset, right.data() + offset, frames);
+            for (size_t i = 0; i < frames; i++) {
+                ASSERT_EQ(left[i + offset], input[offset + i * 2]) << frames << " frames, index " << i;
+                ASSERT_EQ(right[i + offset], input[offset + i * 2 + 1]) << frames << " frames, index " << i;
+            }
+        }
+    }
+}
+
+TEST(PcmKernels, InterleaveInvertsDeinterleave) {
+    for (size_t frames : kFrameCounts) {
+        for (size_t offset : {0, 1}) {
+            auto left = RandomPcm(frames + 1, 1);
+            auto right = RandomPcm(frames + 1, 2);
+            std::vector<int16_t> output(frames * 2 + 1);
+            PcmInterleaveStereo(left.data() + offset, right.data() + offset, output.data() + offset, frames);
+            for (size_t i = 0; i < frames; i++) {
+                ASSERT_EQ(output[offset + i * 2], left[offset + i]);
+                ASSERT_EQ(output[offset + i * 2 + 1], right[offset + i]);
+            }
+            std::vector<int16_t> l(frames + 1), r(frames + 1);
+            PcmDeinterleaveStereo(output.data() + offset, l.data() + offset, r.data() + offset, frames);
+            EXPECT_TRUE(std::equal(l.begin() + offset, l.begin() + offset + frames, left.begin() + offset));
+            EXPECT_TRUE(std::equal(r.begin() + offset, r.begin() + offset + frames, right.begin() + offset));
+        }
+    }
+}
+
+TEST(PcmKernels, ConstantGainMatchesTheNaiveLoop) {
+    auto input = RandomPcm(960, 3);
+    input[0] = INT16_MIN;
+    input[1] = INT16_MAX;
+    std::vector<int32_t> output(input.size());
+    for (int32_t gain : {0, 1, 32768, PCM_GAIN_UNITY}) {
+        PcmApplyGainQ31(input.data(), output.data(), input.size(), gain, gain);
+        for (size_t i = 0; i < input.size(); i++) {
+            ASSERT_EQ(output[i], (int32_t)((int64_t)input[i] * gain));
+        }
+    }
+}
+
+TEST(PcmKernels, GainRampEndsOnTheTargetAndIsMonotonic) {
+    std::vector<int16_t> input(480, 1000);
+    std::vector<int32_t> output(input.size());
+    PcmApplyGainQ31(input.data(), output.data(), input.size(), 0, PCM_GAIN_UNITY);
+    for (size_t i = 1; i < output.size(); i++) {
+        ASSERT_GE(output[i], output[i - 1]);
+    }
+    EXPECT_NEAR(output.back(), 1000 * PCM_GAIN_UNITY, 1000);
+    EXPECT_LT(output.front(), 1000 * PCM_GAIN_UNITY / 100);
+
+    PcmApplyGainQ31(input.data(), output.data(), input.size(), PCM_GAIN_UNITY, 0);
+    for (size_t i = 1; i < output.size(); i++) {
+        ASSERT_LE(output[i], output[i - 1]);
+    }
+    EXPECT_NEAR(output.back(), 0, 1000);
+}
+
+TEST(PcmKernels, ConversionSaturates) {
+    std::vector<int32_t> input = {0, 65536, -65536, INT32_MAX, INT32_MIN, 32767 << 16, -32768 << 16};
+    std::vector<int16_t> output(input.size());
+    PcmConvertQ31ToQ15(input.data(), output.data(), input.size(), 16);
+    EXPECT_EQ(output, (std::vector<int16_t>{0, 1, -1, INT16_MAX, -INT16_MAX, INT16_MAX, -INT16_MAX}));
+
+    // Unity gain then the Q16 shift gives the input back, apart from -32768
+    auto pcm = RandomPcm(960, 4);
+    std::vector<int32_t> scaled(pcm.size());
+    std::vector<int16_t> back(pcm.size());
+    PcmApplyGainQ31(pcm.data(), scaled.data(), pcm.size(), PCM_GAIN_UNITY, PCM_GAIN_UNITY);
+    PcmConvertQ31ToQ15(scaled.data(), back.data(), pcm.size(), 16);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        ASSERT_EQ(back[i], std::max<int16_t>(pcm[i], -INT16_MAX));
+    }
+}
@@ -0,0 +1,201 @@
+#include <gtest/gtest.h>
+
+#include "loopback_protocol.h"
+#include "cbor.h"
+
+static std::string CborText(const std::vector<uint8_t>& cbor) {
+    cJSON* root = CborToJson(cbor.data(), cbor.size());
+    if (root == nullptr) {
+        return "";
+    }
+    char* json = cJSON_PrintUnformatted(root);
+    std::string text(json);
+    cJSON_free(json);
+    cJSON_Delete(root);
+    return text;
+}
+
+TEST(Protocol, ControlMessagesAreJsonUnlessTheServerAcceptsCbor) {
+    LoopbackProtocol protocol;
+    protocol.ReceiveHello(R"({"type":"hello","session_id":"s1"})");
+    protocol.SendStartListening(kListeningModeAutoStop);
+    protocol.SendAbortSpeaking(kAbortReasonNone);
+    EXPECT_TRUE(protocol.cbor_messages().empty());
+    EXPECT_EQ(protocol.texts(), (std::vector<std::string>{
+        R"({"session_id":"s1","type":"listen","state":"start","mode":"auto"})",
+        R"({"session_id":"s1","type":"abort"})"}));
+}
+
+TEST(Protocol, CborCarriesTheSameFields) {
+    LoopbackProtocol protocol;
+    protocol.ReceiveHello(R"({"type":"hello","session_id":"s2","features":{"cbor":true}})");
+    protocol.SendWakeWordDetected("你好小智");
+    protocol.SendStartListening(kListeningModeRealtime);
+    protocol.SendStopListening();
+    protocol.SendAbortSpeaking(kAbortReasonWakeWordDetected);
+    EXPECT_TRUE(protocol.texts().empty());
+    auto cbor = protocol.cbor_messages();
+    ASSERT_EQ(cbor.size(), 4u);
+    EXPECT_EQ(CborText(cbor[0]), R"({"session_id":"s2","type":"listen","state":"detect","text":"你好小智"})");
+    EXPECT_EQ(CborText(cbor[1]), R"({"session_id":"s2","type":"listen","state":"start","mode":"realtime"})");
+    EXPECT_EQ(CborText(cbor[2]), R"({"session_id":"s2","type":"listen","state":"stop"})");
+    EXPECT_EQ(CborText(cbor[3]), R"({"session_id":"s2","type":"abort","reason":"wake_word_detected"})");
+}
+
+TEST(Protocol, FailedCborFallsBackToJson) {
+    LoopbackProtocol protocol;
+    protocol.ReceiveHello(R"({"type":"hello","session_id":"s3","features":{"cbor":true}})");
+    protocol.set_fail_cbor(true);
+    protocol.SendStopListening();
+    protocol.SendAbortSpeaking(kAbortReasonNone);
+    protocol.SendWakeWordDetected("hi");
+    EXPECT_EQ(protocol.texts(), (std::vector<std::string>{
+        R"({"session_id":"s3","type":"listen","state":"stop"})",
+        R"({"session_id":"s3","type":"abort"})",
+        R"({"session_id":"s3","type":"listen","state":"detect","text":"hi"})"}));
+}
+
+TEST(Protocol, TooLongCborFallsBackToJson) {
+    LoopbackProtocol protocol;
+    protocol.ReceiveHello(R"({"type":"hello","session_id":"s4","features":{"cbor":true}})");
+    std::string wake_word(300, 'a');
+    protocol.SendWakeWordDetected(wake_word);
+    EXPECT_TRUE(protocol.cbor_messages().empty());
+    ASSERT_EQ(protocol.texts().size(), 1u);
+    EXPECT_NE(protocol.texts()[0].find(wake_word), std::string::npos);
+}
+
+TEST(Protocol, ChatMessagesSkipTheJsonTree) {
+    LoopbackProtocol protocol;
+    std::vector<std::string> chats;
+    std::vector<std::string> others;
+    protocol.OnIncomingChat([&chats](ChatMessage&& message) {
+        chats.push_back(std::string(message.type) + "/" + std::string(message.state) + "/" + message.text);
+    });
+    protocol.OnIncomingJson([&others](const cJSON* root) {
+        others.push_back(cJSON_GetObjectItem(root, "type")->valuestring);
+    });
+    protocol.Receive(R"({"type":"tts","state":"sentence_start","text":"今天\n天气"})");
+    protocol.Receive(R"({"type":"stt","text":"hi"})");
+    protocol.Receive(R"({"type":"llm","emotion":"happy","text":"😀"})");
+    protocol.Receive(R"({"type":"mcp","payload":{}})");
+    protocol.Receive(R"({"type":"iot","commands":[]})");
+    EXPECT_EQ(chats, (std::vector<std::string>{"tts/sentence_start/今天\n天气", "stt//hi", "llm//😀"}));
+    EXPECT_EQ(others, (std::vector<std::string>{"mcp", "iot"}));
+}
+
+TEST(Protocol, CborChatMessagesSkipTheJsonTree) {
+    LoopbackProtocol protocol;
+    std::vector<std::string> chats;
+    std::vector<std::string> others;
+    protocol.OnIncomingChat([&chats](ChatMessage&& message) {
+        chats.push_back(std::string(message.type) + "/" + std::string(message.state) + "/" + message.text +
+            "/" + message.emotion);
+    });
+    protocol.OnIncomingJson([&others](const cJSON* root) {
+        others.push_back(cJSON_GetObjectItem(root, "type")->valuestring);
+    });
+
+    uint8_t buffer[128];
+    CborWriter tts(buffer, sizeof(buffer));
+    tts.Map(4);
+    tts.Text("session_id");
+    tts.Text("s5");
+    // Fields the dispatch does not use are skipped, containers included
+    tts.Text("extra");
+    tts.Map(2);
+    tts.Text("list");
+    tts.Array(2);
+    tts.Int(1);
+    tts.Text("two");
+    tts.Text("flag");
+    tts.Bool(true);
+    tts.Text("type");
+    tts.Text("tts");
+    tts.Text("text");
+    tts.Text("今天天气");
+    ASSERT_TRUE(tts.ok());
+    std::vector<uint8_t> tts_bytes(tts.data(), tts.data() + tts.size());
+    protocol.ReceiveCbor(tts_bytes.data(), tts_bytes.size());
+
+    CborWriter llm(buffer, sizeof(buffer));
+    llm.Map(2);
+    llm.Text("emotion");
+    llm.Text("happy");
+    llm.Text("type");
+    llm.Text("llm");
+    protocol.ReceiveCbor(llm.data(), llm.size());
+
+    CborWriter mcp(buffer, sizeof(buffer));
+    mcp.Map(2);
+    mcp.Text("type");
+    mcp.Text("mcp");
+    mcp.Text("payload");
+    mcp.Map(0);
+    protocol.ReceiveCbor(mcp.data(), mcp.size());
+
+    // Cut inside the nested map
+    protocol.ReceiveCbor(tts_bytes.data(), 20);
+    EXPECT_EQ(chats, (std::vector<std::string>{"tts//今天天气/", "llm///happy"}));
+    EXPECT_EQ(others, (std::vector<std::string>{"mcp"}));
+}
+
+TEST(Protocol, ListenStartsAreTaggedWithTheTurn) {
+    LoopbackProtocol protocol;
+    protocol.ReceiveHello(R"({"type":"hello","session_id":"s6"})");
+    EXPECT_FALSE(protocol.turns_enabled());
+    protocol.SendStartListening(kListeningModeAutoStop);
+    EXPECT_EQ(protocol.listen_turn(), 1u);
+
+    protocol.ReceiveHello(R"({"type":"hello","session_id":"s6","features":{"turn":true}})");
+    EXPECT_TRUE(protocol.turns_enabled());
+    protocol.SendStartListening(kListeningModeAutoStop);
+    protocol.ReceiveHello(R"({"type":"hello","session_id":"s6","features":{"turn":true,"cbor":true}})");
+    protocol.SendStartListening(kListeningModeManualStop);
+    EXPECT_EQ(protocol.texts(), (std::vector<std::string>{
+        R"({"session_id":"s6","type":"listen","state":"start","mode":"auto"})",
+        R"({"session_id":"s6","type":"listen","state":"start","mode":"auto","turn":2})"}));
+    ASSERT_EQ(protocol.cbor_messages().size(), 1u);
+    EXPECT_EQ(CborText(protocol.cbor_messages()[0]),
+        R"({"session_id":"s6","type":"listen","state":"start","mode":"manual","turn":3})");
+}
+
+TEST(Protocol, ChatMessagesCarryTheirTurn) {
+    LoopbackProtocol protocol;
+    std::vector<uint32_t> turns;
+    protocol.OnIncomingChat([&turns](ChatMessage&& message) {
+        turns.push_back(message.turn);
+    });
+    protocol.Receive(R"({"type":"tts","state":"start","turn":7})");
+    protocol.Receive(R"({"type":"stt","text":"hi"})");
+    protocol.Receive(R"({"type":"llm","turn":1.5,"emotion":"happy"})");
+
+    uint8_t buffer[64];
+    CborWriter tts(buffer, sizeof(buffer));
+    tts.Map(3);
+    tts.Text("type");
+    tts.Text("tts");
+    tts.Text("turn");
+    tts.Int(9);
+    tts.Text("state");
+    tts.Text("stop");
+    protocol.ReceiveCbor(tts.data(), tts.size());
+    EXPECT_EQ(turns, (std::vector<uint32_t>{7, 0, 0, 9}));
+}
+
+TEST(Protocol, AudioBurstFallsBackToSingleFrames) {
+    LoopbackProtocol protocol;
+    EXPECT_EQ(protocol.max_audio_burst(), 1u);
+    ASSERT_TRUE(protocol.OpenAudioChannel());
+    AudioStreamPacket packets[3];
+    for (int i = 0; i < 3; i++) {
+        packets[i].timestamp = i;
+        packets[i].payload.assign(10, (uint8_t)i);
+    }
+    EXPECT_TRUE(protocol.SendAudioBurst(packets, 3));
+    auto audio = protocol.audio();
+    ASSERT_EQ(audio.size(), 3u);
+    EXPECT_EQ(audio[2].payload[0], 2);
+    AudioStreamStats stats;
+    EXPECT_FALSE(protocol.GetAudioStreamStats(stats));
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include "sequence_tracker.h"
+
+TEST(SequenceTracker, CountsLossAndTakesItBackWhenThePacketShowsUp) {
+    SequenceTracker tracker;
+    EXPECT_TRUE(tracker.Update(1, 60, 60));
+    EXPECT_TRUE(tracker.Update(2, 120, 60));
+    EXPECT_TRUE(tracker.Update(5, 300, 60));
+    EXPECT_EQ(tracker.stats().lost, 2u);
+
+    EXPECT_TRUE(tracker.Update(3, 310, 60));
+    auto stats = tracker.stats();
+    EXPECT_EQ(stats.lost, 1u);
+    EXPECT_EQ(stats.reordered, 1u);
+    EXPECT_EQ(stats.received, 4u);
+}
+
+TEST(SequenceTracker, RejectsDuplicatesInsideTheWindow) {
+    SequenceTracker tracker;
+    for (uint32_t s = 1; s <= 10; s++) {
+        tracker.Update(s, s * 60, 60);
+    }
+    EXPECT_FALSE(tracker.Update(10, 620, 60));
+    EXPECT_FALSE(tracker.Update(4, 630, 60));
+    auto stats = tracker.stats();
+    EXPECT_EQ(stats.duplicated, 2u);
+    EXPECT_EQ(stats.received, 10u);
+    EXPECT_EQ(stats.lost, 0u);
+}
+
+TEST(SequenceTracker, ReorderedTraceEndsWithoutLoss) {
+    SequenceTracker tracker;
+    // Every pair swapped
+    uint32_t order[] = {2, 1, 4, 3, 6, 5, 8, 7, 10, 9};
+    int64_t time = 0;
+    for (auto s : order) {
+        time += 60;
+        EXPECT_TRUE(tracker.Update(s, time, 60));
+    }
+    auto stats = tracker.stats();
+    EXPECT_EQ(stats.received, 10u);
+    EXPECT_EQ(stats.lost, 0u);
+    EXPECT_EQ(stats.reordered, 5u);
+}
+
+TEST(SequenceTracker, JitterFollowsIrregularArrivals) {
+    SequenceTracker tracker;
+    int64_t time = 0;
+    for (uint32_t s = 1; s <= 200; s++) {
+        time += (s % 2) ? 30 : 90;
+        tracker.Update(s, time, 60);
+    }
+    // |D| is 30 ms on every packet, the estimator converges to it
+    EXPECT_NEAR(tracker.stats().jitter_ms, 30, 2);
+
+    tracker.Reset();
+    EXPECT_EQ(tracker.stats().received, 0u);
+    EXPECT_EQ(tracker.stats().jitter_ms, 0);
+}
+
+TEST(SequenceTracker, PacketsBehindTheWindowAreLate) {
+    SequenceTracker tracker;
+    tracker.Update(1, 60, 60);
+    tracker.Update(3, 180, 60);
+    for (uint32_t s = 4; s <= SEQUENCE_TRACKER_WINDOW + 3; s++) {
+        tracker.Update(s, s * 60, 60);
+    }
+    EXPECT_EQ(tracker.stats().lost, 1u);
+
+    // Sequence 2 may be the lost one or a duplicate of 1 shifted out of the window, neither is knowable
+    EXPECT_FALSE(tracker.Update(2, 3000, 60));
+    EXPECT_FALSE(tracker.Update(1, 3010, 60));
+    auto stats = tracker.stats();
+    EXPECT_EQ(stats.lost, 1u);
+    EXPECT_EQ(stats.late, 2u);
+    EXPECT_EQ(stats.reordered, 0u);
+    EXPECT_EQ(stats.received, SEQUENCE_TRACKER_WINDOW + 2);
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "session_recorder.h"
+
+struct Record {
+    uint64_t time_us;
+    uint8_t direction;
+    uint8_t kind;
+    uint32_t timestamp;
+    std::string payload;
+};
+
+// Parses the layout documented in session_recorder.h, the same way session_replay.py does
+static bool ReadRecords(std::vector<Record>& records) {
+    FILE* file = fopen(HOST_SESSION_RECORDER_PATH, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    char magic[8];
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, "XZSREC01", 8) == 0;
+    uint8_t header[20];
+    while (ok && fread(header, 1, sizeof(header), file) == sizeof(header)) {
+        Record record;
+        memcpy(&record.time_us, header, 8);
+        record.direction = header[8];
+        record.kind = header[9];
+        memcpy(&record.timestamp, header + 12, 4);
+        uint32_t size;
+        memcpy(&size, header + 16, 4);
+        record.payload.resize(size);
+        if (size > 0 && fread(&record.payload[0], 1, size, file) != size) {
+            ok = false;
+            break;
+        }
+        records.push_back(std::move(record));
+    }
+    fclose(file);
+    return ok;
+}
+
+TEST(SessionRecorder, WritesTheDocumentedLayout) {
+    auto& recorder = SessionRecorder::GetInstance();
+    recorder.Record(kSessionRecordOut, kSessionRecordOpen, "udp", 3);
+    std::string hello = R"({"type":"hello","session_id":"s1"})";
+    recorder.Record(kSessionRecordIn, kSessionRecordText, hello.data(), hello.size());
+    const uint8_t opus[] = {0xf8, 0xff, 0xfe};
+    recorder.Record(kSessionRecordOut, kSessionRecordAudio, opus, sizeof(opus), 120);
+    recorder.Flush();
+
+    std::vector<Record> records;
+    ASSERT_TRUE(ReadRecords(records));
+    ASSERT_GE(records.size(), 3u);
+    auto* last = &records[records.size() - 3];
+    EXPECT_EQ(last[0].direction, kSessionRecordOut);
+    EXPECT_EQ(last[0].kind, kSessionRecordOpen);
+    EXPECT_EQ(last[0].payload, "udp");
+    EXPECT_EQ(last[1].direction, kSessionRecordIn);
+    EXPECT_EQ(last[1].kind, kSessionRecordText);
+    EXPECT_EQ(last[1].payload, hello);
+    EXPECT_EQ(last[2].kind, kSessionRecordAudio);
+    EXPECT_EQ(last[2].timestamp, 120u);
+    EXPECT_EQ(last[2].payload, std::string((const char*)opus, sizeof(opus)));
+    EXPECT_LE(last[0].time_us, last[1].time_us);
+    EXPECT_LE(last[1].time_us, last[2].time_us);
+}
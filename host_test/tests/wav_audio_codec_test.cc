@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+#include "wav_audio_codec.h"
+
+static std::vector<int16_t> Ramp(size_t samples) {
+    std::vector<int16_t> pcm(samples);
+    for (size_t i = 0; i < samples; i++) {
+        pcm[i] = (int16_t)(i * 37 - 16000);
+    }
+    return pcm;
+}
+
+TEST(WavAudioCodec, MicrophonePlaysTheInputThenSilence) {
+    WavAudioCodec codec(16000, 24000);
+    codec.SetInput(Ramp(500));
+    std::vector<int16_t> pcm(320);
+    ASSERT_TRUE(codec.InputData(pcm));
+    EXPECT_EQ(pcm[0], -16000);
+    EXPECT_EQ(pcm[319], (int16_t)(319 * 37 - 16000));
+    EXPECT_FALSE(codec.input_finished());
+
+    ASSERT_TRUE(codec.InputData(pcm));
+    EXPECT_TRUE(codec.input_finished());
+    EXPECT_EQ(pcm[179], (int16_t)(499 * 37 - 16000));
+    EXPECT_EQ(pcm[180], 0);
+    EXPECT_EQ(codec.input_position(), 500u);
+}
+
+TEST(WavAudioCodec, SpeakerOutputRoundTripsThroughAFile) {
+    auto path = testing::TempDir() + "wav_audio_codec_output.wav";
+    WavAudioCodec codec(16000, 24000);
+    codec.EnableOutput(true);
+    auto first = Ramp(1440);
+    auto second = Ramp(480);
+    codec.OutputData(first);
+    codec.OutputData(second);
+    ASSERT_EQ(codec.output().size(), 1920u);
+    ASSERT_TRUE(codec.SaveOutput(path));
+
+    std::vector<int16_t> samples;
+    int sample_rate = 0;
+    ASSERT_TRUE(ReadWavFile(path, samples, sample_rate));
+    EXPECT_EQ(sample_rate, 24000);
+    EXPECT_EQ(samples, codec.output());
+
+    // The same file as microphone input
+    WavAudioCodec reader(24000, 24000);
+    ASSERT_TRUE(reader.LoadInput(path));
+    std::vector<int16_t> pcm(1920);
+    ASSERT_TRUE(reader.InputData(pcm));
+    EXPECT_EQ(pcm, samples);
+    std::remove(path.c_str());
+}
+
+TEST(WavAudioCodec, RejectsFilesThatAreNotPcm) {
+    auto path = testing::TempDir() + "wav_audio_codec_bad.wav";
+    FILE* file = fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    fputs("RIFF\x10\0\0\0WAVEjunk", file);
+    fclose(file);
+
+    std::vector<int16_t> samples;
+    int sample_rate = 0;
+    EXPECT_FALSE(ReadWavFile(path, samples, sample_rate));
+    std::remove(path.c_str());
+}
@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <cstring>
+
+#include "websocket_protocol.h"
+#include "loopback_server.h"
+#include "cbor.h"
+#include "audio_sink.h"
+
+static std::vector<uint8_t> Payload(uint32_t index, size_t size = 32) {
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; i++) {
+        payload[i] = (uint8_t)(index * 17 + i);
+    }
+    return payload;
+}
+
+// Runs each case over the three binary framings
+class WebsocketTest : public testing::TestWithParam<int> {
+protected:
+    void Open(LoopbackServerOptions options = LoopbackServerOptions()) {
+        server_ = std::make_unique<LoopbackServer>(options);
+        server_->Install(GetParam());
+        protocol_ = std::make_unique<WebsocketProtocol>();
+        sink_.Attach(*protocol_);
+        ASSERT_TRUE(protocol_->Start());
+        ASSERT_TRUE(protocol_->OpenAudioChannel());
+        ASSERT_TRUE(protocol_->IsAudioChannelOpened());
+    }
+
+    void TearDown() override {
+        protocol_.reset();
+        server_.reset();
+    }
+
+    std::unique_ptr<LoopbackServer> server_;
+    std::unique_ptr<WebsocketProtocol> protocol_;
+    AudioSink sink_;
+};
+
+TEST_P(WebsocketTest, HelloNamesTheVersion) {
+    Open();
+    cJSON* hello = cJSON_Parse(server_->last_hello().c_str());
+    ASSERT_NE(hello, nullptr);
+    EXPECT_EQ(cJSON_GetObjectItem(hello, "version")->valueint, GetParam());
+    EXPECT_STREQ(cJSON_GetObjectItem(hello, "transport")->valuestring, "websocket");
+    // Version 1 cannot tell CBOR from audio, it does not offer it
+    auto features = cJSON_GetObjectItem(hello, "features");
+    EXPECT_EQ(cJSON_IsTrue(cJSON_GetObjectItem(features, "cbor")), GetParam() >= 2);
+    cJSON_Delete(hello);
+    EXPECT_EQ(protocol_->session_id(), "loopback-1");
+}
+
+// The hello reply is what refreshes the timeout, OpenAudioChannel must not return before it is recorded
+TEST_P(WebsocketTest, ChannelIsOpenWhenOpenReturns) {
+    Open();
+    for (int i = 0; i < 50; i++) {
+        protocol_->CloseAudioChannel();
+        ASSERT_TRUE(protocol_->OpenAudioChannel());
+        ASSERT_TRUE(protocol_->IsAudioChannelOpened()) << "open " << i;
+    }
+}
+
+TEST_P(WebsocketTest, AudioRoundTripsThroughTheFraming) {
+    LoopbackServerOptions options;
+    options.echo_audio = true;
+    Open(options);
+    for (uint32_t i = 0; i < 5; i++) {
+        AudioStreamPacket packet;
+        packet.timestamp = 1000 + i * 60;
+        packet.payload = Payload(i, 10 + i);
+        ASSERT_TRUE(protocol_->SendAudio(packet));
+    }
+    ASSERT_TRUE(server_->WaitForAudio(5, 5000));
+    ASSERT_TRUE(sink_.Wait(5));
+    auto uplink = server_->audio();
+    auto downlink = sink_.packets();
+    for (uint32_t i = 0; i < 5; i++) {
+        EXPECT_EQ(uplink[i].payload, Payload(i, 10 + i));
+        EXPECT_EQ(downlink[i].payload, Payload(i, 10 + i));
+        // Only version 2 carries the timestamp
+        EXPECT_EQ(downlink[i].timestamp, GetParam() == 2 ? 1000 + i * 60 : 0);
+        EXPECT_EQ(downlink[i].sample_rate, 24000);
+    }
+}
+
+TEST_P(WebsocketTest, ControlMessagesUseCborWhenTheFramingAllows) {
+    LoopbackServerOptions options;
+    options.cbor = true;
+    Open(options);
+    protocol_->SendStopListening();
+    ASSERT_TRUE(server_->WaitForMessage("listen", 5000));
+    EXPECT_EQ(server_->cbor_messages(), GetParam() >= 2 ? 1u : 0u);
+    EXPECT_EQ(server_->messages().back(), R"({"session_id":"loopback-1","type":"listen","state":"stop"})");
+}
+
+TEST_P(WebsocketTest, TruncatedFramesAreDropped) {
+    Open();
+    auto payload = Payload(1, 40);
+    std::string frame;
+    if (GetParam() == 2) {
+        frame.resize(sizeof(BinaryProtocol2) + payload.size());
+        auto bp2 = (BinaryProtocol2*)&frame[0];
+        bp2->version = htons(2);
+        bp2->type = 0;
+        bp2->reserved = 0;
+        bp2->timestamp = 0;
+        bp2->payload_size = htonl(payload.size());
+        memcpy(bp2->payload, payload.data(), payload.size());
+    } else if (GetParam() == 3) {
+        frame.resize(sizeof(BinaryProtocol3) + payload.size());
+        auto bp3 = (BinaryProtocol3*)&frame[0];
+        bp3->type = 0;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(payload.size());
+        memcpy(bp3->payload, payload.data(), payload.size());
+    } else {
+        GTEST_SKIP() << "Version 1 frames have no header";
+    }
+    // The header claims more payload than the frame carries, and a frame too short for the header
+    server_->SendWebSocketFrame(frame.substr(0, frame.size() - 1));
+    server_->SendWebSocketFrame(frame.substr(0, 3));
+    server_->SendWebSocketFrame(frame);
+    ASSERT_TRUE(sink_.Wait(1));
+    server_->link().Flush();
+    auto packets = sink_.packets();
+    ASSERT_EQ(packets.size(), 1u);
+    EXPECT_EQ(packets[0].payload, payload);
+}
+
+TEST_P(WebsocketTest, ServerMessagesReachTheCallbacks) {
+    Open();
+    std::atomic<int> chats{0};
+    std::atomic<int> others{0};
+    protocol_->OnIncomingChat([&chats](ChatMessage&& message) {
+        if (message.type == "tts" && message.text == "你好") {
+            chats++;
+        }
+    });
+    protocol_->OnIncomingJson([&others](const cJSON* root) {
+        others++;
+    });
+    server_->SendText(R"({"type":"tts","state":"sentence_start","text":"你好"})");
+    server_->SendText(R"({"type":"mcp","payload":{"jsonrpc":"2.0","method":"tools/list","id":1}})");
+    if (GetParam() >= 2) {
+        uint8_t buffer[64];
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.Map(3);
+        writer.Text("type");
+        writer.Text("tts");
+        writer.Text("state");
+        writer.Text("sentence_start");
+        writer.Text("text");
+        writer.Text("你好");
+        server_->SendCbor(std::vector<uint8_t>(writer.data(), writer.data() + writer.size()));
+    }
+    server_->link().Flush();
+    EXPECT_EQ(chats, GetParam() >= 2 ? 2 : 1);
+    EXPECT_EQ(others, 1);
+}
+
+TEST_P(WebsocketTest, DisconnectClosesTheChannel) {
+    Open();
+    std::atomic<bool> closed{false};
+    protocol_->OnAudioChannelClosed([&closed]() { closed = true; });
+    server_->CloseWebSocket();
+    server_->link().Flush();
+    EXPECT_TRUE(closed);
+    EXPECT_FALSE(protocol_->IsAudioChannelOpened());
+
+    // A new channel resumes the session on a new connection
+    ASSERT_TRUE(protocol_->OpenAudioChannel());
+    EXPECT_EQ(protocol_->session_id(), "loopback-1");
+    EXPECT_EQ(server_->connects(), 2u);
+}
+
+TEST_P(WebsocketTest, FailedOpenKeepsTheResumableSession) {
+    Open();
+    protocol_->CloseAudioChannel();
+    server_->set_refuse_connections(true);
+    EXPECT_FALSE(protocol_->OpenAudioChannel());
+    server_->set_refuse_connections(false);
+
+    ASSERT_TRUE(protocol_->OpenAudioChannel());
+    EXPECT_NE(server_->last_hello().find(R"("resume_session_id":"loopback-1")"), std::string::npos);
+    EXPECT_EQ(protocol_->session_id(), "loopback-1");
+}
+
+INSTANTIATE_TEST_SUITE_P(Versions, WebsocketTest, testing::Values(1, 2, 3),
+    [](const testing::TestParamInfo<int>& info) { return "V" + std::to_string(info.param); });
@@ -10,6 +10,9 @@
 #include "iot/thing_manager.h"
 #include "assets/lang_config.h"
 #include "mcp_server.h"
+#include "audio_payload_pool.h"
+#include "settings.h"
+#include "latency_tracer.h"
 
 #include <driver/i2c_master.h>
 
@@ -31,15 +34,16 @@
 #include "i2c_device.h"
 
 #include <cstring>
+#include <algorithm>
 #include <esp_log.h>
 #include <cJSON.h>
 #include <driver/gpio.h>
-#include <arpa/inet.h>
 
 #define TAG "Application"
 
-
-
+static inline bool IsValidFrameDuration(int duration_ms) {
+    return duration_ms == 20 || duration_ms == 40 || duration_ms == 60;
+}
 
 static const char* const STATE_STRINGS[] = {
     "unknown",
@@ -157,10 +161,7 @@ void Application::CheckNewVersion() {
             auto codec = board.GetAudioCodec();
             codec->EnableInput(false);
             codec->EnableOutput(false);
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                audio_decode_queue_.clear();
-            }
+            audio_pipeline_.ClearDecodeQueue();
             background_task_->WaitForCompletion();
             delete background_task_;
             background_task_ = nullptr;
@@ -253,7 +254,7 @@ void Application::Alert(const char* status, const char* message, const char* emo
     display->SetEmotion(emotion);
     display->SetChatMessage("system", message);
     if (!sound.empty()) {
-        ResetDecoder();
+        audio_pipeline_.ResetDecoder();
         PlaySound(sound);
     }
 }
@@ -268,32 +269,7 @@ void Application::DismissAlert() {
 }
 
 void Application::PlaySound(const std::string_view& sound) {
-    // Wait for the previous sound to finish
-    {
-        std::unique_lock<std::mutex> lock(mutex_);
-        audio_decode_cv_.wait(lock, [this]() {
-            return audio_decode_queue_.empty();
-        });
-    }
-    background_task_->WaitForCompletion();
-
-    const char* data = sound.data();
-    size_t size = sound.size();
-    for (const char* p = data; p < data + size; ) {
-        auto p3 = (BinaryProtocol3*)p;
-        p += sizeof(BinaryProtocol3);
-
-        auto payload_size = ntohs(p3->payload_size);
-        AudioStreamPacket packet;
-        packet.sample_rate = 16000;
-        packet.frame_duration = 60;
-        packet.payload.resize(payload_size);
-        memcpy(packet.payload.data(), p3->payload, payload_size);
-        p += payload_size;
-
-        std::lock_guard<std::mutex> lock(mutex_);
-        audio_decode_queue_.emplace_back(std::move(packet));
-    }
+    audio_pipeline_.PlaySound(sound);
 }
 
 void Application::ToggleChatState() {
@@ -308,10 +284,15 @@ void Application::ToggleChatState() {
     }
 
     if (device_state_ == kDeviceStateIdle) {
-        Schedule([this]() {
-            SetDeviceState(kDeviceStateConnecting);
-            if (!protocol_->OpenAudioChannel()) {
-                return;
+        Schedule([this, wake_time = esp_timer_get_time()]() {
+            wake_time_us_ = wake_time;
+            if (!protocol_->IsAudioChannelOpened()) {
+                // The hello message of the new session carries the frame duration
+                ApplyFrameDuration();
+                SetDeviceState(kDeviceStateConnecting);
+                if (!protocol_->OpenAudioChannel()) {
+                    return;
+                }
             }
 
             SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
@@ -322,7 +303,7 @@ void Application::ToggleChatState() {
         });
     } else if (device_state_ == kDeviceStateListening) {
         Schedule([this]() {
-            protocol_->CloseAudioChannel();
+            ParkAudioChannel();
         });
     }
 }
@@ -339,8 +320,11 @@ void Application::StartListening() {
     }
     
     if (device_state_ == kDeviceStateIdle) {
-        Schedule([this]() {
+        Schedule([this, wake_time = esp_timer_get_time()]() {
+            wake_time_us_ = wake_time;
             if (!protocol_->IsAudioChannelOpened()) {
+                // The hello message of the new session carries the frame duration
+                ApplyFrameDuration();
                 SetDeviceState(kDeviceStateConnecting);
                 if (!protocol_->OpenAudioChannel()) {
                     return;
@@ -376,6 +360,57 @@ void Application::StopListening() {
     });
 }
 
+void Application::PrewarmAudioChannel() {
+    if (device_state_ != kDeviceStateIdle || warm_channel_seconds_ <= 0) {
+        return;
+    }
+
+    Schedule([this]() {
+        if (device_state_ != kDeviceStateIdle || !protocol_ || protocol_->IsAudioChannelOpened()) {
+            return;
+        }
+        // The hello message carries the frame duration, apply it before connecting
+        ApplyFrameDuration();
+        if (protocol_->OpenAudioChannel()) {
+            channel_parked_ = true;
+            clock_ticks_ = 0;
+            ESP_LOGI(TAG, "Audio channel prewarmed");
+        }
+    });
+}
+
+// Ends the conversation but keeps the transport open for warm_channel_seconds_,
+// the next conversation then skips the connect and hello round trips
+void Application::ParkAudioChannel() {
+    // Without turn tags late replies to this conversation could not be told from the next one's
+    if (warm_channel_seconds_ <= 0 || !protocol_->IsAudioChannelOpened() || !protocol_->turns_enabled()) {
+        protocol_->CloseAudioChannel();
+        return;
+    }
+
+    // Stop the uplink of this turn and cancel any reply the server has started
+    protocol_->SendStopListening();
+    protocol_->SendAbortSpeaking(kAbortReasonNone);
+    channel_parked_ = true;
+    stale_turn_ = protocol_->listen_turn();
+    Board::GetInstance().GetDisplay()->SetChatMessage("system", "");
+    SetDeviceState(kDeviceStateIdle);
+    ESP_LOGI(TAG, "Audio channel kept open for %d seconds", warm_channel_seconds_);
+}
+
+// Wake word / button press to the first audio packet sent, set once per conversation
+void Application::TraceFirstUplink() {
+    if (wake_time_us_ == 0) {
+        return;
+    }
+    int64_t elapsed_us = esp_timer_get_time() - wake_time_us_;
+    ESP_LOGI(TAG, "First uplink packet %d ms after wake", (int)(elapsed_us / 1000));
+#if CONFIG_USE_LATENCY_TRACE
+    LatencyTracer::GetInstance().Record(kLatencyWakeToUplink, elapsed_us);
+#endif
+    wake_time_us_ = 0;
+}
+
 void Application::Start() {
     auto& board = Board::GetInstance();
     SetDeviceState(kDeviceStateStarting);
@@ -385,38 +420,32 @@ void Application::Start() {
 
     /* Setup the audio codec */
     auto codec = board.GetAudioCodec();
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
+    {
+        Settings settings("audio", false);
+        int duration = settings.GetInt("frame_duration", OPUS_FRAME_DURATION_MS);
+        if (IsValidFrameDuration(duration)) {
+            requested_frame_duration_ = duration;
+        }
+        warm_channel_seconds_ = settings.GetInt("warm_channel_seconds", AUDIO_CHANNEL_WARM_SECONDS);
+    }
+    ESP_LOGI(TAG, "Opus frame duration: %d ms", requested_frame_duration_);
+    int complexity;
     if (aec_mode_ != kAecOff) {
         ESP_LOGI(TAG, "AEC mode: %d, setting opus encoder complexity to 0", aec_mode_);
-        opus_encoder_->SetComplexity(0);
+        complexity = 0;
     } else if (board.GetBoardType() == "ml307") {
         ESP_LOGI(TAG, "ML307 board detected, setting opus encoder complexity to 5");
-        opus_encoder_->SetComplexity(5);
+        complexity = 5;
     } else {
         ESP_LOGI(TAG, "WiFi board detected, setting opus encoder complexity to 0");
-        opus_encoder_->SetComplexity(0);
+        complexity = 0;
     }
+    // With AEC the encoder shares the core with the AFE, keep it at the cheapest setting
+    encoder_controller_.Configure(complexity, aec_mode_ != kAecOff ? 0 : OPUS_MAX_ADAPTIVE_COMPLEXITY);
 
-    if (codec->input_sample_rate() != 16000) {
-        input_resampler_.Configure(codec->input_sample_rate(), 16000);
-        reference_resampler_.Configure(codec->input_sample_rate(), 16000);
-    }
     codec->Start();
-
-#if CONFIG_USE_AUDIO_PROCESSOR
-    xTaskCreatePinnedToCore([](void* arg) {
-        Application* app = (Application*)arg;
-        app->AudioLoop();
-        vTaskDelete(NULL);
-    }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_, 1);
-#else
-    xTaskCreate([](void* arg) {
-        Application* app = (Application*)arg;
-        app->AudioLoop();
-        vTaskDelete(NULL);
-    }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_);
-#endif
+    audio_pipeline_.Start(codec, wake_word_.get(), audio_processor_.get(), background_task_,
+        requested_frame_duration_, complexity);
 
     /* Start the clock timer to update the status bar */
     esp_timer_start_periodic(clock_timer_handle_, 1000000);
@@ -452,9 +481,16 @@ void Application::Start() {
         Alert(Lang::Strings::ERROR, message.c_str(), "sad", Lang::Sounds::P3_EXCLAMATION);
     });
     protocol_->OnIncomingAudio([this](AudioStreamPacket&& packet) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        if (device_state_ == kDeviceStateSpeaking && audio_decode_queue_.size() < MAX_AUDIO_PACKETS_IN_QUEUE) {
-            audio_decode_queue_.emplace_back(std::move(packet));
+        int64_t now_us = esp_timer_get_time();
+        packet.receive_time_ms = now_us / 1000;
+#if CONFIG_USE_LATENCY_TRACE
+        if (last_incoming_audio_us_ != 0) {
+            LatencyTracer::GetInstance().Record(kLatencyArrivalGap, now_us - last_incoming_audio_us_);
+        }
+        last_incoming_audio_us_ = now_us;
+#endif
+        if (device_state_ != kDeviceStateSpeaking || !audio_pipeline_.PushDecodePacket(std::move(packet))) {
+            AudioPayloadPool::GetInstance().Release(std::move(packet.payload));
         }
     });
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
@@ -478,23 +514,29 @@ void Application::Start() {
         Schedule([this]() {
             auto display = Board::GetInstance().GetDisplay();
             display->SetChatMessage("system", "");
+            channel_parked_ = false;
             SetDeviceState(kDeviceStateIdle);
         });
     });
-    protocol_->OnIncomingJson([this, display](const cJSON* root) {
-        // Parse JSON data
-        auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
-                Schedule([this]() {
+    protocol_->OnIncomingChat([this, display](ChatMessage&& message) {
+        if (message.type == "tts") {
+            if (message.state == "start") {
+                Schedule([this, turn = message.turn]() {
+                    // A parked channel has no conversation, late replies to the aborted one are dropped
+                    if (channel_parked_ || IsStaleReply(turn)) {
+                        return;
+                    }
                     aborted_ = false;
+                    audio_pipeline_.SetPlaybackAborted(false);
                     if (device_state_ == kDeviceStateIdle || device_state_ == kDeviceStateListening) {
                         SetDeviceState(kDeviceStateSpeaking);
                     }
                 });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
-                Schedule([this]() {
+            } else if (message.state == "stop") {
+                Schedule([this, turn = message.turn]() {
+                    if (IsStaleReply(turn)) {
+                        return;
+                    }
                     background_task_->WaitForCompletion();
                     if (device_state_ == kDeviceStateSpeaking) {
                         if (listening_mode_ == kListeningModeManualStop) {
@@ -504,34 +546,43 @@ void Application::Start() {
                         }
                     }
                 });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
-                    });
-                }
+            } else if (message.state == "sentence_start" && message.has_text) {
+                ESP_LOGI(TAG, "<< %s", message.text.c_str());
+                Schedule([this, display, text = std::move(message.text), turn = message.turn]() {
+                    if (!IsStaleReply(turn)) {
+                        display->SetChatMessage("assistant", text.c_str());
+                    }
+                });
             }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([this, display, message = std::string(text->valuestring)]() {
-                    display->SetChatMessage("user", message.c_str());
+        } else if (message.type == "stt") {
+            if (message.has_text) {
+                ESP_LOGI(TAG, ">> %s", message.text.c_str());
+                Schedule([this, display, text = std::move(message.text), turn = message.turn]() {
+                    if (!IsStaleReply(turn)) {
+                        display->SetChatMessage("user", text.c_str());
+                    }
                 });
             }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
-                    display->SetEmotion(emotion_str.c_str());
+        } else if (message.type == "llm") {
+            if (message.has_emotion) {
+                Schedule([this, display, emotion = std::move(message.emotion), turn = message.turn]() {
+                    if (!IsStaleReply(turn)) {
+                        display->SetEmotion(emotion.c_str());
+                    }
                 });
             }
+        }
+    });
+    protocol_->OnIncomingJson([this, display](const cJSON* root) {
+        // tts / stt / llm messages go to OnIncomingChat, the rest is parsed here
+        auto type = cJSON_GetObjectItem(root, "type");
+        if (!cJSON_IsString(type)) {
+            ESP_LOGW(TAG, "Missing message type");
 #if CONFIG_IOT_PROTOCOL_MCP
         } else if (strcmp(type->valuestring, "mcp") == 0) {
             auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
+            // An array is a JSON-RPC batch
+            if (cJSON_IsObject(payload) || cJSON_IsArray(payload)) {
                 McpServer::GetInstance().ParseMessage(payload);
             }
 #endif
@@ -576,35 +627,10 @@ void Application::Start() {
 
     audio_processor_->Initialize(codec);
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        background_task_->Schedule([this, data = std::move(data)]() mutable {
-            opus_encoder_->Encode(std::move(data), [this](std::vector<uint8_t>&& opus) {
-                AudioStreamPacket packet;
-                packet.payload = std::move(opus);
-#ifdef CONFIG_USE_SERVER_AEC
-                {
-                    std::lock_guard<std::mutex> lock(timestamp_mutex_);
-                    if (!timestamp_queue_.empty()) {
-                        packet.timestamp = timestamp_queue_.front();
-                        timestamp_queue_.pop_front();
-                    } else {
-                        packet.timestamp = 0;
-                    }
-
-                    if (timestamp_queue_.size() > 3) { // 限制队列长度3
-                        timestamp_queue_.pop_front(); // 该包发送前先出队保持队列长度
-                        return;
-                    }
-                }
-#endif
-                std::lock_guard<std::mutex> lock(mutex_);
-                if (audio_send_queue_.size() >= MAX_AUDIO_PACKETS_IN_QUEUE) {
-                    ESP_LOGW(TAG, "Too many audio packets in queue, drop the oldest packet");
-                    audio_send_queue_.pop_front();
-                }
-                audio_send_queue_.emplace_back(std::move(packet));
-                xEventGroupSetBits(event_group_, SEND_AUDIO_EVENT);
-            });
-        });
+        audio_pipeline_.EncodeAudio(std::move(data));
+    });
+    audio_pipeline_.OnAudioQueued([this]() {
+        xEventGroupSetBits(event_group_, SEND_AUDIO_EVENT);
     });
     audio_processor_->OnVadStateChange([this](bool speaking) {
         if (device_state_ == kDeviceStateListening) {
@@ -622,18 +648,26 @@ void Application::Start() {
 
     wake_word_->Initialize(codec);
     wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
-        Schedule([this, &wake_word]() {
+        Schedule([this, &wake_word, wake_time = esp_timer_get_time()]() {
             if (!protocol_) {
                 return;
             }
 
             if (device_state_ == kDeviceStateIdle) {
+                wake_time_us_ = wake_time;
+                bool connect = !protocol_->IsAudioChannelOpened();
+                if (connect) {
+                    // The wake word audio is encoded with the frame duration of the new session,
+                    // apply it before the encoder starts
+                    ApplyFrameDuration();
+                }
                 wake_word_->EncodeWakeWordData();
 
-                if (!protocol_->IsAudioChannelOpened()) {
+                if (connect) {
                     SetDeviceState(kDeviceStateConnecting);
                     if (!protocol_->OpenAudioChannel()) {
                         wake_word_->StartDetection();
+                        audio_pipeline_.NotifyAudioInput();
                         return;
                     }
                 }
@@ -644,13 +678,14 @@ void Application::Start() {
                 // Encode and send the wake word data to the server
                 while (wake_word_->GetWakeWordOpus(packet.payload)) {
                     protocol_->SendAudio(packet);
+                    TraceFirstUplink();
                 }
                 // Set the chat state to wake word detected
                 protocol_->SendWakeWordDetected(wake_word);
 #else
                 // Play the pop up sound to indicate the wake word is detected
                 // And wait 60ms to make sure the queue has been processed by audio task
-                ResetDecoder();
+                audio_pipeline_.ResetDecoder();
                 PlaySound(Lang::Sounds::P3_POPUP);
                 vTaskDelay(pdMS_TO_TICKS(60));
 #endif
@@ -663,6 +698,7 @@ void Application::Start() {
         });
     });
     wake_word_->StartDetection();
+    audio_pipeline_.NotifyAudioInput();
 
     // Wait for the new version check to finish
     xEventGroupWaitBits(event_group_, CHECK_NEW_VERSION_DONE_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
@@ -673,7 +709,7 @@ void Application::Start() {
         display->ShowNotification(message.c_str());
         display->SetChatMessage("system", "");
         // Play the success sound to indicate the device is ready
-        ResetDecoder();
+        audio_pipeline_.ResetDecoder();
         PlaySound(Lang::Sounds::P3_SUCCESS);
     }
 
@@ -690,11 +726,36 @@ void Application::OnClockTimer() {
     auto display = Board::GetInstance().GetDisplay();
     display->UpdateStatusBar();
 
+    // clock_ticks_ counts the seconds since the channel was parked or prewarmed
+    if (channel_parked_ && clock_ticks_ >= warm_channel_seconds_) {
+        Schedule([this]() {
+            if (channel_parked_ && device_state_ == kDeviceStateIdle && clock_ticks_ >= warm_channel_seconds_) {
+                ESP_LOGI(TAG, "Closing the idle audio channel");
+                channel_parked_ = false;
+                protocol_->CloseAudioChannel();
+            }
+        });
+    }
+
+    if (audio_processor_->IsRunning()) {
+        Schedule([this]() {
+            UpdateEncoderController();
+        });
+    }
+
     // Print the debug info every 10 seconds
     if (clock_ticks_ % 10 == 0) {
         // SystemInfo::PrintTaskCpuUsage(pdMS_TO_TICKS(1000));
         // SystemInfo::PrintTaskList();
         SystemInfo::PrintHeapStats();
+        AudioPayloadPool::GetInstance().PrintStats();
+#if CONFIG_USE_LATENCY_TRACE
+        LatencyTracer::GetInstance().PrintStats();
+#endif
+        auto jitter = audio_pipeline_.GetJitterBufferStats();
+        ESP_LOGI(TAG, "jitter buffer: received %lu played %lu late %lu dup %lu overflow %lu concealed %lu underruns %lu jitter %dms depth %d",
+            jitter.received, jitter.played, jitter.late, jitter.duplicated, jitter.overflowed, jitter.concealed,
+            jitter.underruns, jitter.jitter_ms, jitter.target_depth);
 
         // If we have synchronized server time, set the status to clock "HH:MM" if the device is idle
         if (ota_.HasServerTime()) {
@@ -728,13 +789,8 @@ void Application::MainEventLoop() {
         auto bits = xEventGroupWaitBits(event_group_, SCHEDULE_EVENT | SEND_AUDIO_EVENT, pdTRUE, pdFALSE, portMAX_DELAY);
 
         if (bits & SEND_AUDIO_EVENT) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto packets = std::move(audio_send_queue_);
-            lock.unlock();
-            for (auto& packet : packets) {
-                if (!protocol_->SendAudio(packet)) {
-                    break;
-                }
+            if (audio_pipeline_.SendQueuedAudio(*protocol_) > 0) {
+                TraceFirstUplink();
             }
         }
 
@@ -749,142 +805,10 @@ void Application::MainEventLoop() {
     }
 }
 
-// The Audio Loop is used to input and output audio data
-void Application::AudioLoop() {
-    auto codec = Board::GetInstance().GetAudioCodec();
-    while (true) {
-        OnAudioInput();
-        if (codec->output_enabled()) {
-            OnAudioOutput();
-        }
-    }
-}
-
-void Application::OnAudioOutput() {
-    if (busy_decoding_audio_) {
-        return;
-    }
-
-    auto now = std::chrono::steady_clock::now();
-    auto codec = Board::GetInstance().GetAudioCodec();
-    const int max_silence_seconds = 10;
-
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (audio_decode_queue_.empty()) {
-        // Disable the output if there is no audio data for a long time
-        if (device_state_ == kDeviceStateIdle) {
-            auto duration = std::chrono::duration_cast<std::chrono::seconds>(now - last_output_time_).count();
-            if (duration > max_silence_seconds) {
-                codec->EnableOutput(false);
-            }
-        }
-        return;
-    }
-
-    auto packet = std::move(audio_decode_queue_.front());
-    audio_decode_queue_.pop_front();
-    lock.unlock();
-    audio_decode_cv_.notify_all();
-
-    // Synchronize the sample rate and frame duration
-    SetDecodeSampleRate(packet.sample_rate, packet.frame_duration);
-
-    busy_decoding_audio_ = true;
-    background_task_->Schedule([this, codec, packet = std::move(packet)]() mutable {
-        busy_decoding_audio_ = false;
-        if (aborted_) {
-            return;
-        }
-
-        std::vector<int16_t> pcm;
-        if (!opus_decoder_->Decode(std::move(packet.payload), pcm)) {
-            return;
-        }
-        // Resample if the sample rate is different
-        if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-            int target_size = output_resampler_.GetOutputSamples(pcm.size());
-            std::vector<int16_t> resampled(target_size);
-            output_resampler_.Process(pcm.data(), pcm.size(), resampled.data());
-            pcm = std::move(resampled);
-        }
-        codec->OutputData(pcm);
-#ifdef CONFIG_USE_SERVER_AEC
-        std::lock_guard<std::mutex> lock(timestamp_mutex_);
-        timestamp_queue_.push_back(packet.timestamp);
-#endif
-        last_output_time_ = std::chrono::steady_clock::now();
-    });
-}
-
-void Application::OnAudioInput() {
-    if (wake_word_->IsDetectionRunning()) {
-        std::vector<int16_t> data;
-        int samples = wake_word_->GetFeedSize();
-        if (samples > 0) {
-            if (ReadAudio(data, 16000, samples)) {
-                wake_word_->Feed(data);
-                return;
-            }
-        }
-    }
-    if (audio_processor_->IsRunning()) {
-        std::vector<int16_t> data;
-        int samples = audio_processor_->GetFeedSize();
-        if (samples > 0) {
-            if (ReadAudio(data, 16000, samples)) {
-                audio_processor_->Feed(data);
-                return;
-            }
-        }
-    }
-
-    vTaskDelay(pdMS_TO_TICKS(OPUS_FRAME_DURATION_MS / 2));
-}
-
-bool Application::ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples) {
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (!codec->input_enabled()) {
-        return false;
-    }
-
-    if (codec->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec->input_sample_rate() / sample_rate);
-        if (!codec->InputData(data)) {
-            return false;
-        }
-        if (codec->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
-        } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
-        }
-    } else {
-        data.resize(samples);
-        if (!codec->InputData(data)) {
-            return false;
-        }
-    }
-    return true;
-}
-
 void Application::AbortSpeaking(AbortReason reason) {
     ESP_LOGI(TAG, "Abort speaking");
     aborted_ = true;
+    audio_pipeline_.SetPlaybackAborted(true);
     protocol_->SendAbortSpeaking(reason);
 }
 
@@ -921,9 +845,10 @@ void Application::SetDeviceState(DeviceState state) {
             display->SetStatus(Lang::Strings::CONNECTING);
             display->SetEmotion("neutral");
             display->SetChatMessage("system", "");
-            timestamp_queue_.clear();
+            audio_pipeline_.ClearTimestamps();
             break;
         case kDeviceStateListening:
+            channel_parked_ = false;
             display->SetStatus(Lang::Strings::LISTENING);
             display->SetEmotion("neutral");
             // Update the IoT states before sending the start listening command
@@ -936,12 +861,12 @@ void Application::SetDeviceState(DeviceState state) {
                 // Send the start listening command
                 protocol_->SendStartListening(listening_mode_);
                 if (previous_state == kDeviceStateSpeaking) {
-                    audio_decode_queue_.clear();
-                    audio_decode_cv_.notify_all();
+                    audio_pipeline_.ClearDecodeQueue();
                     // FIXME: Wait for the speaker to empty the buffer
                     vTaskDelay(pdMS_TO_TICKS(120));
                 }
-                opus_encoder_->ResetState();
+                audio_pipeline_.ResetEncoder();
+                encoder_sample_time_us_ = esp_timer_get_time();
                 audio_processor_->Start();
                 wake_word_->StopDetection();
             }
@@ -958,37 +883,15 @@ void Application::SetDeviceState(DeviceState state) {
                 wake_word_->StopDetection();
 #endif
             }
-            ResetDecoder();
+            audio_pipeline_.ResetDecoder();
             break;
         default:
             // Do nothing
             break;
     }
-}
-
-void Application::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    opus_decoder_->ResetState();
-    audio_decode_queue_.clear();
-    audio_decode_cv_.notify_all();
-    last_output_time_ = std::chrono::steady_clock::now();
-    auto codec = Board::GetInstance().GetAudioCodec();
-    codec->EnableOutput(true);
-}
-
-void Application::SetDecodeSampleRate(int sample_rate, int frame_duration) {
-    if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
-        return;
-    }
-
-    opus_decoder_.reset();
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
-
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
-        output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
-    }
+    // The decode task only turns the output off after a long silence in idle
+    audio_pipeline_.SetIdle(state == kDeviceStateIdle);
+    audio_pipeline_.NotifyAudioInput();
 }
 
 void Application::UpdateIotStates() {
@@ -1021,7 +924,7 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
     } else if (device_state_ == kDeviceStateListening) {   
         Schedule([this]() {
             if (protocol_) {
-                protocol_->CloseAudioChannel();
+                ParkAudioChannel();
             }
         });
     }
@@ -1048,6 +951,50 @@ void Application::SendMcpMessage(const std::string& payload) {
     });
 }
 
+bool Application::SetFrameDuration(int duration_ms) {
+    if (!IsValidFrameDuration(duration_ms)) {
+        return false;
+    }
+    requested_frame_duration_ = duration_ms;
+    Settings settings("audio", true);
+    settings.SetInt("frame_duration", duration_ms);
+    ESP_LOGI(TAG, "Opus frame duration set to %d ms, applied from the next session", duration_ms);
+    return true;
+}
+
+// Called once before a new session connects
+void Application::ApplyFrameDuration() {
+    encoder_controller_.StartSession();
+    // A link that was congested last session gets the longest frames, they carry the least overhead
+    int duration = std::max(requested_frame_duration_, encoder_controller_.min_frame_duration());
+    audio_pipeline_.SetFrameDuration(duration);
+}
+
+void Application::UpdateEncoderController() {
+    if (device_state_ != kDeviceStateListening && device_state_ != kDeviceStateSpeaking) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    EncoderSample sample;
+    sample.encode_time_us = audio_pipeline_.TakeEncodeTime();
+    sample.elapsed_us = now - encoder_sample_time_us_;
+    encoder_sample_time_us_ = now;
+    sample.send_queue_depth = audio_pipeline_.send_queue_depth();
+    sample.send_queue_limit = audio_pipeline_.send_queue_limit();
+    // Downlink loss is the only view of the link the protocols give, the uplink shares the path
+    AudioStreamStats stats;
+    if (GetAudioStreamStats(stats)) {
+        sample.received = stats.received;
+        sample.lost = stats.lost;
+    }
+    if (!encoder_controller_.Update(sample)) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Encoder: %s", encoder_controller_.GetStatusJson().c_str());
+    audio_pipeline_.SetEncoderComplexity(encoder_controller_.complexity());
+}
+
 void Application::SetAecMode(AecMode mode) {
     aec_mode_ = mode;
     Schedule([this]() {
@@ -9,19 +9,15 @@
 #include <string>
 #include <mutex>
 #include <list>
-#include <vector>
-#include <condition_variable>
 #include <memory>
 
-#include <opus_encoder.h>
-#include <opus_decoder.h>
-#include <opus_resampler.h>
-
 #include "protocol.h"
 #include "ota.h"
 #include "background_task.h"
 #include "audio_processor.h"
 #include "wake_word.h"
+#include "encoder_controller.h"
+#include "audio_pipeline.h"
 
 #define SCHEDULE_EVENT (1 << 0)
 #define SEND_AUDIO_EVENT (1 << 1)
@@ -46,8 +42,10 @@ enum DeviceState {
     kDeviceStateFatalError
 };
 
-#define OPUS_FRAME_DURATION_MS 60
-#define MAX_AUDIO_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+// Highest complexity the encoder controller is configured with, it only lowers it under load
+#define OPUS_MAX_ADAPTIVE_COMPLEXITY 5
+// Seconds an idle audio channel is kept open for the next conversation, 0 closes it right away
+#define AUDIO_CHANNEL_WARM_SECONDS CONFIG_AUDIO_CHANNEL_WARM_SECONDS
 
 class Application {
 public:
@@ -70,6 +68,8 @@ public:
     void ToggleChatState();
     void StartListening();
     void StopListening();
+    // Opens the audio channel ahead of a likely conversation (e.g. on button press down)
+    void PrewarmAudioChannel();
     void UpdateIotStates();
     void Reboot();
     void WakeWordInvoke(const std::string& wake_word);
@@ -78,6 +78,11 @@ public:
     void SendMcpMessage(const std::string& payload);
     void SetAecMode(AecMode mode);
     AecMode GetAecMode() const { return aec_mode_; }
+    // Takes effect from the next audio session, returns false for unsupported durations
+    bool SetFrameDuration(int duration_ms);
+    int frame_duration() const { return audio_pipeline_.frame_duration(); }
+    std::string GetEncoderStatusJson() const { return encoder_controller_.GetStatusJson(); }
+    bool GetAudioStreamStats(AudioStreamStats& stats) const { return protocol_ && protocol_->GetAudioStreamStats(stats); }
     BackgroundTask* GetBackgroundTask() const { return background_task_; }
 
 private:
@@ -98,40 +103,35 @@ private:
 
     bool aborted_ = false;
     bool voice_detected_ = false;
-    bool busy_decoding_audio_ = false;
     int clock_ticks_ = 0;
+    // Warm channel: the channel stays open in idle until warm_channel_seconds_ pass
+    int warm_channel_seconds_ = AUDIO_CHANNEL_WARM_SECONDS;
+    bool channel_parked_ = false;
+    // Last listen turn of a parked conversation, its replies can still be in flight
+    uint32_t stale_turn_ = 0;
+    int64_t wake_time_us_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
 
     // Audio encode / decode
-    TaskHandle_t audio_loop_task_handle_ = nullptr;
     BackgroundTask* background_task_ = nullptr;
-    std::chrono::steady_clock::time_point last_output_time_;
-    std::list<AudioStreamPacket> audio_send_queue_;
-    std::list<AudioStreamPacket> audio_decode_queue_;
-    std::condition_variable audio_decode_cv_;
-
-    // 新增：用于维护音频包的timestamp队列
-    std::list<uint32_t> timestamp_queue_;
-    std::mutex timestamp_mutex_;
-
-    std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
-    std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
+    AudioPipeline audio_pipeline_;
+    int64_t last_incoming_audio_us_ = 0;
 
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
-    OpusResampler output_resampler_;
+    // Adapts the encoder once per second while listening, fed from the background task timing
+    EncoderController encoder_controller_;
+    int64_t encoder_sample_time_us_ = 0;
+    int requested_frame_duration_ = OPUS_FRAME_DURATION_MS;
 
     void MainEventLoop();
-    void OnAudioInput();
-    void OnAudioOutput();
-    bool ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples);
-    void ResetDecoder();
-    void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    bool IsStaleReply(uint32_t turn) const { return turn != 0 && turn <= stale_turn_; }
+    void ApplyFrameDuration();
+    void UpdateEncoderController();
+    void ParkAudioChannel();
+    void TraceFirstUplink();
     void CheckNewVersion();
     void ShowActivationCode();
     void OnClockTimer();
     void SetListeningMode(ListeningMode mode);
-    void AudioLoop();
 };
 
 #endif // _APPLICATION_H_
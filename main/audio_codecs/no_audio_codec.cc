@@ -1,6 +1,9 @@
 #include "no_audio_codec.h"
 
+#include "pcm_kernels.h"
+
 #include <esp_log.h>
+#include <esp_heap_caps.h>
 #include <cmath>
 #include <cstring>
 
@@ -13,6 +16,32 @@ NoAudioCodec::~NoAudioCodec() {
     if (tx_handle_ != nullptr) {
         ESP_ERROR_CHECK(i2s_channel_disable(tx_handle_));
     }
+    heap_caps_free(tx_buffer_);
+    heap_caps_free(rx_buffer_);
+}
+
+void NoAudioCodec::SetOutputVolume(int volume) {
+    AudioCodec::SetOutputVolume(volume);
+    UpdateVolumeFactor();
+}
+
+void NoAudioCodec::UpdateVolumeFactor() {
+    // output_volume_: 0-100
+    // volume_factor_: 0-65536
+    volume_factor_ = (int32_t)(pow(double(output_volume_) / 100.0, 2) * PCM_GAIN_UNITY);
+}
+
+int32_t* NoAudioCodec::ReserveBuffer(int32_t* buffer, int& capacity, int samples) {
+    if (samples <= capacity) {
+        return buffer;
+    }
+    heap_caps_free(buffer);
+    buffer = (int32_t*)heap_caps_malloc(samples * sizeof(int32_t), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    capacity = buffer != nullptr ? samples : 0;
+    if (buffer == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %d samples", samples);
+    }
+    return buffer;
 }
 
 NoAudioCodecDuplex::NoAudioCodecDuplex(int input_sample_rate, int output_sample_rate, gpio_num_t bclk, gpio_num_t ws, gpio_num_t dout, gpio_num_t din) {
@@ -336,59 +365,53 @@ NoAudioCodecSimplexPdm::NoAudioCodecSimplexPdm(int input_sample_rate, int output
 }
 
 int NoAudioCodec::Write(const int16_t* data, int samples) {
-    std::vector<int32_t> buffer(samples);
+    tx_buffer_ = ReserveBuffer(tx_buffer_, tx_buffer_samples_, samples);
+    if (tx_buffer_ == nullptr) {
+        return 0;
+    }
 
-    // output_volume_: 0-100
-    // volume_factor_: 0-65536
-    int32_t volume_factor = pow(double(output_volume_) / 100.0, 2) * 65536;
-    for (int i = 0; i < samples; i++) {
-        int64_t temp = int64_t(data[i]) * volume_factor; // 使用 int64_t 进行乘法运算
-        if (temp > INT32_MAX) {
-            buffer[i] = INT32_MAX;
-        } else if (temp < INT32_MIN) {
-            buffer[i] = INT32_MIN;
-        } else {
-            buffer[i] = static_cast<int32_t>(temp);
-        }
+    // The volume is loaded from the settings in Start(), pick it up on the first write
+    if (volume_factor_ < 0) {
+        UpdateVolumeFactor();
+        applied_volume_factor_ = volume_factor_;
     }
+    // Ramp to a new volume over one write to avoid zipper noise, read the target once so the
+    // ramp ends where the next write starts
+    int32_t volume_factor = volume_factor_;
+    PcmApplyGainQ31(data, tx_buffer_, samples, applied_volume_factor_, volume_factor);
+    applied_volume_factor_ = volume_factor;
 
     size_t bytes_written;
-    ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, buffer.data(), samples * sizeof(int32_t), &bytes_written, portMAX_DELAY));
+    ESP_ERROR_CHECK(i2s_channel_write(tx_handle_, tx_buffer_, samples * sizeof(int32_t), &bytes_written, portMAX_DELAY));
     return bytes_written / sizeof(int32_t);
 }
 
 int NoAudioCodec::Read(int16_t* dest, int samples) {
     size_t bytes_read;
 
-    std::vector<int32_t> bit32_buffer(samples);
-    if (i2s_channel_read(rx_handle_, bit32_buffer.data(), samples * sizeof(int32_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
+    rx_buffer_ = ReserveBuffer(rx_buffer_, rx_buffer_samples_, samples);
+    if (rx_buffer_ == nullptr) {
+        return 0;
+    }
+    if (i2s_channel_read(rx_handle_, rx_buffer_, samples * sizeof(int32_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
         ESP_LOGE(TAG, "Read Failed!");
         return 0;
     }
 
     samples = bytes_read / sizeof(int32_t);
-    for (int i = 0; i < samples; i++) {
-        int32_t value = bit32_buffer[i] >> 12;
-        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
-    }
+    PcmConvertQ31ToQ15(rx_buffer_, dest, samples, 12);
     return samples;
 }
 
 int NoAudioCodecSimplexPdm::Read(int16_t* dest, int samples) {
     size_t bytes_read;
 
-    // PDM 解调后的数据位宽为 16 位
-    std::vector<int16_t> bit16_buffer(samples);
-    if (i2s_channel_read(rx_handle_, bit16_buffer.data(), samples * sizeof(int16_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
+    // PDM 解调后的数据位宽为 16 位，直接读入目标缓冲区
+    if (i2s_channel_read(rx_handle_, dest, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY) != ESP_OK) {
         ESP_LOGE(TAG, "Read Failed!");
         return 0;
     }
 
     // 计算实际读取的样本数
-    samples = bytes_read / sizeof(int16_t);
-
-    // 将 16 位数据直接复制到目标缓冲区
-    memcpy(dest, bit16_buffer.data(), samples * sizeof(int16_t));
-
-    return samples;
+    return bytes_read / sizeof(int16_t);
 }
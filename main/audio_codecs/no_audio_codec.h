@@ -5,14 +5,30 @@
 
 #include <driver/gpio.h>
 #include <driver/i2s_pdm.h>
+#include <atomic>
 
 class NoAudioCodec : public AudioCodec {
 private:
+    // Q16 output gain, recomputed only when the volume changes. SetOutputVolume runs on the
+    // caller's task while the output task reads it in Write
+    std::atomic<int32_t> volume_factor_{-1};
+    int32_t applied_volume_factor_ = -1;
+
     virtual int Write(const int16_t* data, int samples) override;
     virtual int Read(int16_t* dest, int samples) override;
+    // 32-bit I2S sample buffers, kept between calls in DMA capable memory
+    int32_t* tx_buffer_ = nullptr;
+    int32_t* rx_buffer_ = nullptr;
+    int tx_buffer_samples_ = 0;
+    int rx_buffer_samples_ = 0;
+
+    void UpdateVolumeFactor();
+    static int32_t* ReserveBuffer(int32_t* buffer, int& capacity, int samples);
 
 public:
     virtual ~NoAudioCodec();
+
+    virtual void SetOutputVolume(int volume) override;
 };
 
 class NoAudioCodecDuplex : public NoAudioCodec {
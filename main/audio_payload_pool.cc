@@ -0,0 +1,33 @@
+#include "audio_payload_pool.h"
+
+#include <esp_log.h>
+
+#define TAG "AudioPayloadPool"
+
+AudioPayloadPool::AudioPayloadPool() : free_blocks_(AUDIO_PAYLOAD_POOL_BLOCKS) {
+}
+
+std::vector<uint8_t> AudioPayloadPool::Acquire(size_t size) {
+    std::vector<uint8_t> payload;
+    if (size <= AUDIO_PAYLOAD_BLOCK_SIZE && free_blocks_.TryPop(payload)) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        payload.reserve(size > AUDIO_PAYLOAD_BLOCK_SIZE ? size : AUDIO_PAYLOAD_BLOCK_SIZE);
+    }
+    payload.resize(size);
+    return payload;
+}
+
+void AudioPayloadPool::Release(std::vector<uint8_t>&& payload) {
+    // Oversized buffers are not kept, they would pin large chunks of SRAM
+    if (payload.capacity() != AUDIO_PAYLOAD_BLOCK_SIZE) {
+        return;
+    }
+    payload.clear();
+    free_blocks_.TryPush(std::move(payload));
+}
+
+void AudioPayloadPool::PrintStats() {
+    ESP_LOGI(TAG, "hits: %lu misses: %lu free blocks: %u", hits(), misses(), free_blocks_.Size());
+}
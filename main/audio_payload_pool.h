@@ -0,0 +1,47 @@
+#ifndef AUDIO_PAYLOAD_POOL_H
+#define AUDIO_PAYLOAD_POOL_H
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+#include "bounded_queue.h"
+
+// Opus frames from the server rarely exceed this size (60ms @ 24kHz)
+#define AUDIO_PAYLOAD_BLOCK_SIZE 512
+#define AUDIO_PAYLOAD_POOL_BLOCKS 48
+
+/*
+ * Recycles the payload buffers of received AudioStreamPacket.
+ *
+ * Blocks are opus sized vectors that are created on the first misses and then
+ * circulate between the protocol receive path and the decoder, so a long TTS
+ * reply does not allocate and free one buffer per frame in internal SRAM.
+ */
+class AudioPayloadPool {
+public:
+    static AudioPayloadPool& GetInstance() {
+        static AudioPayloadPool instance;
+        return instance;
+    }
+    AudioPayloadPool(const AudioPayloadPool&) = delete;
+    AudioPayloadPool& operator=(const AudioPayloadPool&) = delete;
+
+    // Returns a buffer resized to `size`
+    std::vector<uint8_t> Acquire(size_t size);
+    // Gives a buffer back to the pool, it is freed if the pool is full
+    void Release(std::vector<uint8_t>&& payload);
+    void PrintStats();
+
+    inline uint32_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    inline uint32_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    AudioPayloadPool();
+
+    BoundedQueue<std::vector<uint8_t>> free_blocks_;
+    std::atomic<uint32_t> hits_{0};
+    std::atomic<uint32_t> misses_{0};
+};
+
+#endif // AUDIO_PAYLOAD_POOL_H
@@ -0,0 +1,501 @@
+#include "audio_pipeline.h"
+#include "audio_payload_pool.h"
+#include "pcm_kernels.h"
+#include "latency_tracer.h"
+
+#include <cstring>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <arpa/inet.h>
+
+#define TAG "AudioPipeline"
+
+// Duration of an Opus packet from its TOC byte (RFC 6716 3.1), 0 if it is not a whole number of milliseconds
+static int OpusPacketDurationMs(const uint8_t* data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    // Frame sizes in units of 0.5ms: SILK 10/20/40/60, hybrid 10/20, CELT 2.5/5/10/20
+    static const int kSilkFrames[] = {20, 40, 80, 120};
+    static const int kCeltFrames[] = {5, 10, 20, 40};
+    int config = data[0] >> 3;
+    int frame_halves = config < 12 ? kSilkFrames[config & 3] : config < 16 ? kSilkFrames[config & 1] : kCeltFrames[config & 3];
+    int frames;
+    switch (data[0] & 3) {
+    case 0:
+        frames = 1;
+        break;
+    case 3:
+        frames = size > 1 ? (data[1] & 0x3f) : 0;
+        break;
+    default:
+        frames = 2;
+        break;
+    }
+    int halves = frame_halves * frames;
+    return halves % 2 == 0 ? halves / 2 : 0;
+}
+
+void AudioPipeline::Start(AudioCodec* codec, WakeWord* wake_word, AudioProcessor* audio_processor,
+    BackgroundTask* background_task, int frame_duration, int complexity) {
+    codec_ = codec;
+    wake_word_ = wake_word;
+    audio_processor_ = audio_processor;
+    background_task_ = background_task;
+    frame_duration_ = frame_duration;
+    last_output_time_ = std::chrono::steady_clock::now();
+
+    audio_send_queue_.set_limit(AUDIO_QUEUE_DURATION_MS / frame_duration_);
+    audio_decode_queue_.set_limit(AUDIO_QUEUE_DURATION_MS / frame_duration_);
+    decoder_pool_.Initialize(codec->output_sample_rate());
+    // Local sounds are 16kHz 60ms P3, have their decoder ready before the first one plays
+    decoder_pool_.Preload(16000, 60);
+    decoder_ = decoder_pool_.Get(16000, 60);
+    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration_);
+    complexity_ = complexity;
+    opus_encoder_->SetComplexity(complexity_);
+
+    if (codec->input_sample_rate() != 16000) {
+        input_resampler_.Configure(codec->input_sample_rate(), 16000);
+        reference_resampler_.Configure(codec->input_sample_rate(), 16000);
+    }
+
+    // Two PCM frames circulate between the decode task and the output task
+    for (int i = 0; i < AUDIO_PCM_FRAME_COUNT; i++) {
+        PcmFrame frame;
+        frame.pcm.reserve(codec->output_sample_rate() * OPUS_MAX_FRAME_DURATION_MS / 1000);
+        pcm_free_queue_.TryPush(std::move(frame));
+    }
+    xTaskCreate([](void* arg) {
+        AudioPipeline* pipeline = (AudioPipeline*)arg;
+        pipeline->AudioOutputTask();
+        vTaskDelete(NULL);
+    }, "audio_output", 4096, this, 8, &audio_output_task_handle_);
+    xTaskCreate([](void* arg) {
+        AudioPipeline* pipeline = (AudioPipeline*)arg;
+        pipeline->AudioDecodeTask();
+        vTaskDelete(NULL);
+    }, "audio_decode", 4096 * 6, this, 5, &audio_decode_task_handle_);
+
+#if CONFIG_USE_AUDIO_PROCESSOR
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioPipeline* pipeline = (AudioPipeline*)arg;
+        pipeline->AudioLoop();
+        vTaskDelete(NULL);
+    }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_, 1);
+#else
+    xTaskCreate([](void* arg) {
+        AudioPipeline* pipeline = (AudioPipeline*)arg;
+        pipeline->AudioLoop();
+        vTaskDelete(NULL);
+    }, "audio_loop", 4096 * 2, this, 8, &audio_loop_task_handle_);
+#endif
+}
+
+// The Audio Loop is used to input audio data, it sleeps while nothing consumes the input
+void AudioPipeline::AudioLoop() {
+    while (true) {
+        OnAudioInput();
+    }
+}
+
+void AudioPipeline::NotifyAudioInput() {
+    if (audio_loop_task_handle_ != nullptr) {
+        xTaskNotifyGive(audio_loop_task_handle_);
+    }
+}
+
+void AudioPipeline::OnAudioInput() {
+    bool wants_input = false;
+    if (wake_word_->IsDetectionRunning()) {
+        wants_input = true;
+        int samples = wake_word_->GetFeedSize();
+        if (samples > 0) {
+            if (ReadAudio(input_buffer_, 16000, samples)) {
+                wake_word_->Feed(input_buffer_);
+                return;
+            }
+        }
+    }
+    if (audio_processor_->IsRunning()) {
+        wants_input = true;
+        int samples = audio_processor_->GetFeedSize();
+        if (samples > 0) {
+            if (ReadAudio(input_buffer_, 16000, samples)) {
+                audio_processor_->Feed(input_buffer_);
+                return;
+            }
+        }
+    }
+
+    // Nobody wants input, sleep until a detector or processor is started.
+    // If the input is merely unavailable (e.g. disabled by the board), retry later.
+    ulTaskNotifyTake(pdTRUE, wants_input ? pdMS_TO_TICKS(frame_duration_ / 2) : portMAX_DELAY);
+}
+
+bool AudioPipeline::ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples) {
+    if (!codec_->input_enabled()) {
+        return false;
+    }
+    auto start_time = LATENCY_TRACE_NOW();
+
+    if (codec_->input_sample_rate() != sample_rate) {
+        // The scratch buffers only grow, so this path does not allocate after the first call
+        input_scratch_.resize(samples * codec_->input_sample_rate() / sample_rate);
+        if (!codec_->InputData(input_scratch_)) {
+            return false;
+        }
+        if (codec_->input_channels() == 2) {
+            size_t frames = input_scratch_.size() / 2;
+            channel_scratch_.resize(frames * 2);
+            auto mic_channel = channel_scratch_.data();
+            auto reference_channel = channel_scratch_.data() + frames;
+            PcmDeinterleaveStereo(input_scratch_.data(), mic_channel, reference_channel, frames);
+
+            // Resample both channels back into the input scratch, then interleave into the output
+            size_t resampled_frames = input_resampler_.GetOutputSamples(frames);
+            input_scratch_.resize(resampled_frames * 2);
+            auto resampled_mic = input_scratch_.data();
+            auto resampled_reference = input_scratch_.data() + resampled_frames;
+            input_resampler_.Process(mic_channel, frames, resampled_mic);
+            reference_resampler_.Process(reference_channel, frames, resampled_reference);
+            data.resize(resampled_frames * 2);
+            PcmInterleaveStereo(resampled_mic, resampled_reference, data.data(), resampled_frames);
+        } else {
+            data.resize(input_resampler_.GetOutputSamples(input_scratch_.size()));
+            input_resampler_.Process(input_scratch_.data(), input_scratch_.size(), data.data());
+        }
+    } else {
+        data.resize(samples);
+        if (!codec_->InputData(data)) {
+            return false;
+        }
+    }
+    LATENCY_TRACE(kLatencyMicRead, start_time);
+    return true;
+}
+
+void AudioPipeline::EncodeAudio(std::vector<int16_t>&& data) {
+    auto output_time = LATENCY_TRACE_NOW();
+    background_task_->Schedule([this, data = std::move(data), output_time]() mutable {
+        int64_t encode_start_us = esp_timer_get_time();
+        opus_encoder_->Encode(std::move(data), [this, output_time](std::vector<uint8_t>&& opus) {
+            LATENCY_TRACE(kLatencyEncode, output_time);
+            AudioStreamPacket packet;
+            packet.payload = std::move(opus);
+            packet.encode_time_us = LATENCY_TRACE_NOW();
+#ifdef CONFIG_USE_SERVER_AEC
+            {
+                std::lock_guard<std::mutex> lock(timestamp_mutex_);
+                if (!timestamp_queue_.empty()) {
+                    packet.timestamp = timestamp_queue_.front();
+                    timestamp_queue_.pop_front();
+                } else {
+                    packet.timestamp = 0;
+                }
+
+                if (timestamp_queue_.size() > 3) { // 限制队列长度3
+                    timestamp_queue_.pop_front(); // 该包发送前先出队保持队列长度
+                    return;
+                }
+            }
+#endif
+            AudioStreamPacket dropped;
+            while (!audio_send_queue_.TryPush(std::move(packet))) {
+                if (audio_send_queue_.TryPop(dropped)) {
+                    ESP_LOGW(TAG, "Too many audio packets in queue, drop the oldest packet");
+                }
+            }
+            if (on_audio_queued_) {
+                on_audio_queued_();
+            }
+        });
+        encode_time_us_ += esp_timer_get_time() - encode_start_us;
+    });
+}
+
+size_t AudioPipeline::SendQueuedAudio(Protocol& protocol) {
+    size_t max_burst = protocol.max_audio_burst();
+    size_t sent = 0;
+    AudioStreamPacket packet;
+    while (audio_send_queue_.TryPop(packet)) {
+        // Coalesce only a backlog (e.g. after the wake word or a network stall),
+        // a frame that is on time goes out on its own
+        if (max_burst > 1 && !audio_send_queue_.Empty()) {
+            send_burst_[0] = std::move(packet);
+            size_t count = 1;
+            while (count < max_burst && audio_send_queue_.TryPop(send_burst_[count])) {
+                count++;
+            }
+            if (!protocol.SendAudioBurst(send_burst_.data(), count)) {
+                audio_send_queue_.Clear();
+                break;
+            }
+            for (size_t i = 0; i < count; i++) {
+                LATENCY_TRACE(kLatencySend, send_burst_[i].encode_time_us);
+            }
+            sent += count;
+            continue;
+        }
+        if (!protocol.SendAudio(packet)) {
+            audio_send_queue_.Clear();
+            break;
+        }
+        LATENCY_TRACE(kLatencySend, packet.encode_time_us);
+        sent++;
+    }
+    return sent;
+}
+
+void AudioPipeline::ResetEncoder() {
+    opus_encoder_->ResetState();
+    encode_time_us_ = 0;
+}
+
+void AudioPipeline::SetFrameDuration(int frame_duration) {
+    if (frame_duration == frame_duration_) {
+        return;
+    }
+    // Encode jobs of the last session may still be running on the background task
+    background_task_->WaitForCompletion();
+    frame_duration_ = frame_duration;
+    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, frame_duration_);
+    opus_encoder_->SetComplexity(complexity_);
+    // Keep the queues at the same duration of audio
+    audio_send_queue_.set_limit(AUDIO_QUEUE_DURATION_MS / frame_duration_);
+    audio_decode_queue_.set_limit(AUDIO_QUEUE_DURATION_MS / frame_duration_);
+    ESP_LOGI(TAG, "Opus frame duration: %d ms", frame_duration_);
+}
+
+void AudioPipeline::SetEncoderComplexity(int complexity) {
+    complexity_ = complexity;
+    // The encoder is only touched from the background task
+    background_task_->Schedule([this, complexity]() {
+        opus_encoder_->SetComplexity(complexity);
+    });
+}
+
+void AudioPipeline::ClearTimestamps() {
+    std::lock_guard<std::mutex> lock(timestamp_mutex_);
+    timestamp_queue_.clear();
+}
+
+bool AudioPipeline::PushDecodePacket(AudioStreamPacket&& packet) {
+    if (!audio_decode_queue_.TryPush(std::move(packet))) {
+        return false;
+    }
+    NotifyAudioDecode();
+    return true;
+}
+
+void AudioPipeline::PlaySound(const std::string_view& sound) {
+    // Wait for the previous sound to finish
+    {
+        std::unique_lock<std::mutex> lock(audio_decode_mutex_);
+        audio_decode_cv_.wait(lock, [this]() {
+            return audio_decode_queue_.Empty();
+        });
+    }
+    background_task_->WaitForCompletion();
+
+    const char* data = sound.data();
+    size_t size = sound.size();
+    for (const char* p = data; p < data + size; ) {
+        auto p3 = (BinaryProtocol3*)p;
+        p += sizeof(BinaryProtocol3);
+
+        auto payload_size = ntohs(p3->payload_size);
+        // The P3 header has no timing, the Opus TOC byte of each packet tells its duration
+        int frame_duration = OpusPacketDurationMs(p3->payload, payload_size);
+        if (frame_duration == 0) {
+            frame_duration = 60;
+        }
+        AudioStreamPacket packet;
+        packet.sample_rate = 16000;
+        packet.frame_duration = frame_duration;
+        packet.payload = AudioPayloadPool::GetInstance().Acquire(payload_size);
+        memcpy(packet.payload.data(), p3->payload, payload_size);
+        p += payload_size;
+        packet.receive_time_ms = esp_timer_get_time() / 1000;
+
+        // Sounds may be longer than the ring, wait for the audio loop to drain it
+        while (!audio_decode_queue_.TryPush(std::move(packet))) {
+            vTaskDelay(pdMS_TO_TICKS(frame_duration));
+        }
+        NotifyAudioDecode();
+    }
+}
+
+void AudioPipeline::ResetDecoder() {
+    ClearDecodeQueue();
+    last_output_time_ = std::chrono::steady_clock::now();
+    codec_->EnableOutput(true);
+}
+
+void AudioPipeline::ClearDecodeQueue() {
+    AudioStreamPacket packet;
+    while (audio_decode_queue_.TryPop(packet)) {
+        AudioPayloadPool::GetInstance().Release(std::move(packet.payload));
+    }
+    // The jitter buffer and the decoder belong to the decode task, it resets them on the next pass.
+    // Frames the tasks already hold are dropped by their generation
+    jitter_buffer_reset_ = true;
+    decode_generation_++;
+    NotifyAudioDecode();
+    std::lock_guard<std::mutex> lock(audio_decode_mutex_);
+    audio_decode_cv_.notify_all();
+}
+
+// Switching between formats the pool has seen (e.g. TTS and a local sound) does not allocate
+void AudioPipeline::SetDecodeSampleRate(int sample_rate, int frame_duration) {
+    decoder_ = decoder_pool_.Get(sample_rate, frame_duration);
+}
+
+void AudioPipeline::NotifyAudioDecode() {
+    if (audio_decode_task_handle_ != nullptr) {
+        xTaskNotifyGive(audio_decode_task_handle_);
+    }
+}
+
+// The decode task turns received packets into PCM frames for the output task,
+// so decoding never waits behind opus encoding on the background task
+void AudioPipeline::AudioDecodeTask() {
+    auto& payload_pool = AudioPayloadPool::GetInstance();
+    const int max_silence_seconds = 10;
+    int64_t first_packet_time_ms = 0;
+    AudioStreamPacket packet;
+    PcmFrame frame;
+
+    while (true) {
+        if (jitter_buffer_reset_.exchange(false)) {
+            while (jitter_buffer_.Drain(packet)) {
+                payload_pool.Release(std::move(packet.payload));
+            }
+            jitter_buffer_.Reset();
+            decoder_->decoder->ResetState();
+            // Drop decoded frames that have not been played yet
+            while (pcm_ready_queue_.TryPop(frame)) {
+                pcm_free_queue_.TryPush(std::move(frame));
+            }
+            first_packet_time_ms = 0;
+        }
+
+        // Move the received packets into the jitter buffer. While it is full they stay in the
+        // decode queue, so PlaySound and the protocol see the backpressure instead of the
+        // jitter buffer dropping the surplus
+        bool received = false;
+        while (!jitter_buffer_.Full() && audio_decode_queue_.TryPop(packet)) {
+            received = true;
+            if (first_packet_time_ms == 0) {
+                first_packet_time_ms = packet.receive_time_ms;
+            }
+            if (!jitter_buffer_.Put(std::move(packet), packet.receive_time_ms)) {
+                payload_pool.Release(std::move(packet.payload));
+            }
+        }
+        if (received) {
+            std::lock_guard<std::mutex> lock(audio_decode_mutex_);
+            audio_decode_cv_.notify_all();
+        }
+
+        // Wait for the output task to hand back a buffer
+        if (!codec_->output_enabled() || pcm_free_queue_.Empty()) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        // ClearDecodeQueue sets the reset flag before it bumps the generation: if this already
+        // reads the new generation, the reset is handled first and no old packet gets stamped with it
+        uint32_t generation = decode_generation_;
+        if (jitter_buffer_reset_) {
+            continue;
+        }
+
+        // An empty payload (kJitterBufferConceal) makes the decoder run packet loss concealment
+        auto result = jitter_buffer_.Get(packet, esp_timer_get_time() / 1000);
+        if (result == kJitterBufferEmpty) {
+            if (jitter_buffer_.Empty()) {
+                // Disable the output if there is no audio data for a long time
+                if (idle_) {
+                    auto duration = std::chrono::duration_cast<std::chrono::seconds>(
+                        std::chrono::steady_clock::now() - last_output_time_.load()).count();
+                    if (duration > max_silence_seconds) {
+                        codec_->EnableOutput(false);
+                    }
+                }
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+            } else {
+                // The jitter buffer is holding frames back, check again shortly
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            }
+            continue;
+        }
+
+        if (playback_aborted_) {
+            payload_pool.Release(std::move(packet.payload));
+            continue;
+        }
+
+        // Synchronize the sample rate and frame duration
+        SetDecodeSampleRate(packet.sample_rate, packet.frame_duration);
+        bool decoded = decoder_->decoder->Decode(std::move(packet.payload), decode_buffer_);
+        payload_pool.Release(std::move(packet.payload));
+        if (!decoded) {
+            continue;
+        }
+        if (result == kJitterBufferPacket) {
+            LATENCY_TRACE(kLatencyDecode, packet.receive_time_ms * 1000);
+        }
+
+        pcm_free_queue_.TryPop(frame);
+        // Resample if the sample rate is different
+        if (decoder_->resample) {
+            frame.pcm.resize(decoder_->resampler.GetOutputSamples(decode_buffer_.size()));
+            decoder_->resampler.Process(decode_buffer_.data(), decode_buffer_.size(), frame.pcm.data());
+        } else {
+            frame.pcm.swap(decode_buffer_);
+        }
+        frame.timestamp = packet.timestamp;
+        frame.generation = generation;
+        frame.decode_time_us = LATENCY_TRACE_NOW();
+        frame.first_packet_time_ms = first_packet_time_ms;
+        first_packet_time_ms = -1;
+        pcm_ready_queue_.TryPush(std::move(frame));
+        xTaskNotifyGive(audio_output_task_handle_);
+    }
+}
+
+// The output task drains decoded frames into the codec, blocking on the I2S DMA
+void AudioPipeline::AudioOutputTask() {
+    PcmFrame frame;
+
+    while (true) {
+        if (!pcm_ready_queue_.TryPop(frame)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        // Decoded before the last reset, e.g. popped just as the reply was aborted
+        if (frame.generation != decode_generation_) {
+            pcm_free_queue_.TryPush(std::move(frame));
+            NotifyAudioDecode();
+            continue;
+        }
+
+        codec_->OutputData(frame.pcm);
+        LATENCY_TRACE(kLatencyOutput, frame.decode_time_us);
+        if (frame.first_packet_time_ms > 0) {
+            ESP_LOGI(TAG, "First audio out %lld ms after the first packet",
+                esp_timer_get_time() / 1000 - frame.first_packet_time_ms);
+        }
+#ifdef CONFIG_USE_SERVER_AEC
+        {
+            std::lock_guard<std::mutex> lock(timestamp_mutex_);
+            timestamp_queue_.push_back(frame.timestamp);
+        }
+#endif
+        last_output_time_ = std::chrono::steady_clock::now();
+
+        pcm_free_queue_.TryPush(std::move(frame));
+        NotifyAudioDecode();
+    }
+}
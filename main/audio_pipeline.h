@@ -0,0 +1,165 @@
+#ifndef AUDIO_PIPELINE_H
+#define AUDIO_PIPELINE_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include <opus_encoder.h>
+#include <opus_resampler.h>
+
+#include "audio_codec.h"
+#include "audio_processor.h"
+#include "wake_word.h"
+#include "background_task.h"
+#include "bounded_queue.h"
+#include "jitter_buffer.h"
+#include "decoder_pool.h"
+#include "protocol.h"
+
+// Default frame duration, a session can use 20 / 40 / 60 ms (see Application::SetFrameDuration)
+#define OPUS_FRAME_DURATION_MS 60
+#define OPUS_MIN_FRAME_DURATION_MS 20
+#define OPUS_MAX_FRAME_DURATION_MS 60
+// Queues hold up to 2.4s of audio, the slots are sized for the shortest frames
+#define AUDIO_QUEUE_DURATION_MS 2400
+#define MAX_AUDIO_PACKETS_IN_QUEUE (AUDIO_QUEUE_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS)
+#define AUDIO_PCM_FRAME_COUNT 2
+
+/*
+ * The audio tasks and queues between the codec and the protocol.
+ *
+ * Uplink: the audio loop reads the codec and feeds the wake word detector or
+ * the audio processor, the processed audio is opus encoded on the background
+ * task and queued until the main loop sends it with SendQueuedAudio().
+ * Downlink: packets from PushDecodePacket() / PlaySound() go through the jitter
+ * buffer and the decoder pool on the decode task, the output task writes the
+ * PCM frames to the codec.
+ *
+ * Application owns the conversation state and drives this through the calls
+ * below; the pipeline itself knows nothing about device states.
+ */
+class AudioPipeline {
+public:
+    AudioPipeline() = default;
+    AudioPipeline(const AudioPipeline&) = delete;
+    AudioPipeline& operator=(const AudioPipeline&) = delete;
+
+    // Sets up the encoder, decoders and PCM frames for the codec and starts the audio tasks
+    void Start(AudioCodec* codec, WakeWord* wake_word, AudioProcessor* audio_processor,
+        BackgroundTask* background_task, int frame_duration, int complexity);
+
+    // Wakes the audio loop after a detector or the processor was started
+    void NotifyAudioInput();
+    // Called with the processor output, encodes it on the background task
+    void EncodeAudio(std::vector<int16_t>&& data);
+    // Called on the background task whenever an encoded packet was queued
+    void OnAudioQueued(std::function<void()> callback) { on_audio_queued_ = std::move(callback); }
+    // Sends what is queued, a backlog is coalesced up to the protocol's burst size.
+    // Returns the number of packets sent, the queue is dropped if a send fails
+    size_t SendQueuedAudio(Protocol& protocol);
+    // A new turn starts with a fresh encoder state and encode time, call with the background task idle
+    void ResetEncoder();
+    // Replaces the encoder once the background task is idle, for a new session
+    void SetFrameDuration(int frame_duration);
+    void SetEncoderComplexity(int complexity);
+    // Encode time spent on the background task since the last call
+    uint32_t TakeEncodeTime() { return encode_time_us_.exchange(0); }
+    void ClearTimestamps();
+
+    // Returns false if the decode queue is full, the packet is left untouched then
+    bool PushDecodePacket(AudioStreamPacket&& packet);
+    // Queues a P3 sound after the previous one, blocks while the decode queue is full
+    void PlaySound(const std::string_view& sound);
+    // Drops queued and buffered playback and turns the output on
+    void ResetDecoder();
+    void ClearDecodeQueue();
+    // Packets are dropped instead of decoded while the reply is aborted
+    void SetPlaybackAborted(bool aborted) { playback_aborted_ = aborted; }
+    // While idle the output is turned off after a long silence
+    void SetIdle(bool idle) { idle_ = idle; }
+
+    inline int frame_duration() const { return frame_duration_; }
+    inline size_t send_queue_depth() const { return audio_send_queue_.Size(); }
+    inline size_t send_queue_limit() const { return audio_send_queue_.limit(); }
+    JitterBufferStats GetJitterBufferStats() const { return jitter_buffer_.GetStats(); }
+
+private:
+    // audio_decode_queue_ -> decode task -> PCM frames -> output task
+    struct PcmFrame {
+        std::vector<int16_t> pcm;
+        uint32_t timestamp = 0;
+        // decode_generation_ when the frame was decoded, a newer one means the playback was reset
+        uint32_t generation = 0;
+        int64_t first_packet_time_ms = 0;
+        int64_t decode_time_us = 0;
+    };
+
+    AudioCodec* codec_ = nullptr;
+    WakeWord* wake_word_ = nullptr;
+    AudioProcessor* audio_processor_ = nullptr;
+    BackgroundTask* background_task_ = nullptr;
+    std::function<void()> on_audio_queued_;
+
+    TaskHandle_t audio_loop_task_handle_ = nullptr;
+    TaskHandle_t audio_decode_task_handle_ = nullptr;
+    TaskHandle_t audio_output_task_handle_ = nullptr;
+
+    // Lock-free rings, slots are preallocated and sized by MAX_AUDIO_PACKETS_IN_QUEUE
+    BoundedQueue<AudioStreamPacket> audio_send_queue_{MAX_AUDIO_PACKETS_IN_QUEUE};
+    std::array<AudioStreamPacket, AUDIO_MAX_BURST_FRAMES> send_burst_;
+    BoundedQueue<AudioStreamPacket> audio_decode_queue_{MAX_AUDIO_PACKETS_IN_QUEUE};
+    std::mutex audio_decode_mutex_;
+    std::condition_variable audio_decode_cv_;
+
+    // Re-sequences audio_decode_queue_ for playback, owned by the decode task
+    JitterBuffer jitter_buffer_{MAX_AUDIO_PACKETS_IN_QUEUE};
+    std::atomic<bool> jitter_buffer_reset_{false};
+    std::atomic<uint32_t> decode_generation_{0};
+    std::atomic<bool> playback_aborted_{false};
+    std::atomic<bool> idle_{false};
+    std::vector<int16_t> decode_buffer_;
+    BoundedQueue<PcmFrame> pcm_free_queue_{AUDIO_PCM_FRAME_COUNT};
+    BoundedQueue<PcmFrame> pcm_ready_queue_{AUDIO_PCM_FRAME_COUNT};
+    std::atomic<std::chrono::steady_clock::time_point> last_output_time_;
+    // Decoders are cached per format, decoder_ is the one the decode task uses now
+    DecoderPool decoder_pool_;
+    DecoderSlot* decoder_ = nullptr;
+
+    // Output timestamps, echoed in the uplink for server side AEC
+    std::list<uint32_t> timestamp_queue_;
+    std::mutex timestamp_mutex_;
+
+    // Only used on the background task
+    std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
+    std::atomic<uint32_t> encode_time_us_{0};
+    int complexity_ = 0;
+    int frame_duration_ = OPUS_FRAME_DURATION_MS;
+
+    // Audio input buffers, owned by the audio loop and reused for every chunk
+    std::vector<int16_t> input_buffer_;
+    std::vector<int16_t> input_scratch_;
+    std::vector<int16_t> channel_scratch_;
+    OpusResampler input_resampler_;
+    OpusResampler reference_resampler_;
+
+    void AudioLoop();
+    void OnAudioInput();
+    bool ReadAudio(std::vector<int16_t>& data, int sample_rate, int samples);
+    void NotifyAudioDecode();
+    void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    void AudioDecodeTask();
+    void AudioOutputTask();
+};
+
+#endif // AUDIO_PIPELINE_H
@@ -1,4 +1,5 @@
 #include "afe_audio_processor.h"
+#include "latency_tracer.h"
 #include <esp_log.h>
 
 #define PROCESSOR_RUNNING 0x01
@@ -74,6 +75,14 @@ void AfeAudioProcessor::Feed(const std::vector<int16_t>& data) {
     if (afe_data_ == nullptr) {
         return;
     }
+#if CONFIG_USE_LATENCY_TRACE
+    int64_t feed_time = LatencyTracer::NowUs();
+    if (!feed_times_.TryPush(std::move(feed_time))) {
+        int64_t oldest;
+        feed_times_.TryPop(oldest);
+        feed_times_.TryPush(std::move(feed_time));
+    }
+#endif
     afe_iface_->feed(afe_data_, data.data());
 }
 
@@ -86,6 +95,9 @@ void AfeAudioProcessor::Stop() {
     if (afe_data_ != nullptr) {
         afe_iface_->reset_buffer(afe_data_);
     }
+#if CONFIG_USE_LATENCY_TRACE
+    feed_times_.Clear();
+#endif
 }
 
 bool AfeAudioProcessor::IsRunning() {
@@ -120,6 +132,13 @@ void AfeAudioProcessor::AudioProcessorTask() {
             continue;
         }
 
+#if CONFIG_USE_LATENCY_TRACE
+        int64_t feed_time;
+        if (feed_times_.TryPop(feed_time)) {
+            LATENCY_TRACE(kLatencyAfeFetch, feed_time);
+        }
+#endif
+
         // VAD state change
         if (vad_state_change_callback_) {
             if (res->vad_state == VAD_SPEECH && !is_speaking_) {
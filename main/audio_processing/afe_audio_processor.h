@@ -12,6 +12,7 @@
 
 #include "audio_processor.h"
 #include "audio_codec.h"
+#include "bounded_queue.h"
 
 class AfeAudioProcessor : public AudioProcessor {
 public:
@@ -36,6 +37,10 @@ private:
     std::function<void(bool speaking)> vad_state_change_callback_;
     AudioCodec* codec_ = nullptr;
     bool is_speaking_ = false;
+#if CONFIG_USE_LATENCY_TRACE
+    // Feed times of the chunks inside the AFE, to trace the feed -> fetch latency
+    BoundedQueue<int64_t> feed_times_{16};
+#endif
 
     void AudioProcessorTask();
 };
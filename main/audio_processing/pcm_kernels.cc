@@ -0,0 +1,75 @@
+#include "pcm_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+static inline bool IsWordAligned(const void* p) {
+    return ((uintptr_t)p & 3) == 0;
+}
+
+static inline uint32_t LoadWord(const int16_t* p) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+static inline void StoreWord(int16_t* p, uint32_t word) {
+    memcpy(p, &word, sizeof(word));
+}
+
+void PcmDeinterleaveStereo(const int16_t* input, int16_t* left, int16_t* right, size_t frames) {
+    size_t i = 0;
+    if (IsWordAligned(input) && IsWordAligned(left) && IsWordAligned(right)) {
+        // Two frames per step: w0 = R0:L0, w1 = R1:L1 (little endian)
+        for (; i + 2 <= frames; i += 2) {
+            uint32_t w0 = LoadWord(input + i * 2);
+            uint32_t w1 = LoadWord(input + i * 2 + 2);
+            StoreWord(left + i, (w0 & 0xFFFF) | (w1 << 16));
+            StoreWord(right + i, (w0 >> 16) | (w1 & 0xFFFF0000));
+        }
+    }
+    for (; i < frames; i++) {
+        left[i] = input[i * 2];
+        right[i] = input[i * 2 + 1];
+    }
+}
+
+void PcmInterleaveStereo(const int16_t* left, const int16_t* right, int16_t* output, size_t frames) {
+    size_t i = 0;
+    if (IsWordAligned(left) && IsWordAligned(right) && IsWordAligned(output)) {
+        // Two frames per step: l = L1:L0, r = R1:R0
+        for (; i + 2 <= frames; i += 2) {
+            uint32_t l = LoadWord(left + i);
+            uint32_t r = LoadWord(right + i);
+            StoreWord(output + i * 2, (l & 0xFFFF) | (r << 16));
+            StoreWord(output + i * 2 + 2, (l >> 16) | (r & 0xFFFF0000));
+        }
+    }
+    for (; i < frames; i++) {
+        output[i * 2] = left[i];
+        output[i * 2 + 1] = right[i];
+    }
+}
+
+void PcmApplyGainQ31(const int16_t* __restrict input, int32_t* __restrict output, size_t samples, int32_t gain_start, int32_t gain_end) {
+    if (gain_start == gain_end || samples == 0) {
+        for (size_t i = 0; i < samples; i++) {
+            output[i] = (int32_t)input[i] * gain_start;
+        }
+        return;
+    }
+    // Step the gain in 1/65536 units of Q16 to keep the ramp exact for short blocks
+    int64_t gain = (int64_t)gain_start << 16;
+    int64_t step = (((int64_t)gain_end - gain_start) << 16) / (int64_t)samples;
+    for (size_t i = 0; i < samples; i++) {
+        gain += step;
+        output[i] = (int32_t)input[i] * (int32_t)(gain >> 16);
+    }
+}
+
+void PcmConvertQ31ToQ15(const int32_t* __restrict input, int16_t* __restrict output, size_t samples, int shift) {
+    for (size_t i = 0; i < samples; i++) {
+        int32_t value = input[i] >> shift;
+        output[i] = (int16_t)std::clamp<int32_t>(value, -INT16_MAX, INT16_MAX);
+    }
+}
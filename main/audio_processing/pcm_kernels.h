@@ -0,0 +1,33 @@
+#ifndef PCM_KERNELS_H
+#define PCM_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Sample format kernels for the audio input and output paths.
+ *
+ * The stereo fast path works on 32-bit words (two 16-bit lanes per register), so
+ * it vectorizes on any target without intrinsics. It is used when all buffers are
+ * 4-byte aligned, otherwise the scalar loop is used. The gain and conversion
+ * loops are branch free so the compiler can unroll / vectorize them.
+ */
+
+// input: L0 R0 L1 R1 ... -> left: L0 L1 ..., right: R0 R1 ...
+void PcmDeinterleaveStereo(const int16_t* input, int16_t* left, int16_t* right, size_t frames);
+
+// left: L0 L1 ..., right: R0 R1 ... -> output: L0 R0 L1 R1 ...
+void PcmInterleaveStereo(const int16_t* left, const int16_t* right, int16_t* output, size_t frames);
+
+// Q16 gain, 65536 is unity. Q15 samples scaled by a gain <= 65536 always fit in
+// Q31, so no saturation is needed on this path.
+#define PCM_GAIN_UNITY 65536
+
+// output[i] = input[i] * gain (Q15 -> Q31), gain moves linearly from gain_start to
+// gain_end over the block so volume changes do not produce zipper noise
+void PcmApplyGainQ31(const int16_t* __restrict input, int32_t* __restrict output, size_t samples, int32_t gain_start, int32_t gain_end);
+
+// output[i] = saturate(input[i] >> shift), clamped to +-INT16_MAX
+void PcmConvertQ31ToQ15(const int32_t* __restrict input, int16_t* __restrict output, size_t samples, int shift);
+
+#endif // PCM_KERNELS_H
@@ -3,7 +3,9 @@
 #include "settings.h"
 #include "display/display.h"
 #include "assets/lang_config.h"
+#include "application.h"
 
+#include <cJSON.h>
 #include <esp_log.h>
 #include <esp_ota_ops.h>
 #include <esp_chip_info.h>
@@ -44,6 +46,21 @@ std::string Board::GenerateUuid() {
     return std::string(uuid_str);
 }
 
+void Board::AddAudioStreamJson(cJSON* root) {
+    AudioStreamStats stats;
+    if (!Application::GetInstance().GetAudioStreamStats(stats)) {
+        return;
+    }
+    auto audio_stream = cJSON_CreateObject();
+    cJSON_AddNumberToObject(audio_stream, "received", stats.received);
+    cJSON_AddNumberToObject(audio_stream, "lost", stats.lost);
+    cJSON_AddNumberToObject(audio_stream, "reordered", stats.reordered);
+    cJSON_AddNumberToObject(audio_stream, "duplicated", stats.duplicated);
+    cJSON_AddNumberToObject(audio_stream, "late", stats.late);
+    cJSON_AddNumberToObject(audio_stream, "jitter_ms", stats.jitter_ms);
+    cJSON_AddItemToObject(root, "audio_stream", audio_stream);
+}
+
 bool Board::GetBatteryLevel(int &level, bool& charging, bool& discharging) {
     return false;
 }
@@ -14,6 +14,7 @@
 void* create_board();
 class AudioCodec;
 class Display;
+struct cJSON;
 class Board {
 private:
     Board(const Board&) = delete; // 禁用拷贝构造函数
@@ -22,6 +23,8 @@ private:
 protected:
     Board();
     std::string GenerateUuid();
+    // Adds the "audio_stream" object of GetDeviceStatusJson, if the protocol tracks it
+    void AddAudioStreamJson(cJSON* root);
 
     // 软件生成的设备唯一标识
     std::string uuid_;
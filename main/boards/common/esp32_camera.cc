@@ -11,6 +11,9 @@
 
 #define TAG "Esp32Camera"
 
+// Upload progress is reported to the MCP caller every this many JPEG bytes
+#define EXPLAIN_PROGRESS_BYTES 8192
+
 Esp32Camera::Esp32Camera(const camera_config_t& config) {
     // camera init
     esp_err_t err = esp_camera_init(&config); // 配置上面定义的参数
@@ -262,7 +265,11 @@ std::string Esp32Camera::Explain(const std::string& question) {
     http->Write(file_header.c_str(), file_header.size());
     
     // 第三块：JPEG数据
+    auto& mcp_server = McpServer::GetInstance();
     size_t total_sent = 0;
+    size_t next_progress = EXPLAIN_PROGRESS_BYTES;
+    size_t reported = 0;
+    bool cancelled = false;
     while (true) {
         JpegChunk chunk;
         if (xQueueReceive(jpeg_queue, &chunk, portMAX_DELAY) != pdPASS) {
@@ -272,8 +279,17 @@ std::string Esp32Camera::Explain(const std::string& question) {
         if (chunk.data == nullptr) {
             break; // The last chunk
         }
-        http->Write((const char*)chunk.data, chunk.len);
-        total_sent += chunk.len;
+        // After a cancel the encoder is still drained, it blocks on a full queue otherwise
+        cancelled = cancelled || mcp_server.IsCallCancelled();
+        if (!cancelled) {
+            http->Write((const char*)chunk.data, chunk.len);
+            total_sent += chunk.len;
+            if (total_sent >= next_progress) {
+                mcp_server.SendProgress(total_sent, 0, "Uploading the photo");
+                reported = total_sent;
+                next_progress += EXPLAIN_PROGRESS_BYTES;
+            }
+        }
         heap_caps_free(chunk.data);
     }
     // Wait for the encoder thread to finish
@@ -281,12 +297,23 @@ std::string Esp32Camera::Explain(const std::string& question) {
     // 清理队列
     vQueueDelete(jpeg_queue);
 
+    if (cancelled) {
+        ESP_LOGI(TAG, "Explain cancelled after %u bytes", (unsigned)total_sent);
+        http->Close();
+        return "{\"success\": false, \"message\": \"Cancelled\"}";
+    }
+    // Progress must increase, the last chunk may already have been reported
+    if (total_sent > reported) {
+        mcp_server.SendProgress(total_sent, total_sent, "Photo uploaded, waiting for the explanation");
+    }
+
     // 第四块：multipart尾部
     http->Write(multipart_footer.c_str(), multipart_footer.size());
     
     // 结束块
     http->Write("", 0);
 
+    // Blocks until the explanation arrives. Waiting for it can not be cancelled, a cancelled call only gets no response
     if (http->GetStatusCode() != 200) {
         ESP_LOGE(TAG, "Failed to upload photo, status code: %d", http->GetStatusCode());
         return "{\"success\": false, \"message\": \"Failed to upload photo\"}";
@@ -138,6 +138,13 @@ std::string Ml307Board::GetDeviceStatusJson() {
      *         "level": 50,
      *         "charging": true
      *     },
+     *     "audio_stream": {
+     *         "received": 500,
+     *         "lost": 2,
+     *         "reordered": 1,
+     *         "duplicated": 0,
+     *         "jitter_ms": 12
+     *     },
      *     "network": {
      *         "type": "cellular",
      *         "carrier": "CHINA MOBILE",
@@ -179,6 +186,9 @@ std::string Ml307Board::GetDeviceStatusJson() {
         cJSON_AddItemToObject(root, "battery", battery);
     }
 
+    // Audio stream of the current / last session (UDP transport only)
+    AddAudioStreamJson(root);
+
     // Network
     auto network = cJSON_CreateObject();
     cJSON_AddStringToObject(network, "type", "cellular");
@@ -218,6 +218,13 @@ std::string WifiBoard::GetDeviceStatusJson() {
      *         "level": 50,
      *         "charging": true
      *     },
+     *     "audio_stream": {
+     *         "received": 500,
+     *         "lost": 2,
+     *         "reordered": 1,
+     *         "duplicated": 0,
+     *         "jitter_ms": 12
+     *     },
      *     "network": {
      *         "type": "wifi",
      *         "ssid": "Xiaozhi",
@@ -262,6 +269,9 @@ std::string WifiBoard::GetDeviceStatusJson() {
         cJSON_AddItemToObject(root, "battery", battery);
     }
 
+    // Audio stream of the current / last session (UDP transport only)
+    AddAudioStreamJson(root);
+
     // Network
     auto network = cJSON_CreateObject();
     auto& wifi_station = WifiStation::GetInstance();
@@ -558,6 +558,10 @@
         }
 
         void InitializeButtons() {
+            // Connect while the button is still down, the click arrives after the release
+            boot_button_.OnPressDown([this]() {
+                Application::GetInstance().PrewarmAudioChannel();
+            });
             boot_button_.OnClick([this]() {
                 power_save_timer_->WakeUp();
                 auto& app = Application::GetInstance();
@@ -0,0 +1,120 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Fixed-capacity lock-free queue (Vyukov bounded MPMC ring).
+ *
+ * All slots are allocated once in the constructor, TryPush / TryPop never touch
+ * the heap and never block. The physical ring is rounded up to a power of two so
+ * the position counters can wrap freely; `limit` is the logical capacity and can
+ * be lowered at runtime without reallocating.
+ * Items left in a slot after TryPop are moved-from and hold no resources.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t limit) : limit_(limit) {
+        size_t size = 1;
+        while (size < limit) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        slots_ = std::make_unique<Slot[]>(size);
+        for (size_t i = 0; i < size; i++) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Returns false if the queue is full, `item` is left untouched in that case
+    bool TryPush(T&& item) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots_[pos & mask_];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                // Modular distance, larger than the ring means `pos` is stale
+                size_t used = pos - head_.load(std::memory_order_acquire);
+                if (used > mask_ + 1) {
+                    pos = tail_.load(std::memory_order_relaxed);
+                    continue;
+                }
+                if (used >= limit_.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.item = std::move(item);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty
+    bool TryPop(T& item) {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots_[pos & mask_];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    item = std::move(slot.item);
+                    slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void Clear() {
+        T item;
+        while (TryPop(item)) {
+        }
+    }
+
+    // Approximate while producers / consumers are active
+    size_t Size() const {
+        size_t head = head_.load(std::memory_order_acquire);
+        size_t used = tail_.load(std::memory_order_acquire) - head;
+        return used > mask_ + 1 ? 0 : used;
+    }
+    bool Empty() const { return Size() == 0; }
+    size_t limit() const { return limit_.load(std::memory_order_relaxed); }
+    size_t capacity() const { return mask_ + 1; }
+    // Items already queued beyond a lowered limit are kept, new pushes fail until it drains
+    void set_limit(size_t limit) {
+        limit_.store(limit < mask_ + 1 ? limit : mask_ + 1, std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    std::atomic<size_t> limit_;
+    size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<size_t> head_{0};
+    std::atomic<size_t> tail_{0};
+};
+
+#endif // BOUNDED_QUEUE_H
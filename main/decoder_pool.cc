@@ -0,0 +1,78 @@
+#include "decoder_pool.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#define TAG "DecoderPool"
+
+void DecoderPool::Initialize(int output_sample_rate) {
+    output_sample_rate_ = output_sample_rate;
+}
+
+void DecoderPool::Preload(int sample_rate, int frame_duration) {
+    if (Find(sample_rate, frame_duration) == nullptr) {
+        Create(sample_rate, frame_duration);
+    }
+}
+
+DecoderSlot* DecoderPool::Get(int sample_rate, int frame_duration) {
+    if (current_ != nullptr && current_->decoder->sample_rate() == sample_rate &&
+        current_->decoder->duration_ms() == frame_duration) {
+        return current_;
+    }
+
+    auto slot = Find(sample_rate, frame_duration);
+    if (slot != nullptr) {
+        hits_++;
+        // The cached state belongs to the stream that used it last
+        slot->decoder->ResetState();
+        if (slot->resample) {
+            slot->resampler.Configure(sample_rate, output_sample_rate_);
+        }
+    } else {
+        misses_++;
+        slot = Create(sample_rate, frame_duration);
+    }
+    slot->last_used = ++clock_;
+    current_ = slot;
+    return slot;
+}
+
+DecoderSlot* DecoderPool::Find(int sample_rate, int frame_duration) {
+    for (auto& slot : slots_) {
+        if (slot.decoder && slot.decoder->sample_rate() == sample_rate &&
+            slot.decoder->duration_ms() == frame_duration) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+DecoderSlot* DecoderPool::Create(int sample_rate, int frame_duration) {
+    // Take an empty slot, otherwise the least recently used one
+    DecoderSlot* slot = &slots_[0];
+    for (auto& candidate : slots_) {
+        if (!candidate.decoder) {
+            slot = &candidate;
+            break;
+        }
+        if (candidate.last_used < slot->last_used) {
+            slot = &candidate;
+        }
+    }
+    if (slot == current_) {
+        current_ = nullptr;
+    }
+
+    int64_t start_time = esp_timer_get_time();
+    slot->decoder.reset();
+    slot->decoder = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
+    slot->resample = sample_rate != output_sample_rate_;
+    if (slot->resample) {
+        slot->resampler.Configure(sample_rate, output_sample_rate_);
+    }
+    slot->last_used = clock_;
+    ESP_LOGI(TAG, "Created decoder %d Hz %d ms%s in %lld us", sample_rate, frame_duration,
+        slot->resample ? " (resampled)" : "", esp_timer_get_time() - start_time);
+    return slot;
+}
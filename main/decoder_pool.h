@@ -0,0 +1,53 @@
+#ifndef DECODER_POOL_H
+#define DECODER_POOL_H
+
+#include <memory>
+#include <cstdint>
+
+#include <opus_decoder.h>
+#include <opus_resampler.h>
+
+// Server TTS, local P3 sounds and one spare format
+#define DECODER_POOL_SIZE 3
+
+// An opus decoder and the resampler that brings its output to the codec rate
+struct DecoderSlot {
+    std::unique_ptr<OpusDecoderWrapper> decoder;
+    OpusResampler resampler;
+    bool resample = false;
+    uint32_t last_used = 0;
+};
+
+/*
+ * Keeps decoders for the last few (sample rate, frame duration) formats.
+ *
+ * The server TTS (usually 24kHz) and the local sounds (16kHz P3) interleave,
+ * creating a decoder allocates its state and buffers every time, so a switch
+ * between cached formats only resets the decoder state instead. The least
+ * recently used slot is replaced when a new format shows up.
+ * Owned by the audio decode task, not thread safe.
+ */
+class DecoderPool {
+public:
+    void Initialize(int output_sample_rate);
+    // Creates the decoder ahead of time, e.g. for the formats that will play first
+    void Preload(int sample_rate, int frame_duration);
+    // Returns the decoder for the format, reset if it was not the last one used
+    DecoderSlot* Get(int sample_rate, int frame_duration);
+
+    inline uint32_t hits() const { return hits_; }
+    inline uint32_t misses() const { return misses_; }
+
+private:
+    int output_sample_rate_ = 0;
+    DecoderSlot slots_[DECODER_POOL_SIZE];
+    DecoderSlot* current_ = nullptr;
+    uint32_t clock_ = 0;
+    uint32_t hits_ = 0;
+    uint32_t misses_ = 0;
+
+    DecoderSlot* Find(int sample_rate, int frame_duration);
+    DecoderSlot* Create(int sample_rate, int frame_duration);
+};
+
+#endif // DECODER_POOL_H
@@ -0,0 +1,93 @@
+#include "encoder_controller.h"
+
+#include <cJSON.h>
+
+// Frame duration used when the link was congested, see Application::ApplyFrameDuration
+#define ENCODER_CONGESTED_FRAME_DURATION_MS 60
+
+void EncoderController::Configure(int complexity, int max_complexity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_complexity_ = max_complexity;
+    complexity_ = complexity > max_complexity ? max_complexity : complexity;
+    configured_complexity_ = complexity_;
+}
+
+void EncoderController::StartSession() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The previous session decides the frame duration of this one
+    min_frame_duration_ = session_congested_ ? ENCODER_CONGESTED_FRAME_DURATION_MS : 0;
+    session_congested_ = false;
+    congested_samples_ = 0;
+    last_received_ = 0;
+    last_lost_ = 0;
+}
+
+bool EncoderController::Update(const EncoderSample& sample) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    load_percent_ = sample.elapsed_us > 0 ? (int)((uint64_t)sample.encode_time_us * 100 / sample.elapsed_us) : 0;
+    queue_percent_ = sample.send_queue_limit > 0 ? (int)(sample.send_queue_depth * 100 / sample.send_queue_limit) : 0;
+
+    // Counters restart with every session
+    if (sample.received < last_received_ || sample.lost < last_lost_) {
+        last_received_ = 0;
+        last_lost_ = 0;
+    }
+    uint32_t received = sample.received - last_received_;
+    uint32_t lost = sample.lost - last_lost_;
+    last_received_ = sample.received;
+    last_lost_ = sample.lost;
+    loss_percent_ = received + lost > 0 ? (int)(lost * 100 / (received + lost)) : 0;
+
+    congested_ = queue_percent_ >= ENCODER_CONGESTED_QUEUE_PERCENT || loss_percent_ >= ENCODER_CONGESTED_LOSS_PERCENT;
+    congested_samples_ = congested_ ? congested_samples_ + 1 : 0;
+    if (congested_samples_ >= ENCODER_CONGESTED_SAMPLES) {
+        session_congested_ = true;
+    }
+
+    int complexity = complexity_;
+    if (load_percent_ > ENCODER_LOAD_HIGH_PERCENT) {
+        complexity--;
+    } else if (load_percent_ < ENCODER_LOAD_LOW_PERCENT) {
+        complexity++;
+    }
+    if (complexity < 0) {
+        complexity = 0;
+    } else if (complexity > configured_complexity_) {
+        complexity = configured_complexity_;
+    }
+    if (complexity == complexity_) {
+        return false;
+    }
+    complexity_ = complexity;
+    return true;
+}
+
+std::string EncoderController::GetStatusJson() const {
+    // A snapshot, Update() may run on the main task meanwhile
+    int complexity, max_complexity, min_frame_duration, load_percent, queue_percent, loss_percent;
+    bool congested;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        complexity = complexity_;
+        max_complexity = max_complexity_;
+        min_frame_duration = min_frame_duration_;
+        load_percent = load_percent_;
+        queue_percent = queue_percent_;
+        loss_percent = loss_percent_;
+        congested = congested_;
+    }
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "complexity", complexity);
+    cJSON_AddNumberToObject(root, "max_complexity", max_complexity);
+    cJSON_AddNumberToObject(root, "min_frame_duration", min_frame_duration);
+    cJSON_AddNumberToObject(root, "encoder_load_percent", load_percent);
+    cJSON_AddNumberToObject(root, "send_queue_percent", queue_percent);
+    cJSON_AddNumberToObject(root, "loss_percent", loss_percent);
+    cJSON_AddBoolToObject(root, "congested", congested);
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
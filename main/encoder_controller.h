@@ -0,0 +1,70 @@
+#ifndef ENCODER_CONTROLLER_H
+#define ENCODER_CONTROLLER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+// Share of one core the opus encoder may use before the complexity is lowered
+#define ENCODER_LOAD_HIGH_PERCENT 40
+#define ENCODER_LOAD_LOW_PERCENT 20
+// Send queue fill / loss rate that mark the link as congested
+#define ENCODER_CONGESTED_QUEUE_PERCENT 50
+#define ENCODER_CONGESTED_LOSS_PERCENT 5
+// Consecutive congested samples before the next session falls back to the longest frames
+#define ENCODER_CONGESTED_SAMPLES 3
+
+// One second of measurements while the encoder is running
+struct EncoderSample {
+    uint32_t encode_time_us = 0;    // Time spent in OpusEncoderWrapper::Encode
+    uint32_t elapsed_us = 0;        // Wall time covered by the sample
+    size_t send_queue_depth = 0;
+    size_t send_queue_limit = 0;
+    uint32_t received = 0;          // Audio stream counters since the session started
+    uint32_t lost = 0;
+};
+
+/*
+ * Adapts the uplink opus encoder to the CPU and the link.
+ *
+ * The complexity is lowered while the encoder load is high and given back,
+ * up to the configured value, once there is headroom again. It does not
+ * change the bitrate, so the link plays no part in it. A session that
+ * stayed congested makes the next one use the longest frames, which cuts
+ * the per-packet overhead. The encoder wrapper does not expose bitrate or
+ * FEC, so those are left to opus' defaults.
+ *
+ * Update() runs on the main task, GetStatusJson() may be called from any task.
+ */
+class EncoderController {
+public:
+    // max_complexity caps the configured complexity (e.g. 0 while the device runs AEC)
+    void Configure(int complexity, int max_complexity);
+    // Called when a session starts, keeps what was learned about the link
+    void StartSession();
+    // Returns true if complexity() changed
+    bool Update(const EncoderSample& sample);
+
+    inline int complexity() const { return complexity_; }
+    // Frames shorter than this are not worth their overhead on the current link, 0 if any will do
+    inline int min_frame_duration() const { return min_frame_duration_; }
+    std::string GetStatusJson() const;
+
+private:
+    mutable std::mutex mutex_;      // Guards the status fields for GetStatusJson
+    int complexity_ = 0;
+    int configured_complexity_ = 0;
+    int max_complexity_ = 0;
+    int min_frame_duration_ = 0;
+    int load_percent_ = 0;
+    int queue_percent_ = 0;
+    int loss_percent_ = 0;
+    bool congested_ = false;
+    int congested_samples_ = 0;
+    bool session_congested_ = false;
+    uint32_t last_received_ = 0;
+    uint32_t last_lost_ = 0;
+};
+
+#endif // ENCODER_CONTROLLER_H
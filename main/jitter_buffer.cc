@@ -0,0 +1,184 @@
+#include "jitter_buffer.h"
+
+#include <algorithm>
+
+JitterBuffer::JitterBuffer(size_t capacity) : slots_(capacity) {
+}
+
+void JitterBuffer::Reset() {
+    for (auto& slot : slots_) {
+        slot.valid = false;
+        slot.packet = AudioStreamPacket();
+    }
+    count_ = 0;
+    started_ = false;
+    playing_ = false;
+    drained_ = false;
+    consecutive_concealed_ = 0;
+    // The link keeps its jitter, the next reply starts with the depth it needs
+    jitter_.Restart();
+}
+
+bool JitterBuffer::Drain(AudioStreamPacket& packet) {
+    for (auto& slot : slots_) {
+        if (slot.valid) {
+            packet = std::move(slot.packet);
+            slot.valid = false;
+            count_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void JitterBuffer::UpdateJitter(uint32_t sequence, int64_t arrival_ms, int frame_duration) {
+    if (!jitter_.Update(sequence, arrival_ms, frame_duration)) {
+        return;
+    }
+
+    // Cover twice the jitter plus the frame being decoded
+    stats_.jitter_ms = jitter_.jitter_ms();
+    if (frame_duration > 0) {
+        int depth = (2 * stats_.jitter_ms + frame_duration - 1) / frame_duration + JITTER_BUFFER_MIN_DEPTH;
+        stats_.target_depth = std::clamp(depth, JITTER_BUFFER_MIN_DEPTH, JITTER_BUFFER_MAX_DEPTH);
+    }
+}
+
+bool JitterBuffer::Put(AudioStreamPacket&& packet, int64_t arrival_ms) {
+    // Packets without a sequence (websocket, local sounds) are played in arrival order. Their
+    // arrival times say nothing about the network, so they stay out of the jitter estimate
+    bool sequenced = packet.sequence != 0;
+    uint32_t sequence = sequenced ? packet.sequence : (started_ ? highest_sequence_ + 1 : 1);
+    if (!started_) {
+        started_ = true;
+        next_sequence_ = sequence;
+        highest_sequence_ = sequence - 1;
+    }
+
+    int32_t behind = (int32_t)(next_sequence_ - sequence);
+    if (behind > 0) {
+        if ((size_t)behind <= slots_.size()) {
+            stats_.late++;
+            return false;
+        }
+        // Far behind the playout point, the sender has restarted its sequence
+        Reset();
+        started_ = true;
+        next_sequence_ = sequence;
+        highest_sequence_ = sequence - 1;
+    }
+    if ((size_t)(sequence - next_sequence_) >= slots_.size()) {
+        stats_.overflowed++;
+        return false;
+    }
+    auto& slot = slots_[sequence % slots_.size()];
+    if (slot.valid) {
+        stats_.duplicated++;
+        return false;
+    }
+
+    if (sequenced) {
+        UpdateJitter(sequence, arrival_ms, packet.frame_duration);
+    }
+    if (drained_ && sequence == next_sequence_) {
+        // The stream continued after the playout ran dry
+        stats_.underruns++;
+    }
+    drained_ = false;
+    newest_arrival_ms_ = arrival_ms;
+    sample_rate_ = packet.sample_rate;
+    frame_duration_ = packet.frame_duration;
+
+    slot.packet = std::move(packet);
+    slot.packet.sequence = sequence;
+    slot.valid = true;
+    count_++;
+    if ((int32_t)(sequence - highest_sequence_) > 0) {
+        highest_sequence_ = sequence;
+    }
+    stats_.received++;
+    return true;
+}
+
+bool JitterBuffer::FindLowestSequence(uint32_t& sequence) const {
+    bool found = false;
+    int32_t lowest = 0;
+    for (auto& slot : slots_) {
+        if (!slot.valid) {
+            continue;
+        }
+        int32_t offset = (int32_t)(slot.packet.sequence - next_sequence_);
+        if (!found || offset < lowest) {
+            lowest = offset;
+            found = true;
+        }
+    }
+    if (found) {
+        sequence = next_sequence_ + lowest;
+    }
+    return found;
+}
+
+bool JitterBuffer::TakeSlot(uint32_t sequence, AudioStreamPacket& packet) {
+    auto& slot = slots_[sequence % slots_.size()];
+    if (!slot.valid || slot.packet.sequence != sequence) {
+        return false;
+    }
+    packet = std::move(slot.packet);
+    slot.valid = false;
+    count_--;
+    next_sequence_ = sequence + 1;
+    consecutive_concealed_ = 0;
+    stats_.played++;
+    return true;
+}
+
+JitterBufferResult JitterBuffer::Get(AudioStreamPacket& packet, int64_t now_ms) {
+    if (count_ == 0) {
+        if (playing_) {
+            playing_ = false;
+            drained_ = true;
+        }
+        return kJitterBufferEmpty;
+    }
+
+    // Hold back while below the target depth, unless the sender went quiet
+    bool waiting = (int)count_ < stats_.target_depth &&
+        now_ms - newest_arrival_ms_ < stats_.target_depth * frame_duration_;
+    if (!playing_) {
+        if (waiting) {
+            return kJitterBufferEmpty;
+        }
+        playing_ = true;
+    }
+
+    if (TakeSlot(next_sequence_, packet)) {
+        return kJitterBufferPacket;
+    }
+
+    // The next frame is missing but later ones are buffered, give it a chance to arrive
+    if (waiting) {
+        return kJitterBufferEmpty;
+    }
+    if (consecutive_concealed_ < JITTER_BUFFER_MAX_CONCEAL) {
+        consecutive_concealed_++;
+        stats_.concealed++;
+        packet.sample_rate = sample_rate_;
+        packet.frame_duration = frame_duration_;
+        packet.timestamp = 0;
+        packet.sequence = next_sequence_++;
+        packet.payload.clear();
+        return kJitterBufferConceal;
+    }
+
+    // Too many frames lost in a row, resync on the oldest buffered one
+    uint32_t sequence;
+    if (FindLowestSequence(sequence) && TakeSlot(sequence, packet)) {
+        return kJitterBufferPacket;
+    }
+    return kJitterBufferEmpty;
+}
+
+JitterBufferStats JitterBuffer::GetStats() const {
+    return stats_;
+}
@@ -0,0 +1,90 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "audio_stream_packet.h"
+#include "jitter_estimator.h"
+
+#define JITTER_BUFFER_MIN_DEPTH 1
+#define JITTER_BUFFER_MAX_DEPTH 8
+#define JITTER_BUFFER_MAX_CONCEAL 3
+
+struct JitterBufferStats {
+    uint32_t received = 0;
+    uint32_t played = 0;
+    uint32_t late = 0;
+    uint32_t duplicated = 0;
+    uint32_t overflowed = 0;
+    uint32_t concealed = 0;
+    uint32_t underruns = 0;
+    int jitter_ms = 0;
+    int target_depth = JITTER_BUFFER_MIN_DEPTH;
+};
+
+enum JitterBufferResult {
+    kJitterBufferEmpty,   // Nothing to play yet
+    kJitterBufferPacket,  // A received frame was returned
+    kJitterBufferConceal, // The frame is missing, decode it with packet loss concealment
+};
+
+/*
+ * Re-sequences incoming opus frames for playback.
+ *
+ * Frames are keyed on AudioStreamPacket::sequence. Packets without a sequence
+ * are appended in arrival order and get the next one when they are stored.
+ * The playout depth follows the arrival jitter of the sequenced packets
+ * (JitterEstimator), and a missing frame is reported as
+ * kJitterBufferConceal so the caller can run the decoder's PLC instead of
+ * skipping it.
+ *
+ * Not thread safe, it is owned by the audio output stage.
+ */
+class JitterBuffer {
+public:
+    explicit JitterBuffer(size_t capacity);
+
+    void Reset();
+    // Returns false if the packet is late, duplicated or does not fit; it is left untouched then
+    bool Put(AudioStreamPacket&& packet, int64_t arrival_ms);
+    // For kJitterBufferConceal, `packet` carries the stream parameters and an empty payload
+    JitterBufferResult Get(AudioStreamPacket& packet, int64_t now_ms);
+    // Removes any buffered packet so the caller can recycle its payload
+    bool Drain(AudioStreamPacket& packet);
+
+    inline bool Empty() const { return count_ == 0; }
+    inline size_t size() const { return count_; }
+    // True when the next packet in order would overflow, the caller should hold it back until Get frees a slot
+    inline bool Full() const { return started_ && (size_t)(highest_sequence_ + 1 - next_sequence_) >= slots_.size(); }
+    JitterBufferStats GetStats() const;
+
+private:
+    struct Slot {
+        bool valid = false;
+        AudioStreamPacket packet;
+    };
+
+    std::vector<Slot> slots_;
+    size_t count_ = 0;
+    bool started_ = false;
+    bool playing_ = false;
+    bool drained_ = false;
+    uint32_t next_sequence_ = 0;
+    uint32_t highest_sequence_ = 0;
+    int consecutive_concealed_ = 0;
+    int sample_rate_ = 0;
+    int frame_duration_ = 0;
+    int64_t newest_arrival_ms_ = 0;
+
+    JitterEstimator jitter_;
+
+    JitterBufferStats stats_;
+
+    void UpdateJitter(uint32_t sequence, int64_t arrival_ms, int frame_duration);
+    bool FindLowestSequence(uint32_t& sequence) const;
+    bool TakeSlot(uint32_t sequence, AudioStreamPacket& packet);
+};
+
+#endif // JITTER_BUFFER_H
@@ -0,0 +1,86 @@
+#include "json_writer.h"
+
+#include <cstdio>
+
+void JsonWriter::BeginObject() {
+    Separate();
+    out_ += '{';
+    need_comma_ = false;
+}
+
+void JsonWriter::EndObject() {
+    out_ += '}';
+    need_comma_ = true;
+}
+
+void JsonWriter::BeginArray() {
+    Separate();
+    out_ += '[';
+    need_comma_ = false;
+}
+
+void JsonWriter::EndArray() {
+    out_ += ']';
+    need_comma_ = true;
+}
+
+void JsonWriter::Key(std::string_view key) {
+    Separate();
+    AppendEscaped(key);
+    out_ += ':';
+    // The value follows the colon without a comma
+    need_comma_ = false;
+}
+
+void JsonWriter::String(std::string_view value) {
+    Separate();
+    AppendEscaped(value);
+}
+
+void JsonWriter::Number(int value) {
+    Separate();
+    char buffer[12];
+    int length = snprintf(buffer, sizeof(buffer), "%d", value);
+    out_.append(buffer, length);
+}
+
+void JsonWriter::Bool(bool value) {
+    Separate();
+    out_ += value ? "true" : "false";
+}
+
+void JsonWriter::Raw(std::string_view json) {
+    Separate();
+    out_ += json;
+}
+
+// UTF-8 is copied as is, like cJSON does, only quotes, backslashes and control characters are escaped
+void JsonWriter::AppendEscaped(std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    out_ += '"';
+    size_t start = 0;
+    for (size_t i = 0; i < value.size(); i++) {
+        unsigned char c = value[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out_.append(value.data() + start, i - start);
+        start = i + 1;
+        switch (c) {
+        case '"': out_ += "\\\""; break;
+        case '\\': out_ += "\\\\"; break;
+        case '\b': out_ += "\\b"; break;
+        case '\f': out_ += "\\f"; break;
+        case '\n': out_ += "\\n"; break;
+        case '\r': out_ += "\\r"; break;
+        case '\t': out_ += "\\t"; break;
+        default:
+            out_ += "\\u00";
+            out_ += hex[c >> 4];
+            out_ += hex[c & 0xf];
+            break;
+        }
+    }
+    out_.append(value.data() + start, value.size() - start);
+    out_ += '"';
+}
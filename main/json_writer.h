@@ -0,0 +1,51 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/*
+ * Appends compact JSON to a string as it is produced.
+ *
+ * There is no intermediate tree: commas are placed from the nesting state and
+ * strings are escaped on the way in. The output is reserved up front and can
+ * be reused with Clear(), which keeps the capacity. Nesting is not validated,
+ * callers pair the Begin / End calls themselves.
+ */
+class JsonWriter {
+public:
+    explicit JsonWriter(size_t capacity = 256) {
+        out_.reserve(capacity);
+    }
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(std::string_view key);
+    void String(std::string_view value);
+    void Number(int value);
+    void Bool(bool value);
+    // Appends an already serialized JSON value
+    void Raw(std::string_view json);
+
+    inline void Clear() { out_.clear(); need_comma_ = false; }
+    inline const std::string& str() const { return out_; }
+    inline size_t size() const { return out_.size(); }
+    inline std::string Release() { need_comma_ = false; return std::move(out_); }
+
+private:
+    std::string out_;
+    bool need_comma_ = false;
+
+    inline void Separate() {
+        if (need_comma_) {
+            out_ += ',';
+        }
+        need_comma_ = true;
+    }
+    void AppendEscaped(std::string_view value);
+};
+
+#endif // JSON_WRITER_H
@@ -0,0 +1,102 @@
+#include "latency_tracer.h"
+
+#include <esp_log.h>
+#include <cJSON.h>
+#include <cstdio>
+
+#define TAG "LatencyTracer"
+
+// Upper bound of each bucket in ms, the last bucket takes everything above
+static const uint32_t kBucketLimitsMs[LATENCY_TRACER_BUCKETS - 1] = {1, 2, 5, 10, 20, 40, 60, 100, 200, 500, 1000};
+
+static const char* const kStageNames[kLatencyStageCount] = {
+    "mic_read",
+    "afe_fetch",
+    "encode",
+    "send",
+    "arrival_gap",
+    "decode",
+    "output",
+    "wake_uplink",
+};
+
+void LatencyTracer::Record(LatencyStage stage, int64_t duration_us) {
+    if (duration_us < 0) {
+        duration_us = 0;
+    }
+    auto& histogram = histograms_[stage];
+    uint32_t us = duration_us > UINT32_MAX ? UINT32_MAX : (uint32_t)duration_us;
+    uint32_t ms = us / 1000;
+    int bucket = 0;
+    while (bucket < LATENCY_TRACER_BUCKETS - 1 && ms >= kBucketLimitsMs[bucket]) {
+        bucket++;
+    }
+    histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    histogram.count.fetch_add(1, std::memory_order_relaxed);
+    histogram.total_us.fetch_add(us, std::memory_order_relaxed);
+    uint32_t max_us = histogram.max_us.load(std::memory_order_relaxed);
+    while (us > max_us && !histogram.max_us.compare_exchange_weak(max_us, us, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyTracer::Reset() {
+    for (auto& histogram : histograms_) {
+        histogram.count.store(0, std::memory_order_relaxed);
+        histogram.max_us.store(0, std::memory_order_relaxed);
+        histogram.total_us.store(0, std::memory_order_relaxed);
+        for (auto& bucket : histogram.buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void LatencyTracer::PrintStats() {
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        auto& histogram = histograms_[i];
+        uint32_t count = histogram.count.load(std::memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+        char buckets[LATENCY_TRACER_BUCKETS * 11 + 1];
+        int length = 0;
+        for (int j = 0; j < LATENCY_TRACER_BUCKETS; j++) {
+            length += snprintf(buckets + length, sizeof(buckets) - length, " %lu",
+                histogram.buckets[j].load(std::memory_order_relaxed));
+        }
+        ESP_LOGI(TAG, "%-9s count %lu avg %lu us max %lu us |%s", kStageNames[i], count,
+            (uint32_t)(histogram.total_us.load(std::memory_order_relaxed) / count),
+            histogram.max_us.load(std::memory_order_relaxed), buckets);
+    }
+}
+
+std::string LatencyTracer::GetStatsJson() {
+    cJSON* root = cJSON_CreateObject();
+    cJSON* limits = cJSON_CreateArray();
+    for (auto limit : kBucketLimitsMs) {
+        cJSON_AddItemToArray(limits, cJSON_CreateNumber(limit));
+    }
+    cJSON_AddItemToObject(root, "bucket_limits_ms", limits);
+
+    cJSON* stages = cJSON_CreateObject();
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        auto& histogram = histograms_[i];
+        uint32_t count = histogram.count.load(std::memory_order_relaxed);
+        cJSON* stage = cJSON_CreateObject();
+        cJSON_AddNumberToObject(stage, "count", count);
+        cJSON_AddNumberToObject(stage, "avg_us", count ? histogram.total_us.load(std::memory_order_relaxed) / count : 0);
+        cJSON_AddNumberToObject(stage, "max_us", histogram.max_us.load(std::memory_order_relaxed));
+        cJSON* buckets = cJSON_CreateArray();
+        for (auto& bucket : histogram.buckets) {
+            cJSON_AddItemToArray(buckets, cJSON_CreateNumber(bucket.load(std::memory_order_relaxed)));
+        }
+        cJSON_AddItemToObject(stage, "buckets", buckets);
+        cJSON_AddItemToObject(stages, kStageNames[i], stage);
+    }
+    cJSON_AddItemToObject(root, "stages", stages);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
@@ -0,0 +1,68 @@
+#ifndef LATENCY_TRACER_H
+#define LATENCY_TRACER_H
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+#include <esp_timer.h>
+
+enum LatencyStage {
+    kLatencyMicRead,        // codec->InputData() in ReadAudio
+    kLatencyAfeFetch,       // AFE feed -> fetch
+    kLatencyEncode,         // AFE output -> opus packet ready
+    kLatencySend,           // opus packet ready -> protocol_->SendAudio() returned
+    kLatencyArrivalGap,     // interval between incoming audio packets
+    kLatencyDecode,         // packet received -> PCM decoded
+    kLatencyOutput,         // PCM decoded -> codec->OutputData() returned
+    kLatencyWakeToUplink,   // wake word / button press -> first audio packet sent
+    kLatencyStageCount
+};
+
+#define LATENCY_TRACER_BUCKETS 12
+
+/*
+ * Per-stage latency histograms for the audio pipeline.
+ *
+ * Everything lives in a fixed table, Record() is a few relaxed atomic adds and
+ * can be called from any task. Build with CONFIG_USE_LATENCY_TRACE to enable
+ * it, otherwise LATENCY_TRACE() compiles to nothing.
+ */
+class LatencyTracer {
+public:
+    static LatencyTracer& GetInstance() {
+        static LatencyTracer instance;
+        return instance;
+    }
+    LatencyTracer(const LatencyTracer&) = delete;
+    LatencyTracer& operator=(const LatencyTracer&) = delete;
+
+    static inline int64_t NowUs() { return esp_timer_get_time(); }
+
+    void Record(LatencyStage stage, int64_t duration_us);
+    void Reset();
+    void PrintStats();
+    std::string GetStatsJson();
+
+private:
+    LatencyTracer() = default;
+
+    struct Histogram {
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> max_us{0};
+        std::atomic<uint64_t> total_us{0};
+        std::atomic<uint32_t> buckets[LATENCY_TRACER_BUCKETS] = {};
+    };
+    Histogram histograms_[kLatencyStageCount];
+};
+
+#if CONFIG_USE_LATENCY_TRACE
+#define LATENCY_TRACE(stage, start_us) \
+    LatencyTracer::GetInstance().Record(stage, LatencyTracer::NowUs() - (start_us))
+#define LATENCY_TRACE_NOW() LatencyTracer::NowUs()
+#else
+#define LATENCY_TRACE(stage, start_us) do { } while (0)
+#define LATENCY_TRACE_NOW() 0
+#endif
+
+#endif // LATENCY_TRACER_H
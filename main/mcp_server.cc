@@ -10,8 +10,8 @@
 #include <esp_app_desc.h>
 #include <algorithm>
 #include <cstring>
-#include <esp_pthread.h>
 #include "application.h"
+#include "latency_tracer.h"
 #include "display.h"
 #include "board.h"
 #include "rp2040iic.h"  // 确保Rp2040类的声明被引入
@@ -19,6 +19,11 @@
 #define TAG "MCP"
 
 #define DEFAULT_TOOLCALL_STACK_SIZE 6144
+#define MAX_TOOLS_LIST_PAYLOAD_SIZE 8000
+#define MAX_BATCH_SIZE TOOL_POOL_QUEUE_SIZE
+
+// The call whose tool runs on this worker, for progress and cancellation
+thread_local McpCall* McpServer::current_call_ = nullptr;
 
 // McpServer::McpServer() {
 // }
@@ -32,6 +37,7 @@ McpServer::~McpServer() {
         delete tool;
     }
     tools_.clear();
+    tool_index_.clear();
 }
 static const std::vector<uint8_t> AVAILABLE_SERVO_IDS = {3, 4,7, 9, 12, 26, 27, 28};
 void McpServer::AddCommonTools() {
@@ -113,7 +119,7 @@ AddTool("self.motor.set_motion",
             this->current_motor_direction = "reverse";
             return "{\"success\": true, \"message\": \"马达反转中，速度：" + std::to_string(speed) + "\"}";
         }
-    });
+    }, "motor");
 
 
 // 修改马达速度单独调节工具
@@ -146,7 +152,7 @@ AddTool("self.motor.adjust_speed",
             rp2040->etPwmOutput(MOTOR_PIN_REV, new_speed);
         }
         return "{\"success\": true, \"direction\": \"" + this->current_motor_direction + "\", \"new_speed\": " + std::to_string(new_speed) + ", \"message\": \"速度已更新\"}";
-    });
+    }, "motor");
 
     // 添加第二马达运动控制工具
 AddTool("self.motor2.set_motion",
@@ -202,7 +208,7 @@ AddTool("self.motor2.set_motion",
             this->current_motor2_direction = "reverse";
             return "{\"success\": true, \"message\": \"第二马达反转中，速度：" + std::to_string(speed) + "\"}";
         }
-    });
+    }, "motor");
 
 
     // 添加第二马达速度单独调节工具
@@ -235,7 +241,7 @@ AddTool("self.motor2.adjust_speed",
             rp2040->etPwmOutput(MOTOR2_PIN_REV, new_speed);
         }
         return "{\"success\": true, \"direction\": \"" + this->current_motor2_direction + "\", \"new_speed\": " + std::to_string(new_speed) + ", \"message\": \"第二马达速度已更新\"}";
-    });
+    }, "motor");
 
 
 
@@ -383,7 +389,7 @@ AddTool("self.motors.set_multiple_motion",
         
         result += "}";
         return result;
-    });
+    }, "motor");
 
 
 
@@ -416,6 +422,56 @@ AddTool("self.motors.set_multiple_motion",
             return true;
         });
 
+    AddTool("self.audio.set_frame_duration",
+        "Set the opus frame duration in milliseconds used from the next conversation. "
+        "Must be 20, 40 or 60. 20 gives the lowest latency (better for interrupting the assistant), "
+        "60 uses the least bandwidth.",
+        PropertyList({
+            Property("duration", kPropertyTypeInteger, 20, 60)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            int duration = properties["duration"].value<int>();
+            if (!Application::GetInstance().SetFrameDuration(duration)) {
+                throw std::runtime_error("Invalid frame duration " + std::to_string(duration) + " ms, must be 20, 40 or 60");
+            }
+            return true;
+        });
+
+    AddTool("self.audio.get_encoder_status",
+        "Get the state of the adaptive opus encoder: the complexity in use, the encoder CPU load, "
+        "the send queue fill, the audio loss rate, and whether the link is treated as congested "
+        "(a congested session makes the next one use 60ms frames).",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return Application::GetInstance().GetEncoderStatusJson();
+        });
+
+    AddTool("self.get_tool_call_stats",
+        "Get the statistics of the tool call workers: completed and rejected calls, calls waiting, "
+        "and the average / maximum time calls waited in the queue and ran, in microseconds.",
+        PropertyList(),
+        [this](const PropertyList& properties) -> ReturnValue {
+            return tool_pool_.GetStatsJson();
+        });
+
+#if CONFIG_USE_LATENCY_TRACE
+    AddTool("self.audio.get_latency_stats",
+        "Get the latency histograms of the audio pipeline stages (mic_read, afe_fetch, encode, send, arrival_gap, decode, output). "
+        "Set `reset` to true to clear them after reading. The stats are also printed to the serial log.",
+        PropertyList({
+            Property("reset", kPropertyTypeBoolean, false)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& tracer = LatencyTracer::GetInstance();
+            tracer.PrintStats();
+            auto json = tracer.GetStatsJson();
+            if (properties["reset"].value<bool>()) {
+                tracer.Reset();
+            }
+            return json;
+        });
+#endif
+
 
 // 添加设置单个舵机角度的工具（已添加7号舵机支持）
 AddTool("self.servo.set_angle", 
@@ -452,7 +508,7 @@ AddTool("self.servo.set_angle",
         } else {
             return "{\"success\": false, \"message\": \"Failed to set servo " + std::to_string(servo_id) + " angle\"}";
         }
-    });
+    }, "servo");
 
 
 // 添加同时设置多个舵机角度的工具（已添加7号舵机支持）
@@ -466,7 +522,7 @@ AddTool("self.servo.set_multiple_angles",
     PropertyList({
         Property("servos", kPropertyTypeString)  // 用字符串接收JSON数组
     }),
-    [rp2040, AVAILABLE_SERVO_IDS](const PropertyList& properties) -> ReturnValue{
+    [this, rp2040, AVAILABLE_SERVO_IDS](const PropertyList& properties) -> ReturnValue{
         
         std::string servos_json = properties["servos"].value<std::string>();
         cJSON* servos_array = cJSON_Parse(servos_json.c_str());
@@ -484,6 +540,11 @@ AddTool("self.servo.set_multiple_angles",
         // 遍历数组中的每个舵机
         int array_size = cJSON_GetArraySize(servos_array);
         for (int i = 0; i < array_size; ++i) {
+            if (IsCallCancelled()) {
+                fail_list.push_back("Cancelled before item " + std::to_string(i));
+                break;
+            }
+            SendProgress(i, array_size);
             cJSON* servo_obj = cJSON_GetArrayItem(servos_array, i);
             if (!cJSON_IsObject(servo_obj)) {
                 fail_list.push_back("Item " + std::to_string(i) + ": not an object");
@@ -550,7 +611,7 @@ AddTool("self.servo.set_multiple_angles",
         
         result += "}";
         return result;
-    });
+    }, "servo");
 
 
     auto backlight = board.GetBacklight();
@@ -589,11 +650,13 @@ AddTool("self.servo.set_multiple_angles",
             "Args:\n"
             "  `question`: The question that you want to ask about the photo.\n"
             "Return:\n"
-            "  A JSON object that provides the photo information.",
+            "  A JSON object that provides the photo information.\n"
+            "Cancelling stops the upload; once the photo is uploaded the device still waits for the explanation.",
             PropertyList({
                 Property("question", kPropertyTypeString)
             }),
-            [camera](const PropertyList& properties) -> ReturnValue {
+            [this, camera](const PropertyList& properties) -> ReturnValue {
+                SendProgress(0, 0, "Taking the photo");
                 if (!camera->Capture()) {
                     return "{\"success\": false, \"message\": \"Failed to capture photo\"}";
                 }
@@ -604,21 +667,26 @@ AddTool("self.servo.set_multiple_angles",
 
     // Restore the original tools list to the end of the tools list
     tools_.insert(tools_.end(), original_tools.begin(), original_tools.end());
+    InvalidateToolsList();
 }
 
 void McpServer::AddTool(McpTool* tool) {
     // Prevent adding duplicate tools
-    if (std::find_if(tools_.begin(), tools_.end(), [tool](const McpTool* t) { return t->name() == tool->name(); }) != tools_.end()) {
+    if (!tool_index_.emplace(tool->name(), tool).second) {
         ESP_LOGW(TAG, "Tool %s already added", tool->name().c_str());
         return;
     }
 
     ESP_LOGI(TAG, "Add tool: %s", tool->name().c_str());
     tools_.push_back(tool);
+    InvalidateToolsList();
 }
 
-void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
-    AddTool(new McpTool(name, description, properties, callback));
+void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+    const std::string& resource_group) {
+    auto tool = new McpTool(name, description, properties, callback);
+    tool->set_resource_group(resource_group);
+    AddTool(tool);
 }
 
 void McpServer::ParseMessage(const std::string& message) {
@@ -670,10 +738,42 @@ void McpServer::ParseCapabilities(const cJSON* capabilities) {
 }
 
 void McpServer::ParseMessage(const cJSON* json) {
+    if (!cJSON_IsArray(json)) {
+        ParseRequest(json, nullptr);
+        return;
+    }
+
+    // JSON-RPC batch: the requests run side by side, the responses go back as one array
+    int size = cJSON_GetArraySize(json);
+    if (size == 0 || size > MAX_BATCH_SIZE) {
+        ESP_LOGE(TAG, "Invalid batch size: %d", size);
+        ReplyInvalidRequest("Invalid batch size: " + std::to_string(size), nullptr);
+        return;
+    }
+    auto batch = std::make_shared<McpBatch>(size);
+    for (auto request = json->child; request != nullptr; request = request->next) {
+        ParseRequest(request, batch);
+    }
+}
+
+void McpServer::ParseRequest(const cJSON* json, const std::shared_ptr<McpBatch>& batch) {
+    // A lone invalid message is only logged, inside a batch it takes an error so that
+    // every element is accounted for
+    if (!cJSON_IsObject(json)) {
+        ESP_LOGE(TAG, "Invalid request: not an object");
+        if (batch) {
+            ReplyInvalidRequest("Invalid request: not an object", batch);
+        }
+        return;
+    }
+
     // Check JSONRPC version
     auto version = cJSON_GetObjectItem(json, "jsonrpc");
     if (version == nullptr || !cJSON_IsString(version) || strcmp(version->valuestring, "2.0") != 0) {
-        ESP_LOGE(TAG, "Invalid JSONRPC version: %s", version ? version->valuestring : "null");
+        ESP_LOGE(TAG, "Invalid JSONRPC version: %s", cJSON_IsString(version) ? version->valuestring : "null");
+        if (batch) {
+            ReplyInvalidRequest("Invalid JSONRPC version", batch);
+        }
         return;
     }
     
@@ -681,11 +781,24 @@ void McpServer::ParseMessage(const cJSON* json) {
     auto method = cJSON_GetObjectItem(json, "method");
     if (method == nullptr || !cJSON_IsString(method)) {
         ESP_LOGE(TAG, "Missing method");
+        if (batch) {
+            ReplyInvalidRequest("Missing method", batch);
+        }
         return;
     }
     
     auto method_str = std::string(method->valuestring);
+    if (method_str == "notifications/cancelled") {
+        auto params = cJSON_GetObjectItem(json, "params");
+        auto request_id = cJSON_GetObjectItem(params, "requestId");
+        if (cJSON_IsNumber(request_id)) {
+            CancelCall(request_id->valueint);
+        }
+        SkipReply(batch);
+        return;
+    }
     if (method_str.find("notifications") == 0) {
+        SkipReply(batch);
         return;
     }
     
@@ -693,12 +806,14 @@ void McpServer::ParseMessage(const cJSON* json) {
     auto params = cJSON_GetObjectItem(json, "params");
     if (params != nullptr && !cJSON_IsObject(params)) {
         ESP_LOGE(TAG, "Invalid params for method: %s", method_str.c_str());
+        SkipReply(batch);
         return;
     }
 
     auto id = cJSON_GetObjectItem(json, "id");
     if (id == nullptr || !cJSON_IsNumber(id)) {
         ESP_LOGE(TAG, "Invalid id for method: %s", method_str.c_str());
+        SkipReply(batch);
         return;
     }
     auto id_int = id->valueint;
@@ -711,10 +826,21 @@ void McpServer::ParseMessage(const cJSON* json) {
             }
         }
         auto app_desc = esp_app_get_description();
-        std::string message = "{\"protocolVersion\":\"2024-11-05\",\"capabilities\":{\"tools\":{}},\"serverInfo\":{\"name\":\"" BOARD_NAME "\",\"version\":\"";
-        message += app_desc->version;
-        message += "\"}}";
-        ReplyResult(id_int, message);
+        JsonWriter writer;
+        writer.BeginObject();
+        writer.Key("protocolVersion");
+        writer.String("2024-11-05");
+        writer.Key("capabilities");
+        writer.Raw("{\"tools\":{}}");
+        writer.Key("serverInfo");
+        writer.BeginObject();
+        writer.Key("name");
+        writer.String(BOARD_NAME);
+        writer.Key("version");
+        writer.String(app_desc->version);
+        writer.EndObject();
+        writer.EndObject();
+        ReplyResult(id_int, writer.str(), batch);
     } else if (method_str == "tools/list") {
         std::string cursor_str = "";
         if (params != nullptr) {
@@ -723,119 +849,246 @@ void McpServer::ParseMessage(const cJSON* json) {
                 cursor_str = std::string(cursor->valuestring);
             }
         }
-        GetToolsList(id_int, cursor_str);
+        GetToolsList(id_int, cursor_str, batch);
     } else if (method_str == "tools/call") {
         if (!cJSON_IsObject(params)) {
             ESP_LOGE(TAG, "tools/call: Missing params");
-            ReplyError(id_int, "Missing params");
+            ReplyError(id_int, "Missing params", batch);
             return;
         }
         auto tool_name = cJSON_GetObjectItem(params, "name");
         if (!cJSON_IsString(tool_name)) {
             ESP_LOGE(TAG, "tools/call: Missing name");
-            ReplyError(id_int, "Missing name");
+            ReplyError(id_int, "Missing name", batch);
             return;
         }
         auto tool_arguments = cJSON_GetObjectItem(params, "arguments");
         if (tool_arguments != nullptr && !cJSON_IsObject(tool_arguments)) {
             ESP_LOGE(TAG, "tools/call: Invalid arguments");
-            ReplyError(id_int, "Invalid arguments");
+            ReplyError(id_int, "Invalid arguments", batch);
             return;
         }
         auto stack_size = cJSON_GetObjectItem(params, "stackSize");
         if (stack_size != nullptr && !cJSON_IsNumber(stack_size)) {
             ESP_LOGE(TAG, "tools/call: Invalid stackSize");
-            ReplyError(id_int, "Invalid stackSize");
+            ReplyError(id_int, "Invalid stackSize", batch);
             return;
         }
-        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments, stack_size ? stack_size->valueint : DEFAULT_TOOLCALL_STACK_SIZE);
+        // The caller wants notifications/progress for this call
+        std::string progress_token;
+        auto progress = cJSON_GetObjectItem(cJSON_GetObjectItem(params, "_meta"), "progressToken");
+        if (cJSON_IsString(progress)) {
+            JsonWriter writer(32);
+            writer.String(progress->valuestring);
+            progress_token = writer.Release();
+        } else if (cJSON_IsNumber(progress)) {
+            // Printed from the JSON number, valueint would truncate 1.5 or anything beyond an int
+            char* text = cJSON_PrintUnformatted(progress);
+            if (text != nullptr) {
+                progress_token = text;
+                cJSON_free(text);
+            }
+        }
+        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments, stack_size ? stack_size->valueint : DEFAULT_TOOLCALL_STACK_SIZE,
+            progress_token, batch);
     } else {
         ESP_LOGE(TAG, "Method not implemented: %s", method_str.c_str());
-        ReplyError(id_int, "Method not implemented: " + method_str);
+        ReplyError(id_int, "Method not implemented: " + method_str, batch);
     }
 }
 
-void McpServer::ReplyResult(int id, const std::string& result) {
-    std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
-    payload += std::to_string(id) + ",\"result\":";
-    payload += result;
-    payload += "}";
-    Application::GetInstance().SendMcpMessage(payload);
+void McpBatch::AddResponse(std::string&& response) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        responses_.push_back(std::move(response));
+    }
+    Complete();
 }
 
-void McpServer::ReplyError(int id, const std::string& message) {
-    std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
-    payload += std::to_string(id);
-    payload += ",\"error\":{\"message\":\"";
-    payload += message;
-    payload += "\"}}";
-    Application::GetInstance().SendMcpMessage(payload);
+void McpBatch::Complete() {
+    std::vector<std::string> responses;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ > 0) {
+            return;
+        }
+        responses = std::move(responses_);
+    }
+    // The last request has answered, notifications add nothing
+    if (responses.empty()) {
+        return;
+    }
+    size_t size = 2;
+    for (auto& response : responses) {
+        size += response.size() + 1;
+    }
+    JsonWriter writer(size);
+    writer.BeginArray();
+    for (auto& response : responses) {
+        writer.Raw(response);
+    }
+    writer.EndArray();
+    Application::GetInstance().SendMcpMessage(writer.str());
 }
 
-void McpServer::GetToolsList(int id, const std::string& cursor) {
-    const int max_payload_size = 8000;
-    std::string json = "{\"tools\":[";
-    
-    bool found_cursor = cursor.empty();
-    auto it = tools_.begin();
-    std::string next_cursor = "";
-    
-    while (it != tools_.end()) {
-        // 如果我们还没有找到起始位置，继续搜索
-        if (!found_cursor) {
-            if ((*it)->name() == cursor) {
-                found_cursor = true;
-            } else {
-                ++it;
-                continue;
-            }
+void McpServer::SendReply(std::string&& payload, const std::shared_ptr<McpBatch>& batch) {
+    if (batch) {
+        batch->AddResponse(std::move(payload));
+    } else {
+        Application::GetInstance().SendMcpMessage(payload);
+    }
+}
+
+void McpServer::ReplyResult(int id, const std::string& result, const std::shared_ptr<McpBatch>& batch) {
+    JsonWriter writer(result.size() + 48);
+    writer.BeginObject();
+    writer.Key("jsonrpc");
+    writer.String("2.0");
+    writer.Key("id");
+    writer.Number(id);
+    writer.Key("result");
+    writer.Raw(result);
+    writer.EndObject();
+    SendReply(writer.Release(), batch);
+}
+
+void McpServer::ReplyError(int id, const std::string& message, const std::shared_ptr<McpBatch>& batch) {
+    JsonWriter writer(message.size() + 64);
+    writer.BeginObject();
+    writer.Key("jsonrpc");
+    writer.String("2.0");
+    writer.Key("id");
+    writer.Number(id);
+    writer.Key("error");
+    writer.BeginObject();
+    writer.Key("message");
+    writer.String(message);
+    writer.EndObject();
+    writer.EndObject();
+    SendReply(writer.Release(), batch);
+}
+
+void McpServer::ReplyInvalidRequest(const std::string& message, const std::shared_ptr<McpBatch>& batch) {
+    JsonWriter writer(message.size() + 64);
+    writer.BeginObject();
+    writer.Key("jsonrpc");
+    writer.String("2.0");
+    writer.Key("id");
+    writer.Raw("null");
+    writer.Key("error");
+    writer.BeginObject();
+    writer.Key("message");
+    writer.String(message);
+    writer.EndObject();
+    writer.EndObject();
+    SendReply(writer.Release(), batch);
+}
+
+void McpServer::SkipReply(const std::shared_ptr<McpBatch>& batch) {
+    if (batch) {
+        batch->Complete();
+    }
+}
+
+void McpServer::InvalidateToolsList() {
+    tools_list_pages_.clear();
+    tools_list_cursors_.clear();
+}
+
+// Renders the tools from `start` until the payload limit, returns the index of the first tool left out.
+// `tool` is scratch space for one descriptor, so one that does not fit never touches the page.
+size_t McpServer::RenderToolsListPage(size_t start, JsonWriter& page, JsonWriter& tool) const {
+    page.Clear();
+    page.BeginObject();
+    page.Key("tools");
+    page.BeginArray();
+    size_t i = start;
+    for (; i < tools_.size(); i++) {
+        tool.Clear();
+        tools_[i]->WriteJson(tool);
+        if (page.size() + tool.size() + 1 + 30 > MAX_TOOLS_LIST_PAYLOAD_SIZE) {
+            break;
         }
-        
-        // 添加tool前检查大小
-        std::string tool_json = (*it)->to_json() + ",";
-        if (json.length() + tool_json.length() + 30 > max_payload_size) {
-            // 如果添加这个tool会超出大小限制，设置next_cursor并退出循环
-            next_cursor = (*it)->name();
+        page.Raw(tool.str());
+    }
+    page.EndArray();
+    if (i < tools_.size()) {
+        page.Key("nextCursor");
+        page.String(tools_[i]->name());
+    }
+    page.EndObject();
+    return i;
+}
+
+// The tool set only changes while tools are added, so every page is rendered once
+void McpServer::BuildToolsListPages() {
+    JsonWriter page(MAX_TOOLS_LIST_PAYLOAD_SIZE);
+    JsonWriter tool(1024);
+    size_t start = 0;
+    while (start < tools_.size()) {
+        size_t next = RenderToolsListPage(start, page, tool);
+        tools_list_cursors_[tools_[start]->name()] = tools_list_pages_.size();
+        if (next == start) {
+            // The tool alone exceeds the limit, an empty page makes the request fail
+            tools_list_pages_.emplace_back();
             break;
         }
-        
-        json += tool_json;
-        ++it;
+        tools_list_pages_.push_back(page.str());
+        start = next;
     }
-    
-    if (json.back() == ',') {
-        json.pop_back();
+    ESP_LOGI(TAG, "tools/list: %u tools in %u pages", (unsigned)tools_.size(), (unsigned)tools_list_pages_.size());
+}
+
+void McpServer::GetToolsList(int id, const std::string& cursor, const std::shared_ptr<McpBatch>& batch) {
+    if (tools_.empty()) {
+        ReplyResult(id, "{\"tools\":[]}", batch);
+        return;
     }
-    
-    if (json.back() == '[' && !tools_.empty()) {
-        // 如果没有添加任何tool，返回错误
-        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", next_cursor.c_str());
-        ReplyError(id, "Failed to add tool " + next_cursor + " because of payload size limit");
+    if (tools_list_pages_.empty()) {
+        BuildToolsListPages();
+    }
+
+    auto page = tools_list_cursors_.find(cursor.empty() ? tools_.front()->name() : cursor);
+    if (page == tools_list_cursors_.end()) {
+        // Not a page boundary of the current tool set, render from that tool on
+        auto tool = std::find_if(tools_.begin(), tools_.end(), [&cursor](const McpTool* t) { return t->name() == cursor; });
+        if (tool == tools_.end()) {
+            ESP_LOGE(TAG, "tools/list: Invalid cursor %s", cursor.c_str());
+            ReplyError(id, "Invalid cursor: " + cursor, batch);
+            return;
+        }
+        JsonWriter page_writer(MAX_TOOLS_LIST_PAYLOAD_SIZE);
+        JsonWriter tool_writer(1024);
+        size_t start = tool - tools_.begin();
+        if (RenderToolsListPage(start, page_writer, tool_writer) == start) {
+            ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", cursor.c_str());
+            ReplyError(id, "Failed to add tool " + cursor + " because of payload size limit", batch);
+            return;
+        }
+        ReplyResult(id, page_writer.str(), batch);
         return;
     }
 
-    if (next_cursor.empty()) {
-        json += "]}";
-    } else {
-        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+    auto& json = tools_list_pages_[page->second];
+    if (json.empty()) {
+        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", page->first.c_str());
+        ReplyError(id, "Failed to add tool " + page->first + " because of payload size limit", batch);
+        return;
     }
-    
-    ReplyResult(id, json);
+    ReplyResult(id, json, batch);
 }
 
-void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size) {
-    auto tool_iter = std::find_if(tools_.begin(), tools_.end(), 
-                                 [&tool_name](const McpTool* tool) { 
-                                     return tool->name() == tool_name; 
-                                 });
-    
-    if (tool_iter == tools_.end()) {
+void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size,
+    const std::string& progress_token, const std::shared_ptr<McpBatch>& batch) {
+    auto tool_iter = tool_index_.find(tool_name);
+    if (tool_iter == tool_index_.end()) {
         ESP_LOGE(TAG, "tools/call: Unknown tool: %s", tool_name.c_str());
-        ReplyError(id, "Unknown tool: " + tool_name);
+        ReplyError(id, "Unknown tool: " + tool_name, batch);
         return;
     }
 
-    PropertyList arguments = (*tool_iter)->properties();
+    McpTool* tool = tool_iter->second;
+    PropertyList arguments = tool->properties();
     try {
         for (auto& argument : arguments) {
             bool found = false;
@@ -855,36 +1108,123 @@ void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* to
 
             if (!argument.has_default_value() && !found) {
                 ESP_LOGE(TAG, "tools/call: Missing valid argument: %s", argument.name().c_str());
-                ReplyError(id, "Missing valid argument: " + argument.name());
+                ReplyError(id, "Missing valid argument: " + argument.name(), batch);
                 return;
             }
         }
     } catch (const std::exception& e) {  // 捕获所有std::exception子类
     ESP_LOGE(TAG, "tools/call: %s", e.what());
-    ReplyError(id, e.what());
+    ReplyError(id, e.what(), batch);
     return;
     } 
     catch (const std::runtime_error& e) {
         ESP_LOGE(TAG, "tools/call: %s", e.what());
-        ReplyError(id, e.what());
+        ReplyError(id, e.what(), batch);
         return;
     }
 
-    // Start a task to receive data with stack size
-    esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
-    cfg.thread_name = "tool_call";
-    cfg.stack_size = stack_size;
-    cfg.prio = 1;
-    esp_pthread_set_cfg(&cfg);
+    ToolStackClass stack_class;
+    if (!ToolWorkerPool::GetStackClass(stack_size, stack_class)) {
+        ESP_LOGE(TAG, "tools/call: stackSize %d is not available", stack_size);
+        ReplyError(id, "stackSize " + std::to_string(stack_size) + " is not available", batch);
+        return;
+    }
 
-    // Use a thread to call the tool to avoid blocking the main thread
-    tool_call_thread_ = std::thread([this, id, tool_iter, arguments = std::move(arguments)]() {
-        try {
-            ReplyResult(id, (*tool_iter)->Call(arguments));
-        } catch (const std::runtime_error& e) {
-            ESP_LOGE(TAG, "tools/call: %s", e.what());
-            ReplyError(id, e.what());
+    auto call = std::make_shared<McpCall>();
+    call->id = id;
+    call->progress_token = progress_token;
+    {
+        std::lock_guard<std::mutex> lock(calls_mutex_);
+        calls_[id] = call;
+    }
+
+    // Run the tool on a pool worker to avoid blocking the main thread. Calls are serialized per
+    // resource group, or per tool if it has none (tool names start with "self.", groups do not)
+    const std::string& key = tool->resource_group().empty() ? tool->name() : tool->resource_group();
+    bool queued = tool_pool_.Submit(stack_class, key, tool->max_concurrency(), [this, call, tool, arguments = std::move(arguments), batch]() {
+        // A cancelled call gets no response, whether it was still queued or stopped early
+        bool replied = false;
+        if (!call->cancelled) {
+            current_call_ = call.get();
+            try {
+                auto result = tool->Call(arguments);
+                if (!call->cancelled) {
+                    ReplyResult(call->id, result, batch);
+                    replied = true;
+                }
+            } catch (const std::runtime_error& e) {
+                ESP_LOGE(TAG, "tools/call: %s", e.what());
+                if (!call->cancelled) {
+                    ReplyError(call->id, e.what(), batch);
+                    replied = true;
+                }
+            }
+            current_call_ = nullptr;
+        }
+        FinishCall(call);
+        if (!replied) {
+            SkipReply(batch);
         }
     });
-    tool_call_thread_.detach();
+    if (!queued) {
+        FinishCall(call);
+        ESP_LOGW(TAG, "tools/call: Too many pending calls, rejected %s", tool_name.c_str());
+        ReplyError(id, "Device busy: too many pending tool calls, retry later", batch);
+    }
+}
+
+void McpServer::FinishCall(const std::shared_ptr<McpCall>& call) {
+    std::lock_guard<std::mutex> lock(calls_mutex_);
+    auto it = calls_.find(call->id);
+    // The id may have been reused by a newer call already
+    if (it != calls_.end() && it->second == call) {
+        calls_.erase(it);
+    }
+}
+
+void McpServer::CancelCall(int id) {
+    std::lock_guard<std::mutex> lock(calls_mutex_);
+    auto it = calls_.find(id);
+    if (it == calls_.end()) {
+        ESP_LOGW(TAG, "notifications/cancelled: No pending call %d", id);
+        return;
+    }
+    ESP_LOGI(TAG, "notifications/cancelled: Cancel call %d", id);
+    it->second->cancelled = true;
+}
+
+void McpServer::SendProgress(int progress, int total, const std::string& message) {
+    auto call = current_call_;
+    if (call == nullptr || call->progress_token.empty() || call->cancelled) {
+        return;
+    }
+    JsonWriter writer(128 + message.size());
+    writer.BeginObject();
+    writer.Key("jsonrpc");
+    writer.String("2.0");
+    writer.Key("method");
+    writer.String("notifications/progress");
+    writer.Key("params");
+    writer.BeginObject();
+    writer.Key("progressToken");
+    writer.Raw(call->progress_token);
+    writer.Key("progress");
+    writer.Number(progress);
+    if (total > 0) {
+        writer.Key("total");
+        writer.Number(total);
+    }
+    if (!message.empty()) {
+        writer.Key("message");
+        writer.String(message);
+    }
+    writer.EndObject();
+    writer.EndObject();
+    // Sent right away, also for calls in a batch, so the caller sees it before the result
+    Application::GetInstance().SendMcpMessage(writer.str());
+}
+
+bool McpServer::IsCallCancelled() const {
+    auto call = current_call_;
+    return call != nullptr && call->cancelled;
 }
\ No newline at end of file
@@ -4,14 +4,20 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <functional>
 #include <variant>
 #include <optional>
 #include <stdexcept>
-#include <thread>
 
 #include <cJSON.h>
 
+#include "tool_worker_pool.h"
+#include "json_writer.h"
+
 // 添加类型别名
 using ReturnValue = std::variant<bool, int, std::string>;
 
@@ -87,38 +93,39 @@ public:
         value_ = value;
     }
 
-    std::string to_json() const {
-        cJSON *json = cJSON_CreateObject();
-        
+    void WriteJson(JsonWriter& writer) const {
+        writer.BeginObject();
         if (type_ == kPropertyTypeBoolean) {
-            cJSON_AddStringToObject(json, "type", "boolean");
+            writer.Key("type");
+            writer.String("boolean");
             if (has_default_value_) {
-                cJSON_AddBoolToObject(json, "default", value<bool>());
+                writer.Key("default");
+                writer.Bool(value<bool>());
             }
         } else if (type_ == kPropertyTypeInteger) {
-            cJSON_AddStringToObject(json, "type", "integer");
+            writer.Key("type");
+            writer.String("integer");
             if (has_default_value_) {
-                cJSON_AddNumberToObject(json, "default", value<int>());
+                writer.Key("default");
+                writer.Number(value<int>());
             }
             if (min_value_.has_value()) {
-                cJSON_AddNumberToObject(json, "minimum", min_value_.value());
+                writer.Key("minimum");
+                writer.Number(min_value_.value());
             }
             if (max_value_.has_value()) {
-                cJSON_AddNumberToObject(json, "maximum", max_value_.value());
+                writer.Key("maximum");
+                writer.Number(max_value_.value());
             }
         } else if (type_ == kPropertyTypeString) {
-            cJSON_AddStringToObject(json, "type", "string");
+            writer.Key("type");
+            writer.String("string");
             if (has_default_value_) {
-                cJSON_AddStringToObject(json, "default", value<std::string>().c_str());
+                writer.Key("default");
+                writer.String(value<std::string>());
             }
         }
-        
-        char *json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
-        
-        return result;
+        writer.EndObject();
     }
 };
 
@@ -161,34 +168,38 @@ public:
     }
 
     auto begin() { return properties_.begin(); }
+    auto begin() const { return properties_.begin(); }
     auto end() { return properties_.end(); }
     auto end() const { return properties_.end(); }
 
 
-    std::vector<std::string> GetRequired() const {
-        std::vector<std::string> required;
-        for (auto& property : properties_) {
+    void WriteJson(JsonWriter& writer) const {
+        writer.BeginObject();
+        for (const auto& property : properties_) {
+            writer.Key(property.name());
+            property.WriteJson(writer);
+        }
+        writer.EndObject();
+    }
+
+    // Names of the properties without a default value, as a JSON array
+    void WriteRequired(JsonWriter& writer) const {
+        writer.BeginArray();
+        for (const auto& property : properties_) {
             if (!property.has_default_value()) {
-                required.push_back(property.name());
+                writer.String(property.name());
             }
         }
-        return required;
+        writer.EndArray();
     }
 
-    std::string to_json() const {
-        cJSON *json = cJSON_CreateObject();
-        
+    bool HasRequired() const {
         for (const auto& property : properties_) {
-            cJSON *prop_json = cJSON_Parse(property.to_json().c_str());
-            cJSON_AddItemToObject(json, property.name().c_str(), prop_json);
+            if (!property.has_default_value()) {
+                return true;
+            }
         }
-        
-        char *json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
-        
-        return result;
+        return false;
     }
 };
 
@@ -198,6 +209,8 @@ private:
     std::string description_;
     PropertyList properties_;
     std::function<ReturnValue(const PropertyList&)> callback_;
+    int max_concurrency_ = 1;   // Calls of this tool running at once, more wait in the worker queue
+    std::string resource_group_;    // Tools driving the same hardware share it, their calls run one at a time
 
 public:
     McpTool(const std::string& name, 
@@ -212,64 +225,80 @@ public:
     inline const std::string& name() const { return name_; }
     inline const std::string& description() const { return description_; }
     inline const PropertyList& properties() const { return properties_; }
-
-    std::string to_json() const {
-        std::vector<std::string> required = properties_.GetRequired();
-        
-        cJSON *json = cJSON_CreateObject();
-        cJSON_AddStringToObject(json, "name", name_.c_str());
-        cJSON_AddStringToObject(json, "description", description_.c_str());
-        
-        cJSON *input_schema = cJSON_CreateObject();
-        cJSON_AddStringToObject(input_schema, "type", "object");
-        
-        cJSON *properties = cJSON_Parse(properties_.to_json().c_str());
-        cJSON_AddItemToObject(input_schema, "properties", properties);
-        
-        if (!required.empty()) {
-            cJSON *required_array = cJSON_CreateArray();
-            for (const auto& property : required) {
-                cJSON_AddItemToArray(required_array, cJSON_CreateString(property.c_str()));
-            }
-            cJSON_AddItemToObject(input_schema, "required", required_array);
+    inline int max_concurrency() const { return max_concurrency_; }
+    inline void set_max_concurrency(int max_concurrency) { max_concurrency_ = max_concurrency; }
+    inline const std::string& resource_group() const { return resource_group_; }
+    inline void set_resource_group(const std::string& resource_group) { resource_group_ = resource_group; }
+
+    void WriteJson(JsonWriter& writer) const {
+        writer.BeginObject();
+        writer.Key("name");
+        writer.String(name_);
+        writer.Key("description");
+        writer.String(description_);
+        writer.Key("inputSchema");
+        writer.BeginObject();
+        writer.Key("type");
+        writer.String("object");
+        writer.Key("properties");
+        properties_.WriteJson(writer);
+        if (properties_.HasRequired()) {
+            writer.Key("required");
+            properties_.WriteRequired(writer);
         }
-        
-        cJSON_AddItemToObject(json, "inputSchema", input_schema);
-        
-        char *json_str = cJSON_PrintUnformatted(json);
-        std::string result(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(json);
-        
-        return result;
+        writer.EndObject();
+        writer.EndObject();
     }
 
     std::string Call(const PropertyList& properties) {
         ReturnValue return_value = callback_(properties);
         // 返回结果
-        cJSON* result = cJSON_CreateObject();
-        cJSON* content = cJSON_CreateArray();
-        cJSON* text = cJSON_CreateObject();
-        cJSON_AddStringToObject(text, "type", "text");
+        JsonWriter writer;
+        writer.BeginObject();
+        writer.Key("content");
+        writer.BeginArray();
+        writer.BeginObject();
+        writer.Key("type");
+        writer.String("text");
+        writer.Key("text");
         if (std::holds_alternative<std::string>(return_value)) {
-            cJSON_AddStringToObject(text, "text", std::get<std::string>(return_value).c_str());
+            writer.String(std::get<std::string>(return_value));
         } else if (std::holds_alternative<bool>(return_value)) {
-            cJSON_AddStringToObject(text, "text", std::get<bool>(return_value) ? "true" : "false");
+            writer.String(std::get<bool>(return_value) ? "true" : "false");
         } else if (std::holds_alternative<int>(return_value)) {
-            cJSON_AddStringToObject(text, "text", std::to_string(std::get<int>(return_value)).c_str());
+            writer.String(std::to_string(std::get<int>(return_value)));
         }
-        cJSON_AddItemToArray(content, text);
-        cJSON_AddItemToObject(result, "content", content);
-        cJSON_AddBoolToObject(result, "isError", false);
-
-        auto json_str = cJSON_PrintUnformatted(result);
-        std::string result_str(json_str);
-        cJSON_free(json_str);
-        cJSON_Delete(result);
-        return result_str;
+        writer.EndObject();
+        writer.EndArray();
+        writer.Key("isError");
+        writer.Bool(false);
+        writer.EndObject();
+        return writer.Release();
     }
 };
 
+// Collects the responses of one JSON-RPC batch. Every request completes it exactly
+// once, with or without a response; the last one sends them as a single array.
+class McpBatch {
+public:
+    explicit McpBatch(int pending) : pending_(pending) {}
+    void AddResponse(std::string&& response);
+    // For a request that has no response (a notification or a cancelled call)
+    void Complete();
+
+private:
+    std::mutex mutex_;
+    int pending_;
+    std::vector<std::string> responses_;
+};
+
+// A tools/call from the moment it is queued until its tool returns
+struct McpCall {
+    int id = 0;
+    std::string progress_token;     // JSON value of params._meta.progressToken, empty if not asked for
+    std::atomic<bool> cancelled{false};
+};
+
 class McpServer {
 public:
     static McpServer& GetInstance() {
@@ -279,9 +308,16 @@ public:
 
     void AddCommonTools();
     void AddTool(McpTool* tool);
-    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
+    // Tools with the same resource_group (e.g. "motor") never run concurrently
+    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+        const std::string& resource_group = "");
     void ParseMessage(const cJSON* json);
     void ParseMessage(const std::string& message);
+    // For tools: reports progress of the call running on this thread, if the caller asked for it.
+    // message is optional partial output, e.g. a step that finished.
+    void SendProgress(int progress, int total = 0, const std::string& message = "");
+    // For tools: true once the caller cancelled the call running on this thread, stop early if it is
+    bool IsCallCancelled() const;
 
 private:
     McpServer();
@@ -289,17 +325,37 @@ private:
 
     void ParseCapabilities(const cJSON* capabilities);
 
-    void ReplyResult(int id, const std::string& result);
-    void ReplyError(int id, const std::string& message);
-
-    void GetToolsList(int id, const std::string& cursor);
-    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size);
+    void ParseRequest(const cJSON* json, const std::shared_ptr<McpBatch>& batch);
+    // batch is null for a single request, the reply is sent right away then
+    void SendReply(std::string&& payload, const std::shared_ptr<McpBatch>& batch);
+    void ReplyResult(int id, const std::string& result, const std::shared_ptr<McpBatch>& batch);
+    void ReplyError(int id, const std::string& message, const std::shared_ptr<McpBatch>& batch);
+    // Error for a message that is not a valid request, its id is null
+    void ReplyInvalidRequest(const std::string& message, const std::shared_ptr<McpBatch>& batch);
+    // The request gets no response, a batch still counts it as done
+    void SkipReply(const std::shared_ptr<McpBatch>& batch);
+
+    void GetToolsList(int id, const std::string& cursor, const std::shared_ptr<McpBatch>& batch);
+    size_t RenderToolsListPage(size_t start, JsonWriter& page, JsonWriter& tool) const;
+    void BuildToolsListPages();
+    void InvalidateToolsList();
+    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size,
+        const std::string& progress_token, const std::shared_ptr<McpBatch>& batch);
+    void FinishCall(const std::shared_ptr<McpCall>& call);
+    void CancelCall(int id);
 
     std::string current_motor_direction; // 新增成员变量
     std::string current_motor2_direction; // 新增：第二电机方向
     
     std::vector<McpTool*> tools_;
-    std::thread tool_call_thread_;
+    std::unordered_map<std::string, McpTool*> tool_index_;
+    // tools/list results rendered once per tool set, keyed by the cursor that starts each page
+    std::vector<std::string> tools_list_pages_;
+    std::unordered_map<std::string, size_t> tools_list_cursors_;
+    ToolWorkerPool tool_pool_;
+    std::mutex calls_mutex_;
+    std::unordered_map<int, std::shared_ptr<McpCall>> calls_;
+    static thread_local McpCall* current_call_;
 };
 
 #endif // MCP_SERVER_H
@@ -0,0 +1,18 @@
+#ifndef AUDIO_STREAM_PACKET_H
+#define AUDIO_STREAM_PACKET_H
+
+#include <cstdint>
+#include <vector>
+
+// Kept free of ESP-IDF and cJSON headers so the audio queue logic builds anywhere
+struct AudioStreamPacket {
+    int sample_rate = 0;
+    int frame_duration = 0;
+    uint32_t timestamp = 0;
+    std::vector<uint8_t> payload;
+    uint32_t sequence = 0;          // Transport sequence, 0 if the transport has none
+    int64_t receive_time_ms = 0;    // Local arrival time, for jitter estimation and latency tracing
+    int64_t encode_time_us = 0;     // Local time the uplink packet was encoded, for latency tracing
+};
+
+#endif // AUDIO_STREAM_PACKET_H
@@ -0,0 +1,16 @@
+#ifndef AUDIO_STREAM_STATS_H
+#define AUDIO_STREAM_STATS_H
+
+#include <cstdint>
+
+// Receive statistics of the current audio channel
+struct AudioStreamStats {
+    uint32_t received = 0;
+    uint32_t lost = 0;          // Sequence numbers never received
+    uint32_t reordered = 0;     // Arrived after a higher sequence number
+    uint32_t duplicated = 0;
+    uint32_t late = 0;          // Too far behind to tell from a duplicate, dropped
+    int jitter_ms = 0;          // RFC 3550 inter-arrival jitter
+};
+
+#endif // AUDIO_STREAM_STATS_H
@@ -0,0 +1,257 @@
+#include "cbor.h"
+
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#define CBOR_MAX_DEPTH 16
+
+void CborWriter::Put(const void* data, size_t size) {
+    if (!ok_ || size > capacity_ - size_) {
+        ok_ = false;
+        return;
+    }
+    memcpy(buffer_ + size_, data, size);
+    size_ += size;
+}
+
+void CborWriter::Head(uint8_t major, uint64_t value) {
+    uint8_t head[9];
+    size_t length;
+    major <<= 5;
+    if (value < 24) {
+        head[0] = major | value;
+        length = 1;
+    } else if (value <= 0xFF) {
+        head[0] = major | 24;
+        head[1] = value;
+        length = 2;
+    } else if (value <= 0xFFFF) {
+        head[0] = major | 25;
+        head[1] = value >> 8;
+        head[2] = value;
+        length = 3;
+    } else if (value <= 0xFFFFFFFF) {
+        head[0] = major | 26;
+        for (int i = 0; i < 4; i++) {
+            head[1 + i] = value >> (24 - i * 8);
+        }
+        length = 5;
+    } else {
+        head[0] = major | 27;
+        for (int i = 0; i < 8; i++) {
+            head[1 + i] = value >> (56 - i * 8);
+        }
+        length = 9;
+    }
+    Put(head, length);
+}
+
+void CborWriter::Text(std::string_view text) {
+    Head(3, text.size());
+    Put(text.data(), text.size());
+}
+
+void CborWriter::Int(int64_t value) {
+    if (value >= 0) {
+        Head(0, value);
+    } else {
+        Head(1, (uint64_t)(-1 - value));
+    }
+}
+
+void CborWriter::Bool(bool value) {
+    uint8_t simple = value ? 0xF5 : 0xF4;
+    Put(&simple, 1);
+}
+
+void CborWriter::Null() {
+    uint8_t simple = 0xF6;
+    Put(&simple, 1);
+}
+
+bool CborReader::ReadUint(uint8_t additional, uint64_t& value) {
+    if (additional < 24) {
+        value = additional;
+        return true;
+    }
+    if (additional > 27) {
+        return false;
+    }
+    size_t length = 1 << (additional - 24);
+    if (length > size_ - offset_) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < length; i++) {
+        value = (value << 8) | data_[offset_++];
+    }
+    return true;
+}
+
+static double HalfToDouble(uint16_t half) {
+    int exponent = (half >> 10) & 0x1F;
+    int mantissa = half & 0x3FF;
+    double value;
+    if (exponent == 0) {
+        value = ldexp(mantissa, -24);
+    } else if (exponent != 31) {
+        value = ldexp(mantissa + 1024, exponent - 25);
+    } else {
+        value = mantissa == 0 ? INFINITY : NAN;
+    }
+    return (half & 0x8000) ? -value : value;
+}
+
+bool CborReader::Next(CborItem& item) {
+    if (error_ || offset_ >= size_) {
+        return false;
+    }
+    uint8_t initial = data_[offset_++];
+    uint8_t major = initial >> 5;
+    uint8_t additional = initial & 0x1F;
+    uint64_t value;
+    if (!ReadUint(additional, value)) {
+        error_ = true;
+        return false;
+    }
+    item.value = value;
+    item.data = nullptr;
+
+    switch (major) {
+    case 0:
+        item.type = kCborUnsigned;
+        return true;
+    case 1:
+        item.type = kCborNegative;
+        return true;
+    case 2:
+    case 3:
+        if (value > size_ - offset_) {
+            error_ = true;
+            return false;
+        }
+        item.type = major == 2 ? kCborBytes : kCborText;
+        item.data = data_ + offset_;
+        offset_ += value;
+        return true;
+    case 4:
+        item.type = kCborArray;
+        return true;
+    case 5:
+        item.type = kCborMap;
+        return true;
+    case 7:
+        if (additional == 20 || additional == 21) {
+            item.type = kCborBool;
+            item.boolean = additional == 21;
+            return true;
+        } else if (additional == 22) {
+            item.type = kCborNull;
+            return true;
+        } else if (additional == 25) {
+            item.type = kCborFloat;
+            item.number = HalfToDouble(value);
+            return true;
+        } else if (additional == 26) {
+            uint32_t bits = value;
+            float number;
+            memcpy(&number, &bits, sizeof(number));
+            item.type = kCborFloat;
+            item.number = number;
+            return true;
+        } else if (additional == 27) {
+            item.type = kCborFloat;
+            memcpy(&item.number, &value, sizeof(item.number));
+            return true;
+        }
+        break;
+    default:
+        // Tags (major type 6) are not used by the protocol
+        break;
+    }
+    error_ = true;
+    return false;
+}
+
+static bool SkipItems(CborReader& reader, uint64_t count, int depth) {
+    CborItem item;
+    for (uint64_t i = 0; i < count; i++) {
+        if (!reader.Next(item)) {
+            return false;
+        }
+        if (item.type == kCborArray || item.type == kCborMap) {
+            if (depth >= CBOR_MAX_DEPTH || !SkipItems(reader, item.type == kCborMap ? item.value * 2 : item.value, depth + 1)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool CborReader::Skip(const CborItem& item) {
+    if (item.type == kCborArray) {
+        return SkipItems(*this, item.value, 1);
+    } else if (item.type == kCborMap) {
+        return SkipItems(*this, item.value * 2, 1);
+    }
+    return true;
+}
+
+static cJSON* ReadJsonValue(CborReader& reader, int depth) {
+    CborItem item;
+    if (depth > CBOR_MAX_DEPTH || !reader.Next(item)) {
+        return nullptr;
+    }
+
+    switch (item.type) {
+    case kCborUnsigned:
+        return cJSON_CreateNumber((double)item.value);
+    case kCborNegative:
+        return cJSON_CreateNumber(-1.0 - (double)item.value);
+    case kCborFloat:
+        return cJSON_CreateNumber(item.number);
+    case kCborBool:
+        return cJSON_CreateBool(item.boolean);
+    case kCborNull:
+        return cJSON_CreateNull();
+    case kCborBytes:
+    case kCborText:
+        return cJSON_CreateString(std::string((const char*)item.data, item.value).c_str());
+    case kCborArray: {
+        cJSON* array = cJSON_CreateArray();
+        for (uint64_t i = 0; i < item.value; i++) {
+            cJSON* child = ReadJsonValue(reader, depth + 1);
+            if (child == nullptr) {
+                cJSON_Delete(array);
+                return nullptr;
+            }
+            cJSON_AddItemToArray(array, child);
+        }
+        return array;
+    }
+    case kCborMap: {
+        cJSON* object = cJSON_CreateObject();
+        for (uint64_t i = 0; i < item.value; i++) {
+            CborItem key;
+            if (!reader.Next(key) || key.type != kCborText) {
+                cJSON_Delete(object);
+                return nullptr;
+            }
+            cJSON* child = ReadJsonValue(reader, depth + 1);
+            if (child == nullptr) {
+                cJSON_Delete(object);
+                return nullptr;
+            }
+            cJSON_AddItemToObject(object, std::string((const char*)key.data, key.value).c_str(), child);
+        }
+        return object;
+    }
+    }
+    return nullptr;
+}
+
+cJSON* CborToJson(const uint8_t* data, size_t size) {
+    CborReader reader(data, size);
+    return ReadJsonValue(reader, 0);
+}
@@ -0,0 +1,90 @@
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <cJSON.h>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*
+ * Minimal CBOR (RFC 8949) codec for control messages.
+ *
+ * CborWriter encodes into a caller supplied buffer and never allocates, a
+ * message that does not fit sets ok() to false. CborReader walks an encoded
+ * buffer item by item without copying. Only definite lengths are supported,
+ * which is all the writer produces.
+ */
+class CborWriter {
+public:
+    CborWriter(uint8_t* buffer, size_t capacity) : buffer_(buffer), capacity_(capacity) {}
+
+    void Map(size_t pairs) { Head(5, pairs); }
+    void Array(size_t items) { Head(4, items); }
+    void Text(std::string_view text);
+    void Int(int64_t value);
+    void Bool(bool value);
+    void Null();
+
+    inline bool ok() const { return ok_; }
+    inline size_t size() const { return size_; }
+    inline const uint8_t* data() const { return buffer_; }
+
+private:
+    uint8_t* buffer_;
+    size_t capacity_;
+    size_t size_ = 0;
+    bool ok_ = true;
+
+    void Head(uint8_t major, uint64_t value);
+    void Put(const void* data, size_t size);
+};
+
+enum CborType {
+    kCborUnsigned,
+    kCborNegative,
+    kCborBytes,
+    kCborText,
+    kCborArray,
+    kCborMap,
+    kCborBool,
+    kCborNull,
+    kCborFloat,
+};
+
+struct CborItem {
+    CborType type;
+    uint64_t value;         // Integer magnitude, string length or container size
+    const uint8_t* data;    // Bytes / text, not null terminated
+    double number;          // Floats
+    bool boolean;
+};
+
+class CborReader {
+public:
+    CborReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    // Returns false at the end of the buffer or on malformed input (see error())
+    bool Next(CborItem& item);
+    // Skips what a map or array item returned by Next() contains, other items have nothing to skip
+    bool Skip(const CborItem& item);
+    inline bool error() const { return error_; }
+    inline bool at_end() const { return offset_ >= size_; }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t offset_ = 0;
+    bool error_ = false;
+
+    bool ReadUint(uint8_t additional, uint64_t& value);
+};
+
+// Builds the cJSON tree of one CBOR map / value, returns nullptr if it is malformed
+cJSON* CborToJson(const uint8_t* data, size_t size);
+
+// Control messages are CBOR maps (major type 5, 0xA0-0xBF), a JSON text starts with '{'
+static inline bool IsCborMessage(const uint8_t* data, size_t size) {
+    return size > 0 && (data[0] & 0xE0) == 0xA0;
+}
+
+#endif // CBOR_H
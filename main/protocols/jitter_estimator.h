@@ -0,0 +1,58 @@
+#ifndef JITTER_ESTIMATOR_H
+#define JITTER_ESTIMATOR_H
+
+#include <cstdint>
+
+/*
+ * RFC 3550 inter-arrival jitter of a sequenced packet stream.
+ *
+ * D is the arrival spacing minus the send spacing (the frame duration per
+ * sequence number), and J += (|D| - J) / 16. Only arrivals with a higher
+ * sequence number than the previous one are used, so reordering does not
+ * count twice. Shared by SequenceTracker and JitterBuffer.
+ */
+class JitterEstimator {
+public:
+    // Forgets the estimate as well
+    void Reset() {
+        has_last_arrival_ = false;
+        jitter_q4_ = 0;
+    }
+    // Forgets the last arrival but keeps the estimate, for a new stream over the same link
+    void Restart() {
+        has_last_arrival_ = false;
+    }
+
+    // Returns false if the arrival was out of order and left the estimate alone
+    bool Update(uint32_t sequence, int64_t arrival_ms, int frame_duration) {
+        if (has_last_arrival_) {
+            int32_t sequence_delta = (int32_t)(sequence - last_sequence_);
+            if (sequence_delta <= 0) {
+                return false;
+            }
+            int64_t d = (arrival_ms - last_arrival_ms_) - (int64_t)sequence_delta * frame_duration;
+            if (d < 0) {
+                d = -d;
+            }
+            // A stall of many seconds would take minutes to decay
+            if (d > 10000) {
+                d = 10000;
+            }
+            jitter_q4_ += (int32_t)d - ((jitter_q4_ + 8) >> 4);
+        }
+        has_last_arrival_ = true;
+        last_sequence_ = sequence;
+        last_arrival_ms_ = arrival_ms;
+        return true;
+    }
+
+    inline int jitter_ms() const { return jitter_q4_ >> 4; }
+
+private:
+    bool has_last_arrival_ = false;
+    uint32_t last_sequence_ = 0;
+    int64_t last_arrival_ms_ = 0;
+    int32_t jitter_q4_ = 0;     // J in 1/16 ms
+};
+
+#endif // JITTER_ESTIMATOR_H
@@ -0,0 +1,193 @@
+#include "json_scanner.h"
+
+#include <cstdint>
+
+static const size_t kNotFound = std::string_view::npos;
+
+size_t JsonScanner::SkipSpace(size_t pos) const {
+    while (pos < size_ && (data_[pos] == ' ' || data_[pos] == '\t' || data_[pos] == '\n' || data_[pos] == '\r')) {
+        pos++;
+    }
+    return pos;
+}
+
+// pos is at the opening quote, returns the position after the closing quote
+size_t JsonScanner::SkipString(size_t pos) const {
+    for (pos++; pos < size_; pos++) {
+        if (data_[pos] == '\\') {
+            pos++;
+        } else if (data_[pos] == '"') {
+            return pos + 1;
+        }
+    }
+    return kNotFound;
+}
+
+// Returns the position of the value of a top-level key, or kNotFound
+size_t JsonScanner::FindValue(std::string_view key) const {
+    size_t pos = SkipSpace(0);
+    if (pos >= size_ || data_[pos] != '{') {
+        return kNotFound;
+    }
+
+    int depth = 0;
+    bool expect_key = false;
+    while (pos < size_) {
+        char c = data_[pos];
+        if (c == '"') {
+            size_t end = SkipString(pos);
+            if (end == kNotFound) {
+                return kNotFound;
+            }
+            if (depth != 1 || !expect_key) {
+                pos = end;
+                continue;
+            }
+
+            std::string_view name(data_ + pos + 1, end - pos - 2);
+            pos = SkipSpace(end);
+            if (pos >= size_ || data_[pos] != ':') {
+                return kNotFound;
+            }
+            pos = SkipSpace(pos + 1);
+            expect_key = false;
+            if (name == key) {
+                return pos < size_ ? pos : kNotFound;
+            }
+            continue;
+        }
+
+        if (c == '{' || c == '[') {
+            depth++;
+            expect_key = depth == 1;
+        } else if (c == '}' || c == ']') {
+            if (--depth == 0) {
+                return kNotFound;
+            }
+        } else if (c == ',' && depth == 1) {
+            expect_key = true;
+        }
+        pos++;
+    }
+    return kNotFound;
+}
+
+bool JsonScanner::FindString(std::string_view key, std::string_view& value) const {
+    size_t pos = FindValue(key);
+    if (pos == kNotFound || data_[pos] != '"') {
+        return false;
+    }
+    size_t end = SkipString(pos);
+    if (end == kNotFound) {
+        return false;
+    }
+    value = std::string_view(data_ + pos + 1, end - pos - 2);
+    return true;
+}
+
+bool JsonScanner::FindUint(std::string_view key, uint32_t& value) const {
+    size_t pos = FindValue(key);
+    if (pos == kNotFound || data_[pos] < '0' || data_[pos] > '9') {
+        return false;
+    }
+    uint64_t number = 0;
+    for (; pos < size_ && data_[pos] >= '0' && data_[pos] <= '9'; pos++) {
+        number = number * 10 + (data_[pos] - '0');
+        if (number > UINT32_MAX) {
+            return false;
+        }
+    }
+    // A fraction or an exponent is not an integer
+    if (pos < size_ && (data_[pos] == '.' || data_[pos] == 'e' || data_[pos] == 'E')) {
+        return false;
+    }
+    value = number;
+    return true;
+}
+
+static bool ReadHex4(std::string_view raw, size_t pos, uint32_t& value) {
+    if (pos + 4 > raw.size()) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = pos; i < pos + 4; i++) {
+        char c = raw[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void AppendUtf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out += (char)code;
+    } else if (code < 0x800) {
+        out += (char)(0xC0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += (char)(0xE0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    } else {
+        out += (char)(0xF0 | (code >> 18));
+        out += (char)(0x80 | ((code >> 12) & 0x3F));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+}
+
+bool UnescapeJsonString(std::string_view raw, std::string& out) {
+    out.clear();
+    out.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); i++) {
+        if (raw[i] != '\\') {
+            out += raw[i];
+            continue;
+        }
+        if (++i >= raw.size()) {
+            return false;
+        }
+        switch (raw[i]) {
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            uint32_t code;
+            if (!ReadHex4(raw, i + 1, code)) {
+                return false;
+            }
+            i += 4;
+            // Characters outside the BMP come as a surrogate pair
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                uint32_t low;
+                if (i + 2 >= raw.size() || raw[i + 1] != '\\' || raw[i + 2] != 'u' ||
+                    !ReadHex4(raw, i + 3, low) || low < 0xDC00 || low > 0xDFFF) {
+                    return false;
+                }
+                i += 6;
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                return false;
+            }
+            AppendUtf8(out, code);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef JSON_SCANNER_H
+#define JSON_SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ * Reads top-level string members of a JSON object in place.
+ *
+ * Nothing is allocated or copied, FindString() returns a view of the raw
+ * (still escaped) value inside the scanned text. Nested objects and arrays
+ * are skipped, so a key is only matched at the top level. Use it to pick a
+ * few fields out of a frequent message, anything more goes through cJSON.
+ */
+class JsonScanner {
+public:
+    JsonScanner(const char* data, size_t size) : data_(data), size_(size) {}
+
+    // Returns false if the key is missing, its value is not a string or the text is malformed
+    bool FindString(std::string_view key, std::string_view& value) const;
+    // The same for a non-negative integer that fits in 32 bits
+    bool FindUint(std::string_view key, uint32_t& value) const;
+
+private:
+    const char* data_;
+    size_t size_;
+
+    size_t SkipSpace(size_t pos) const;
+    size_t SkipString(size_t pos) const;
+    size_t FindValue(std::string_view key) const;
+};
+
+// Decodes the escapes of a raw JSON string value into UTF-8, returns false if one is invalid
+bool UnescapeJsonString(std::string_view raw, std::string& out);
+
+#endif // JSON_SCANNER_H
@@ -2,11 +2,16 @@
 #include "board.h"
 #include "application.h"
 #include "settings.h"
+#include "audio_payload_pool.h"
+#include "cbor.h"
+#include "session_recorder.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <ml307_mqtt.h>
 #include <ml307_udp.h>
 #include <cstring>
+#include <algorithm>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
@@ -60,11 +65,27 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     });
 
     mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
-        cJSON* root = cJSON_Parse(payload.c_str());
-        if (root == nullptr) {
-            ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
+        cJSON* root;
+        bool cbor = IsCborMessage((const uint8_t*)payload.data(), payload.size());
+        SESSION_RECORD(kSessionRecordIn, cbor ? kSessionRecordCbor : kSessionRecordText, payload.data(), payload.size());
+        if (cbor ? DispatchChatMessage((const uint8_t*)payload.data(), payload.size())
+                 : DispatchChatMessage(payload.data(), payload.size())) {
+            last_incoming_time_ = std::chrono::steady_clock::now();
             return;
         }
+        if (cbor) {
+            root = CborToJson((const uint8_t*)payload.data(), payload.size());
+            if (root == nullptr) {
+                ESP_LOGE(TAG, "Failed to parse CBOR message, length %u", payload.size());
+                return;
+            }
+        } else {
+            root = cJSON_Parse(payload.c_str());
+            if (root == nullptr) {
+                ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
+                return;
+            }
+        }
         cJSON* type = cJSON_GetObjectItem(root, "type");
         if (!cJSON_IsString(type)) {
             ESP_LOGE(TAG, "Message type is invalid");
@@ -82,8 +103,8 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
                     CloseAudioChannel();
                 });
             }
-        } else if (on_incoming_json_ != nullptr) {
-            on_incoming_json_(root);
+        } else {
+            DispatchJson(root);
         }
         cJSON_Delete(root);
         last_incoming_time_ = std::chrono::steady_clock::now();
@@ -113,6 +134,7 @@ bool MqttProtocol::SendText(const std::string& text) {
     if (publish_topic_.empty()) {
         return false;
     }
+    SESSION_RECORD(kSessionRecordOut, kSessionRecordText, text.data(), text.size());
     if (!mqtt_->Publish(publish_topic_, text)) {
         ESP_LOGE(TAG, "Failed to publish message: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
@@ -121,30 +143,110 @@ bool MqttProtocol::SendText(const std::string& text) {
     return true;
 }
 
+bool MqttProtocol::SendCbor(const uint8_t* data, size_t size) {
+    if (publish_topic_.empty()) {
+        return false;
+    }
+    SESSION_RECORD(kSessionRecordOut, kSessionRecordCbor, data, size);
+    if (!mqtt_->Publish(publish_topic_, std::string((const char*)data, size))) {
+        ESP_LOGE(TAG, "Failed to publish CBOR message");
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
+    }
+    return true;
+}
+
 bool MqttProtocol::SendAudio(const AudioStreamPacket& packet) {
     std::lock_guard<std::mutex> lock(channel_mutex_);
     if (udp_ == nullptr) {
         return false;
     }
+    SESSION_RECORD(kSessionRecordOut, kSessionRecordAudio, packet.payload.data(), packet.payload.size(), packet.timestamp);
+    return SendEncrypted(packet.payload.data(), packet.payload.size(), packet.timestamp, 0);
+}
 
-    std::string nonce(aes_nonce_);
-    *(uint16_t*)&nonce[2] = htons(packet.payload.size());
-    *(uint32_t*)&nonce[8] = htonl(packet.timestamp);
-    *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
+/*
+ * Coalesced packets (only after the server accepted "udp_burst" in the hello):
+ * |type 0x02|frames 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
+ * |frame_len 2u|opus frame_len| x frames   (encrypted as a whole)
+ * The frames take consecutive sequence numbers starting at `sequence`.
+ */
+bool MqttProtocol::SendAudioBurst(const AudioStreamPacket* packets, size_t count) {
+    std::lock_guard<std::mutex> lock(channel_mutex_);
+    if (udp_ == nullptr) {
+        return false;
+    }
 
-    std::string encrypted;
-    encrypted.resize(aes_nonce_.size() + packet.payload.size());
-    memcpy(encrypted.data(), nonce.data(), nonce.size());
+#if CONFIG_USE_SESSION_RECORDER
+    for (size_t i = 0; i < count; i++) {
+        SESSION_RECORD(kSessionRecordOut, kSessionRecordAudio, packets[i].payload.data(), packets[i].payload.size(), packets[i].timestamp);
+    }
+#endif
+
+    size_t index = 0;
+    while (index < count) {
+        // Take as many frames as the server accepts and the datagram can hold
+        size_t frames = 0;
+        size_t size = 0;
+        while (index + frames < count && frames < udp_burst_frames_) {
+            size_t frame_size = 2 + packets[index + frames].payload.size();
+            if (frames > 0 && aes_nonce_.size() + size + frame_size > MQTT_UDP_MAX_DATAGRAM_SIZE) {
+                break;
+            }
+            size += frame_size;
+            frames++;
+        }
 
+        auto& first = packets[index];
+        if (frames == 1) {
+            if (!SendEncrypted(first.payload.data(), first.payload.size(), first.timestamp, 0)) {
+                return false;
+            }
+        } else {
+            burst_buffer_.resize(size);
+            auto p = burst_buffer_.data();
+            for (size_t i = 0; i < frames; i++) {
+                auto& payload = packets[index + i].payload;
+                *(uint16_t*)p = htons(payload.size());
+                memcpy(p + 2, payload.data(), payload.size());
+                p += 2 + payload.size();
+            }
+            if (!SendEncrypted(burst_buffer_.data(), size, first.timestamp, frames)) {
+                return false;
+            }
+        }
+        index += frames;
+    }
+    return true;
+}
+
+// Called with channel_mutex_ held, `burst_frames` is 0 for a single frame packet
+bool MqttProtocol::SendEncrypted(const uint8_t* data, size_t size, uint32_t timestamp, uint8_t burst_frames) {
+    // Build the header and the ciphertext in place in the reused send buffer
+    send_buffer_.resize(aes_nonce_.size() + size);
+    auto header = (uint8_t*)send_buffer_.data();
+    memcpy(header, aes_nonce_.data(), aes_nonce_.size());
+    if (burst_frames > 0) {
+        header[0] = 0x02;
+        header[1] = burst_frames;
+    }
+    *(uint16_t*)&header[2] = htons(size);
+    *(uint32_t*)&header[8] = htonl(timestamp);
+    *(uint32_t*)&header[12] = htonl(local_sequence_ + 1);
+    local_sequence_ += burst_frames > 0 ? burst_frames : 1;
+
+    // mbedtls advances the counter block, so it works on a copy of the header
+    uint8_t nonce_counter[16];
+    memcpy(nonce_counter, header, sizeof(nonce_counter));
     size_t nc_off = 0;
     uint8_t stream_block[16] = {0};
-    if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet.payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
-        (uint8_t*)packet.payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
+    if (mbedtls_aes_crypt_ctr(&aes_ctx_, size, &nc_off, nonce_counter, stream_block,
+        data, header + aes_nonce_.size()) != 0) {
         ESP_LOGE(TAG, "Failed to encrypt audio data");
         return false;
     }
 
-    return udp_->Send(encrypted) > 0;
+    return udp_->Send(send_buffer_) > 0;
 }
 
 void MqttProtocol::CloseAudioChannel() {
@@ -161,6 +263,12 @@ void MqttProtocol::CloseAudioChannel() {
     message += "\"type\":\"goodbye\"";
     message += "}";
     SendText(message);
+    SESSION_RECORD_FLUSH();
+
+    AudioStreamStats stats;
+    GetAudioStreamStats(stats);
+    ESP_LOGI(TAG, "UDP audio received %lu lost %lu reordered %lu duplicated %lu late %lu jitter %dms",
+        stats.received, stats.lost, stats.reordered, stats.duplicated, stats.late, stats.jitter_ms);
 
     if (on_audio_channel_closed_ != nullptr) {
         on_audio_channel_closed_();
@@ -176,7 +284,9 @@ bool MqttProtocol::OpenAudioChannel() {
     }
 
     error_occurred_ = false;
+    cbor_enabled_ = false;
     session_id_ = "";
+    SESSION_RECORD(kSessionRecordOut, kSessionRecordOpen, "udp", strlen("udp"));
     xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 
     auto message = GetHelloMessage();
@@ -203,7 +313,7 @@ bool MqttProtocol::OpenAudioChannel() {
          * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
          * |payload payload_len|
          */
-        if (data.size() < sizeof(aes_nonce_)) {
+        if (data.size() < aes_nonce_.size()) {
             ESP_LOGE(TAG, "Invalid audio packet size: %u", data.size());
             return;
         }
@@ -213,33 +323,40 @@ bool MqttProtocol::OpenAudioChannel() {
         }
         uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
         uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
-            return;
+        // Late packets are passed on, the jitter buffer puts them back in order if they can still be played
+        bool accepted;
+        {
+            std::lock_guard<std::mutex> lock(receive_stats_mutex_);
+            accepted = receive_tracker_.Update(sequence, esp_timer_get_time() / 1000, server_frame_duration_);
         }
-        if (sequence != remote_sequence_ + 1) {
-            ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
+        if (!accepted) {
+            ESP_LOGW(TAG, "Dropped duplicated or late audio packet: %lu", sequence);
+            return;
         }
 
         size_t decrypted_size = data.size() - aes_nonce_.size();
         size_t nc_off = 0;
         uint8_t stream_block[16] = {0};
-        auto nonce = (uint8_t*)data.data();
-        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
+        // The counter block is advanced by mbedtls, do not let it write into the received data
+        uint8_t nonce_counter[16];
+        memcpy(nonce_counter, data.data(), sizeof(nonce_counter));
+        auto encrypted = (const uint8_t*)data.data() + aes_nonce_.size();
         AudioStreamPacket packet;
         packet.sample_rate = server_sample_rate_;
         packet.frame_duration = server_frame_duration_;
         packet.timestamp = timestamp;
-        packet.payload.resize(decrypted_size);
-        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet.payload.data());
+        packet.sequence = sequence;
+        packet.payload = AudioPayloadPool::GetInstance().Acquire(decrypted_size);
+        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce_counter, stream_block, encrypted, packet.payload.data());
         if (ret != 0) {
             ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
+            AudioPayloadPool::GetInstance().Release(std::move(packet.payload));
             return;
         }
+        SESSION_RECORD(kSessionRecordIn, kSessionRecordAudio, packet.payload.data(), packet.payload.size(), timestamp);
         if (on_incoming_audio_ != nullptr) {
             on_incoming_audio_(std::move(packet));
         }
-        remote_sequence_ = sequence;
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
@@ -257,19 +374,31 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON_AddStringToObject(root, "type", "hello");
     cJSON_AddNumberToObject(root, "version", 3);
     cJSON_AddStringToObject(root, "transport", "udp");
+    if (!resume_session_id_.empty()) {
+        cJSON_AddStringToObject(root, "resume_session_id", resume_session_id_.c_str());
+    }
     cJSON* features = cJSON_CreateObject();
 #if CONFIG_USE_SERVER_AEC
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
 #if CONFIG_IOT_PROTOCOL_MCP
     cJSON_AddBoolToObject(features, "mcp", true);
+#endif
+    // Replies can carry the turn of the listen start they answer
+    cJSON_AddBoolToObject(features, "turn", true);
+    // Control messages can be published as CBOR instead of JSON text
+    cJSON_AddBoolToObject(features, "cbor", true);
+#ifndef CONFIG_USE_SERVER_AEC
+    // Up to this many opus frames can be coalesced into one UDP packet (type 0x02).
+    // Server side AEC needs the timestamp of every frame, a coalesced packet carries only the first
+    cJSON_AddNumberToObject(features, "udp_burst", AUDIO_MAX_BURST_FRAMES);
 #endif
     cJSON_AddItemToObject(root, "features", features);
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", Application::GetInstance().frame_duration());
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -288,8 +417,9 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
     auto session_id = cJSON_GetObjectItem(root, "session_id");
     if (cJSON_IsString(session_id)) {
         session_id_ = session_id->valuestring;
-        ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
+        ESP_LOGI(TAG, "Session ID: %s%s", session_id_.c_str(), session_id_ == resume_session_id_ ? " (resumed)" : "");
     }
+    ParseServerFeatures(root);
 
     // Get sample rate from hello message
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
@@ -309,6 +439,14 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
         ESP_LOGE(TAG, "UDP is not specified");
         return;
     }
+    // The server opts in to coalesced packets by echoing the frame count it accepts
+    udp_burst_frames_ = 1;
+#ifndef CONFIG_USE_SERVER_AEC
+    auto burst = cJSON_GetObjectItem(udp, "burst");
+    if (cJSON_IsNumber(burst) && burst->valueint > 1) {
+        udp_burst_frames_ = std::min<int>(burst->valueint, AUDIO_MAX_BURST_FRAMES);
+    }
+#endif
     udp_server_ = cJSON_GetObjectItem(udp, "server")->valuestring;
     udp_port_ = cJSON_GetObjectItem(udp, "port")->valueint;
     auto key = cJSON_GetObjectItem(udp, "key")->valuestring;
@@ -320,7 +458,14 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
     mbedtls_aes_init(&aes_ctx_);
     mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
     local_sequence_ = 0;
-    remote_sequence_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(receive_stats_mutex_);
+        receive_tracker_.Reset();
+    }
+    // A failed open keeps offering the last session the server accepted
+    resume_session_id_ = session_id_;
+    // OpenAudioChannel returns as soon as the event is set, the channel must not look timed out by then
+    last_incoming_time_ = std::chrono::steady_clock::now();
     xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 }
 
@@ -343,6 +488,13 @@ std::string MqttProtocol::DecodeHexString(const std::string& hex_string) {
     return decoded;
 }
 
+bool MqttProtocol::GetAudioStreamStats(AudioStreamStats& stats) const {
+    // The UDP receive task updates the counters while the copy is made
+    std::lock_guard<std::mutex> lock(receive_stats_mutex_);
+    stats = receive_tracker_.stats();
+    return true;
+}
+
 bool MqttProtocol::IsAudioChannelOpened() const {
     return udp_ != nullptr && !error_occurred_ && !IsTimeout();
 }
@@ -3,6 +3,7 @@
 
 
 #include "protocol.h"
+#include "sequence_tracker.h"
 #include <mqtt.h>
 #include <udp.h>
 #include <cJSON.h>
@@ -20,6 +21,9 @@
 
 #define MQTT_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
 
+// Coalesced datagrams stay below a typical path MTU
+#define MQTT_UDP_MAX_DATAGRAM_SIZE 1400
+
 class MqttProtocol : public Protocol {
 public:
     MqttProtocol();
@@ -27,9 +31,12 @@ public:
 
     bool Start() override;
     bool SendAudio(const AudioStreamPacket& packet) override;
+    bool SendAudioBurst(const AudioStreamPacket* packets, size_t count) override;
+    size_t max_audio_burst() const override { return udp_burst_frames_; }
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    bool GetAudioStreamStats(AudioStreamStats& stats) const override;
 
 private:
     EventGroupHandle_t event_group_handle_;
@@ -41,16 +48,22 @@ private:
     Udp* udp_ = nullptr;
     mbedtls_aes_context aes_ctx_;
     std::string aes_nonce_;
+    std::string send_buffer_;   // Header + ciphertext of the last audio frame, reused between sends
     std::string udp_server_;
     int udp_port_;
     uint32_t local_sequence_;
-    uint32_t remote_sequence_;
+    SequenceTracker receive_tracker_;   // Updated by the UDP receive task, read for diagnostics
+    mutable std::mutex receive_stats_mutex_;    // Guards receive_tracker_
+    size_t udp_burst_frames_ = 1;   // Frames per datagram accepted by the server
+    std::vector<uint8_t> burst_buffer_;
 
     bool StartMqttClient(bool report_error=false);
     void ParseServerHello(const cJSON* root);
     std::string DecodeHexString(const std::string& hex_string);
+    bool SendEncrypted(const uint8_t* data, size_t size, uint32_t timestamp, uint8_t burst_frames);
 
     bool SendText(const std::string& text) override;
+    bool SendCbor(const uint8_t* data, size_t size) override;
     std::string GetHelloMessage();
 };
 
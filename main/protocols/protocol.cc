@@ -1,13 +1,22 @@
 #include "protocol.h"
+#include "cbor.h"
+#include "json_scanner.h"
 
 #include <esp_log.h>
 
 #define TAG "Protocol"
 
+// Control messages are tiny, they are encoded on the stack
+#define CBOR_CONTROL_BUFFER_SIZE 256
+
 void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
+void Protocol::OnIncomingChat(std::function<void(ChatMessage&& message)> callback) {
+    on_incoming_chat_ = callback;
+}
+
 void Protocol::OnIncomingAudio(std::function<void(AudioStreamPacket&& packet)> callback) {
     on_incoming_audio_ = callback;
 }
@@ -31,7 +40,145 @@ void Protocol::SetError(const std::string& message) {
     }
 }
 
+static inline bool IsChatType(std::string_view type) {
+    return type == "tts" || type == "stt" || type == "llm";
+}
+
+// Chat messages arrive for every sentence, the few fields they carry are read in place.
+// Returns false for any other message, the caller then parses it with cJSON.
+bool Protocol::DispatchChatMessage(const char* data, size_t size) {
+    if (on_incoming_chat_ == nullptr) {
+        return false;
+    }
+    JsonScanner scanner(data, size);
+    ChatMessage message;
+    if (!scanner.FindString("type", message.type) || !IsChatType(message.type)) {
+        return false;
+    }
+    scanner.FindString("state", message.state);
+    scanner.FindUint("turn", message.turn);
+    std::string_view value;
+    if (scanner.FindString("text", value)) {
+        message.has_text = UnescapeJsonString(value, message.text);
+    }
+    if (scanner.FindString("emotion", value)) {
+        message.has_emotion = UnescapeJsonString(value, message.emotion);
+    }
+    on_incoming_chat_(std::move(message));
+    return true;
+}
+
+// The same for a CBOR map, its fields are read with CborReader
+bool Protocol::DispatchChatMessage(const uint8_t* cbor, size_t size) {
+    if (on_incoming_chat_ == nullptr) {
+        return false;
+    }
+    CborReader reader(cbor, size);
+    CborItem map;
+    if (!reader.Next(map) || map.type != kCborMap) {
+        return false;
+    }
+    ChatMessage message;
+    CborItem key, value;
+    for (uint64_t i = 0; i < map.value; i++) {
+        if (!reader.Next(key) || key.type != kCborText || !reader.Next(value)) {
+            return false;
+        }
+        std::string_view name((const char*)key.data, key.value);
+        if (value.type == kCborUnsigned && name == "turn" && value.value <= UINT32_MAX) {
+            message.turn = value.value;
+            continue;
+        }
+        if (value.type != kCborText) {
+            if (!reader.Skip(value)) {
+                return false;
+            }
+            continue;
+        }
+        std::string_view text((const char*)value.data, value.value);
+        if (name == "type") {
+            message.type = text;
+        } else if (name == "state") {
+            message.state = text;
+        } else if (name == "text") {
+            message.text = text;
+            message.has_text = true;
+        } else if (name == "emotion") {
+            message.emotion = text;
+            message.has_emotion = true;
+        }
+    }
+    if (!IsChatType(message.type)) {
+        return false;
+    }
+    on_incoming_chat_(std::move(message));
+    return true;
+}
+
+// Messages that were parsed anyway (e.g. CBOR) take the same route
+void Protocol::DispatchJson(const cJSON* root) {
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (on_incoming_chat_ != nullptr && cJSON_IsString(type) && IsChatType(type->valuestring)) {
+        ChatMessage message;
+        message.type = type->valuestring;
+        auto state = cJSON_GetObjectItem(root, "state");
+        if (cJSON_IsString(state)) {
+            message.state = state->valuestring;
+        }
+        auto text = cJSON_GetObjectItem(root, "text");
+        if (cJSON_IsString(text)) {
+            message.text = text->valuestring;
+            message.has_text = true;
+        }
+        auto emotion = cJSON_GetObjectItem(root, "emotion");
+        if (cJSON_IsString(emotion)) {
+            message.emotion = emotion->valuestring;
+            message.has_emotion = true;
+        }
+        auto turn = cJSON_GetObjectItem(root, "turn");
+        if (cJSON_IsNumber(turn) && turn->valuedouble >= 0 && turn->valuedouble <= UINT32_MAX) {
+            message.turn = (uint32_t)turn->valuedouble;
+        }
+        on_incoming_chat_(std::move(message));
+    } else if (on_incoming_json_ != nullptr) {
+        on_incoming_json_(root);
+    }
+}
+
+void Protocol::ParseServerFeatures(const cJSON* root) {
+    cbor_enabled_ = false;
+    turns_enabled_ = false;
+    auto features = cJSON_GetObjectItem(root, "features");
+    if (cJSON_IsObject(features)) {
+        cbor_enabled_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "cbor"));
+        turns_enabled_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "turn"));
+    }
+    if (cbor_enabled_) {
+        ESP_LOGI(TAG, "Control messages are sent as CBOR");
+    }
+    if (turns_enabled_) {
+        ESP_LOGI(TAG, "Replies are tagged with the listen turn");
+    }
+}
+
 void Protocol::SendAbortSpeaking(AbortReason reason) {
+    if (cbor_enabled_) {
+        uint8_t buffer[CBOR_CONTROL_BUFFER_SIZE];
+        CborWriter writer(buffer, sizeof(buffer));
+        writer.Map(reason == kAbortReasonWakeWordDetected ? 3 : 2);
+        writer.Text("session_id");
+        writer.Text(session_id_);
+        writer.Text("type");
+        writer.Text("abort");
+        if (reason == kAbortReasonWakeWordDetected) {
+            writer.Text("reason");
+            writer.Text("wake_word_detected");
+        }
+        if (writer.ok() && SendCbor(writer.data(), writer.size())) {
+            return;
+        }
+    }
+
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
     if (reason == kAbortReasonWakeWordDetected) {
         message += ",\"reason\":\"wake_word_detected\"";
@@ -40,13 +187,61 @@ void Protocol::SendAbortSpeaking(AbortReason reason) {
     SendText(message);
 }
 
+// Encodes {"session_id", "type": "listen", "state", [key: value], ["turn"]}, returns false if it did
+// not fit or could not be sent, the caller falls back to the JSON text then
+bool Protocol::SendListenCbor(const char* state, const char* key, std::string_view value, uint32_t turn) {
+    uint8_t buffer[CBOR_CONTROL_BUFFER_SIZE];
+    CborWriter writer(buffer, sizeof(buffer));
+    writer.Map(3 + (key != nullptr) + (turn != 0));
+    writer.Text("session_id");
+    writer.Text(session_id_);
+    writer.Text("type");
+    writer.Text("listen");
+    writer.Text("state");
+    writer.Text(state);
+    if (key != nullptr) {
+        writer.Text(key);
+        writer.Text(value);
+    }
+    if (turn != 0) {
+        writer.Text("turn");
+        writer.Int(turn);
+    }
+    if (!writer.ok()) {
+        return false;
+    }
+    return SendCbor(writer.data(), writer.size());
+}
+
+bool Protocol::SendAudioBurst(const AudioStreamPacket* packets, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (!SendAudio(packets[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
+    if (cbor_enabled_ && SendListenCbor("detect", "text", wake_word)) {
+        return;
+    }
     std::string json = "{\"session_id\":\"" + session_id_ + 
                       "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
     SendText(json);
 }
 
+// Every listen start opens a new turn, a server that tags its replies with it lets late replies
+// to an earlier turn be told apart
 void Protocol::SendStartListening(ListeningMode mode) {
+    listen_turn_++;
+    uint32_t turn = turns_enabled_ ? listen_turn_ : 0;
+    if (cbor_enabled_) {
+        const char* mode_name = mode == kListeningModeRealtime ? "realtime" : mode == kListeningModeAutoStop ? "auto" : "manual";
+        if (SendListenCbor("start", "mode", mode_name, turn)) {
+            return;
+        }
+    }
     std::string message = "{\"session_id\":\"" + session_id_ + "\"";
     message += ",\"type\":\"listen\",\"state\":\"start\"";
     if (mode == kListeningModeRealtime) {
@@ -56,11 +251,17 @@ void Protocol::SendStartListening(ListeningMode mode) {
     } else {
         message += ",\"mode\":\"manual\"";
     }
+    if (turn != 0) {
+        message += ",\"turn\":" + std::to_string(turn);
+    }
     message += "}";
     SendText(message);
 }
 
 void Protocol::SendStopListening() {
+    if (cbor_enabled_ && SendListenCbor("stop", nullptr, "")) {
+        return;
+    }
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
     SendText(message);
 }
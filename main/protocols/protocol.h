@@ -3,20 +3,22 @@
 
 #include <cJSON.h>
 #include <string>
+#include <string_view>
 #include <functional>
 #include <chrono>
 #include <vector>
 
-struct AudioStreamPacket {
-    int sample_rate = 0;
-    int frame_duration = 0;
-    uint32_t timestamp = 0;
-    std::vector<uint8_t> payload;
-};
+#include "audio_stream_packet.h"
+#include "audio_stream_stats.h"
+
+// Most frames a transport may coalesce into one packet when the uplink is backlogged
+#define AUDIO_MAX_BURST_FRAMES 4
+
+#define BINARY_PROTOCOL_TYPE_CBOR 2
 
 struct BinaryProtocol2 {
     uint16_t version;
-    uint16_t type;          // Message type (0: OPUS, 1: JSON)
+    uint16_t type;          // Message type (0: OPUS, 1: JSON, 2: CBOR)
     uint32_t reserved;      // Reserved for future use
     uint32_t timestamp;     // Timestamp in milliseconds (used for server-side AEC)
     uint32_t payload_size;  // Payload size in bytes
@@ -30,6 +32,18 @@ struct BinaryProtocol3 {
     uint8_t payload[];
 } __attribute__((packed));
 
+// tts / stt / llm messages, read without building a cJSON tree (see JsonScanner and CborReader).
+// The views are only valid inside the callback.
+struct ChatMessage {
+    std::string_view type;
+    std::string_view state;
+    std::string text;
+    std::string emotion;
+    bool has_text = false;
+    bool has_emotion = false;
+    uint32_t turn = 0;          // Listen start the message answers, 0 if the server did not tag it
+};
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -54,9 +68,26 @@ public:
     inline const std::string& session_id() const {
         return session_id_;
     }
+    // Whether the server echoes the turn of the listen start in its tts / stt / llm messages
+    inline bool turns_enabled() const {
+        return turns_enabled_;
+    }
+    // Turn of the last listen start sent, counted over the life of the protocol
+    inline uint32_t listen_turn() const {
+        return listen_turn_;
+    }
+    // Frames the transport can carry in one packet, 1 unless the server opted in
+    virtual size_t max_audio_burst() const {
+        return 1;
+    }
+    // Only transports with sequence numbers keep receive statistics
+    virtual bool GetAudioStreamStats(AudioStreamStats& stats) const {
+        return false;
+    }
 
     void OnIncomingAudio(std::function<void(AudioStreamPacket&& packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    void OnIncomingChat(std::function<void(ChatMessage&& message)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
@@ -66,6 +97,7 @@ public:
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
     virtual bool SendAudio(const AudioStreamPacket& packet) = 0;
+    virtual bool SendAudioBurst(const AudioStreamPacket* packets, size_t count);
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
@@ -76,6 +108,7 @@ public:
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
+    std::function<void(ChatMessage&& message)> on_incoming_chat_;
     std::function<void(AudioStreamPacket&& packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
@@ -83,11 +116,21 @@ protected:
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    bool cbor_enabled_ = false;     // Both sides accepted CBOR control messages in the hello
+    bool turns_enabled_ = false;    // Both sides accepted turn tags in the hello
+    uint32_t listen_turn_ = 0;
     bool error_occurred_ = false;
     std::string session_id_;
+    std::string resume_session_id_; // Last session a hello succeeded with, offered in the next hello to continue it
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
 
     virtual bool SendText(const std::string& text) = 0;
+    virtual bool SendCbor(const uint8_t* data, size_t size) { return false; }
+    void ParseServerFeatures(const cJSON* root);
+    bool DispatchChatMessage(const char* data, size_t size);
+    bool DispatchChatMessage(const uint8_t* cbor, size_t size);
+    void DispatchJson(const cJSON* root);
+    bool SendListenCbor(const char* state, const char* key, std::string_view value, uint32_t turn = 0);
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
 };
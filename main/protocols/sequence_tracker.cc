@@ -0,0 +1,43 @@
+#include "sequence_tracker.h"
+
+void SequenceTracker::Reset() {
+    stats_ = AudioStreamStats();
+    highest_sequence_ = 0;
+    received_mask_ = 0;
+    jitter_.Reset();
+}
+
+bool SequenceTracker::Update(uint32_t sequence, int64_t arrival_ms, int frame_duration) {
+    if (stats_.received == 0 || sequence > highest_sequence_) {
+        if (stats_.received > 0) {
+            uint32_t advance = sequence - highest_sequence_;
+            stats_.lost += advance - 1;
+            received_mask_ = advance >= SEQUENCE_TRACKER_WINDOW ? 0 : received_mask_ << advance;
+        }
+        // Only in-order arrivals feed the jitter estimate
+        jitter_.Update(sequence, arrival_ms, frame_duration);
+        stats_.jitter_ms = jitter_.jitter_ms();
+        received_mask_ |= 1;
+        highest_sequence_ = sequence;
+        stats_.received++;
+        return true;
+    }
+
+    uint32_t age = highest_sequence_ - sequence;
+    if (age >= SEQUENCE_TRACKER_WINDOW) {
+        // It may be a duplicate, so it must not take back a loss
+        stats_.late++;
+        return false;
+    }
+    if (received_mask_ & (1u << age)) {
+        stats_.duplicated++;
+        return false;
+    }
+    received_mask_ |= 1u << age;
+    stats_.received++;
+    stats_.reordered++;
+    if (stats_.lost > 0) {
+        stats_.lost--;
+    }
+    return true;
+}
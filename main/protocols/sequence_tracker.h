@@ -0,0 +1,35 @@
+#ifndef SEQUENCE_TRACKER_H
+#define SEQUENCE_TRACKER_H
+
+#include <cstdint>
+
+#include "audio_stream_stats.h"
+#include "jitter_estimator.h"
+
+// Sequence numbers this far behind the highest one can still be told apart from duplicates
+#define SEQUENCE_TRACKER_WINDOW 32
+
+/*
+ * Loss / reorder / duplicate accounting for a sequenced packet stream.
+ *
+ * A gap is counted as lost when a higher sequence number arrives and is
+ * taken back if the missing packet shows up later, as long as it is within
+ * the window; older packets cannot be told from duplicates and are dropped
+ * as late. Jitter follows the RFC 3550 estimator (JitterEstimator).
+ * Playback order is restored by the jitter buffer, this only observes.
+ */
+class SequenceTracker {
+public:
+    void Reset();
+    // Returns false for a duplicate or a packet behind the window, the caller may drop it
+    bool Update(uint32_t sequence, int64_t arrival_ms, int frame_duration);
+    inline const AudioStreamStats& stats() const { return stats_; }
+
+private:
+    AudioStreamStats stats_;
+    uint32_t highest_sequence_ = 0;
+    uint32_t received_mask_ = 0;    // Bit n: highest_sequence_ - n was received
+    JitterEstimator jitter_;
+};
+
+#endif // SEQUENCE_TRACKER_H
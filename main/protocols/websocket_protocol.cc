@@ -3,6 +3,9 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "audio_payload_pool.h"
+#include "cbor.h"
+#include "session_recorder.h"
 
 #include <cstring>
 #include <cJSON.h>
@@ -12,6 +15,13 @@
 
 #define TAG "WS"
 
+// Incoming opus frames borrow their buffer from the payload pool
+static std::vector<uint8_t> CopyPayload(const void* data, size_t size) {
+    auto payload = AudioPayloadPool::GetInstance().Acquire(size);
+    memcpy(payload.data(), data, size);
+    return payload;
+}
+
 WebsocketProtocol::WebsocketProtocol() {
     event_group_handle_ = xEventGroupCreate();
 }
@@ -32,38 +42,37 @@ bool WebsocketProtocol::SendAudio(const AudioStreamPacket& packet) {
     if (websocket_ == nullptr) {
         return false;
     }
+    SESSION_RECORD(kSessionRecordOut, kSessionRecordAudio, packet.payload.data(), packet.payload.size(), packet.timestamp);
 
+    // Header and payload are assembled in a buffer kept between frames, it only grows
+    // when a frame is larger than any before it
     if (version_ == 2) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol2) + packet.payload.size());
-        auto bp2 = (BinaryProtocol2*)serialized.data();
+        send_buffer_.resize(sizeof(BinaryProtocol2) + packet.payload.size());
+        auto bp2 = (BinaryProtocol2*)send_buffer_.data();
         bp2->version = htons(version_);
         bp2->type = 0;
         bp2->reserved = 0;
         bp2->timestamp = htonl(packet.timestamp);
         bp2->payload_size = htonl(packet.payload.size());
         memcpy(bp2->payload, packet.payload.data(), packet.payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
     } else if (version_ == 3) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol3) + packet.payload.size());
-        auto bp3 = (BinaryProtocol3*)serialized.data();
+        send_buffer_.resize(sizeof(BinaryProtocol3) + packet.payload.size());
+        auto bp3 = (BinaryProtocol3*)send_buffer_.data();
         bp3->type = 0;
         bp3->reserved = 0;
         bp3->payload_size = htons(packet.payload.size());
         memcpy(bp3->payload, packet.payload.data(), packet.payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
     } else {
         return websocket_->Send(packet.payload.data(), packet.payload.size(), true);
     }
+    return websocket_->Send(send_buffer_.data(), send_buffer_.size(), true);
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
     if (websocket_ == nullptr) {
         return false;
     }
+    SESSION_RECORD(kSessionRecordOut, kSessionRecordText, text.data(), text.size());
 
     if (!websocket_->Send(text)) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
@@ -83,6 +92,7 @@ void WebsocketProtocol::CloseAudioChannel() {
         delete websocket_;
         websocket_ = nullptr;
     }
+    SESSION_RECORD_FLUSH();
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
@@ -99,6 +109,8 @@ bool WebsocketProtocol::OpenAudioChannel() {
     }
 
     error_occurred_ = false;
+    cbor_enabled_ = false;
+    session_id_ = "";
 
     websocket_ = Board::GetInstance().CreateWebSocket();
     
@@ -115,56 +127,56 @@ bool WebsocketProtocol::OpenAudioChannel() {
 
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
         if (binary) {
-            if (on_incoming_audio_ != nullptr) {
-                if (version_ == 2) {
-                    BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
-                    bp2->version = ntohs(bp2->version);
-                    bp2->type = ntohs(bp2->type);
-                    bp2->timestamp = ntohl(bp2->timestamp);
-                    bp2->payload_size = ntohl(bp2->payload_size);
-                    auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    });
-                } else if (version_ == 3) {
-                    BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
-                    bp3->type = bp3->type;
-                    bp3->payload_size = ntohs(bp3->payload_size);
-                    auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    });
-                } else {
-                    on_incoming_audio_(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    });
+            // Parse the header in place and copy only the opus payload into a pooled block
+            uint16_t type = 0;
+            uint32_t timestamp = 0;
+            const uint8_t* payload = (const uint8_t*)data;
+            size_t payload_size = len;
+            if (version_ == 2) {
+                auto bp2 = (const BinaryProtocol2*)data;
+                if (len < sizeof(BinaryProtocol2) || ntohl(bp2->payload_size) > len - sizeof(BinaryProtocol2)) {
+                    ESP_LOGE(TAG, "Invalid binary frame, length %u", len);
+                    return;
+                }
+                type = ntohs(bp2->type);
+                timestamp = ntohl(bp2->timestamp);
+                payload = bp2->payload;
+                payload_size = ntohl(bp2->payload_size);
+            } else if (version_ == 3) {
+                auto bp3 = (const BinaryProtocol3*)data;
+                if (len < sizeof(BinaryProtocol3) || ntohs(bp3->payload_size) > len - sizeof(BinaryProtocol3)) {
+                    ESP_LOGE(TAG, "Invalid binary frame, length %u", len);
+                    return;
                 }
+                type = bp3->type;
+                payload = bp3->payload;
+                payload_size = ntohs(bp3->payload_size);
+            }
+
+            if (type == BINARY_PROTOCOL_TYPE_CBOR) {
+                SESSION_RECORD(kSessionRecordIn, kSessionRecordCbor, payload, payload_size);
+                HandleControlMessage(payload, payload_size);
+            } else if (on_incoming_audio_ != nullptr) {
+                SESSION_RECORD(kSessionRecordIn, kSessionRecordAudio, payload, payload_size, timestamp);
+                on_incoming_audio_(AudioStreamPacket{
+                    .sample_rate = server_sample_rate_,
+                    .frame_duration = server_frame_duration_,
+                    .timestamp = timestamp,
+                    .payload = CopyPayload(payload, payload_size)
+                });
             }
         } else {
-            // Parse JSON data
-            auto root = cJSON_Parse(data);
-            auto type = cJSON_GetObjectItem(root, "type");
-            if (cJSON_IsString(type)) {
-                if (strcmp(type->valuestring, "hello") == 0) {
-                    ParseServerHello(root);
+            SESSION_RECORD(kSessionRecordIn, kSessionRecordText, data, len);
+            if (!DispatchChatMessage(data, len)) {
+                // Parse JSON data
+                auto root = cJSON_Parse(data);
+                if (root != nullptr) {
+                    HandleControlMessage(root);
                 } else {
-                    if (on_incoming_json_ != nullptr) {
-                        on_incoming_json_(root);
-                    }
+                    ESP_LOGE(TAG, "Failed to parse json message %s", data);
                 }
-            } else {
-                ESP_LOGE(TAG, "Missing message type, data: %s", data);
+                cJSON_Delete(root);
             }
-            cJSON_Delete(root);
         }
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
@@ -177,6 +189,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
     });
 
     ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
+    SESSION_RECORD(kSessionRecordOut, kSessionRecordOpen, "websocket", strlen("websocket"));
     if (!websocket_->Connect(url.c_str())) {
         ESP_LOGE(TAG, "Failed to connect to websocket server");
         SetError(Lang::Strings::SERVER_NOT_CONNECTED);
@@ -209,6 +222,9 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON* root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "type", "hello");
     cJSON_AddNumberToObject(root, "version", version_);
+    if (!resume_session_id_.empty()) {
+        cJSON_AddStringToObject(root, "resume_session_id", resume_session_id_.c_str());
+    }
     cJSON* features = cJSON_CreateObject();
 #if CONFIG_USE_SERVER_AEC
     cJSON_AddBoolToObject(features, "aec", true);
@@ -216,13 +232,19 @@ std::string WebsocketProtocol::GetHelloMessage() {
 #if CONFIG_IOT_PROTOCOL_MCP
     cJSON_AddBoolToObject(features, "mcp", true);
 #endif
+    // Replies can carry the turn of the listen start they answer
+    cJSON_AddBoolToObject(features, "turn", true);
+    if (version_ >= 2) {
+        // Control messages can be sent as CBOR in binary frames (type 2)
+        cJSON_AddBoolToObject(features, "cbor", true);
+    }
     cJSON_AddItemToObject(root, "features", features);
     cJSON_AddStringToObject(root, "transport", "websocket");
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    cJSON_AddNumberToObject(audio_params, "frame_duration", Application::GetInstance().frame_duration());
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -231,6 +253,68 @@ std::string WebsocketProtocol::GetHelloMessage() {
     return message;
 }
 
+void WebsocketProtocol::HandleControlMessage(const cJSON* root) {
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (!cJSON_IsString(type)) {
+        ESP_LOGE(TAG, "Missing message type");
+        return;
+    }
+    if (strcmp(type->valuestring, "hello") == 0) {
+        ParseServerHello(root);
+    } else {
+        DispatchJson(root);
+    }
+}
+
+// Chat messages are read straight from the CBOR map, the rest are converted for the JSON handlers
+void WebsocketProtocol::HandleControlMessage(const uint8_t* cbor, size_t size) {
+    if (DispatchChatMessage(cbor, size)) {
+        return;
+    }
+    auto root = CborToJson(cbor, size);
+    if (root == nullptr) {
+        ESP_LOGE(TAG, "Invalid CBOR message, length %u", size);
+        return;
+    }
+    HandleControlMessage(root);
+    cJSON_Delete(root);
+}
+
+bool WebsocketProtocol::SendCbor(const uint8_t* data, size_t size) {
+    if (websocket_ == nullptr) {
+        return false;
+    }
+    SESSION_RECORD(kSessionRecordOut, kSessionRecordCbor, data, size);
+
+    if (version_ == 2) {
+        control_buffer_.resize(sizeof(BinaryProtocol2) + size);
+        auto bp2 = (BinaryProtocol2*)control_buffer_.data();
+        bp2->version = htons(version_);
+        bp2->type = htons(BINARY_PROTOCOL_TYPE_CBOR);
+        bp2->reserved = 0;
+        bp2->timestamp = 0;
+        bp2->payload_size = htonl(size);
+        memcpy(bp2->payload, data, size);
+    } else if (version_ == 3) {
+        control_buffer_.resize(sizeof(BinaryProtocol3) + size);
+        auto bp3 = (BinaryProtocol3*)control_buffer_.data();
+        bp3->type = BINARY_PROTOCOL_TYPE_CBOR;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(size);
+        memcpy(bp3->payload, data, size);
+    } else {
+        // Version 1 has no binary framing to tell control messages from audio
+        return false;
+    }
+
+    if (!websocket_->Send(control_buffer_.data(), control_buffer_.size(), true)) {
+        ESP_LOGE(TAG, "Failed to send CBOR message");
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
+    }
+    return true;
+}
+
 void WebsocketProtocol::ParseServerHello(const cJSON* root) {
     auto transport = cJSON_GetObjectItem(root, "transport");
     if (transport == nullptr || strcmp(transport->valuestring, "websocket") != 0) {
@@ -241,7 +325,7 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
     auto session_id = cJSON_GetObjectItem(root, "session_id");
     if (cJSON_IsString(session_id)) {
         session_id_ = session_id->valuestring;
-        ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
+        ESP_LOGI(TAG, "Session ID: %s%s", session_id_.c_str(), session_id_ == resume_session_id_ ? " (resumed)" : "");
     }
 
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
@@ -256,5 +340,12 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         }
     }
 
+    ParseServerFeatures(root);
+    cbor_enabled_ = cbor_enabled_ && version_ >= 2;
+
+    // A failed open keeps offering the last session the server accepted
+    resume_session_id_ = session_id_;
+    // OpenAudioChannel returns as soon as the event is set, the channel must not look timed out by then
+    last_incoming_time_ = std::chrono::steady_clock::now();
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
 }
@@ -25,9 +25,14 @@ private:
     EventGroupHandle_t event_group_handle_;
     WebSocket* websocket_ = nullptr;
     int version_ = 1;
+    std::vector<uint8_t> send_buffer_;
+    std::vector<uint8_t> control_buffer_;
 
     void ParseServerHello(const cJSON* root);
+    void HandleControlMessage(const cJSON* root);
+    void HandleControlMessage(const uint8_t* cbor, size_t size);
     bool SendText(const std::string& text) override;
+    bool SendCbor(const uint8_t* data, size_t size) override;
     std::string GetHelloMessage();
 };
 
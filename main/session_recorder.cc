@@ -0,0 +1,76 @@
+#include "session_recorder.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cstring>
+
+#define TAG "SessionRecorder"
+
+#define SESSION_RECORD_MAGIC "XZSREC01"
+
+#ifndef CONFIG_SESSION_RECORDER_PATH
+#define CONFIG_SESSION_RECORDER_PATH "/sdcard/session.rec"
+#endif
+
+struct SessionRecordHeader {
+    uint64_t time_us;
+    uint8_t direction;
+    uint8_t kind;
+    uint16_t reserved;
+    uint32_t timestamp;
+    uint32_t size;
+} __attribute__((packed));
+
+SessionRecorder::~SessionRecorder() {
+    if (file_ != nullptr) {
+        fclose(file_);
+    }
+}
+
+// Called with mutex_ held, a new recording replaces the previous one
+bool SessionRecorder::Open() {
+    if (file_ != nullptr) {
+        return true;
+    }
+    if (failed_) {
+        return false;
+    }
+    file_ = fopen(CONFIG_SESSION_RECORDER_PATH, "wb");
+    if (file_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to open %s, recording is disabled", CONFIG_SESSION_RECORDER_PATH);
+        failed_ = true;
+        return false;
+    }
+    fwrite(SESSION_RECORD_MAGIC, 1, strlen(SESSION_RECORD_MAGIC), file_);
+    ESP_LOGI(TAG, "Recording sessions to %s", CONFIG_SESSION_RECORDER_PATH);
+    return true;
+}
+
+void SessionRecorder::Record(SessionRecordDirection direction, SessionRecordKind kind, const void* data, size_t size, uint32_t timestamp) {
+    SessionRecordHeader header = {
+        .time_us = (uint64_t)esp_timer_get_time(),
+        .direction = (uint8_t)direction,
+        .kind = (uint8_t)kind,
+        .reserved = 0,
+        .timestamp = timestamp,
+        .size = (uint32_t)size,
+    };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!Open()) {
+        return;
+    }
+    if (fwrite(&header, sizeof(header), 1, file_) != 1 || fwrite(data, 1, size, file_) != size) {
+        ESP_LOGE(TAG, "Failed to write record, recording is disabled");
+        fclose(file_);
+        file_ = nullptr;
+        failed_ = true;
+    }
+}
+
+void SessionRecorder::Flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_ != nullptr) {
+        fflush(file_);
+    }
+}
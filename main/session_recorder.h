@@ -0,0 +1,64 @@
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+
+enum SessionRecordDirection {
+    kSessionRecordIn,       // server -> device
+    kSessionRecordOut,      // device -> server
+};
+
+enum SessionRecordKind {
+    kSessionRecordOpen,     // audio channel opened, the payload is the transport name
+    kSessionRecordText,     // JSON text message
+    kSessionRecordAudio,    // one opus frame, header fields stripped
+    kSessionRecordCbor,     // CBOR control message
+};
+
+/*
+ * Captures everything a protocol sends and receives into a file so that a
+ * conversation can be replayed by scripts/session_replay/session_replay.py.
+ *
+ * File layout (little endian): the 8 byte magic "XZSREC01", then records of
+ * |time_us 8u|direction 1u|kind 1u|reserved 2u|timestamp 4u|size 4u|payload size|
+ * where time_us is esp_timer_get_time() and timestamp the audio timestamp.
+ * Build with CONFIG_USE_SESSION_RECORDER, otherwise SESSION_RECORD() compiles
+ * to nothing.
+ */
+class SessionRecorder {
+public:
+    static SessionRecorder& GetInstance() {
+        static SessionRecorder instance;
+        return instance;
+    }
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    void Record(SessionRecordDirection direction, SessionRecordKind kind, const void* data, size_t size, uint32_t timestamp = 0);
+    // Writes buffered records out, called when the audio channel closes
+    void Flush();
+
+private:
+    SessionRecorder() = default;
+    ~SessionRecorder();
+
+    std::mutex mutex_;
+    FILE* file_ = nullptr;
+    bool failed_ = false;
+
+    bool Open();
+};
+
+#if CONFIG_USE_SESSION_RECORDER
+#define SESSION_RECORD(direction, kind, data, size, ...) \
+    SessionRecorder::GetInstance().Record(direction, kind, data, size, ##__VA_ARGS__)
+#define SESSION_RECORD_FLUSH() SessionRecorder::GetInstance().Flush()
+#else
+#define SESSION_RECORD(direction, kind, data, size, ...) do { } while (0)
+#define SESSION_RECORD_FLUSH() do { } while (0)
+#endif
+
+#endif // SESSION_RECORDER_H
@@ -0,0 +1,131 @@
+#include "tool_worker_pool.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <cJSON.h>
+
+#define TAG "ToolWorkerPool"
+
+struct ToolWorkerArgs {
+    ToolWorkerPool* pool;
+    ToolStackClass stack_class;
+};
+
+ToolWorkerPool::~ToolWorkerPool() {
+    for (auto handle : workers_) {
+        vTaskDelete(handle);
+    }
+}
+
+bool ToolWorkerPool::GetStackClass(int stack_size, ToolStackClass& stack_class) {
+    if (stack_size <= TOOL_WORKER_STACK_SIZE) {
+        stack_class = kToolStackDefault;
+    } else if (stack_size <= TOOL_WORKER_LARGE_STACK_SIZE) {
+        stack_class = kToolStackLarge;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool ToolWorkerPool::Submit(ToolStackClass stack_class, const std::string& key, int max_concurrency, std::function<void()> job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (jobs_.size() >= TOOL_POOL_QUEUE_SIZE) {
+        rejected_++;
+        return false;
+    }
+    if (!started_[stack_class]) {
+        StartWorkers(stack_class);
+    }
+    jobs_.push_back(Job{stack_class, key, max_concurrency, esp_timer_get_time(), std::move(job)});
+    condition_variable_.notify_all();
+    return true;
+}
+
+void ToolWorkerPool::StartWorkers(ToolStackClass stack_class) {
+    started_[stack_class] = true;
+    bool large = stack_class == kToolStackLarge;
+    int count = large ? TOOL_WORKER_LARGE_COUNT : TOOL_WORKER_COUNT;
+    for (int i = 0; i < count; i++) {
+        // Lives as long as the worker, which never exits
+        auto args = new ToolWorkerArgs{this, stack_class};
+        TaskHandle_t handle = nullptr;
+        xTaskCreate([](void* arg) {
+            auto args = (ToolWorkerArgs*)arg;
+            args->pool->WorkerLoop(args->stack_class);
+        }, large ? "tool_call_large" : "tool_call", large ? TOOL_WORKER_LARGE_STACK_SIZE : TOOL_WORKER_STACK_SIZE, args, 1, &handle);
+        if (handle == nullptr) {
+            ESP_LOGE(TAG, "Failed to create tool worker");
+            delete args;
+            continue;
+        }
+        workers_.push_back(handle);
+    }
+}
+
+void ToolWorkerPool::WorkerLoop(ToolStackClass stack_class) {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            std::list<Job>::iterator it;
+            // The oldest job of this class whose tool is below its concurrency limit
+            condition_variable_.wait(lock, [this, stack_class, &it]() {
+                for (it = jobs_.begin(); it != jobs_.end(); ++it) {
+                    if (it->stack_class != stack_class) {
+                        continue;
+                    }
+                    auto running = running_.find(it->key);
+                    if (running == running_.end() || running->second < it->max_concurrency) {
+                        return true;
+                    }
+                }
+                return false;
+            });
+            job = std::move(*it);
+            jobs_.erase(it);
+            running_[job.key]++;
+        }
+
+        int64_t start_time = esp_timer_get_time();
+        job.run();
+        int64_t end_time = esp_timer_get_time();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--running_[job.key] == 0) {
+            running_.erase(job.key);
+        }
+        uint32_t queue_delay = start_time - job.queue_time_us;
+        uint32_t exec_time = end_time - start_time;
+        completed_++;
+        total_queue_delay_us_ += queue_delay;
+        total_exec_time_us_ += exec_time;
+        if (queue_delay > max_queue_delay_us_) {
+            max_queue_delay_us_ = queue_delay;
+        }
+        if (exec_time > max_exec_time_us_) {
+            max_exec_time_us_ = exec_time;
+        }
+        ESP_LOGD(TAG, "Tool call waited %lu us, ran %lu us", queue_delay, exec_time);
+        // A job held back by the concurrency limit may be runnable now
+        condition_variable_.notify_all();
+    }
+}
+
+std::string ToolWorkerPool::GetStatsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "completed", completed_);
+    cJSON_AddNumberToObject(root, "rejected", rejected_);
+    cJSON_AddNumberToObject(root, "queued", jobs_.size());
+    cJSON_AddNumberToObject(root, "workers", workers_.size());
+    cJSON_AddNumberToObject(root, "queue_delay_avg_us", completed_ ? total_queue_delay_us_ / completed_ : 0);
+    cJSON_AddNumberToObject(root, "queue_delay_max_us", max_queue_delay_us_);
+    cJSON_AddNumberToObject(root, "exec_time_avg_us", completed_ ? total_exec_time_us_ / completed_ : 0);
+    cJSON_AddNumberToObject(root, "exec_time_max_us", max_exec_time_us_);
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
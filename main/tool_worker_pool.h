@@ -0,0 +1,78 @@
+#ifndef TOOL_WORKER_POOL_H
+#define TOOL_WORKER_POOL_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <string>
+#include <cstdint>
+
+// Two workers for ordinary tools, one with a large stack for tools that ask for it (e.g. camera)
+#define TOOL_WORKER_STACK_SIZE 6144
+#define TOOL_WORKER_COUNT 2
+#define TOOL_WORKER_LARGE_STACK_SIZE 16384
+#define TOOL_WORKER_LARGE_COUNT 1
+// Calls waiting for a worker, more are refused so the server can back off.
+// Also the largest JSON-RPC batch, so a full batch fits when the pool is idle.
+#define TOOL_POOL_QUEUE_SIZE 16
+
+enum ToolStackClass {
+    kToolStackDefault,
+    kToolStackLarge,
+    kToolStackClassCount
+};
+
+/*
+ * Fixed set of tasks that run MCP tool calls.
+ *
+ * Replaces a detached thread per call: the workers of a stack class are
+ * created on first use and then kept, so a burst of motor / servo calls only
+ * queues closures. Jobs sharing a key (the tool, or the resource group of
+ * tools that drive the same hardware) run at most max_concurrency at a time,
+ * later ones wait in the queue in order.
+ */
+class ToolWorkerPool {
+public:
+    ToolWorkerPool() = default;
+    ~ToolWorkerPool();
+    ToolWorkerPool(const ToolWorkerPool&) = delete;
+    ToolWorkerPool& operator=(const ToolWorkerPool&) = delete;
+
+    // Picks the class for a requested stack size, false if no worker has that much stack
+    static bool GetStackClass(int stack_size, ToolStackClass& stack_class);
+    // Returns false when the queue is full, the job is dropped in that case
+    bool Submit(ToolStackClass stack_class, const std::string& key, int max_concurrency, std::function<void()> job);
+    std::string GetStatsJson();
+
+private:
+    struct Job {
+        ToolStackClass stack_class;
+        std::string key;
+        int max_concurrency;
+        int64_t queue_time_us;
+        std::function<void()> run;
+    };
+
+    std::mutex mutex_;
+    std::condition_variable condition_variable_;
+    std::list<Job> jobs_;
+    std::unordered_map<std::string, int> running_;
+    std::list<TaskHandle_t> workers_;
+    bool started_[kToolStackClassCount] = {};
+
+    uint32_t completed_ = 0;
+    uint32_t rejected_ = 0;
+    uint64_t total_queue_delay_us_ = 0;
+    uint32_t max_queue_delay_us_ = 0;
+    uint64_t total_exec_time_us_ = 0;
+    uint32_t max_exec_time_us_ = 0;
+
+    void StartWorkers(ToolStackClass stack_class);
+    void WorkerLoop(ToolStackClass stack_class);
+};
+
+#endif // TOOL_WORKER_POOL_H
@@ -0,0 +1,407 @@
+#! /usr/bin/env python3
+# Replays a session captured with CONFIG_USE_SESSION_RECORDER from a local stand-in server
+import argparse
+import asyncio
+import json
+import os
+import ssl
+import struct
+import sys
+import time
+from collections import namedtuple
+
+MAGIC = b"XZSREC01"
+RECORD_HEADER = struct.Struct("<QBBHII")
+
+DIRECTION_IN, DIRECTION_OUT = 0, 1
+KIND_OPEN, KIND_TEXT, KIND_AUDIO, KIND_CBOR = 0, 1, 2, 3
+KIND_NAMES = {KIND_OPEN: "open", KIND_TEXT: "text", KIND_AUDIO: "audio", KIND_CBOR: "cbor"}
+
+BINARY_PROTOCOL_TYPE_CBOR = 2
+
+Record = namedtuple("Record", "time_us direction kind timestamp payload")
+# A run of server messages, started when the device sends `trigger`
+Step = namedtuple("Step", "trigger records")
+
+
+def load_sessions(path):
+    """Reads a recording and splits it at every audio channel open"""
+    with open(path, "rb") as f:
+        data = f.read()
+    if not data.startswith(MAGIC):
+        raise ValueError(f"{path} is not a session recording")
+
+    sessions = []
+    offset = len(MAGIC)
+    while offset + RECORD_HEADER.size <= len(data):
+        time_us, direction, kind, _, timestamp, size = RECORD_HEADER.unpack_from(data, offset)
+        offset += RECORD_HEADER.size
+        if offset + size > len(data):
+            print("Recording is truncated, ignoring the last record", file=sys.stderr)
+            break
+        record = Record(time_us, direction, kind, timestamp, data[offset:offset + size])
+        offset += size
+        if kind == KIND_OPEN:
+            sessions.append([])
+        if sessions:
+            sessions[-1].append(record)
+    return sessions
+
+
+def build_steps(records):
+    """Each control message of the device starts a step holding the server messages that followed it"""
+    steps = []
+    anchor_us = 0
+    for record in records:
+        if record.direction == DIRECTION_OUT and record.kind in (KIND_TEXT, KIND_CBOR):
+            steps.append(Step(record, []))
+            anchor_us = record.time_us
+        elif record.direction == DIRECTION_IN and steps:
+            steps[-1].records.append((record.time_us - anchor_us, record))
+    return steps
+
+
+def decode_control(kind, payload):
+    if kind == KIND_TEXT:
+        return json.loads(payload.decode("utf-8"))
+    try:
+        import cbor2
+        return cbor2.loads(payload)
+    except ImportError:
+        return {"type": "cbor"}
+
+
+def describe(message):
+    text = message.get("type", "?")
+    if "state" in message:
+        text += "/" + str(message["state"])
+    return text
+
+
+def dump(sessions):
+    for index, records in enumerate(sessions):
+        transport = records[0].payload.decode()
+        duration = (records[-1].time_us - records[0].time_us) / 1e6
+        print(f"session {index}: {transport}, {len(records)} records, {duration:.1f}s")
+        for record in records[1:]:
+            at = (record.time_us - records[0].time_us) / 1000
+            arrow = "<-" if record.direction == DIRECTION_IN else "->"
+            if record.kind == KIND_AUDIO:
+                detail = f"{len(record.payload)} bytes ts {record.timestamp}"
+            else:
+                detail = describe(decode_control(record.kind, record.payload))
+            print(f"  {at:10.1f} ms {arrow} {KIND_NAMES.get(record.kind, '?'):5} {detail}")
+
+
+class Replayer:
+    """Plays the server side of a session step by step and measures how the device responds"""
+
+    def __init__(self, steps, speed, send_text, send_audio):
+        self.steps = steps
+        self.speed = speed
+        self.send_text = send_text
+        self.send_audio = send_audio
+        self.next_step = 0
+        self.start = time.monotonic()
+        self.trigger_time = None
+        self.trigger_name = None
+        self.waiting_uplink = False
+        self.uplink_frames = 0
+        self.uplink_bytes = 0
+        self.downlink_frames = 0
+        self.tasks = []
+
+    def now_ms(self):
+        return (time.monotonic() - self.start) * 1000
+
+    def on_control(self, message):
+        name = describe(message)
+        print(f"{self.now_ms():10.1f} ms -> {name}")
+        self.trigger_time = time.monotonic()
+        self.trigger_name = name
+        self.waiting_uplink = message.get("type") == "listen" and message.get("state") in ("start", "detect")
+        if self.next_step >= len(self.steps):
+            return
+        step = self.steps[self.next_step]
+        self.next_step += 1
+        expected = describe(decode_control(step.trigger.kind, step.trigger.payload))
+        if expected != name:
+            print(f"{'':10}    recorded step was started by {expected}, the device may have diverged")
+        self.tasks.append(asyncio.ensure_future(self.play(step)))
+
+    def on_audio(self, payload):
+        self.uplink_frames += 1
+        self.uplink_bytes += len(payload)
+        if self.waiting_uplink:
+            self.waiting_uplink = False
+            latency = (time.monotonic() - self.trigger_time) * 1000
+            print(f"{'':10}    first uplink audio {latency:.1f} ms after {self.trigger_name}")
+
+    async def play(self, step):
+        started = time.monotonic()
+        for offset_us, record in step.records:
+            if self.speed > 0:
+                delay = started + offset_us / 1e6 / self.speed - time.monotonic()
+                if delay > 0:
+                    await asyncio.sleep(delay)
+            if record.kind == KIND_AUDIO:
+                self.downlink_frames += 1
+                await self.send_audio(record.payload, record.timestamp)
+            else:
+                print(f"{self.now_ms():10.1f} ms <- {describe(decode_control(record.kind, record.payload))}")
+                await self.send_text(record)
+
+    def close(self):
+        for task in self.tasks:
+            task.cancel()
+        elapsed = time.monotonic() - self.start
+        print(f"uplink {self.uplink_frames} frames {self.uplink_bytes * 8 / 1000 / max(elapsed, 1e-3):.1f} kbps, "
+              f"downlink {self.downlink_frames} frames, {self.next_step}/{len(self.steps)} steps in {elapsed:.1f}s")
+
+
+async def serve_websocket(args, steps):
+    import websockets
+
+    async def handler(websocket, path=None):
+        request = getattr(websocket, "request", None)
+        headers = request.headers if request is not None else websocket.request_headers
+        version = int(headers.get("Protocol-Version", "1"))
+        print(f"Device {headers.get('Device-Id')} connected, protocol version {version}")
+
+        async def send_text(record):
+            if record.kind == KIND_CBOR:
+                await send_binary(BINARY_PROTOCOL_TYPE_CBOR, 0, record.payload)
+            else:
+                await websocket.send(record.payload.decode("utf-8"))
+
+        async def send_binary(frame_type, timestamp, payload):
+            if version == 2:
+                payload = struct.pack(">HHIII", version, frame_type, 0, timestamp, len(payload)) + payload
+            elif version == 3:
+                payload = struct.pack(">BBH", frame_type, 0, len(payload)) + payload
+            await websocket.send(payload)
+
+        async def send_audio(payload, timestamp):
+            await send_binary(0, timestamp, payload)
+
+        replayer = Replayer(steps, args.speed, send_text, send_audio)
+        try:
+            async for message in websocket:
+                if isinstance(message, str):
+                    replayer.on_control(json.loads(message))
+                    continue
+                frame_type, payload = 0, message
+                if version == 2:
+                    _, frame_type, _, _, size = struct.unpack_from(">HHIII", message)
+                    payload = message[16:16 + size]
+                elif version == 3:
+                    frame_type, _, size = struct.unpack_from(">BBH", message)
+                    payload = message[4:4 + size]
+                if frame_type == BINARY_PROTOCOL_TYPE_CBOR:
+                    replayer.on_control(decode_control(KIND_CBOR, payload))
+                else:
+                    replayer.on_audio(payload)
+        except websockets.ConnectionClosed:
+            pass
+        replayer.close()
+
+    ssl_context = make_ssl_context(args)
+    async with websockets.serve(handler, args.host, args.port, ssl=ssl_context, max_size=None):
+        scheme = "wss" if ssl_context else "ws"
+        print(f"Websocket server listening on {scheme}://{args.host}:{args.port}")
+        await asyncio.Future()
+
+
+class UdpChannel(asyncio.DatagramProtocol):
+    """AES-128-CTR audio channel of the MQTT dialect, the 16 byte packet header is the counter block"""
+
+    def __init__(self, key, nonce):
+        from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+        self.cipher = lambda counter: Cipher(algorithms.AES(key), modes.CTR(counter))
+        self.nonce = nonce
+        self.transport = None
+        self.address = None
+        self.sequence = 0
+        self.replayer = None
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, address):
+        self.address = address
+        if len(data) < 16 or self.replayer is None:
+            return
+        payload = self.cipher(data[:16]).decryptor().update(data[16:])
+        if data[0] == 0x02:
+            # Coalesced frames: |frame_len 2u|frame| x flags
+            offset = 0
+            for _ in range(data[1]):
+                size, = struct.unpack_from(">H", payload, offset)
+                self.replayer.on_audio(payload[offset + 2:offset + 2 + size])
+                offset += 2 + size
+        else:
+            self.replayer.on_audio(payload)
+
+    async def send_audio(self, payload, timestamp):
+        if self.address is None:
+            # The device address is only known once it has sent audio
+            return
+        self.sequence += 1
+        header = bytes([0x01, 0x00]) + struct.pack(">H", len(payload)) + self.nonce[4:8] + \
+            struct.pack(">II", timestamp, self.sequence)
+        self.transport.sendto(header + self.cipher(header).encryptor().update(payload), self.address)
+
+
+def read_varint(data, offset):
+    value, shift = 0, 0
+    while True:
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, offset
+        shift += 7
+
+
+def encode_varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        out.append(byte | (0x80 if value else 0))
+        if not value:
+            return bytes(out)
+
+
+async def serve_mqtt(args, steps):
+    key = os.urandom(16)
+    nonce = bytes([0x01, 0x00, 0x00, 0x00]) + os.urandom(4) + bytes(8)
+    loop = asyncio.get_running_loop()
+    _, udp = await loop.create_datagram_endpoint(lambda: UdpChannel(key, nonce), local_addr=(args.host, args.udp_port))
+
+    async def handle_client(reader, writer):
+        replayer = None
+
+        async def publish(payload):
+            topic = b"devices/replay"
+            body = struct.pack(">H", len(topic)) + topic + payload
+            writer.write(b"\x30" + encode_varint(len(body)) + body)
+            await writer.drain()
+
+        async def send_text(record):
+            payload = record.payload
+            if record.kind == KIND_TEXT:
+                message = json.loads(payload)
+                if message.get("type") == "hello":
+                    # Point the device to this server's UDP socket and keys
+                    message["udp"] = {
+                        "server": args.udp_host or args.host,
+                        "port": args.udp_port,
+                        "encryption": "aes-128-ctr",
+                        "key": key.hex(),
+                        "nonce": nonce.hex(),
+                        **({"burst": message["udp"]["burst"]} if "burst" in message.get("udp", {}) else {}),
+                    }
+                    payload = json.dumps(message).encode()
+            await publish(payload)
+
+        while True:
+            try:
+                first = await reader.readexactly(1)
+                length, shift = 0, 0
+                while True:
+                    byte = (await reader.readexactly(1))[0]
+                    length |= (byte & 0x7F) << shift
+                    shift += 7
+                    if not byte & 0x80:
+                        break
+                body = await reader.readexactly(length)
+            except (asyncio.IncompleteReadError, ConnectionError):
+                break
+
+            packet_type = first[0] >> 4
+            if packet_type == 1:        # CONNECT
+                writer.write(b"\x20\x02\x00\x00")
+                print("Device connected to MQTT")
+            elif packet_type == 3:      # PUBLISH
+                qos = (first[0] >> 1) & 0x03
+                topic_length, = struct.unpack_from(">H", body)
+                offset = 2 + topic_length
+                if qos > 0:
+                    writer.write(b"\x40\x02" + body[offset:offset + 2])
+                    offset += 2
+                payload = body[offset:]
+                kind = KIND_CBOR if payload and (payload[0] & 0xE0) == 0xA0 else KIND_TEXT
+                message = decode_control(kind, payload)
+                if message.get("type") == "hello" or replayer is None:
+                    replayer = Replayer(steps, args.speed, send_text, udp.send_audio)
+                    udp.replayer = replayer
+                replayer.on_control(message)
+            elif packet_type == 8:      # SUBSCRIBE
+                topics = 0
+                offset = 2
+                while offset < len(body):
+                    topic_length, = struct.unpack_from(">H", body, offset)
+                    offset += 2 + topic_length + 1
+                    topics += 1
+                writer.write(b"\x90" + encode_varint(2 + topics) + body[:2] + bytes(topics))
+            elif packet_type == 12:     # PINGREQ
+                writer.write(b"\xd0\x00")
+            elif packet_type == 14:     # DISCONNECT
+                break
+            await writer.drain()
+
+        if replayer is not None:
+            replayer.close()
+        writer.close()
+
+    ssl_context = make_ssl_context(args)
+    server = await asyncio.start_server(handle_client, args.host, args.port, ssl=ssl_context)
+    print(f"MQTT server listening on {args.host}:{args.port}{' (TLS)' if ssl_context else ''}, UDP on {args.udp_port}")
+    async with server:
+        await server.serve_forever()
+
+
+def make_ssl_context(args):
+    if not args.certfile:
+        return None
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(args.certfile, args.keyfile)
+    return context
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Replay a recorded device session from a local server")
+    parser.add_argument("recording", help="file written by the session recorder")
+    parser.add_argument("--session", type=int, default=-1, help="session index to replay, default the last one")
+    parser.add_argument("--dump", action="store_true", help="print the recorded sessions and exit")
+    parser.add_argument("--speed", type=float, default=1.0, help="replay speed factor, 0 sends without delays")
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, help="listen port, default 8000 for websocket and 1883 for MQTT")
+    parser.add_argument("--udp-port", type=int, default=8884)
+    parser.add_argument("--udp-host", help="UDP address announced in the hello, default --host")
+    parser.add_argument("--certfile", help="serve TLS with this certificate")
+    parser.add_argument("--keyfile")
+    args = parser.parse_args()
+
+    sessions = load_sessions(args.recording)
+    if args.dump:
+        dump(sessions)
+        return
+    if not sessions:
+        sys.exit("The recording has no sessions")
+
+    records = sessions[args.session]
+    transport = records[0].payload.decode()
+    steps = build_steps(records)
+    print(f"Replaying a {transport} session with {len(steps)} steps at {args.speed}x")
+    if transport == "websocket":
+        args.port = args.port or 8000
+        asyncio.run(serve_websocket(args, steps))
+    else:
+        args.port = args.port or 1883
+        asyncio.run(serve_mqtt(args, steps))
+
+
+if __name__ == "__main__":
+    main()